@@ -0,0 +1,76 @@
+//
+// Streaming of a raw float dataset file by chunks, overlapped with their processing.
+//
+
+#ifndef CHUNK_READER_H
+#define CHUNK_READER_H
+
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dataset {
+
+    /**
+     * Hands out the points of a raw float dataset file (num_points x dim, no header) chunk_size points at a time.
+     * - READ: two buffers; while the caller processes chunk i, a background thread reads chunk i + 1 with pread.
+     *   The file is opened once and advised as sequential, so the page cache reads ahead as well.
+     * - MMAP: the file is mapped read-only and the chunks point into the mapping, without copies. The kernel is
+     *   asked to read the next chunk ahead (MADV_WILLNEED) when a chunk is handed out. Meant for datasets that fit
+     *   in memory.
+     * The pointer returned by next() stays valid until the following call.
+     */
+    class ChunkReader {
+    public:
+        enum Mode { READ, MMAP };
+
+        ChunkReader(const std::string &path, size_t num_points, size_t dim, size_t chunk_size, Mode mode = READ);
+
+        ~ChunkReader();
+
+        /** Next chunk, holding the points first .. first + count - 1, or nullptr after the last one. */
+        const float *next(size_t &first, size_t &count);
+
+        /**
+         * Share of the reading time hidden behind the processing of the previous chunk: 1 - stall / read, where
+         * read is the time spent in pread and stall the time next() waited for it, both after the first chunk,
+         * which cannot be overlapped. Not measured for MMAP, and 0 with a single chunk.
+         */
+        double overlapEfficiency() const;
+
+        /**
+         * "[Loader] ..." line with the mode, the first read, the read and stall times and the overlap efficiency
+         * (n/a with a single chunk).
+         */
+        std::string describe() const;
+
+    private:
+        void readChunk(size_t chunk, float *buffer);
+
+        void startRead(size_t chunk);
+
+        std::string path;
+        size_t num_points;
+        size_t dim;
+        size_t chunk_size;
+        Mode mode;
+        int fd = -1;
+
+        size_t next_chunk = 0;
+        size_t num_chunks;
+
+        // READ
+        std::vector<float> buffers[2];
+        std::thread reader;
+        bool read_failed = false;
+        double first_read_seconds = 0;
+        double read_seconds = 0; // of the chunks after the first
+        double stall_seconds = 0;
+
+        // MMAP
+        char *mapping = nullptr;
+        size_t mapped_size = 0;
+    };
+}
+
+#endif //CHUNK_READER_H
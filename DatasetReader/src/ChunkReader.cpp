@@ -0,0 +1,145 @@
+//
+// Streaming of a raw float dataset file by chunks, overlapped with their processing.
+//
+
+#include "ChunkReader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace dataset {
+
+    static double secondsSince(const std::chrono::steady_clock::time_point &start) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    ChunkReader::ChunkReader(const std::string &path, size_t num_points, size_t dim, size_t chunk_size, Mode mode)
+            : path(path), num_points(num_points), dim(dim), chunk_size(chunk_size), mode(mode) {
+        if (chunk_size == 0)
+            throw std::runtime_error("The chunk size of the dataset reader must be positive!");
+        num_chunks = (num_points + chunk_size - 1) / chunk_size;
+        fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Dataset file " + path + " not found!");
+        size_t bytes = num_points * dim * sizeof(float);
+        if (lseek(fd, 0, SEEK_END) < (off_t) bytes) {
+            close(fd);
+            throw std::runtime_error("Dataset file " + path + " holds fewer points than the dataset size!");
+        }
+
+        if (mode == MMAP) {
+            mapped_size = bytes;
+            void *p = mmap(nullptr, mapped_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (p == MAP_FAILED) {
+                close(fd);
+                throw std::runtime_error("Failed to map dataset file " + path + "!");
+            }
+            mapping = (char *) p;
+            madvise(mapping, mapped_size, MADV_SEQUENTIAL);
+            return;
+        }
+
+        posix_fadvise(fd, 0, bytes, POSIX_FADV_SEQUENTIAL);
+        size_t buffer_points = std::min(chunk_size, num_points);
+        buffers[0].resize(buffer_points * dim);
+        buffers[1].resize(buffer_points * dim);
+        if (num_chunks > 0)
+            startRead(0);
+    }
+
+    ChunkReader::~ChunkReader() {
+        if (reader.joinable())
+            reader.join();
+        if (mapping != nullptr)
+            munmap(mapping, mapped_size);
+        if (fd >= 0)
+            close(fd);
+    }
+
+    void ChunkReader::readChunk(size_t chunk, float *buffer) {
+        auto start = std::chrono::steady_clock::now();
+        size_t first = chunk * chunk_size;
+        size_t bytes = std::min(chunk_size, num_points - first) * dim * sizeof(float);
+        off_t offset = (off_t) (first * dim * sizeof(float));
+        char *dst = (char *) buffer;
+        while (bytes > 0) {
+            ssize_t r = pread(fd, dst, bytes, offset);
+            if (r <= 0) {
+                read_failed = true;
+                break;
+            }
+            dst += r;
+            offset += r;
+            bytes -= r;
+        }
+        read_seconds += secondsSince(start);
+    }
+
+    void ChunkReader::startRead(size_t chunk) {
+        reader = std::thread(&ChunkReader::readChunk, this, chunk, buffers[chunk % 2].data());
+    }
+
+    const float *ChunkReader::next(size_t &first, size_t &count) {
+        if (next_chunk >= num_chunks)
+            return nullptr;
+        size_t chunk = next_chunk++;
+        first = chunk * chunk_size;
+        count = std::min(chunk_size, num_points - first);
+
+        if (mode == MMAP) {
+            if (next_chunk < num_chunks) {
+                // madvise needs a page-aligned start
+                size_t page = (size_t) sysconf(_SC_PAGESIZE);
+                size_t begin = (first + count) * dim * sizeof(float) / page * page;
+                size_t end = std::min(mapped_size, (first + count + chunk_size) * dim * sizeof(float));
+                madvise(mapping + begin, end - begin, MADV_WILLNEED);
+            }
+            return (const float *) (mapping + first * dim * sizeof(float));
+        }
+
+        // the buffer of the previous chunk is free again, so the next read can start right away
+        auto start = std::chrono::steady_clock::now();
+        reader.join();
+        if (chunk == 0) {
+            // nothing to overlap the first read with
+            first_read_seconds = read_seconds;
+            read_seconds = 0;
+        } else {
+            stall_seconds += secondsSince(start);
+        }
+        if (read_failed)
+            throw std::runtime_error("Failed to read dataset file " + path + "!");
+        if (next_chunk < num_chunks)
+            startRead(next_chunk);
+        return buffers[chunk % 2].data();
+    }
+
+    double ChunkReader::overlapEfficiency() const {
+        if (mode == MMAP || read_seconds <= 0)
+            return 0;
+        return std::max(0.0, 1 - stall_seconds / read_seconds);
+    }
+
+    std::string ChunkReader::describe() const {
+        std::ostringstream out;
+        if (mode == MMAP) {
+            out << "[Loader] mmap - " << num_chunks << " chunks of " << chunk_size << " points";
+            return out.str();
+        }
+        out << "[Loader] double-buffered pread - " << num_chunks << " chunks of " << chunk_size << " points"
+            << " - first chunk " << first_read_seconds << "s"
+            << " - read " << read_seconds << "s"
+            << " - stalled " << stall_seconds << "s";
+        // a single chunk leaves nothing to overlap
+        if (num_chunks < 2)
+            out << " - overlap n/a";
+        else
+            out << " - overlap " << 100 * overlapEfficiency() << "%";
+        return out.str();
+    }
+}
@@ -5,6 +5,11 @@
 #include <malloc.h>
 #include <x86intrin.h>
 #include <queue>
+#include <vector>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
 #include <cmath>
 #include "float.h"
 using namespace std;
@@ -20,275 +25,323 @@ void load_data(const std::string &path, float*& data, size_t num,int dim){// loa
     }
     in.close();
 }
-///dist(a,b) = (a-b)**2
-float l2distance(const float* a, const float* b, unsigned size) {
-    float result = 0;
-
-#ifdef __GNUC__
-#ifdef __AVX__
-
-    #define AVX_L2SQR(addr1, addr2, dest, tmp1, tmp2) \
-      tmp1 = _mm256_loadu_ps(addr1);\
-      tmp2 = _mm256_loadu_ps(addr2);\
-      tmp1 = _mm256_sub_ps(tmp1, tmp2); \
-      tmp1 = _mm256_mul_ps(tmp1, tmp1); \
-      dest = _mm256_add_ps(dest, tmp1);
-
-      __m256 sum;
-      __m256 l0, l1;
-      __m256 r0, r1;
-      unsigned D = (size + 7) & ~7U;
-      unsigned DR = D % 16;
-      unsigned DD = D - DR;
-      const float *l = a;
-      const float *r = b;
-      const float *e_l = l + DD;
-      const float *e_r = r + DD;
-      float unpack[8] __attribute__ ((aligned (32))) = {0, 0, 0, 0, 0, 0, 0, 0};
-
-      sum = _mm256_loadu_ps(unpack);
-      if(DR){AVX_L2SQR(e_l, e_r, sum, l0, r0);}
-
-      for (unsigned i = 0; i < DD; i += 16, l += 16, r += 16) {
-      	AVX_L2SQR(l, r, sum, l0, r0);
-      	AVX_L2SQR(l + 8, r + 8, sum, l1, r1);
-      }
-      _mm256_storeu_ps(unpack, sum);
-      result = unpack[0] + unpack[1] + unpack[2] + unpack[3] + unpack[4] + unpack[5] + unpack[6] + unpack[7];
 
+/***
+ * Tiled exact k-NN
+ * dist(q,x) = ||q||^2 + ||x||^2 - 2<q,x>, where the dot products of a block of queries against a tile of data points
+ * are computed like a small GEMM: a 4 queries x 2 points register block reuses every load 4 (resp. 2) times.
+ * ***/
+#if defined(__AVX512F__)
+typedef __m512 vfloat;
+#define V_WIDTH 16
+#define V_ZERO() _mm512_setzero_ps()
+#define V_LOAD(p) _mm512_loadu_ps(p)
+#define V_SUB(a, b) _mm512_sub_ps(a, b)
+#define V_MADD(a, b, c) _mm512_fmadd_ps(a, b, c)
+#define V_SUM(v) _mm512_reduce_add_ps(v)
+#elif defined(__AVX__)
+typedef __m256 vfloat;
+#define V_WIDTH 8
+#define V_ZERO() _mm256_setzero_ps()
+#define V_LOAD(p) _mm256_loadu_ps(p)
+#define V_SUB(a, b) _mm256_sub_ps(a, b)
+#ifdef __FMA__
+#define V_MADD(a, b, c) _mm256_fmadd_ps(a, b, c)
 #else
-#ifdef __SSE2__
-#define SSE_L2SQR(addr1, addr2, dest, tmp1, tmp2) \
-          tmp1 = _mm_load_ps(addr1);\
-          tmp2 = _mm_load_ps(addr2);\
-          tmp1 = _mm_sub_ps(tmp1, tmp2); \
-          tmp1 = _mm_mul_ps(tmp1, tmp1); \
-          dest = _mm_add_ps(dest, tmp1);
-
-    __m128 sum;
-    __m128 l0, l1, l2, l3;
-    __m128 r0, r1, r2, r3;
-    unsigned D = (size + 3) & ~3U;
-    unsigned DR = D % 16;
-    unsigned DD = D - DR;
-    const float *l = a;
-    const float *r = b;
-    const float *e_l = l + DD;
-    const float *e_r = r + DD;
-    float unpack[4] __attribute__ ((aligned (16))) = {0, 0, 0, 0};
-
-    sum = _mm_load_ps(unpack);
-    switch (DR) {
-        case 12:
-        SSE_L2SQR(e_l+8, e_r+8, sum, l2, r2);
-        case 8:
-        SSE_L2SQR(e_l+4, e_r+4, sum, l1, r1);
-        case 4:
-        SSE_L2SQR(e_l, e_r, sum, l0, r0);
-        default:
-            break;
-    }
-    for (unsigned i = 0; i < DD; i += 16, l += 16, r += 16) {
-        SSE_L2SQR(l, r, sum, l0, r0);
-        SSE_L2SQR(l + 4, r + 4, sum, l1, r1);
-        SSE_L2SQR(l + 8, r + 8, sum, l2, r2);
-        SSE_L2SQR(l + 12, r + 12, sum, l3, r3);
-    }
-    _mm_storeu_ps(unpack, sum);
-    result += unpack[0] + unpack[1] + unpack[2] + unpack[3];
-
-//nomal distance
-#else
-
-    float diff0, diff1, diff2, diff3;
-      const float* last = a + size;
-      const float* unroll_group = last - 3;
-
-      /* Process 4 items with each loop for efficiency. */
-      while (a < unroll_group) {
-          diff0 = a[0] - b[0];
-          diff1 = a[1] - b[1];
-          diff2 = a[2] - b[2];
-          diff3 = a[3] - b[3];
-          result += diff0 * diff0 + diff1 * diff1 + diff2 * diff2 + diff3 * diff3;
-          a += 4;
-          b += 4;
-      }
-      /* Process last 0-3 pixels.  Not needed for standard vector lengths. */
-      while (a < last) {
-          diff0 = *a++ - *b++;
-          result += diff0 * diff0;
-      }
-#endif
+#define V_MADD(a, b, c) _mm256_add_ps(_mm256_mul_ps(a, b), c)
 #endif
+static inline float hsum256(__m256 v) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+#define V_SUM(v) hsum256(v)
 #endif
 
+static inline float dot(const float *a, const float *b, unsigned dim) {
+    unsigned d = 0;
+    float result = 0;
+#ifdef V_WIDTH
+    vfloat s = V_ZERO();
+    for (; d + V_WIDTH <= dim; d += V_WIDTH) s = V_MADD(V_LOAD(a + d), V_LOAD(b + d), s);
+    result = V_SUM(s);
+#endif
+    for (; d < dim; d++) result += a[d] * b[d];
     return result;
 }
 
+/// ||a-b||^2 with a scalar tail, so any dimension is read in bounds
+static inline float l2sqr(const float *a, const float *b, unsigned dim) {
+    unsigned d = 0;
+    float result = 0;
+#ifdef V_WIDTH
+    vfloat s = V_ZERO();
+    for (; d + V_WIDTH <= dim; d += V_WIDTH) {
+        vfloat diff = V_SUB(V_LOAD(a + d), V_LOAD(b + d));
+        s = V_MADD(diff, diff, s);
+    }
+    result = V_SUM(s);
+#endif
+    for (; d < dim; d++) result += (a[d] - b[d]) * (a[d] - b[d]);
+    return result;
+}
 
-float relative_contrast(const float * data, const float * queries, unsigned int nd, unsigned int nq, unsigned int dim){
-    float rc = 0.0;
-    float * rcperquery = new float[nq];
-    float * means  = new float[nq];
-    float * mins  = new float[nq];
-    {
-#pragma omp parallel for
-        for (unsigned int i = 0; i < nq; i++) {
-            rcperquery[i] = 0.0;
-            double mean = 0;
-            float min = 100000;
-            float dist;
-            for (unsigned int j = 0; j < nd; j++) {
-                dist = l2distance(data + j*dim, queries + i*dim, dim);
-                if(dist == 0 )continue;
-                mean += dist;
-                if (dist < min)min = dist;
+/// out[i*ldo + j] = <q_i, x_j> for the nq queries of q and the nx points of x
+static void dot_tile(const float *q, unsigned nq, const float *x, unsigned nx, unsigned dim, float *out, unsigned ldo) {
+    unsigned i = 0;
+#ifdef V_WIDTH
+    for (; i + 4 <= nq; i += 4) {
+        const float *q0 = q + (size_t) i * dim, *q1 = q0 + dim, *q2 = q1 + dim, *q3 = q2 + dim;
+        unsigned j = 0;
+        for (; j + 2 <= nx; j += 2) {
+            const float *x0 = x + (size_t) j * dim, *x1 = x0 + dim;
+            vfloat s00 = V_ZERO(), s01 = V_ZERO(), s10 = V_ZERO(), s11 = V_ZERO();
+            vfloat s20 = V_ZERO(), s21 = V_ZERO(), s30 = V_ZERO(), s31 = V_ZERO();
+            unsigned d = 0;
+            for (; d + V_WIDTH <= dim; d += V_WIDTH) {
+                vfloat a0 = V_LOAD(x0 + d), a1 = V_LOAD(x1 + d);
+                vfloat b = V_LOAD(q0 + d);
+                s00 = V_MADD(b, a0, s00); s01 = V_MADD(b, a1, s01);
+                b = V_LOAD(q1 + d);
+                s10 = V_MADD(b, a0, s10); s11 = V_MADD(b, a1, s11);
+                b = V_LOAD(q2 + d);
+                s20 = V_MADD(b, a0, s20); s21 = V_MADD(b, a1, s21);
+                b = V_LOAD(q3 + d);
+                s30 = V_MADD(b, a0, s30); s31 = V_MADD(b, a1, s31);
+            }
+            float r[8] = {V_SUM(s00), V_SUM(s01), V_SUM(s10), V_SUM(s11),
+                          V_SUM(s20), V_SUM(s21), V_SUM(s30), V_SUM(s31)};
+            for (; d < dim; d++) {
+                r[0] += q0[d] * x0[d]; r[1] += q0[d] * x1[d];
+                r[2] += q1[d] * x0[d]; r[3] += q1[d] * x1[d];
+                r[4] += q2[d] * x0[d]; r[5] += q2[d] * x1[d];
+                r[6] += q3[d] * x0[d]; r[7] += q3[d] * x1[d];
+            }
+            for (unsigned ii = 0; ii < 4; ii++) {
+                out[(size_t) (i + ii) * ldo + j] = r[2 * ii];
+                out[(size_t) (i + ii) * ldo + j + 1] = r[2 * ii + 1];
             }
-            mean = mean / nd;
-            means[i] = mean;
-            mins[i] = min;
-            rcperquery[i] = sqrt(mean / min);
         }
+        for (; j < nx; j++)
+            for (unsigned ii = 0; ii < 4; ii++)
+                out[(size_t) (i + ii) * ldo + j] = dot(q + (size_t) (i + ii) * dim, x + (size_t) j * dim, dim);
     }
-
-
-    for(unsigned int i = 0;i<nq;i++) {
-        std::cout << " RC Q "<<i<<":"<<rcperquery[i]<< " , [mean,min] : "<<sqrt(means[i])<<" " <<sqrt(mins[i])<<std::endl;
-        rc += rcperquery[i] ;
-    }
-    rc = rc / nq;
-    delete rcperquery;
-    return rc;
+#endif
+    for (; i < nq; i++)
+        for (unsigned j = 0; j < nx; j++)
+            out[(size_t) i * ldo + j] = dot(q + (size_t) i * dim, x + (size_t) j * dim, dim);
 }
-float local_intrinsic_dim(const float * data, const float * queries, unsigned int nd, unsigned int nq, unsigned int dim, unsigned int k = 100) {
-    float lid = 0.0;
-    float *lidperquery = new float[nq];
-    {
-#pragma omp parallel for
-    for (int i = 0; i < nq; i++) {
-        std::priority_queue<float, std::vector<float>> pq;
-        float maxdistk = 0;
-        double sum = 0;
-        float dist = 0.0;
-        for (unsigned int j = 0; j < nd; j++) {
-            dist = l2distance(data + j*dim, queries + i*dim, dim);
-            pq.emplace(dist);
-            if (pq.size() > k)pq.pop();
-        }
-        maxdistk = pq.top();
-        while (!pq.empty()) {
-            dist = pq.top();
-            sum += log(dist / maxdistk)/2;
-            pq.pop();
-        }
-        lidperquery[i] = -(k / sum);
+
+/***
+ * State of the pass over the data: per query, a max-heap of its k closest points so far (exact squared distances)
+ * and the running sum of the distances to all the points scanned. Finished by knn_finish into sorted ids/dists.
+ * ***/
+typedef std::pair<float, unsigned int> candidate;
+struct knn_pass {
+    unsigned int k;
+    std::vector<std::vector<candidate>> heaps;
+    std::vector<double> sums;
+    std::vector<unsigned int> ids;
+    std::vector<float> dists;
+};
+
+static inline void push_candidate(std::vector<candidate> &h, const candidate &c, unsigned int k) {
+    if (h.size() < k) {
+        h.push_back(c);
+        std::push_heap(h.begin(), h.end());
+    } else if (c.first < h.front().first) {
+        std::pop_heap(h.begin(), h.end());
+        h.back() = c;
+        std::push_heap(h.begin(), h.end());
     }
 }
-    for(unsigned int i = 0;i<nq;i++) {
-        std::cout << " LID Q "<<i<<":"<<lidperquery[i]<<std::endl;
-        lid += lidperquery[i] ;
-    }
-    lid = lid / nq;
-    delete lidperquery;
-    return lid;
+
+void knn_init(knn_pass &out, unsigned int nd, unsigned int nq, unsigned int k, bool self_join) {
+    out.k = std::min(k, nd - (self_join ? 1 : 0));
+    out.heaps.assign(nq, std::vector<candidate>());
+    for (auto &h : out.heaps) h.reserve(out.k + 1);
+    out.sums.assign(nq, 0);
 }
 
-/*** Metrics for DATA ***/
-void RCLID(const float * data, unsigned int nd, unsigned int dim,unsigned int nq, unsigned int k = 100) {
-    float lid = 0.0;
-    float rc = 0.0;
-    float *lidperquery = new float[nq];
-    float *rcperquery = new float[nq];
+/***
+ * Scores the dn data points of chunk (global ids first..first+dn-1) against every query.
+ * Queries are processed in blocks; the threads share the data tiles of a block and keep their own top-k heaps,
+ * merged at the end of the block. The surviving candidates are re-ranked with l2sqr while the chunk is still in memory,
+ * so the kept distances do not carry the cancellation error of the norm expansion.
+ * self_join: the queries are the first nq data points, and each of them is skipped in its own neighborhood.
+ * ***/
+void knn_scan(const float * chunk, size_t first, unsigned int dn, const float * queries, unsigned int nq,
+              unsigned int dim, bool self_join, knn_pass &out) {
+    const unsigned int QB = 64;                                  // queries per block
+    const unsigned int DB = std::max(8u, (32768u / std::max(dim, 1u)) & ~1u); // data points per tile (~128KB)
+    const unsigned int k = out.k;
 
-    {
+    std::vector<float> dnorms(dn), qnorms(nq);
+#pragma omp parallel for
+    for (long j = 0; j < (long) dn; j++) dnorms[j] = dot(chunk + (size_t) j * dim, chunk + (size_t) j * dim, dim);
 #pragma omp parallel for
-        for(int i = 0; i < nq; i++){
-            double meand = 0;
-            std::priority_queue<float, std::vector<float>> pq;
-            float maxdistk = 0;
-            double sum = 0;
-            float dist;
-            for(int j=0;j<nd;j++){
-                if(i==j)continue;
-                dist = l2distance(data + j*dim, data + i*dim, dim);
-                meand+=dist;
-                pq.emplace(dist);
-                if (pq.size() > k)pq.pop();
+    for (long i = 0; i < (long) nq; i++) qnorms[i] = dot(queries + (size_t) i * dim, queries + (size_t) i * dim, dim);
+
+    std::vector<std::vector<candidate>> heaps(QB);
+    for (unsigned int qb = 0; qb < nq; qb += QB) {
+        unsigned int qn = std::min(QB, nq - qb);
+        for (unsigned int i = 0; i < qn; i++) heaps[i].clear();
+
+#pragma omp parallel
+        {
+            std::vector<std::vector<candidate>> local(qn);
+            for (auto &h : local) h.reserve(k + 1);
+            std::vector<double> local_sums(qn, 0);
+            std::vector<float> tile((size_t) qn * DB);
+
+#pragma omp for schedule(dynamic)
+            for (long db = 0; db < (long) dn; db += DB) {
+                unsigned int tn = std::min((long) DB, (long) dn - db);
+                dot_tile(queries + (size_t) qb * dim, qn, chunk + (size_t) db * dim, tn, dim, tile.data(), DB);
+                for (unsigned int i = 0; i < qn; i++) {
+                    const float *row = tile.data() + (size_t) i * DB;
+                    auto &h = local[i];
+                    double sum = 0;
+                    for (unsigned int j = 0; j < tn; j++) {
+                        if (self_join && qb + i == first + db + j) continue;
+                        float dist = std::max(0.0f, qnorms[qb + i] + dnorms[db + j] - 2 * row[j]);
+                        sum += dist;
+                        if (h.size() < k || dist < h.front().first)
+                            push_candidate(h, candidate(dist, db + j), k);
+                    }
+                    local_sums[i] += sum;
+                }
             }
-            maxdistk = pq.top();
-     	    meand = meand/(nd-1);//-1 because we skip when data is compared to itself
-            rcperquery[i] = meand/maxdistk;
-
-            while (!pq.empty()) {
-                dist = pq.top();
-                sum += log(dist / maxdistk)/2;
-                pq.pop();
+
+#pragma omp critical
+            for (unsigned int i = 0; i < qn; i++) {
+                out.sums[qb + i] += local_sums[i];
+                for (auto &c : local[i]) push_candidate(heaps[i], c, k);
             }
-            lidperquery[i] = -(k / sum);
         }
-    }
 
-    for(unsigned int i = 0;i<nq;i++) {
-        std::cout << " Q "<<i<<", RC:"<<rcperquery[i]<<" , LID:"<<lidperquery[i]<<std::endl;
-        lid += lidperquery[i] ;
-        rc += rcperquery[i];
+#pragma omp parallel for
+        for (long i = 0; i < (long) qn; i++)
+            for (auto &c : heaps[i])
+                push_candidate(out.heaps[qb + i],
+                               candidate(l2sqr(chunk + (size_t) c.second * dim, queries + (size_t) (qb + i) * dim, dim),
+                                         (unsigned int) (first + c.second)), k);
     }
+}
 
-//    delete dists;
-    delete lidperquery;
-    delete rcperquery;
-    cout << "DATASET , RC:"<<rc/nq<<", LID:"<<lid/nq<<endl;
+void knn_finish(knn_pass &out) {
+    size_t nq = out.heaps.size();
+    out.ids.assign(nq * out.k, 0);
+    out.dists.assign(nq * out.k, 0);
+    for (size_t i = 0; i < nq; i++) {
+        auto &h = out.heaps[i];
+        std::sort(h.begin(), h.end());
+        for (unsigned int r = 0; r < out.k; r++) {
+            out.ids[i * out.k + r] = h[r].second;
+            out.dists[i * out.k + r] = h[r].first;
+        }
+        std::vector<candidate>().swap(h);
+    }
 }
-/*** Metrics for DATA&QUERY ***/
-void RCLID(const float * data, const float * queries,
-           unsigned int nd, unsigned int nq, unsigned int dim, unsigned int k = 100){
-    float lid = 0.0;
-    float rc = 0.0;
-    float *lidperquery = new float[nq];
-    float *rcperquery = new float[nq];
 
-    {
-#pragma omp parallel for
-        for(int i = 0; i < nq; i++){
-            float mind = 1000000;
-            double meand = 0;
-            std::priority_queue<float, std::vector<float>> pq;
-            float dist;
-            for(int j=0;j<nd;j++){
-                dist = l2distance(data + j*dim, queries + i*dim, dim);
-                meand+=dist;
-                pq.emplace(dist);
-                if (pq.size() > k)pq.pop();
-            }
-            meand = meand/(nd);
-        
+/***
+ * Streams the nd points of a dataset file through knn_scan, chunk_size points at a time. The next chunk is read with
+ * pread in the background while the current one is scored, so at most two chunks are resident.
+ * ***/
+void knn_stream(const std::string &path, unsigned int nd, unsigned int dim, unsigned int chunk_size,
+                const float * queries, unsigned int nq, bool self_join, knn_pass &out) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0){cout<<"open file error"<<endl;exit(-1);}
+    std::vector<float> buffers[2];
+    buffers[0].resize((size_t) chunk_size * dim);
+    buffers[1].resize((size_t) chunk_size * dim);
+
+    auto read_chunk = [fd, dim, nd, chunk_size](float * buffer, size_t first) {
+        size_t bytes = (size_t) std::min((size_t) chunk_size, nd - first) * dim * sizeof(float);
+        off_t offset = (off_t) (first * dim * sizeof(float));
+        char * dst = (char *) buffer;
+        while (bytes > 0) {
+            ssize_t r = pread(fd, dst, bytes, offset);
+            if (r <= 0) {cout<<"read file error"<<endl;exit(-1);}
+            dst += r; offset += r; bytes -= r;
+        }
+    };
+
+    std::thread reader(read_chunk, buffers[0].data(), (size_t) 0);
+    for (size_t first = 0, b = 0; first < nd; first += chunk_size, b ^= 1) {
+        reader.join();
+        if (first + chunk_size < nd)
+            reader = std::thread(read_chunk, buffers[b ^ 1].data(), first + chunk_size);
+        unsigned int dn = std::min((size_t) chunk_size, nd - first);
+        knn_scan(buffers[b].data(), first, dn, queries, nq, dim, self_join, out);
+        std::cout << "Scanned "<<first + dn<<"/"<<nd<<" points"<<std::endl;
+    }
+    close(fd);
+}
 
-            float maxdistk = 0;
-            double sum = 0;
+/// Stores the k-NN in the bin truthset layout: int32 #queries, int32 k, the ids as uint32, then the squared distances
+void write_groundtruth(const std::string &path, const knn_pass &knn, unsigned int nq) {
+    ofstream out(path.c_str(), ios::binary);
+    if(!out.is_open()){cout<<"open file error"<<endl;exit(-1);}
+    int npts = nq, ndims = knn.k;
+    out.write((char *) &npts, sizeof(int));
+    out.write((char *) &ndims, sizeof(int));
+    out.write((char *) knn.ids.data(), (size_t) nq * knn.k * sizeof(unsigned int));
+    out.write((char *) knn.dists.data(), (size_t) nq * knn.k * sizeof(float));
+    out.close();
+    cout << "Ground truth ("<<nq<<" queries, k="<<knn.k<<") written to "<<path<<endl;
+}
 
-            maxdistk = pq.top();
+/// LID of one query from its (squared) k-NN distances sorted ascending
+static float lid_of(const float * dists, unsigned int k) {
+    float maxdistk = dists[k - 1];
+    double sum = 0;
+    for (unsigned int r = 0; r < k; r++) sum += log(dists[r] / maxdistk)/2;
+    return -(k / sum);
+}
 
- 	    rcperquery[i] = meand/maxdistk;
-            while (!pq.empty()) {
-                dist = pq.top();
-                sum += log(dist / maxdistk)/2;
-                pq.pop();
-            }
-            lidperquery[i] = -(k / sum);
-        }
+float relative_contrast(const knn_pass &knn, unsigned int nd, unsigned int nq){
+    float rc = 0.0;
+    for(unsigned int i = 0;i<nq;i++) {
+        // closest non-zero distance, i.e. duplicates of the query are skipped
+        float min = 100000;
+        for (unsigned int r = 0; r < knn.k; r++)
+            if (knn.dists[(size_t) i * knn.k + r] != 0) { min = knn.dists[(size_t) i * knn.k + r]; break; }
+        double mean = knn.sums[i] / nd;
+        float rcq = sqrt(mean / min);
+        std::cout << " RC Q "<<i<<":"<<rcq<< " , [mean,min] : "<<sqrt(mean)<<" " <<sqrt(min)<<std::endl;
+        rc += rcq ;
     }
+    rc = rc / nq;
+    return rc;
+}
+float local_intrinsic_dim(const knn_pass &knn, unsigned int nq) {
+    float lid = 0.0;
+    for(unsigned int i = 0;i<nq;i++) {
+        float lidq = lid_of(knn.dists.data() + (size_t) i * knn.k, knn.k);
+        std::cout << " LID Q "<<i<<":"<<lidq<<std::endl;
+        lid += lidq ;
+    }
+    lid = lid / nq;
+    return lid;
+}
+
+/*** Metrics for DATA (self_join pass) and DATA&QUERY ***/
+void RCLID(const knn_pass &knn, unsigned int nd, unsigned int nq, bool self_join) {
+    float lid = 0.0;
+    float rc = 0.0;
 
     for(unsigned int i = 0;i<nq;i++) {
-//        delete dists[i];
-        std::cout << " Q "<<i<<", RC:"<<rcperquery[i]<<" , LID:"<<lidperquery[i]<<std::endl;
-        lid += lidperquery[i] ;
-        rc += rcperquery[i];
+        const float *dists = knn.dists.data() + (size_t) i * knn.k;
+        double meand = knn.sums[i] / (self_join ? nd - 1 : nd);//-1 because we skip when data is compared to itself
+        float rcq = meand / dists[knn.k - 1];
+        float lidq = lid_of(dists, knn.k);
+        std::cout << " Q "<<i<<", RC:"<<rcq<<" , LID:"<<lidq<<std::endl;
+        lid += lidq ;
+        rc += rcq;
     }
 
-//    delete dists;
-    delete lidperquery;
-    delete rcperquery;
     cout << "DATASET , RC:"<<rc/nq<<", LID:"<<lid/nq<<endl;
 }
 
@@ -296,6 +349,7 @@ void RCLID(const float * data, const float * queries,
 int main(int argc, char** argv) {
     string data_path;
     string query_path;
+    string groundtruth_path;
 
     unsigned int num_points;
     unsigned int num_query;
@@ -303,6 +357,8 @@ int main(int argc, char** argv) {
     unsigned short mode;
 
     unsigned pertosample;
+    unsigned knn_k;
+    unsigned chunk_size;
 /***
  * Parameters reading
  * ***/
@@ -318,7 +374,11 @@ int main(int argc, char** argv) {
             ("timeseries-size", po::value(&ts_len), "dimension")
             ("mode", po::value(&mode), "0 : Relative Contrast | 1 : Local intrinsic dimensionality @ k | 2 : RCLIDDATA | 3 : RCLID")
             ("k", po::value(&pertosample)->default_value(100),
-             "percentage of sample to use, per default it's 100, i.e 100% of the dataset will be used for evaluation");
+             "percentage of sample to use, per default it's 100, i.e 100% of the dataset will be used for evaluation")
+            ("knn", po::value(&knn_k)->default_value(100), "number of exact neighbors per query, used for LID@k and the ground truth")
+            ("groundtruth", po::value(&groundtruth_path), "write the exact k-NN computed during the pass (bin truthset layout)")
+            ("chunk-size", po::value(&chunk_size)->default_value(0),
+             "stream the dataset by chunks of this many points instead of loading it whole (0 : load it whole)");
 
     po::options_description desc("Allowed options");
     desc.add(desc_visible);
@@ -332,36 +392,45 @@ int main(int argc, char** argv) {
     po::notify(vm);
 }
 
-if(mode==0){
-    std::cout<<"Dataset size "<<num_points<<", Queryset size "<<num_query<<", Dimension "<<ts_len<<"\nCalculating Relative Contrast..."<<std::endl;
-    float* data = nullptr;float * query = nullptr;
+if(mode > 3){
+    std::cerr << "Unknown mode "<<mode<<std::endl;
+    return -1;
+}
+if(mode == 2)
+    std::cout<<"Dataset size "<<num_points<<", Dimension "<<ts_len<<"\nCalculating Dataset RC and LID..."<<std::endl;
+else if(mode == 3)
+    std::cout<<"Dataset size "<<num_points<<", Dimension "<<ts_len<<"\nCalculating Dataset and Query RC and LID..."<<std::endl;
+else
+    std::cout<<"Dataset size "<<num_points<<", Queryset size "<<num_query<<", Dimension "<<ts_len<<"\nCalculating "
+             <<(mode == 0 ? "Relative Contrast" : "Local Intrinsic Dimensionality")<<"..."<<std::endl;
+
+// one pass over the data serves every metric and the ground truth
+float* data = nullptr;float * query = nullptr;
+bool self_join = mode == 2;
+knn_pass knn;
+knn_init(knn, num_points, num_query, knn_k, self_join);
+if(chunk_size > 0){
+    // out-of-core: only the queries and two chunks of the dataset are resident
+    load_data(self_join ? data_path : query_path,query,num_query,ts_len);
+    knn_stream(data_path, num_points, ts_len, chunk_size, query, num_query, self_join, knn);
+}else{
     load_data(data_path,data,num_points,ts_len);
-    load_data(query_path,query,num_query,ts_len);
+    if(self_join) query = data;
+    else load_data(query_path,query,num_query,ts_len);
+    knn_scan(data, 0, num_points, query, num_query, ts_len, self_join, knn);
+}
+knn_finish(knn);
+if(!groundtruth_path.empty())
+    write_groundtruth(groundtruth_path, knn, num_query);
 
-    auto rc = relative_contrast(data,query,num_points,num_query,ts_len);
+if(mode==0){
+    auto rc = relative_contrast(knn,num_points,num_query);
     std::cout << "Relative Contrast : "<<rc<<std::endl;
 }else
     if(mode==1){
-        std::cout<<"Dataset size "<<num_points<<", Queryset size "<<num_query<<", Dimension "<<ts_len<<"\nCalculating Local Intrinsic Dimensionality..."<<std::endl;
-        float* data = nullptr;float * query = nullptr;
-        load_data(data_path,data,num_points,ts_len);
-        load_data(query_path,query,num_query,ts_len);
-
-        auto lid = local_intrinsic_dim(data,query,num_points,num_query,ts_len);
+        auto lid = local_intrinsic_dim(knn,num_query);
         std::cout << "Local Intrinsic Dimensionality : "<<lid<<std::endl;
     }else
-        if(mode == 2){
-    std::cout<<"Dataset size "<<num_points<<", Dimension "<<ts_len<<"\nCalculating Dataset RC and LID..."<<std::endl;
-    float* data = nullptr;float * query = nullptr;
-    load_data(data_path,data,num_points,ts_len);
-    RCLID(data,num_points,ts_len, num_query);
-}else
-    if(mode == 3){
-    std::cout<<"Dataset size "<<num_points<<", Dimension "<<ts_len<<"\nCalculating Dataset and Query RC and LID..."<<std::endl;
-    float* data = nullptr;float * query = nullptr;
-    load_data(data_path,data,num_points,ts_len);
-    load_data(query_path,query,num_query,ts_len);
-    RCLID(data,query,num_points,num_query,ts_len);;
-}
+    RCLID(knn,num_points,num_query,self_join);
 return 0;
 }
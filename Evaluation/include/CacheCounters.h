@@ -0,0 +1,45 @@
+//
+// Hardware cache counters around a measured section.
+//
+
+#ifndef CACHE_COUNTERS_H
+#define CACHE_COUNTERS_H
+
+#include <cstdint>
+#include <string>
+
+namespace evaluation {
+
+    /**
+     * Counts the last-level cache and data TLB load misses of the calling thread with perf_event_open.
+     * When the counters cannot be opened (no PMU access, e.g. perf_event_paranoid or containers),
+     * available() is false and every count reads 0.
+     */
+    class CacheCounters {
+    public:
+        CacheCounters();
+
+        ~CacheCounters();
+
+        bool available() const { return llc_fd >= 0; }
+
+        void start();
+
+        void stop();
+
+        uint64_t llcMisses() const { return llc_misses; }
+
+        uint64_t tlbMisses() const { return tlb_misses; }
+
+        /** "llc_misses=..., dtlb_misses=..." or a note that the counters are unavailable. */
+        std::string describe(size_t num_queries) const;
+
+    private:
+        int llc_fd = -1;
+        int tlb_fd = -1;
+        uint64_t llc_misses = 0;
+        uint64_t tlb_misses = 0;
+    };
+}
+
+#endif //CACHE_COUNTERS_H
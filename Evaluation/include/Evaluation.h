@@ -0,0 +1,99 @@
+//
+// Shared in-process evaluation of the benchmark drivers.
+//
+
+#ifndef EVALUATION_H
+#define EVALUATION_H
+
+#include <cfloat>
+#include <string>
+#include <vector>
+
+namespace evaluation {
+
+    /**
+     * Exact k-NN of a query set. Loaded either from an .ivecs file (ids only) or from the bin
+     * truthset layout: int32 #queries, int32 k, #queries*k uint32 ids, then optionally
+     * #queries*k float squared distances.
+     */
+    class GroundTruth {
+    public:
+        size_t num_queries = 0;
+        size_t k = 0;
+        std::vector<unsigned int> ids;
+        std::vector<float> dists; //empty when the file holds ids only
+
+        void load(const std::string &path);
+
+        bool hasDistances() const { return !dists.empty(); }
+    };
+
+    /**
+     * Aggregated metrics of one run. Latencies are in seconds, recall in [0, 1].
+     */
+    struct Summary {
+        size_t num_queries = 0;
+        size_t k = 0;
+        double recall = 0;
+        double mean_relative_error = 0;
+        double total_time = 0;
+        double qps = 0;
+        double mean_latency = 0;
+        double p50 = 0;
+        double p95 = 0;
+        double p99 = 0;
+    };
+
+    /**
+     * Collects the answer and latency of every query and compares them against the ground truth.
+     * Each query writes its own slot, so record() can be called concurrently for different queries.
+     * When no ids are recorded (e.g. leaf-local ids), recall is computed on the distances: an answer
+     * counts as a hit when it is not farther than the k-th exact neighbor.
+     */
+    class Evaluator {
+    public:
+        Evaluator(const std::string &groundtruth_file, size_t num_queries, size_t k);
+
+        template<typename id_t>
+        void record(size_t query_id, const id_t *ids, const float *dists, double latency) {
+            unsigned int *qids = result_ids.data() + query_id * k;
+            float *qdists = result_dists.data() + query_id * k;
+            for (size_t i = 0; i < k; i++) {
+                if (ids != nullptr) qids[i] = (unsigned int) ids[i];
+                qdists[i] = (dists != nullptr) ? dists[i] : FLT_MAX;
+            }
+            has_ids[query_id] = ids != nullptr;
+            latencies[query_id] = latency;
+        }
+
+        void record(size_t query_id, const float *dists, double latency) {
+            record<unsigned int>(query_id, nullptr, dists, latency);
+        }
+
+        Summary summarize(double total_time) const;
+
+        /**
+         * Writes one summary line for the run. The format follows the extension of output_file:
+         * CSV (header written only when the file is new) for ".csv", JSON otherwise.
+         * An empty output_file prints JSON on stdout.
+         */
+        void report(const std::string &method, double total_time, const std::string &output_file = "") const;
+
+    private:
+        GroundTruth groundtruth;
+        size_t num_queries;
+        size_t k;
+        std::vector<unsigned int> result_ids;
+        std::vector<float> result_dists;
+        std::vector<char> has_ids;
+        std::vector<double> latencies;
+    };
+
+    std::string toJson(const std::string &method, const Summary &summary);
+
+    std::string csvHeader();
+
+    std::string toCsv(const std::string &method, const Summary &summary);
+}
+
+#endif //EVALUATION_H
@@ -0,0 +1,83 @@
+//
+// Hardware cache counters around a measured section.
+//
+
+#include "CacheCounters.h"
+
+#include <cstring>
+#include <sstream>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace evaluation {
+
+#ifdef __linux__
+    static int openCounter(uint32_t type, uint64_t config) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+    static uint64_t readCounter(int fd) {
+        uint64_t value = 0;
+        if (fd < 0 || read(fd, &value, sizeof(value)) != sizeof(value)) return 0;
+        return value;
+    }
+
+    CacheCounters::CacheCounters() {
+        llc_fd = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+        tlb_fd = openCounter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                                                 (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                 (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    }
+
+    CacheCounters::~CacheCounters() {
+        if (llc_fd >= 0) close(llc_fd);
+        if (tlb_fd >= 0) close(tlb_fd);
+    }
+
+    void CacheCounters::start() {
+        for (int fd : {llc_fd, tlb_fd}) {
+            if (fd < 0) continue;
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    void CacheCounters::stop() {
+        for (int fd : {llc_fd, tlb_fd})
+            if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        llc_misses = readCounter(llc_fd);
+        tlb_misses = readCounter(tlb_fd);
+    }
+#else
+    CacheCounters::CacheCounters() {}
+
+    CacheCounters::~CacheCounters() {}
+
+    void CacheCounters::start() {}
+
+    void CacheCounters::stop() {}
+#endif
+
+    std::string CacheCounters::describe(size_t num_queries) const {
+        if (!available())
+            return "cache counters unavailable (perf_event_open failed)";
+        std::ostringstream out;
+        double per_query = num_queries ? 1.0 / num_queries : 0;
+        out << "llc_misses/query=" << llc_misses * per_query;
+        if (tlb_fd >= 0) out << ", dtlb_misses/query=" << tlb_misses * per_query;
+        return out.str();
+    }
+}
@@ -0,0 +1,184 @@
+//
+// Shared in-process evaluation of the benchmark drivers.
+//
+
+#include "Evaluation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+namespace evaluation {
+
+    static bool endsWith(const std::string &s, const std::string &suffix) {
+        return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    void GroundTruth::load(const std::string &path) {
+        std::ifstream in(path.c_str(), std::ios::binary);
+        if (!in.is_open())
+            throw std::runtime_error("Ground truth file " + path + " not found!");
+        in.seekg(0, std::ios::end);
+        size_t file_size = in.tellg();
+        in.seekg(0, std::ios::beg);
+
+        ids.clear();
+        dists.clear();
+        if (endsWith(path, ".ivecs")) {
+            int dim;
+            in.read((char *) &dim, sizeof(int));
+            if (dim <= 0 || file_size % ((dim + 1) * sizeof(int)) != 0)
+                throw std::runtime_error("Ground truth file " + path + " is not a valid ivecs file!");
+            k = dim;
+            num_queries = file_size / ((dim + 1) * sizeof(int));
+            ids.resize(num_queries * k);
+            in.seekg(0, std::ios::beg);
+            for (size_t i = 0; i < num_queries; i++) {
+                in.read((char *) &dim, sizeof(int));
+                in.read((char *) (ids.data() + i * k), k * sizeof(unsigned int));
+            }
+            return;
+        }
+
+        int npts, ndims;
+        in.read((char *) &npts, sizeof(int));
+        in.read((char *) &ndims, sizeof(int));
+        num_queries = npts;
+        k = ndims;
+        size_t with_dists = 2 * sizeof(int) + num_queries * k * (sizeof(unsigned int) + sizeof(float));
+        size_t ids_only = 2 * sizeof(int) + num_queries * k * sizeof(unsigned int);
+        if (npts <= 0 || ndims <= 0 || (file_size != with_dists && file_size != ids_only))
+            throw std::runtime_error("Ground truth file " + path + " does not follow the bin truthset layout!");
+        ids.resize(num_queries * k);
+        in.read((char *) ids.data(), num_queries * k * sizeof(unsigned int));
+        if (file_size == with_dists) {
+            dists.resize(num_queries * k);
+            in.read((char *) dists.data(), num_queries * k * sizeof(float));
+        }
+    }
+
+    Evaluator::Evaluator(const std::string &groundtruth_file, size_t num_queries, size_t k)
+            : num_queries(num_queries), k(k),
+              result_ids(num_queries * k, 0), result_dists(num_queries * k, FLT_MAX),
+              has_ids(num_queries, 0), latencies(num_queries, 0) {
+        groundtruth.load(groundtruth_file);
+        if (groundtruth.num_queries < num_queries)
+            throw std::runtime_error("The ground truth holds fewer queries than the workload!");
+        if (groundtruth.k < k)
+            throw std::runtime_error("The ground truth holds fewer neighbors than k!");
+    }
+
+    Summary Evaluator::summarize(double total_time) const {
+        Summary summary;
+        summary.num_queries = num_queries;
+        summary.k = k;
+        summary.total_time = total_time;
+        if (num_queries == 0) return summary;
+        summary.qps = num_queries / total_time;
+
+        size_t gk = groundtruth.k;
+        double hits = 0;
+        double error = 0;
+        size_t error_count = 0;
+        for (size_t q = 0; q < num_queries; q++) {
+            const unsigned int *gt_ids = groundtruth.ids.data() + q * gk;
+            const float *gt_dists = groundtruth.hasDistances() ? groundtruth.dists.data() + q * gk : nullptr;
+            const unsigned int *res_ids = result_ids.data() + q * k;
+            const float *res_dists = result_dists.data() + q * k;
+
+            if (has_ids[q]) {
+                //neighbors tied with the k-th one are accepted as well
+                size_t tie_breaker = k;
+                if (gt_dists != nullptr)
+                    while (tie_breaker < gk && gt_dists[tie_breaker] == gt_dists[k - 1]) tie_breaker++;
+                std::set<unsigned int> gt(gt_ids, gt_ids + tie_breaker);
+                std::set<unsigned int> res(res_ids, res_ids + k);
+                for (auto id : res)
+                    if (gt.count(id)) hits++;
+            } else if (gt_dists != nullptr) {
+                for (size_t i = 0; i < k; i++)
+                    if (res_dists[i] <= gt_dists[k - 1] * (1 + 1e-6f)) hits++;
+            } else {
+                throw std::runtime_error("Recall without ids needs a ground truth holding the distances!");
+            }
+
+            if (gt_dists != nullptr) {
+                for (size_t i = 0; i < k; i++) {
+                    if (res_dists[i] == FLT_MAX || gt_dists[i] <= 0) continue;
+                    error += std::sqrt(res_dists[i]) / std::sqrt(gt_dists[i]) - 1;
+                    error_count++;
+                }
+            }
+        }
+        summary.recall = hits / (num_queries * k);
+        summary.mean_relative_error = error_count ? error / error_count : 0;
+
+        std::vector<double> sorted_latencies(latencies);
+        std::sort(sorted_latencies.begin(), sorted_latencies.end());
+        auto percentile = [&sorted_latencies](double p) {
+            size_t rank = (size_t) std::ceil(p * sorted_latencies.size());
+            return sorted_latencies[rank == 0 ? 0 : rank - 1];
+        };
+        double sum = 0;
+        for (auto l : sorted_latencies) sum += l;
+        summary.mean_latency = sum / num_queries;
+        summary.p50 = percentile(0.50);
+        summary.p95 = percentile(0.95);
+        summary.p99 = percentile(0.99);
+        return summary;
+    }
+
+    void Evaluator::report(const std::string &method, double total_time, const std::string &output_file) const {
+        Summary summary = summarize(total_time);
+        if (output_file.empty()) {
+            std::cout << toJson(method, summary) << std::endl;
+            return;
+        }
+        bool csv = endsWith(output_file, ".csv");
+        bool empty;
+        {
+            std::ifstream probe(output_file.c_str(), std::ios::binary | std::ios::ate);
+            empty = !probe.is_open() || probe.tellg() == 0;
+        }
+        std::ofstream out(output_file.c_str(), std::ios::app);
+        if (!out.is_open())
+            throw std::runtime_error("Summary file " + output_file + " cannot be opened!");
+        if (csv && empty) out << csvHeader() << "\n";
+        out << (csv ? toCsv(method, summary) : toJson(method, summary)) << "\n";
+    }
+
+    std::string toJson(const std::string &method, const Summary &s) {
+        std::ostringstream out;
+        out.precision(9);
+        out << "{\"method\":\"" << method << "\""
+            << ",\"queries\":" << s.num_queries
+            << ",\"k\":" << s.k
+            << ",\"recall\":" << s.recall
+            << ",\"mean_relative_error\":" << s.mean_relative_error
+            << ",\"total_time\":" << s.total_time
+            << ",\"qps\":" << s.qps
+            << ",\"mean_latency\":" << s.mean_latency
+            << ",\"p50\":" << s.p50
+            << ",\"p95\":" << s.p95
+            << ",\"p99\":" << s.p99 << "}";
+        return out.str();
+    }
+
+    std::string csvHeader() {
+        return "method,queries,k,recall,mean_relative_error,total_time,qps,mean_latency,p50,p95,p99";
+    }
+
+    std::string toCsv(const std::string &method, const Summary &s) {
+        std::ostringstream out;
+        out.precision(9);
+        out << method << "," << s.num_queries << "," << s.k << "," << s.recall << ","
+            << s.mean_relative_error << "," << s.total_time << "," << s.qps << ","
+            << s.mean_latency << "," << s.p50 << "," << s.p95 << "," << s.p99;
+        return out.str();
+    }
+}
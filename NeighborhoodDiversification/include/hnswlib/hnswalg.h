@@ -1809,21 +1809,47 @@ int getL(size_t size) {
         };
 
 
+        /**
+         * Keeps the k closest candidates and writes them closest first into the caller buffers,
+         * ids as external labels (ids may be null when only the distances are wanted).
+         * Slots beyond the number of candidates found are padded with max distance / max label.
+         */
+        void getKnnResults(std::priority_queue<std::pair<dist_t, tableint>,
+                std::vector<std::pair<dist_t, tableint>>, CompareByFirst> &top_candidates,
+                           size_t k, labeltype * ids, dist_t * dists) const {
+            while (top_candidates.size() > k) {
+                top_candidates.pop();
+            }
+            for (size_t i = top_candidates.size(); i < k; i++) {
+                dists[i] = std::numeric_limits<dist_t>::max();
+                if (ids) ids[i] = std::numeric_limits<labeltype>::max();
+            }
+            int i = top_candidates.size() - 1;
+            while ( top_candidates.size() > 0) {
+                std::pair<dist_t, tableint> rez = top_candidates.top();
+                dists[i] = rez.first;
+                if (ids) ids[i] = getExternalLabel(rez.second);
+                top_candidates.pop();
+                --i;
+            }
+        }
+
         ///used for  hierarchical and flat search
         float * searchGraph(const void *query_data, size_t k, querying_stats & stats) const {
-            auto f = std::chrono::high_resolution_clock::now();
-//            auto timer1 = new Timer() ;
-//            t_build->printElapsedTime(std::string ("Index Building").c_str());
-//            t_build->restart();
-            
             float *  result = nullptr;
             if (cur_element_count == 0) return result;
             result = static_cast<float *>(malloc(sizeof(float) * k));
+            searchGraph(query_data, k, nullptr, result, stats);
+            return result;
+        };
+
+        void searchGraph(const void *query_data, size_t k, labeltype * ids, dist_t * dists, querying_stats & stats) const {
+            auto f = std::chrono::high_resolution_clock::now();
+            if (cur_element_count == 0) return;
             auto stime = std::chrono::high_resolution_clock::now();
 
             tableint currObj = enterpoint_node_;
             dist_t curdist = fstdistfunc_(query_data, getDataByInternalId(enterpoint_node_), dist_func_param_);
-//            __RESET_NUM_DISTCAL
             for (int level = maxlevel_; level > 0; level--) {
                 bool changed = true;
                 while (changed) {
@@ -1832,8 +1858,6 @@ int getL(size_t size) {
 
                     data = (unsigned int *) get_linklist(currObj, level);
                     int size = getListCount(data);
-//                    metric_hops++;
-//                    metric_distance_computations+=size;
                     stats.distance_computations_hrl +=size;
                     stats.num_hops_hrl++;
                     tableint *datal = (tableint *) (data + 1);
@@ -1842,7 +1866,6 @@ int getL(size_t size) {
                         if (cand < 0 || cand > max_elements_)
                             throw std::runtime_error("cand error");
                         dist_t d = fstdistfunc_(query_data, getDataByInternalId(cand), dist_func_param_);
-//                        __COUNT_NUM_DISTCAL
                         if (d < curdist) {
                             curdist = d;
                             currObj = cand;
@@ -1869,24 +1892,13 @@ int getL(size_t size) {
             elapsed = finish - stime;
             stats.time_layer0=elapsed.count();
             stime = std::chrono::high_resolution_clock::now();
-            while (top_candidates.size() > k) {
-                top_candidates.pop();
-            }
-            int i = k-1;
-            while ( top_candidates.size() > 0) {
-                std::pair<dist_t, tableint> rez = top_candidates.top();
-                result[i] = rez.first;
-                top_candidates.pop();
-                --i;
-            }
+            getKnnResults(top_candidates, k, ids, dists);
             finish = std::chrono::high_resolution_clock::now();
             elapsed = finish - stime;
             stats.time_pq=elapsed.count();
             finish = std::chrono::high_resolution_clock::now();
             elapsed = finish - f;
             stats.time_leaves_search = elapsed.count();
-            return result;
-
         };
 
 
@@ -1923,14 +1935,18 @@ int getL(size_t size) {
         };
 
         float * searchGraphBsl(const void *query_data, size_t k, querying_stats & stats) const {
-
             float *  result = nullptr;
             if (cur_element_count == 0) return result;
             result = static_cast<float *>(malloc(sizeof(float) * k));
-            auto start = new PTK::Timer();
+            searchGraphBsl(query_data, k, nullptr, result, stats);
+            return result;
+        };
+
+        void searchGraphBsl(const void *query_data, size_t k, labeltype * ids, dist_t * dists, querying_stats & stats) const {
+            if (cur_element_count == 0) return;
+            PTK::Timer start;
 
             tableint currObj = enterpoint_node_;
-            dist_t curdist = fstdistfunc_(query_data, getDataByInternalId(enterpoint_node_), dist_func_param_);
 
             auto stime = std::chrono::high_resolution_clock::now();
 
@@ -1945,29 +1961,24 @@ int getL(size_t size) {
             stats.time_layer0+=elapsed.count();
 
             stime = std::chrono::high_resolution_clock::now();
-            while (top_candidates.size() > k) {
-                top_candidates.pop();
-            }
-            int i = k-1;
-            while ( top_candidates.size() > 0) {
-                std::pair<dist_t, tableint> rez = top_candidates.top();
-                result[i] = rez.first;
-                top_candidates.pop();
-                --i;
-            }
+            getKnnResults(top_candidates, k, ids, dists);
             finish = std::chrono::high_resolution_clock::now();
             elapsed = finish - stime;
             stats.time_pq+=elapsed.count();
-            stats.time_leaves_search = start->getElapsedTime();
-            return result;
-
+            stats.time_leaves_search = start.getElapsedTime();
         };
-        float * searchGraphBslrdseed(const void *query_data, size_t k, querying_stats & stats) const {
 
+        float * searchGraphBslrdseed(const void *query_data, size_t k, querying_stats & stats) const {
             float *  result = nullptr;
             if (cur_element_count == 0) return result;
             result = static_cast<float *>(malloc(sizeof(float) * k));
-            auto start = new PTK::Timer();
+            searchGraphBslrdseed(query_data, k, nullptr, result, stats);
+            return result;
+        };
+
+        void searchGraphBslrdseed(const void *query_data, size_t k, labeltype * ids, dist_t * dists, querying_stats & stats) const {
+            if (cur_element_count == 0) return;
+            PTK::Timer start;
 
             auto stime = std::chrono::high_resolution_clock::now();
 
@@ -1982,37 +1993,30 @@ int getL(size_t size) {
             stats.time_layer0+=elapsed.count();
 
             stime = std::chrono::high_resolution_clock::now();
-            while (top_candidates.size() > k) {
-                top_candidates.pop();
-            }
-            int i = k-1;
-            while ( top_candidates.size() > 0) {
-                std::pair<dist_t, tableint> rez = top_candidates.top();
-                result[i] = rez.first;
-                top_candidates.pop();
-                --i;
-            }
+            getKnnResults(top_candidates, k, ids, dists);
             finish = std::chrono::high_resolution_clock::now();
             elapsed = finish - stime;
             stats.time_pq+=elapsed.count();
-            stats.time_leaves_search = start->getElapsedTime();
-            return result;
-
+            stats.time_leaves_search = start.getElapsedTime();
         };
-        float * searchGraphBsltreeps(const void *query_data, size_t k,uint * eps, querying_stats & stats) const {
 
+        float * searchGraphBsltreeps(const void *query_data, size_t k,uint * eps, querying_stats & stats) const {
             float *  result = nullptr;
             if (cur_element_count == 0) return result;
             result = static_cast<float *>(malloc(sizeof(float) * k));
-            auto start = new PTK::Timer();
+            searchGraphBsltreeps(query_data, k, eps, nullptr, result, stats);
+            return result;
+        };
+
+        void searchGraphBsltreeps(const void *query_data, size_t k, uint * eps, labeltype * ids, dist_t * dists, querying_stats & stats) const {
+            if (cur_element_count == 0) return;
+            PTK::Timer start;
 
             auto stime = std::chrono::high_resolution_clock::now();
 
             std::priority_queue<std::pair<dist_t, tableint>,
                     std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates;
 
-//            std::vector<std::pair<uint,float>> * eps =  KDTeps.getseeds(query_data,ef_,0,stats);
-
             top_candidates=searchBaseLayerSTtreeps<false,true>(
                     eps, query_data, std::max(ef_, k), stats);
 
@@ -2021,22 +2025,11 @@ int getL(size_t size) {
             stats.time_layer0+=elapsed.count();
 
             stime = std::chrono::high_resolution_clock::now();
-            while (top_candidates.size() > k) {
-                top_candidates.pop();
-            }
-            int i = k-1;
-            while ( top_candidates.size() > 0) {
-                std::pair<dist_t, tableint> rez = top_candidates.top();
-                result[i] = rez.first;
-                top_candidates.pop();
-                --i;
-            }
+            getKnnResults(top_candidates, k, ids, dists);
             finish = std::chrono::high_resolution_clock::now();
             elapsed = finish - stime;
             stats.time_pq+=elapsed.count();
-            stats.time_leaves_search = start->getElapsedTime();
-            return result;
-
+            stats.time_leaves_search = start.getElapsedTime();
         };
         std::priority_queue<std::pair<dist_t, labeltype >>
         searchKnn(const void *query_data, size_t k) const {
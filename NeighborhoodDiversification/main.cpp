@@ -43,14 +43,16 @@ void
 query_workload(size_t vecsize,
                size_t qsize, HierarchicalNSW<ts_type> &appr_alg,
                size_t vecdim, vector<std::priority_queue<std::pair<ts_type, labeltype >>> &answers,
-               size_t k, char * queries, size_t efs,bool flatt,int sims);
+               size_t k, char * queries, size_t efs,bool flatt,int sims, char * results_file);
 void
 query_workload_IQP(size_t vecsize,
                size_t qsize, HierarchicalNSW<ts_type> &appr_alg,
                size_t vecdim, vector<std::priority_queue<std::pair<ts_type, labeltype >>> &answers,
                size_t k, char * queries, size_t efs,bool flatt,int sims);
 
-void printKNN(float * results, int k,  querying_stats stats);
+void printKNN(labeltype * ids, float * results, int k,  querying_stats stats);
+
+void write_results(char * results_file, labeltype * ids, float * dists, size_t qsize, size_t k);
 
 
 void read_data(char * dataset,
@@ -64,7 +66,7 @@ void add_data(HierarchicalNSW<ts_type> &appr_alg, ts_type *data, unsigned int ts
 void add_data_ksrep(HierarchicalNSW<ts_type> &appr_alg, ts_type *data, unsigned int ts_length, unsigned int data_size,
                unsigned int label_offset, int i, float d);
 void query_workloadrdseed(        size_t vecsize,        size_t qsize,        HierarchicalNSW<ts_type> &appr_alg,        size_t vecdim,        vector<std::priority_queue<std::pair<ts_type, labeltype >>> &answers,
-        size_t k,        char * queries,        size_t efs);
+        size_t k,        char * queries,        size_t efs, char * results_file);
 
 
 
@@ -75,7 +77,7 @@ void query_workload_kdt(size_t vecsize,
                              vector<std::priority_queue<std::pair<ts_type, labeltype >>> &answers,
                              size_t k,
                              char * queries,
-                             size_t efs, uint **kdeps);
+                             size_t efs, uint **kdeps, char * results_file);
 
 void peak_memory_footprint() {
 
@@ -101,6 +103,7 @@ int main (int argc, char **argv) {
     static char *queries = "/query_current.txt";
 
     static char *index_path = "out/";
+    static char *results_file = nullptr;
     static unsigned int dataset_size = 1000;
     static unsigned int queries_size = 5;
     static unsigned int ts_length = 256;
@@ -135,6 +138,7 @@ int main (int argc, char **argv) {
                 {"cnt",required_argument, 0, 'c'},
                 {"depth",required_argument, 0, 'dp'},
                 {"nt",required_argument, 0, 'nt'},
+                {"results",required_argument, 0, 'rs'},
                 {"help",            no_argument,       0, '?'}
         };
 
@@ -190,6 +194,9 @@ int main (int argc, char **argv) {
             case 'nt':
                 ntrees = atoi(optarg);
                 break;
+            case 'rs':
+                results_file = optarg;
+                break;
             case 'x':
                 mode = atoi(optarg);
                 break;
@@ -298,7 +305,7 @@ int main (int argc, char **argv) {
                     answers,
                     (size_t) k,
                     queries,
-                    (size_t) efs, 0, 0);
+                    (size_t) efs, 0, 0, results_file);
 
             s_build->printElapsedTime(std::string("TOTAL TIME").c_str());
         }
@@ -378,7 +385,7 @@ int main (int argc, char **argv) {
                     answers,
                     (size_t) k,
                     queries,
-                    (size_t) efs, 1, 0);
+                    (size_t) efs, 1, 0, results_file);
 
             s_build->printElapsedTime(std::string("TOTAL TIME").c_str());
 
@@ -396,7 +403,7 @@ int main (int argc, char **argv) {
                     answers,
                     (size_t) k,
                     queries,
-                    (size_t) efs, 1, 0);
+                    (size_t) efs, 1, 0, results_file);
 
             s_build->printElapsedTime(std::string("TOTAL TIME").c_str());
         }
@@ -413,7 +420,7 @@ int main (int argc, char **argv) {
                     answers,
                     (size_t) k,
                     queries,
-                    (size_t) efs);
+                    (size_t) efs, results_file);
 
             s_build->printElapsedTime(std::string("TOTAL TIME").c_str());
         }
@@ -440,7 +447,7 @@ int main (int argc, char **argv) {
                     answers,
                     (size_t) k,
                     queries,
-                    (size_t) efs, kdeps);
+                    (size_t) efs, kdeps, results_file);
 
             s_build->printElapsedTime(std::string("TOTAL TIME").c_str());
         }
@@ -490,7 +497,7 @@ void query_workload_kdt(size_t vecsize,
                            vector<std::priority_queue<std::pair<ts_type, labeltype >>> &answers,
                            size_t k,
                            char * queries,
-                           size_t efs, uint **kdeps) {
+                           size_t efs, uint **kdeps, char * results_file) {
     size_t correct = 0;
     size_t total = 0;
 
@@ -504,18 +511,25 @@ void query_workload_kdt(size_t vecsize,
 
     //#pragma omp parallel for
     querying_stats s;
-    float* result;
+    labeltype * ids = new labeltype[qsize * k];
+    float * dists = new float[qsize * k];
 
     for (int i = 0; i < qsize; i++) {
         fread(query, sizeof(ts_type), vecdim, dfp);
         appr_alg.setEf(efs);
-            result = appr_alg.searchGraphBsltreeps(query, k, kdeps[i],s);
-        printKNN(result, k, s);
+            appr_alg.searchGraphBsltreeps(query, k, kdeps[i], ids + i * k, dists + i * k, s);
+        printKNN(ids + i * k, dists + i * k, k, s);
         s.time_cnmd=0;s.time_update_knn=0;s.time_leaves_search=0;s.time_routing=0;s.time_layer0=0;s.time_pq=0;
         s.num_hops_bsl=0;s.distance_computations_hrl=0;s.num_hops_hrl=0;s.distance_computations_bsl=0;
         s.saxdist_computations_bsl=0;s.saxdist_computations_hsl=0;
     }
 
+    if (results_file != nullptr)
+        write_results(results_file, ids, dists, qsize, k);
+    delete[] ids;
+    delete[] dists;
+    free(query);
+    fclose(dfp);
 }
 
 
@@ -572,7 +586,7 @@ query_workload(//ts_type *massQ,
         size_t k,
         char * queries,
         size_t efs,
-        bool flatt,int sims)
+        bool flatt,int sims, char * results_file)
 {
     size_t correct = 0;
     size_t total = 0;
@@ -587,7 +601,8 @@ query_workload(//ts_type *massQ,
 
     //#pragma omp parallel for
     querying_stats s;
-    float* result;
+    labeltype * ids = new labeltype[qsize * k];
+    float * dists = new float[qsize * k];
 
     for (int i = 0; i < qsize; i++) {
 
@@ -599,21 +614,27 @@ query_workload(//ts_type *massQ,
 
         if(flatt) {
 
-            result = appr_alg.searchGraphBsl(query, k, s);
+            appr_alg.searchGraphBsl(query, k, ids + i * k, dists + i * k, s);
         }
         else {
 
-            result = appr_alg.searchGraph(query, k, s);
+            appr_alg.searchGraph(query, k, ids + i * k, dists + i * k, s);
         }
 
 
-        printKNN(result, k, s);
+        printKNN(ids + i * k, dists + i * k, k, s);
 
         s.time_cnmd=0;s.time_update_knn=0;s.time_leaves_search=0;s.time_routing=0;s.time_layer0=0;s.time_pq=0;
         s.num_hops_bsl=0;s.distance_computations_hrl=0;s.num_hops_hrl=0;s.distance_computations_bsl=0;
         s.saxdist_computations_bsl=0;s.saxdist_computations_hsl=0;
     }
 
+    if (results_file != nullptr)
+        write_results(results_file, ids, dists, qsize, k);
+    delete[] ids;
+    delete[] dists;
+    free(query);
+    fclose(dfp);
 }
 
 
@@ -626,7 +647,7 @@ query_workloadrdseed(
         vector<std::priority_queue<std::pair<ts_type, labeltype >>> &answers,
         size_t k,
         char * queries,
-        size_t efs)
+        size_t efs, char * results_file)
 {
     size_t correct = 0;
     size_t total = 0;
@@ -640,7 +661,8 @@ query_workloadrdseed(
     }
 
     querying_stats s;
-    float* result;
+    labeltype * ids = new labeltype[qsize * k];
+    float * dists = new float[qsize * k];
     appr_alg.setEf(efs);
     for (int i = 0; i < qsize; i++) {
 
@@ -650,27 +672,53 @@ query_workloadrdseed(
 
 
 
-            result = appr_alg.searchGraphBslrdseed(query, k, s);
+            appr_alg.searchGraphBslrdseed(query, k, ids + i * k, dists + i * k, s);
 
 
-        printKNN(result, k, s);
+        printKNN(ids + i * k, dists + i * k, k, s);
 
         s.time_cnmd=0;s.time_update_knn=0;s.time_leaves_search=0;s.time_routing=0;s.time_layer0=0;s.time_pq=0;
         s.num_hops_bsl=0;s.distance_computations_hrl=0;s.num_hops_hrl=0;s.distance_computations_bsl=0;
         s.saxdist_computations_bsl=0;s.saxdist_computations_hsl=0;
     }
 
+    if (results_file != nullptr)
+        write_results(results_file, ids, dists, qsize, k);
+    delete[] ids;
+    delete[] dists;
+    free(query);
+    fclose(dfp);
 }
 
 
 
-void printKNN(float * results, int k, querying_stats stats){
+/**
+ * Writes the k-NN of every query in the bin truthset layout used by the ground-truth tools:
+ * int32 #queries, int32 k, #queries*k uint32 ids, then #queries*k float (squared) distances.
+ */
+void write_results(char * results_file, labeltype * ids, float * dists, size_t qsize, size_t k)
+{
+    FILE *rfp = fopen(results_file, "wb");
+    if (rfp == NULL) {
+        fprintf(stderr, "Results file %s cannot be created!\n", results_file);
+        exit(-1);
+    }
+    int npts = (int) qsize, ndims = (int) k;
+    fwrite(&npts, sizeof(int), 1, rfp);
+    fwrite(&ndims, sizeof(int), 1, rfp);
+    std::vector<unsigned int> ids32(ids, ids + qsize * k);
+    fwrite(ids32.data(), sizeof(unsigned int), qsize * k, rfp);
+    fwrite(dists, sizeof(float), qsize * k, rfp);
+    fclose(rfp);
+}
+
+void printKNN(labeltype * ids, float * results, int k, querying_stats stats){
     cout << "----------"<<k<<"-NN RESULTS----------- | visited nodes : \n";
     for(int i = 0 ; i < k ; i++){
         printf( " K N°%i  => Distance : %f | Node ID : %lu | Time  : %f |  "
                 "Total DC : %lu | HDC : %lu | BDC : %lu | "
                 "Total LBDC : %lu | HLBDC : %lu | BLBDC : %lu | \n",i+1,sqrt(results[i]),
-                0,stats.time_leaves_search,stats.distance_computations_bsl+stats.distance_computations_hrl
+                ids[i],stats.time_leaves_search,stats.distance_computations_bsl+stats.distance_computations_hrl
                 ,stats.distance_computations_hrl,stats.distance_computations_bsl,
                 stats.saxdist_computations_hsl+stats.saxdist_computations_bsl,stats.saxdist_computations_hsl,stats.saxdist_computations_bsl);
 
@@ -0,0 +1,239 @@
+//
+// Offline locality-improving relabeling of graph indexes.
+//
+
+#include "Reordering.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+namespace reordering {
+
+    void Graph::addNode(const unsigned int *neighbors, size_t degree) {
+        if (offsets.empty()) offsets.push_back(0);
+        edges.insert(edges.end(), neighbors, neighbors + degree);
+        offsets.push_back(edges.size());
+    }
+
+    Method parseMethod(const std::string &name) {
+        if (name == "bfs") return Method::BFS;
+        if (name == "rcm") return Method::RCM;
+        if (name == "gorder") return Method::GORDER;
+        throw std::runtime_error("Unknown reordering method " + name + " (expected bfs, rcm or gorder)!");
+    }
+
+    /**
+     * Breadth-first traversal of every component, starting from start and then from the smallest unvisited id.
+     * With by_degree, the neighbors of a node are enqueued by increasing degree (Cuthill-McKee).
+     */
+    static std::vector<unsigned int> breadthFirst(const Graph &graph, unsigned int start, bool by_degree) {
+        size_t n = graph.size();
+        std::vector<unsigned int> order;
+        order.reserve(n);
+        std::vector<char> visited(n, 0);
+        std::vector<unsigned int> children;
+        unsigned int next_root = 0;
+        unsigned int root = start;
+        while (order.size() < n) {
+            visited[root] = 1;
+            size_t head = order.size();
+            order.push_back(root);
+            while (head < order.size()) {
+                unsigned int node = order[head++];
+                children.clear();
+                const unsigned int *neighbors = graph.neighbors(node);
+                for (size_t j = 0; j < graph.degree(node); j++) {
+                    unsigned int neighbor = neighbors[j];
+                    if (neighbor >= n || visited[neighbor]) continue;
+                    visited[neighbor] = 1;
+                    children.push_back(neighbor);
+                }
+                if (by_degree)
+                    std::stable_sort(children.begin(), children.end(), [&graph](unsigned int a, unsigned int b) {
+                        return graph.degree(a) < graph.degree(b);
+                    });
+                order.insert(order.end(), children.begin(), children.end());
+            }
+            while (next_root < n && visited[next_root]) next_root++;
+            root = next_root;
+        }
+        return order;
+    }
+
+    /**
+     * Max-priority structure over small integer keys changed by +-1 steps, as used by Gorder: one doubly
+     * linked list per key value, so updates and extraction of the maximum are O(1) amortized.
+     */
+    class UnitHeap {
+    public:
+        explicit UnitHeap(size_t n) : key(n, 0), prev(n), next(n), removed(n, 0), heads(1, NONE) {
+            for (size_t i = n; i-- > 0;) link((unsigned int) i);
+        }
+
+        void increment(unsigned int node) {
+            if (removed[node]) return;
+            unlink(node);
+            key[node]++;
+            if (key[node] >= heads.size()) heads.push_back(NONE);
+            link(node);
+            top = std::max(top, key[node]);
+        }
+
+        void decrement(unsigned int node) {
+            if (removed[node] || key[node] == 0) return;
+            unlink(node);
+            key[node]--;
+            link(node);
+        }
+
+        void remove(unsigned int node) {
+            if (removed[node]) return;
+            unlink(node);
+            removed[node] = 1;
+        }
+
+        /** Returns the node with the largest key, or NONE when empty. */
+        unsigned int extractMax() {
+            while (top > 0 && heads[top] == NONE) top--;
+            unsigned int node = heads[top];
+            if (node != NONE) remove(node);
+            return node;
+        }
+
+        static const unsigned int NONE = ~0u;
+
+    private:
+        void link(unsigned int node) {
+            unsigned int &head = heads[key[node]];
+            prev[node] = NONE;
+            next[node] = head;
+            if (head != NONE) prev[head] = node;
+            head = node;
+        }
+
+        void unlink(unsigned int node) {
+            if (prev[node] != NONE) next[prev[node]] = next[node];
+            else heads[key[node]] = next[node];
+            if (next[node] != NONE) prev[next[node]] = prev[node];
+        }
+
+        std::vector<size_t> key;
+        std::vector<unsigned int> prev, next;
+        std::vector<char> removed;
+        std::vector<unsigned int> heads;
+        size_t top = 0;
+    };
+
+    const unsigned int UnitHeap::NONE;
+
+    static std::vector<unsigned int> gorder(const Graph &graph, unsigned int start, size_t window) {
+        size_t n = graph.size();
+        // in-edges, to score the edges towards a placed node and the siblings sharing an in-neighbor with it
+        std::vector<size_t> in_offsets(n + 1, 0);
+        for (unsigned int e : graph.edges)
+            if (e < n) in_offsets[e + 1]++;
+        for (size_t i = 0; i < n; i++) in_offsets[i + 1] += in_offsets[i];
+        std::vector<unsigned int> in_edges(in_offsets[n]);
+        std::vector<size_t> fill(in_offsets.begin(), in_offsets.end() - 1);
+        for (unsigned int u = 0; u < n; u++) {
+            const unsigned int *neighbors = graph.neighbors(u);
+            for (size_t j = 0; j < graph.degree(u); j++)
+                if (neighbors[j] < n) in_edges[fill[neighbors[j]]++] = u;
+        }
+        // as in the paper, hubs are not expanded to their siblings: they would touch a large part of the graph
+        size_t hub_degree = std::max<size_t>(64, (size_t) std::sqrt((double) n));
+
+        UnitHeap heap(n);
+        auto update = [&](unsigned int v, bool enter) {
+            auto touch = [&heap, enter](unsigned int u) {
+                if (enter) heap.increment(u);
+                else heap.decrement(u);
+            };
+            const unsigned int *out = graph.neighbors(v);
+            for (size_t j = 0; j < graph.degree(v); j++)
+                if (out[j] < n) touch(out[j]);
+            for (size_t i = in_offsets[v]; i < in_offsets[v + 1]; i++) {
+                unsigned int x = in_edges[i];
+                touch(x);
+                if (graph.degree(x) > hub_degree) continue;
+                const unsigned int *siblings = graph.neighbors(x);
+                for (size_t j = 0; j < graph.degree(x); j++)
+                    if (siblings[j] < n && siblings[j] != v) touch(siblings[j]);
+            }
+        };
+
+        std::vector<unsigned int> order;
+        order.reserve(n);
+        heap.remove(start);
+        order.push_back(start);
+        while (order.size() < n) {
+            update(order.back(), true);
+            if (order.size() > window) update(order[order.size() - window - 1], false);
+            order.push_back(heap.extractMax());
+        }
+        return order;
+    }
+
+    std::vector<unsigned int> computeOrder(const Graph &graph, unsigned int entry_point, Method method,
+                                           size_t window) {
+        if (graph.size() == 0) return std::vector<unsigned int>();
+        if (entry_point >= graph.size())
+            throw std::runtime_error("The entry point is not a node of the graph!");
+        switch (method) {
+            case Method::BFS:
+                return breadthFirst(graph, entry_point, false);
+            case Method::RCM: {
+                std::vector<unsigned int> order = breadthFirst(graph, entry_point, true);
+                std::reverse(order.begin(), order.end());
+                return order;
+            }
+            case Method::GORDER:
+                return gorder(graph, entry_point, std::max<size_t>(window, 1));
+        }
+        throw std::runtime_error("Unknown reordering method!");
+    }
+
+    std::vector<unsigned int> inverse(const std::vector<unsigned int> &order) {
+        std::vector<unsigned int> rank(order.size());
+        for (size_t i = 0; i < order.size(); i++) rank[order[i]] = (unsigned int) i;
+        return rank;
+    }
+
+    double averageGap(const Graph &graph, const std::vector<unsigned int> &rank) {
+        double gap = 0;
+        size_t count = 0;
+        for (unsigned int u = 0; u < graph.size(); u++) {
+            const unsigned int *neighbors = graph.neighbors(u);
+            for (size_t j = 0; j < graph.degree(u); j++) {
+                if (neighbors[j] >= graph.size()) continue;
+                gap += std::abs((double) rank[u] - (double) rank[neighbors[j]]);
+                count++;
+            }
+        }
+        return count ? gap / count : 0;
+    }
+
+    void writeIdMap(const std::string &path, const std::vector<unsigned int> &order) {
+        std::ofstream out(path.c_str(), std::ios::binary);
+        if (!out.is_open())
+            throw std::runtime_error("Id map file " + path + " cannot be opened!");
+        unsigned int n = (unsigned int) order.size();
+        out.write((const char *) &n, sizeof(n));
+        out.write((const char *) order.data(), n * sizeof(unsigned int));
+    }
+
+    std::vector<unsigned int> readIdMap(const std::string &path) {
+        std::ifstream in(path.c_str(), std::ios::binary);
+        if (!in.is_open())
+            throw std::runtime_error("Id map file " + path + " not found!");
+        unsigned int n = 0;
+        in.read((char *) &n, sizeof(n));
+        std::vector<unsigned int> order(n);
+        in.read((char *) order.data(), n * sizeof(unsigned int));
+        if (!in)
+            throw std::runtime_error("Id map file " + path + " is truncated!");
+        return order;
+    }
+}
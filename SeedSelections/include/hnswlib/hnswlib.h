@@ -79,6 +79,11 @@ namespace hnswlib {
         virtual float * searchGraphBsl(const void *, size_t, querying_stats &) const = 0;
         virtual float * searchGraphBslrdseed(const void *, size_t, querying_stats &) const = 0;
         virtual float * searchGraphBsltreeps(const void *, size_t,uint*, querying_stats &) const = 0;
+        // Same searches writing the k closest labels and distances, closest first, into caller buffers
+        virtual void searchGraph(const void *, size_t, labeltype *, dist_t *, querying_stats &) const = 0;
+        virtual void searchGraphBsl(const void *, size_t, labeltype *, dist_t *, querying_stats &) const = 0;
+        virtual void searchGraphBslrdseed(const void *, size_t, labeltype *, dist_t *, querying_stats &) const = 0;
+        virtual void searchGraphBsltreeps(const void *, size_t, uint*, labeltype *, dist_t *, querying_stats &) const = 0;
         // Return k nearest neighbor in the order of closer fist
         virtual std::vector<std::pair<dist_t, labeltype>>
             searchKnnCloserFirst(const void* query_data, size_t k) const;
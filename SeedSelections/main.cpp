@@ -33,38 +33,51 @@ typedef float ts_type;
 #include <chrono>
 #include "hnswlib/hnswlib.h"
 #include "dirent.h"
+#include "Evaluation.h"
+#include "ChunkReader.h"
 
 #include <unordered_set>
+#include <algorithm>
 
 using namespace std;
 using namespace hnswlib;
 
+/**
+ * Where the answers of a query workload go besides the per-query lines:
+ * the binary results file (--results) and the in-process evaluation (--groundtruth, --summary).
+ * Per-query lines are not printed when an evaluator is set.
+ */
+struct workload_output {
+    char * results_file = nullptr;
+    evaluation::Evaluator * evaluator = nullptr;
+    char * summary_file = nullptr;
+};
+
 void
 query_workload(size_t vecsize,
                size_t qsize, HierarchicalNSW<ts_type> &appr_alg,
                size_t vecdim, vector<std::priority_queue<std::pair<ts_type, labeltype >>> &answers,
-               size_t k, char * queries, size_t efs,bool flatt,int sims);
+               size_t k, char * queries, size_t efs,bool flatt,int sims, workload_output &output);
 void
 query_workload_IQP(size_t vecsize,
                size_t qsize, HierarchicalNSW<ts_type> &appr_alg,
                size_t vecdim, vector<std::priority_queue<std::pair<ts_type, labeltype >>> &answers,
                size_t k, char * queries, size_t efs,bool flatt,int sims);
 
-void printKNN(float * results, int k,  querying_stats stats);
+void printKNN(labeltype * ids, float * results, int k,  querying_stats stats);
 
+void write_results(char * results_file, labeltype * ids, float * dists, size_t qsize, size_t k);
+
+void finish_workload(workload_output &output, labeltype * ids, float * dists, size_t qsize, size_t k,
+                     double search_time);
 
-void read_data(char * dataset,
-               ts_type ** pdata,
-               unsigned int ts_length,
-               unsigned int data_size,
-               unsigned int offset);
 
 void add_data(HierarchicalNSW<ts_type> &appr_alg, ts_type *data, unsigned int ts_length, unsigned int data_size,
               unsigned int label_offset, int i, float d, int cnt);
 void add_data_ksrep(HierarchicalNSW<ts_type> &appr_alg, ts_type *data, unsigned int ts_length, unsigned int data_size,
                unsigned int label_offset, int i, float d);
 void query_workloadrdseed(        size_t vecsize,        size_t qsize,        HierarchicalNSW<ts_type> &appr_alg,        size_t vecdim,        vector<std::priority_queue<std::pair<ts_type, labeltype >>> &answers,
-        size_t k,        char * queries,        size_t efs);
+        size_t k,        char * queries,        size_t efs, workload_output &output);
 
 
 
@@ -75,7 +88,14 @@ void query_workload_kdt(size_t vecsize,
                              vector<std::priority_queue<std::pair<ts_type, labeltype >>> &answers,
                              size_t k,
                              char * queries,
-                             size_t efs, uint **kdeps);
+                             size_t efs, uint **kdeps, workload_output &output);
+
+void query_workload_batch(size_t qsize,
+                          HierarchicalNSW<ts_type> &appr_alg,
+                          size_t vecdim,
+                          size_t k,
+                          char * queries,
+                          size_t efs, int ep, uint **kdeps, int nthreads, workload_output &output);
 
 void peak_memory_footprint() {
 
@@ -101,6 +121,10 @@ int main (int argc, char **argv) {
     static char *queries = "/query_current.txt";
 
     static char *index_path = "out/";
+    static char *results_file = nullptr;
+    static char *groundtruth_file = nullptr;
+    static char *summary_file = nullptr;
+    static int dataset_mmap = 0; //build from a mapping of the dataset file instead of prefetched chunk reads
     static unsigned int dataset_size = 1000;
     static unsigned int queries_size = 5;
     static unsigned int ts_length = 256;
@@ -118,6 +142,7 @@ int main (int argc, char **argv) {
     int connectivity = 1;
     int depth = 8;
     int ntrees = 8;
+    int nthreads = 0; //0 keeps the serial one-query-at-a-time workload
     while (1) {
         static struct option long_options[] = {
                 {"dataset",         required_argument, 0, 'd'},
@@ -135,6 +160,11 @@ int main (int argc, char **argv) {
                 {"cnt",required_argument, 0, 'c'},
                 {"depth",required_argument, 0, 'dp'},
                 {"nt",required_argument, 0, 'nt'},
+                {"threads",required_argument, 0, 'th'},
+                {"results",required_argument, 0, 'rs'},
+                {"groundtruth",required_argument, 0, 'gt'},
+                {"summary",required_argument, 0, 'sm'},
+                {"dataset-mmap",required_argument, 0, 'dm'},
                 {"help",            no_argument,       0, '?'}
         };
 
@@ -149,6 +179,9 @@ int main (int argc, char **argv) {
             case 'pr':
                 prune =atof(optarg);
                 break;
+            case 'dm':
+                dataset_mmap = atoi(optarg);
+                break;
             case 'rn':
                 rng =atoi(optarg);
                 break;
@@ -190,6 +223,18 @@ int main (int argc, char **argv) {
             case 'nt':
                 ntrees = atoi(optarg);
                 break;
+            case 'th':
+                nthreads = atoi(optarg);
+                break;
+            case 'rs':
+                results_file = optarg;
+                break;
+            case 'gt':
+                groundtruth_file = optarg;
+                break;
+            case 'sm':
+                summary_file = optarg;
+                break;
             case 'x':
                 mode = atoi(optarg);
                 break;
@@ -231,19 +276,15 @@ int main (int argc, char **argv) {
         mkdir(index_path , 07777);
 
 
-        ts_type *data = (ts_type *)malloc(dataset_size * ts_length * sizeof(ts_type));
-
         HierarchicalNSW<ts_type> appr_alg(&l2space, dataset_size, k, efs);
 
         auto t_build = new PTK::Timer() ;
 
-        int i;
-
         auto buffer_size = 100000;
         if(buffer_size > dataset_size)buffer_size=dataset_size;
-        unsigned int chunk_count = (unsigned  int) (dataset_size / buffer_size);
-        unsigned int last_chunk_size = dataset_size % buffer_size;
-        unsigned int chunk_size = buffer_size;
+        // the next chunk is read while the current one is inserted
+        dataset::ChunkReader reader(dataset, dataset_size, ts_length, buffer_size,
+                                    dataset_mmap ? dataset::ChunkReader::MMAP : dataset::ChunkReader::READ);
 
         double kPi = 3.14159265358979323846264;
         if(rng == 2) {
@@ -252,23 +293,19 @@ int main (int argc, char **argv) {
             cout << " cos "<<prune << endl;
         }
 
-    for (i = 0; i < chunk_count; ++i) {
-        printf("Loading %ld vectors of chunk %ld\n", chunk_size, i + 1);
-        read_data(dataset, &data, ts_length, chunk_size, i * chunk_size);
+    size_t first, chunk_size;
+    while (const ts_type *chunk = reader.next(first, chunk_size)) {
+        printf("Loading %ld vectors of chunk %ld\n", chunk_size, first / buffer_size + 1);
+        ts_type *data = (ts_type *) chunk;
         if(ep==0)
-        add_data(appr_alg, data, ts_length, chunk_size, i * chunk_size, rng, prune,connectivity);
+        add_data(appr_alg, data, ts_length, chunk_size, first, rng, prune,connectivity);
         if(ep==3)
-        add_data_ksrep(appr_alg, data, ts_length, chunk_size, i * chunk_size, rng, prune);
-    }
-    if (last_chunk_size != 0) {
-        printf("Loading %ld vectors of the last chunk %ld\n", last_chunk_size, i + 1);
-        read_data(dataset, &data, ts_length, last_chunk_size, i * chunk_size);
-        if(ep==0)add_data(appr_alg, data, ts_length, last_chunk_size, i * chunk_size, rng, prune,connectivity);
-        if(ep==3)add_data_ksrep(appr_alg, data, ts_length, last_chunk_size, i * chunk_size, rng, prune);
+        add_data_ksrep(appr_alg, data, ts_length, chunk_size, first, rng, prune);
     }
 
 
         t_build->printElapsedTime(std::string ("Index Building").c_str());
+        cout << reader.describe() << endl;
 
         t_build->restart();
 
@@ -285,11 +322,21 @@ int main (int argc, char **argv) {
         if(chdir(index_path) != 0)
             throw std::runtime_error("The index folder doesn't exist, Please make sure to give an existing index path!");
 
+        workload_output output;
+        output.results_file = results_file;
+        output.summary_file = summary_file;
+        if (groundtruth_file != nullptr)
+            output.evaluator = new evaluation::Evaluator(groundtruth_file, queries_size, k);
+
         // HIERARCHY
         if(ep ==0) {
             HierarchicalNSW<ts_type> appr_alg(&l2space, index_full_filename, false);
             auto s_build = new PTK::Timer();
             vector<std::priority_queue<std::pair<ts_type, labeltype >>> answers;
+            if(nthreads > 0)
+                query_workload_batch((size_t) queries_size, appr_alg, (size_t) ts_length, (size_t) k,
+                                     queries, (size_t) efs, ep, nullptr, nthreads, output);
+            else
             query_workload(
                     (size_t) dataset_size,
                     (size_t) queries_size,
@@ -298,7 +345,7 @@ int main (int argc, char **argv) {
                     answers,
                     (size_t) k,
                     queries,
-                    (size_t) efs, 0, 0);
+                    (size_t) efs, 0, 0, output);
 
             s_build->printElapsedTime(std::string("TOTAL TIME").c_str());
         }
@@ -370,6 +417,10 @@ int main (int argc, char **argv) {
 ;
             auto s_build = new PTK::Timer();
             vector<std::priority_queue<std::pair<ts_type, labeltype >>> answers;
+            if(nthreads > 0)
+                query_workload_batch((size_t) queries_size, appr_alg, (size_t) ts_length, (size_t) k,
+                                     queries, (size_t) efs, ep, nullptr, nthreads, output);
+            else
             query_workload(
                     (size_t) dataset_size,
                     (size_t) queries_size,
@@ -378,7 +429,7 @@ int main (int argc, char **argv) {
                     answers,
                     (size_t) k,
                     queries,
-                    (size_t) efs, 1, 0);
+                    (size_t) efs, 1, 0, output);
 
             s_build->printElapsedTime(std::string("TOTAL TIME").c_str());
 
@@ -388,6 +439,10 @@ int main (int argc, char **argv) {
             HierarchicalNSW<ts_type> appr_alg(&l2space, index_full_filename, false);
             auto s_build = new PTK::Timer();
             vector<std::priority_queue<std::pair<ts_type, labeltype >>> answers;
+            if(nthreads > 0)
+                query_workload_batch((size_t) queries_size, appr_alg, (size_t) ts_length, (size_t) k,
+                                     queries, (size_t) efs, ep, nullptr, nthreads, output);
+            else
             query_workload(
                     (size_t) dataset_size,
                     (size_t) queries_size,
@@ -396,7 +451,7 @@ int main (int argc, char **argv) {
                     answers,
                     (size_t) k,
                     queries,
-                    (size_t) efs, 1, 0);
+                    (size_t) efs, 1, 0, output);
 
             s_build->printElapsedTime(std::string("TOTAL TIME").c_str());
         }
@@ -405,6 +460,10 @@ int main (int argc, char **argv) {
             HierarchicalNSW<ts_type> appr_alg(&l2space, index_full_filename, false);
             auto s_build = new PTK::Timer();
             vector<std::priority_queue<std::pair<ts_type, labeltype >>> answers;
+            if(nthreads > 0)
+                query_workload_batch((size_t) queries_size, appr_alg, (size_t) ts_length, (size_t) k,
+                                     queries, (size_t) efs, ep, nullptr, nthreads, output);
+            else
             query_workloadrdseed(
                     (size_t) dataset_size,
                     (size_t) queries_size,
@@ -413,7 +472,7 @@ int main (int argc, char **argv) {
                     answers,
                     (size_t) k,
                     queries,
-                    (size_t) efs);
+                    (size_t) efs, output);
 
             s_build->printElapsedTime(std::string("TOTAL TIME").c_str());
         }
@@ -432,6 +491,10 @@ int main (int argc, char **argv) {
             fclose(file);
             auto s_build = new PTK::Timer();
             vector<std::priority_queue<std::pair<ts_type, labeltype >>> answers;
+            if(nthreads > 0)
+                query_workload_batch((size_t) queries_size, appr_alg, (size_t) ts_length, (size_t) k,
+                                     queries, (size_t) efs, ep, kdeps, nthreads, output);
+            else
             query_workload_kdt(
                     (size_t) dataset_size,
                     (size_t) queries_size,
@@ -440,7 +503,7 @@ int main (int argc, char **argv) {
                     answers,
                     (size_t) k,
                     queries,
-                    (size_t) efs, kdeps);
+                    (size_t) efs, kdeps, output);
 
             s_build->printElapsedTime(std::string("TOTAL TIME").c_str());
         }
@@ -490,7 +553,7 @@ void query_workload_kdt(size_t vecsize,
                            vector<std::priority_queue<std::pair<ts_type, labeltype >>> &answers,
                            size_t k,
                            char * queries,
-                           size_t efs, uint **kdeps) {
+                           size_t efs, uint **kdeps, workload_output &output) {
     size_t correct = 0;
     size_t total = 0;
 
@@ -504,18 +567,28 @@ void query_workload_kdt(size_t vecsize,
 
     //#pragma omp parallel for
     querying_stats s;
-    float* result;
+    labeltype * ids = new labeltype[qsize * k];
+    float * dists = new float[qsize * k];
+    PTK::Timer t_search;
 
     for (int i = 0; i < qsize; i++) {
         fread(query, sizeof(ts_type), vecdim, dfp);
         appr_alg.setEf(efs);
-            result = appr_alg.searchGraphBsltreeps(query, k, kdeps[i],s);
-        printKNN(result, k, s);
+            appr_alg.searchGraphBsltreeps(query, k, kdeps[i], ids + i * k, dists + i * k, s);
+        if (output.evaluator != nullptr)
+            output.evaluator->record(i, ids + i * k, dists + i * k, s.time_leaves_search);
+        else
+        printKNN(ids + i * k, dists + i * k, k, s);
         s.time_cnmd=0;s.time_update_knn=0;s.time_leaves_search=0;s.time_routing=0;s.time_layer0=0;s.time_pq=0;
         s.num_hops_bsl=0;s.distance_computations_hrl=0;s.num_hops_hrl=0;s.distance_computations_bsl=0;
         s.saxdist_computations_bsl=0;s.saxdist_computations_hsl=0;
     }
 
+    finish_workload(output, ids, dists, qsize, k, t_search.getElapsedTime());
+    delete[] ids;
+    delete[] dists;
+    free(query);
+    fclose(dfp);
 }
 
 
@@ -547,19 +620,6 @@ void add_data_ksrep(HierarchicalNSW<ts_type> &appr_alg, ts_type *data, unsigned
         appr_alg.addPoint_ksrep((void *) (data + ts_length * i), (size_t) i+label_offset, rng, prune);
     }
 }
-void read_data(char * dataset,
-               ts_type ** pdata,
-               unsigned int ts_length,
-               unsigned int data_size,
-               unsigned int offset)
-{
-
-    FILE *dfp = fopen(dataset, "rb");
-    fseek(dfp, 0, SEEK_SET);
-    fseek(dfp, (unsigned long) offset * ts_length * sizeof(ts_type), SEEK_SET);
-    fread(*pdata, sizeof(ts_type), data_size * ts_length, dfp);
-    fclose(dfp);
-}
 
 
 void
@@ -572,7 +632,7 @@ query_workload(//ts_type *massQ,
         size_t k,
         char * queries,
         size_t efs,
-        bool flatt,int sims)
+        bool flatt,int sims, workload_output &output)
 {
     size_t correct = 0;
     size_t total = 0;
@@ -587,7 +647,9 @@ query_workload(//ts_type *massQ,
 
     //#pragma omp parallel for
     querying_stats s;
-    float* result;
+    labeltype * ids = new labeltype[qsize * k];
+    float * dists = new float[qsize * k];
+    PTK::Timer t_search;
 
     for (int i = 0; i < qsize; i++) {
 
@@ -599,21 +661,29 @@ query_workload(//ts_type *massQ,
 
         if(flatt) {
 
-            result = appr_alg.searchGraphBsl(query, k, s);
+            appr_alg.searchGraphBsl(query, k, ids + i * k, dists + i * k, s);
         }
         else {
 
-            result = appr_alg.searchGraph(query, k, s);
+            appr_alg.searchGraph(query, k, ids + i * k, dists + i * k, s);
         }
 
 
-        printKNN(result, k, s);
+        if (output.evaluator != nullptr)
+            output.evaluator->record(i, ids + i * k, dists + i * k, s.time_leaves_search);
+        else
+        printKNN(ids + i * k, dists + i * k, k, s);
 
         s.time_cnmd=0;s.time_update_knn=0;s.time_leaves_search=0;s.time_routing=0;s.time_layer0=0;s.time_pq=0;
         s.num_hops_bsl=0;s.distance_computations_hrl=0;s.num_hops_hrl=0;s.distance_computations_bsl=0;
         s.saxdist_computations_bsl=0;s.saxdist_computations_hsl=0;
     }
 
+    finish_workload(output, ids, dists, qsize, k, t_search.getElapsedTime());
+    delete[] ids;
+    delete[] dists;
+    free(query);
+    fclose(dfp);
 }
 
 
@@ -626,7 +696,7 @@ query_workloadrdseed(
         vector<std::priority_queue<std::pair<ts_type, labeltype >>> &answers,
         size_t k,
         char * queries,
-        size_t efs)
+        size_t efs, workload_output &output)
 {
     size_t correct = 0;
     size_t total = 0;
@@ -640,7 +710,9 @@ query_workloadrdseed(
     }
 
     querying_stats s;
-    float* result;
+    labeltype * ids = new labeltype[qsize * k];
+    float * dists = new float[qsize * k];
+    PTK::Timer t_search;
     appr_alg.setEf(efs);
     for (int i = 0; i < qsize; i++) {
 
@@ -650,27 +722,151 @@ query_workloadrdseed(
 
 
 
-            result = appr_alg.searchGraphBslrdseed(query, k, s);
+            appr_alg.searchGraphBslrdseed(query, k, ids + i * k, dists + i * k, s);
 
 
-        printKNN(result, k, s);
+        if (output.evaluator != nullptr)
+            output.evaluator->record(i, ids + i * k, dists + i * k, s.time_leaves_search);
+        else
+        printKNN(ids + i * k, dists + i * k, k, s);
 
         s.time_cnmd=0;s.time_update_knn=0;s.time_leaves_search=0;s.time_routing=0;s.time_layer0=0;s.time_pq=0;
         s.num_hops_bsl=0;s.distance_computations_hrl=0;s.num_hops_hrl=0;s.distance_computations_bsl=0;
         s.saxdist_computations_bsl=0;s.saxdist_computations_hsl=0;
     }
 
+    finish_workload(output, ids, dists, qsize, k, t_search.getElapsedTime());
+    delete[] ids;
+    delete[] dists;
+    free(query);
+    fclose(dfp);
 }
 
 
 
-void printKNN(float * results, int k, querying_stats stats){
+/**
+ * Batch search: the whole query file is loaded once and the queries are fanned out over
+ * nthreads OpenMP threads, each one with its own querying_stats. Per-query lines are printed
+ * in query order once the batch is done, followed by the aggregate QPS and latency percentiles.
+ * ep selects the search routine exactly like the serial workloads (0: hierarchy, 1/2: flat,
+ * 3: k random seeds, 4: KD-trees seeds given in kdeps).
+ */
+void query_workload_batch(size_t qsize,
+                          HierarchicalNSW<ts_type> &appr_alg,
+                          size_t vecdim,
+                          size_t k,
+                          char * queries,
+                          size_t efs, int ep, uint **kdeps, int nthreads, workload_output &output)
+{
+    ts_type * query_set = (ts_type *) malloc(qsize * vecdim * sizeof(ts_type));
+
+    FILE *dfp = fopen(queries, "rb");
+    if (dfp  == NULL) {
+        fprintf(stderr, "Queries file %s not found!\n",queries);
+        exit(-1);
+    }
+    if (fread(query_set, sizeof(ts_type), qsize * vecdim, dfp) != qsize * vecdim) {
+        fprintf(stderr, "Queries file %s holds less than %lu queries!\n", queries, qsize);
+        exit(-1);
+    }
+    fclose(dfp);
+
+    labeltype * ids = new labeltype[qsize * k];
+    float * dists = new float[qsize * k];
+    std::vector<querying_stats> qstats(qsize);
+    std::vector<double> latencies(qsize, 0);
+
+    appr_alg.setEf(efs);
+    auto t_batch = PTK::Timer();
+
+#pragma omp parallel num_threads(nthreads)
+    {
+        querying_stats s;
+#pragma omp for schedule(dynamic, 1)
+        for (long i = 0; i < (long) qsize; i++) {
+            s = querying_stats();
+            const ts_type * query = query_set + i * vecdim;
+            auto t_query = PTK::Timer();
+            if (ep == 0)
+                appr_alg.searchGraph(query, k, ids + i * k, dists + i * k, s);
+            else if (ep == 3)
+                appr_alg.searchGraphBslrdseed(query, k, ids + i * k, dists + i * k, s);
+            else if (ep == 4)
+                appr_alg.searchGraphBsltreeps(query, k, kdeps[i], ids + i * k, dists + i * k, s);
+            else
+                appr_alg.searchGraphBsl(query, k, ids + i * k, dists + i * k, s);
+            latencies[i] = t_query.getElapsedTime();
+            qstats[i] = s;
+        }
+    }
+
+    double total_time = t_batch.getElapsedTime();
+
+    for (size_t i = 0; i < qsize; i++) {
+        if (output.evaluator != nullptr)
+            output.evaluator->record(i, ids + i * k, dists + i * k, latencies[i]);
+        else
+            printKNN(ids + i * k, dists + i * k, k, qstats[i]);
+    }
+
+    std::vector<double> sorted_latencies(latencies);
+    std::sort(sorted_latencies.begin(), sorted_latencies.end());
+    auto percentile = [&sorted_latencies](double p) {
+        size_t rank = (size_t) std::ceil(p * sorted_latencies.size());
+        return sorted_latencies[rank == 0 ? 0 : rank - 1];
+    };
+    double mean_latency = 0;
+    for (auto l : sorted_latencies) mean_latency += l;
+    mean_latency /= qsize;
+
+    printf("----------BATCH SEARCH----------- | Queries : %lu | Threads : %i | Time  : %f | QPS : %f | "
+           "Mean latency : %f | P50 : %f | P95 : %f | P99 : %f | \n",
+           qsize, nthreads, total_time, qsize / total_time,
+           mean_latency, percentile(0.50), percentile(0.95), percentile(0.99));
+
+    finish_workload(output, ids, dists, qsize, k, total_time);
+    delete[] ids;
+    delete[] dists;
+    free(query_set);
+}
+
+
+/**
+ * Writes the k-NN of every query in the bin truthset layout used by the ground-truth tools:
+ * int32 #queries, int32 k, #queries*k uint32 ids, then #queries*k float (squared) distances.
+ */
+void write_results(char * results_file, labeltype * ids, float * dists, size_t qsize, size_t k)
+{
+    FILE *rfp = fopen(results_file, "wb");
+    if (rfp == NULL) {
+        fprintf(stderr, "Results file %s cannot be created!\n", results_file);
+        exit(-1);
+    }
+    int npts = (int) qsize, ndims = (int) k;
+    fwrite(&npts, sizeof(int), 1, rfp);
+    fwrite(&ndims, sizeof(int), 1, rfp);
+    std::vector<unsigned int> ids32(ids, ids + qsize * k);
+    fwrite(ids32.data(), sizeof(unsigned int), qsize * k, rfp);
+    fwrite(dists, sizeof(float), qsize * k, rfp);
+    fclose(rfp);
+}
+
+void finish_workload(workload_output &output, labeltype * ids, float * dists, size_t qsize, size_t k,
+                     double search_time)
+{
+    if (output.results_file != nullptr)
+        write_results(output.results_file, ids, dists, qsize, k);
+    if (output.evaluator != nullptr)
+        output.evaluator->report("WTSS", search_time, output.summary_file ? output.summary_file : "");
+}
+
+void printKNN(labeltype * ids, float * results, int k, querying_stats stats){
     cout << "----------"<<k<<"-NN RESULTS----------- | visited nodes : \n";
     for(int i = 0 ; i < k ; i++){
         printf( " K N°%i  => Distance : %f | Node ID : %lu | Time  : %f |  "
                 "Total DC : %lu | HDC : %lu | BDC : %lu | "
                 "Total LBDC : %lu | HLBDC : %lu | BLBDC : %lu | \n",i+1,sqrt(results[i]),
-                0,stats.time_leaves_search,stats.distance_computations_bsl+stats.distance_computations_hrl
+                ids[i],stats.time_leaves_search,stats.distance_computations_bsl+stats.distance_computations_hrl
                 ,stats.distance_computations_hrl,stats.distance_computations_bsl,
                 stats.saxdist_computations_hsl+stats.saxdist_computations_bsl,stats.saxdist_computations_hsl,stats.saxdist_computations_bsl);
 
@@ -11,19 +11,22 @@
 #include <dirent.h>
 #include "sys/stat.h"
 #include "string.h"
+#include <vector>
 #include "Setting.h"
 #include "hnswlib/hnswlib.h"
 #include "BufferManager.h"
 #include "Node.h"
+#include "LeafGraphCache.h"
 using namespace std;
 class Node;
 class BufferManager;
+class LeafGraphCache;
 class Setting;
 typedef struct timelapse timelapse;
 class Index {
 public:
 
-    Index(char *root_directory, unsigned int mode);
+    Index(char *root_directory, unsigned int mode, double cache_size = 0);
     ~Index();
     Setting *index_setting;
     Node * first_node;
@@ -39,10 +42,11 @@ public:
 
     void write();
 
-    static Index *Read(char *path, unsigned int mode);
+    static Index *Read(char *path, unsigned int mode, double cache_size = 0);
     unsigned int in_memory;
     int ef;
     hnswlib::L2Space *l2space;
+    LeafGraphCache *leaf_cache = nullptr;//leaf graphs of a read index, loaded on demand
 
     Node ** getLeaves();
 
@@ -53,6 +57,12 @@ protected :
 
     bool insertTS(ts_type *pDouble);
 
+    bool chooseSplitPolicy(Node *node, short *&child_node_points, int &num_child_node_points);
+
+    void bulkLoad(FILE *ifile, file_position_type num_series, ts_type *batch, file_position_type batch_size);
+
+    void splitAndGraph(Node *node, std::vector<ts_type *> &series);
+
     char *getIndexFilename() const;
 };
 struct timelapse {
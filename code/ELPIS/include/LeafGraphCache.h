@@ -0,0 +1,81 @@
+//
+// Leaf graphs loaded on demand within a memory budget.
+//
+
+#ifndef herculesHNSW_LEAFGRAPHCACHE_H
+#define herculesHNSW_LEAFGRAPHCACHE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "globals.h"
+#include "hnswlib/hnswlib.h"
+
+class Index;
+class Node;
+
+/**
+ * Owner of the leaf graphs while querying: a leaf graph is read from its file on the first probe of the leaf, and
+ * the graphs not used recently are evicted (CLOCK) once their size exceeds the budget. The size of a graph is
+ * accounted as the size of its file.
+ * A background thread loads the leaves given to prefetch(), so that the next candidates of a query are read while
+ * the current ones are searched.
+ */
+class LeafGraphCache {
+public:
+    /** budget_bytes = 0 keeps every graph once loaded. */
+    LeafGraphCache(Index *index, unsigned long budget_bytes);
+    ~LeafGraphCache();
+
+    /** Returns the graph of leaf, loading it if needed. The graph is not evicted until release(leaf). */
+    hnswlib::HierarchicalNSW<ts_type> *acquire(Node *leaf);
+
+    void release(Node *leaf);
+
+    /** Queues the loading of leaf for the background thread, if it is not in memory. */
+    void prefetch(Node *leaf);
+
+    void toString();
+
+    unsigned long budget_bytes;
+    unsigned long used_bytes;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long prefetched;
+    unsigned long evictions;
+
+private:
+    enum entry_state { ABSENT, LOADING, READY };
+
+    struct entry {
+        entry_state state = ABSENT;
+        unsigned int pins = 0;
+        bool referenced = false;
+        bool queued = false;
+        unsigned long bytes = 0;
+    };
+
+    void load(Node *leaf, entry &e, std::unique_lock<std::mutex> &lock, bool pin);
+
+    void evict();
+
+    void loaderLoop();
+
+    Index *index;
+    std::mutex mutex;
+    std::condition_variable loaded;
+    std::unordered_map<Node *, entry> entries;//references stay valid when the map grows
+    std::vector<Node *> resident;
+    size_t clock_hand;
+
+    std::deque<Node *> prefetch_queue;
+    std::condition_variable prefetch_ready;
+    bool stop;
+    std::thread loader;
+};
+
+
+#endif //herculesHNSW_LEAFGRAPHCACHE_H
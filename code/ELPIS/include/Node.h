@@ -151,6 +151,8 @@ public:
 
     void leafToGraph(Index *pIndex);
 
+    void buildGraph(Index *pIndex, ts_type **series);
+
 protected :
     Node();
     Node(Index *index, FILE *file);
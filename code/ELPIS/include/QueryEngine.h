@@ -9,6 +9,8 @@
 #include "globals.h"
 #include "hnswlib/hnswlib.h"
 #include "pqueue.h"
+#include "Evaluation.h"
+#include <atomic>
 #include <queue>
 #include "future"
 
@@ -20,6 +22,17 @@ typedef struct q_index q_index;
 
 typedef struct query_worker_data  worker_backpack__;
 
+typedef struct knn_answer knn_answer;
+
+typedef struct query_thread_data query_thread_data;
+
+//how --parallel 1 spreads the threads: over the leaves of each query, over the queries, or chosen from the workload
+#define SCHEDULE_INTRA_QUERY 0
+#define SCHEDULE_INTER_QUERY 1
+#define SCHEDULE_AUTO 2
+//the auto schedule keeps intra-query parallelism only if every worker gets at least that many leaves of a query
+#define INTRA_QUERY_MIN_LEAVES_PER_WORKER 4
+
 struct CompareByFirst{
     constexpr bool operator()(std::pair<float, unsigned int> const &a,std::pair<float, unsigned int> const &b) const noexcept {
         return a.first < b.first;
@@ -39,11 +52,16 @@ public :
     queue<unsigned int> visited;
     bool parallel;
     unsigned int nworker;
+    int schedule = SCHEDULE_AUTO;
+    unsigned int query_threads;//threads running whole queries in the inter-query schedule
     std::priority_queue<std::pair<float,unsigned int>, std::vector<std::pair<float,unsigned int>>> top_candidates;
     FILE *query_file;
 
     querying_stats stats;
     float *results;
+    knn_answer *answers;//the results with their leaf and label
+    evaluation::Evaluator *evaluator = nullptr;//when set, answers are recorded instead of printed
+    unsigned int query_id;
     worker_backpack__ *qwdata;
     pqueue_t *pq;
     pqueue_t *candidate_leaves;
@@ -55,13 +73,23 @@ public :
 
     void queryBinaryFile(int q_num, unsigned int k, int i);
 
-    void printKNN(float *results, int k, double time, queue<unsigned int> &visited, bool para=0);
+    void printKNN(float *results, knn_answer *answers, unsigned int answers_size, int k, double time, querying_stats &stats,
+                  queue<unsigned int> &visited, unsigned int query_id, bool para=0);
 
     void searchNpLeafParallel(ts_type *query_ts, unsigned int k, unsigned int nprobes);
 
-    void setEF(Node *node, int ef);
+    int chooseSchedule(unsigned int q_num);
+
+    void queryInterParallel(ts_type *queries, unsigned int q_num, unsigned int k);
+
+    void searchQuery(ts_type *query_ts, unsigned int k, unsigned int nprobes, query_thread_data *thread);
 
-    inline void copypq(query_worker_data *pData, priority_queue<pair<float, unsigned int>> queue);
+    Node *routeToLeaf(ts_type *query_ts);
+
+    unsigned int collectCandidates(ts_type *query_ts, Node *App_node, ts_type kth_bsf, pqueue_t *pq,
+                                   query_result *candidates, querying_stats &stats);
+
+    void setEF(Node *node, int ef);
 
 
     ~QueryEngine();
@@ -86,6 +114,17 @@ struct query_result {
     ts_type max_distance;
     size_t pqueue_position;
 };
+/**
+ An answer of a query: the series labelled label in the graph of leaf leaf_id.
+  @param ts_type distance;
+  @param unsigned long leaf_id;
+  @param unsigned int label;
+ */
+struct knn_answer {
+    ts_type distance;
+    unsigned long leaf_id;
+    unsigned int label;
+};
 /**
   @param ts_type distance;
   @param double time;
@@ -171,10 +210,11 @@ set_pos2(void *a, size_t pos) {
 typedef struct query_worker_data
 {
     std::priority_queue<std::pair<float,unsigned int>, std::vector<std::pair<float,unsigned int>>> * top_candidates;
-    ts_type * kth_bsf;
+    std::atomic<ts_type> * kth_bsf;//shared by the workers of a query
     int id;
     querying_stats * stats;
-    float * localknn;
+    knn_answer * knn;//the k best answers of the worker, sorted
+    unsigned int knn_size;
     float bsf;
     unsigned short local_nprobes;
     bool end;
@@ -183,6 +223,22 @@ typedef struct query_worker_data
 
 } worker_backpack__;
 
+/**
+ * Everything a thread of the inter-query schedule needs to run whole queries on its own: the visited flags of the
+ * leaf searches, the priority queue of the tree traversal and the answers of its current query.
+ */
+struct query_thread_data {
+    std::priority_queue<std::pair<float,unsigned int>, std::vector<std::pair<float,unsigned int>>> top_candidates;
+    querying_stats stats;
+    unsigned short *flags;
+    unsigned short curr_flag;
+    pqueue_t *pq;
+    query_result *candidates;
+    knn_answer *answers;
+    unsigned int answers_size;
+    float *results;
+};
+
 
 
 
@@ -11,12 +11,15 @@ int main(int argc, char **argv) {
     static char *dataset = "nodataset";
     static char *queries = "noquery";
     static char * index_path = "index/";
+    static char * groundtruth_file = nullptr;
+    static char * summary_file = nullptr;
     static unsigned int dataset_size = 1000;
     static unsigned int queries_size = 5;
     static unsigned int time_series_size = 256;
     static unsigned int init_segments = 1;
     static unsigned int leaf_size = 100;
     static double buffered_memory_size = 64.2;
+    static double cache_size = 0;
     static int use_ascii_input = 0;
     int ef = 10;
     static int mode = 0;
@@ -25,6 +28,7 @@ int main(int argc, char **argv) {
     static unsigned int nprobes = 0;
     bool parallel = 0;
     static unsigned int nworker = 0;
+    static int schedule = SCHEDULE_AUTO;
     ///HNSW args
     static int efConstruction = 500;
     static int M = 4 ;
@@ -35,6 +39,7 @@ int main(int argc, char **argv) {
         static struct option long_options[] = {
                 {"ascii-input",      required_argument, 0, 'a'},
                 {"buffer-size",      required_argument, 0, 'b'},
+                {"cache-size",       required_argument, 0, 'cs'},
                 {"epsilon",          required_argument, 0, 'c'},
                 {"kb",          required_argument, 0, 'mh'},
                 {"flatt",          required_argument, 0, 'ft'},
@@ -60,10 +65,13 @@ int main(int argc, char **argv) {
                 {"nprobes",          required_argument, 0, 'o'},
                 {"parallel",          required_argument, 0, 'pr'},
                 {"nworker",          required_argument, 0, 'nw'},
+                {"schedule",          required_argument, 0, 'sc'},
 
                 {"incremental",      no_argument,       0, 'h'},
                 {"index-path-hercules",       required_argument, 0, 'pd'},
                 {"index-path-hnsw",       required_argument, 0, 'ph'},
+                {"groundtruth",      required_argument, 0, 'gt'},
+                {"summary",          required_argument, 0, 'sm'},
                 {"help",             no_argument,       0, '?'}
         };
 
@@ -82,6 +90,13 @@ int main(int argc, char **argv) {
             case 'nw':
                 nworker = atoi(optarg);
                 break;
+            case 'sc':
+                schedule = atoi(optarg);
+                if (schedule < SCHEDULE_INTRA_QUERY || schedule > SCHEDULE_AUTO) {
+                    fprintf(stderr, "Please give a schedule of 0, 1 or 2.\n");
+                    exit(-1);
+                }
+                break;
             case 'efc':
                 efConstruction = atoi(optarg);
                 if(efConstruction<1){
@@ -112,6 +127,9 @@ int main(int argc, char **argv) {
             case 'b':
                 buffered_memory_size = atof(optarg);
                 break;
+            case 'cs':
+                cache_size = atof(optarg);
+                break;
 
             case 'f':
                 queries_size = atoi(optarg);
@@ -176,6 +194,7 @@ int main(int argc, char **argv) {
                        \t--mode: 0=index, 1=query, 2=index & query  3=calc_tlb\t\t\n\
                        \t--index-path XX \t\tThe path of the output folder\n\
                        \t--buffer-size XX \t\tThe size of the buffer memory in MB\n\
+                       \t--cache-size XX \t\tThe memory budget of the leaf graphs while querying in MB (0 = no limit)\n\
                        \t--timeseries-size XX\t\tThe size of each time series\n\
                        \t--ascii-input X \t\t\0 for ascii files and 1 for binary files\n\
                        \t--leaf-size XX\t\t\tThe maximum size of each leaf\n\
@@ -183,6 +202,9 @@ int main(int argc, char **argv) {
                        \t--efconstruction XX\t\t\tparameter that controls speed/accuracy trade-off during the leaf index construction.\n\
                         \t--parallel XX\t\t\tset to 1 for querying in parallel.\n\
                         \t--nworker XX\t\t\tNumber of workers for parallel querying, if not, set to number of cores-1.\n\
+                        \t--schedule XX\t\t\tWith --parallel 1: 0=leaves of a query in parallel, 1=queries in parallel, 2=chosen from nprobes and queries-size (default).\n\
+                        \t--groundtruth XX\t\tGround truth file (ivecs or bin) to compute recall, QPS and latency percentiles in-process.\n\
+                        \t--summary XX\t\t\tFile the evaluation summary is appended to (CSV for .csv, JSON otherwise).\n\
                        \t--help\n\n\
                        \t--**********************EXAMPLES**********************\n\n\
                        \t--*********************INDEX MODE*********************\n\n\
@@ -202,6 +224,12 @@ int main(int argc, char **argv) {
             case 'a':
                 use_ascii_input = atoi(optarg);
                 break;
+            case 'gt':
+                groundtruth_file = optarg;
+                break;
+            case 'sm':
+                summary_file = optarg;
+                break;
 
             default:
                 exit(-1);
@@ -223,12 +251,21 @@ int main(int argc, char **argv) {
     }
     else if(mode==1){
 
-        Index * index = Index::Read(index_path,mode);
+        Index * index = Index::Read(index_path,mode,cache_size);
 
         QueryEngine * queryengine = new QueryEngine(queries, index, ef, nprobes,
                                      parallel, nworker, flatt,k);//k
+        queryengine->schedule = schedule;
+        if(groundtruth_file != nullptr)
+            queryengine->evaluator = new evaluation::Evaluator(groundtruth_file, queries_size, k);
         queryengine->queryBinaryFile(queries_size, k, mode);
         cout << "[Querying Time] "<< index->time_stats->querying_time <<"(sec)"<<endl;
+        index->leaf_cache->toString();
+        if(queryengine->evaluator != nullptr){
+            queryengine->evaluator->report("ELPIS", index->time_stats->querying_time,
+                                           summary_file ? summary_file : "");
+            delete queryengine->evaluator;
+        }
 
         delete index;
         delete queryengine;
@@ -3,6 +3,17 @@
 //
 
 #include "Index.h"
+#include <algorithm>
+#include <atomic>
+#include <omp.h>
+#include <string>
+#include <vector>
+
+#define READ_BATCH_BYTES (64 << 20)
+//top tree leaves per thread targeted by the bulk load, a few per thread to balance the partitions
+#define TOP_TREE_LEAVES_PER_THREAD 8
+
+static void readBatch(FILE *ifile, ts_type *batch, file_position_type count, unsigned int ts_length);
 
 /**
  Construct Index object from Index file :<br>
@@ -76,12 +87,7 @@ mkdir(index_path , 07777);
 void Index::buildIndexFromBinaryData(char * dataset, file_position_type dataset_size) {
     // Record start time
     auto start = std::chrono::high_resolution_clock::now();
-
-    auto * ts = static_cast<ts_type *>(malloc(sizeof(ts_type) * this->index_setting->timeseries_size));
-    if(ts == nullptr){
-        cerr << "Could not Allocate ts in index.cpp"<<endl;
-        exit(-1);
-    }
+    unsigned int ts_length = this->index_setting->timeseries_size;
 
     FILE *ifile;
     ifile = fopen(dataset   , "rb");
@@ -92,48 +98,72 @@ void Index::buildIndexFromBinaryData(char * dataset, file_position_type dataset_
 
     fseek(ifile, 0L, SEEK_END);
     auto sz = (file_position_type) ftell(ifile);
-    file_position_type total_records = sz /this->index_setting->timeseries_size * sizeof(ts_type);
+    file_position_type total_records = sz / (ts_length * sizeof(ts_type));
     fseek(ifile, 0L, SEEK_SET);
     if (total_records < dataset_size) {
         fprintf(stderr, "File %s has only %llu records!\n", dataset, total_records);
         exit(-1);
     }
 
-    file_position_type ts_loaded = 0;
+    //the dataset is read by batches of READ_BATCH_BYTES
+    file_position_type batch_size = std::max<file_position_type>(1, READ_BATCH_BYTES / (sizeof(ts_type) * ts_length));
+    auto * batch = static_cast<ts_type *>(malloc(sizeof(ts_type) * ts_length * batch_size));
+    if(batch == nullptr){
+        cerr << "Could not Allocate the read batch in index.cpp"<<endl;
+        exit(-1);
+    }
 
-    while (ts_loaded < dataset_size) {
+    //with several threads, only the first series build the top of the tree by insertion, the others are bulk
+    //loaded in the leaves of this top tree
+    int num_threads = omp_get_max_threads();
+    file_position_type top_tree_size = dataset_size;
+    if (num_threads > 1)
+        top_tree_size = std::min<file_position_type>(dataset_size, (file_position_type) TOP_TREE_LEAVES_PER_THREAD *
+                                                                   num_threads * this->index_setting->max_leaf_size);
 
-        //printf("\r\x1b[32mLoading: \x1b[36m%d\x1b[0m\n",(ts_loaded + 1));
+    file_position_type ts_loaded = 0;
 
-        fread(ts, sizeof(ts_type), this->index_setting->timeseries_size, ifile);
+    while (ts_loaded < top_tree_size) {
+        file_position_type count = std::min(batch_size, top_tree_size - ts_loaded);
+        readBatch(ifile, batch, count, ts_length);
 
-        if (!this->insertTS(ts)) {
-            cerr << "Error in index.c:  Could not add the time series to the index."<<endl;
-            exit(-1);
+        for (file_position_type i = 0; i < count; i++) {
+            if (!this->insertTS(batch + i * ts_length)) {
+                cerr << "Error in index.c:  Could not add the time series to the index."<<endl;
+                exit(-1);
+            }
         }
-        ts_loaded++;
+        ts_loaded += count;
     }
 
-    hercules_file_map *lastP = this->buffer_manager->file_map_tail;
-    Node ** nodes = static_cast<Node **>(malloc_index(Node::num_leaf_node * sizeof(Node *)));
-    int i =0;
-    while(lastP != nullptr){
-            nodes[i++] = lastP->file_buffer->node;
-            lastP = lastP->prev;
-        }
+    if (ts_loaded < dataset_size) {
+        this->bulkLoad(ifile, dataset_size - ts_loaded, batch, batch_size);
+    } else {
+        hercules_file_map *lastP = this->buffer_manager->file_map_tail;
+        Node ** nodes = static_cast<Node **>(malloc_index(Node::num_leaf_node * sizeof(Node *)));
+        int i =0;
+        while(lastP != nullptr){
+                nodes[i++] = lastP->file_buffer->node;
+                lastP = lastP->prev;
+            }
 
+        //largest leaves first, the small ones then fill the gaps at the end of the build
+        std::sort(nodes, nodes + i, [](Node *a, Node *b) { return a->node_size > b->node_size; });
 #pragma omp parallel default(none) shared(i,nodes)
-    {
-#pragma omp for //num_threads(n1)
+#pragma omp single
+        for(int j =0; j<i;j++) {
+            Node *node = nodes[j];
+#pragma omp task firstprivate(node)
+            node->leafToGraph(this);
+        }
+
         for(int j =0; j<i;j++)
-            nodes[j]->leafToGraph(this);
+            nodes[j]->deleteFileBuffer(this);
+        free(nodes);
     }
-
-    for(int j =0; j<i;j++)
-        nodes[j]->deleteFileBuffer(this);
     free(this->buffer_manager->mem_array);
 
-    free(ts);
+    free(batch);
     if (fclose(ifile)) {
         fprintf(stderr, "Error in index.cpp: Could not close the filename %s", dataset);
         exit(-1);
@@ -148,6 +178,331 @@ void Index::buildIndexFromBinaryData(char * dataset, file_position_type dataset_
 
 }
 
+static void readBatch(FILE *ifile, ts_type *batch, file_position_type count, unsigned int ts_length) {
+    if (fread(batch, sizeof(ts_type) * ts_length, count, ifile) != count) {
+        cerr << "Error in Index.cpp: Could not read " << count << " time series from the dataset." << endl;
+        exit(-1);
+    }
+}
+
+/**
+ * Internal node of the top tree in the bulk load: the children are entries of the top tree (>= 0) or
+ * partitions (-1 - partition).
+ */
+struct TopTreeEntry {
+    Node *node;
+    int left;
+    int right;
+};
+
+/**
+ * Leaf of the top tree and the series routed to it: in memory, or appended to a spill file once the
+ * memory budget is used.
+ */
+struct BulkPartition {
+    Node *leaf;
+    std::vector<ts_type> buffered;
+    file_position_type num_spilled;
+    std::string spill_filename;
+};
+
+/**
+ * Sketches of the series a thread routes through an internal node of the top tree: max mean, min mean,
+ * max stdev and min stdev of every vertical, then horizontal, segment, as in updateStatistics.
+ */
+struct TopTreeSketch {
+    std::vector<ts_type> indicators;
+    unsigned int size;
+};
+
+static int flattenTopTree(Node *node, std::vector<TopTreeEntry> &top_tree, std::vector<BulkPartition> &partitions) {
+    if (node->is_leaf) {
+        partitions.push_back(BulkPartition{node, std::vector<ts_type>(), 0, std::string()});
+        return -(int) partitions.size();
+    }
+    int entry = top_tree.size();
+    top_tree.push_back(TopTreeEntry{node, 0, 0});
+    int left = flattenTopTree(node->left_child, top_tree, partitions);
+    int right = flattenTopTree(node->right_child, top_tree, partitions);
+    top_tree[entry].left = left;
+    top_tree[entry].right = right;
+    return entry;
+}
+
+static void sketchSegments(ts_type *indicators, short *points, int num_points, ts_type *ts) {
+    for (int i = 0; i < num_points; ++i, indicators += 4) {
+        ts_type mean, stdev;
+#ifdef __DO_SSE__
+        calc_mean_stdev_SIMD(ts, get_segment_start(points, i), get_segment_end(points, i), &mean, &stdev);
+#else
+        calc_mean_stdev(ts, get_segment_start(points, i), get_segment_end(points, i), &mean, &stdev);
+#endif
+        indicators[0] = fmaxf(indicators[0], mean);
+        indicators[1] = fminf(indicators[1], mean);
+        indicators[2] = fmaxf(indicators[2], stdev);
+        indicators[3] = fminf(indicators[3], stdev);
+    }
+}
+
+static void mergeSketches(segment_sketch *sketches, const ts_type *indicators, int num_points) {
+    for (int i = 0; i < num_points; ++i, indicators += 4) {
+        if (sketches[i].indicators == nullptr) {
+            sketches[i].indicators = static_cast<ts_type *>(malloc(sizeof(ts_type) * 4));
+            sketches[i].indicators[0] = -FLT_MAX;
+            sketches[i].indicators[1] = FLT_MAX;
+            sketches[i].indicators[2] = -FLT_MAX;
+            sketches[i].indicators[3] = FLT_MAX;
+            sketches[i].num_indicators = 4;
+        }
+        sketches[i].indicators[0] = fmaxf(sketches[i].indicators[0], indicators[0]);
+        sketches[i].indicators[1] = fminf(sketches[i].indicators[1], indicators[1]);
+        sketches[i].indicators[2] = fmaxf(sketches[i].indicators[2], indicators[2]);
+        sketches[i].indicators[3] = fminf(sketches[i].indicators[3], indicators[3]);
+    }
+}
+
+static void spillPartition(BulkPartition &partition, unsigned int ts_length) {
+    if (partition.buffered.empty())
+        return;
+    FILE *spill = fopen(partition.spill_filename.c_str(), "ab");
+    if (spill == nullptr || fwrite(partition.buffered.data(), sizeof(ts_type), partition.buffered.size(), spill)
+                            != partition.buffered.size()) {
+        cerr << "Error in Index.cpp: Could not spill the series of leaf " << partition.leaf->filename << " to "
+             << partition.spill_filename << ". Reason = " << strerror(errno) << endl;
+        exit(-1);
+    }
+    fclose(spill);
+    partition.num_spilled += partition.buffered.size() / ts_length;
+    std::vector<ts_type>().swap(partition.buffered);
+}
+
+/**
+ * Bulk loads the next num_series series of ifile in the leaves of the tree built so far (the top tree), in three
+ * steps:
+ * <ol>
+ * <li>the series are read by batches, each batch is routed down the top tree in parallel. The statistics of the
+ * internal nodes are gathered per thread and merged at the end, the series are copied to the append buffer of
+ * their leaf at a slot reserved with an atomic counter, and spilled to disk past the memory budget.</li>
+ * <li>every leaf of the top tree (a partition) is then split recursively with the same QoS split decisions as
+ * insertTS, but over all its series at once. Partitions and subtrees are tasks, the largest partitions first.</li>
+ * <li>each final leaf gets its graph as soon as it is reached, while the other partitions are still split, see
+ * Node::buildGraph.</li>
+ * </ol>
+ */
+void Index::bulkLoad(FILE *ifile, file_position_type num_series, ts_type *batch, file_position_type batch_size) {
+    unsigned int ts_length = this->index_setting->timeseries_size;
+    size_t ts_bytes = sizeof(ts_type) * ts_length;
+    int num_threads = omp_get_max_threads();
+
+    std::vector<TopTreeEntry> top_tree;
+    std::vector<BulkPartition> partitions;
+    int root = flattenTopTree(this->first_node, top_tree, partitions);
+    int num_partitions = partitions.size();
+    for (BulkPartition &partition : partitions) {
+        char *full_filename = partition.leaf->getBufferFullFileName(this);
+        partition.spill_filename = std::string(full_filename) + ".bulk";
+        free(full_filename);
+    }
+    cout << "[Bulk Loading] " << num_series << " time series into the " << num_partitions
+         << " leaves of the top tree, with " << num_threads << " threads" << endl;
+
+    std::vector<std::vector<TopTreeSketch>> thread_sketches(num_threads, std::vector<TopTreeSketch>(top_tree.size()));
+    for (auto &sketches : thread_sketches) {
+        for (size_t e = 0; e < top_tree.size(); e++) {
+            Node *node = top_tree[e].node;
+            sketches[e].size = 0;
+            for (int i = 0; i < node->num_node_points + node->num_hs_node_points; i++)
+                sketches[e].indicators.insert(sketches[e].indicators.end(), {-FLT_MAX, FLT_MAX, -FLT_MAX, FLT_MAX});
+        }
+    }
+
+    std::vector<int> target(batch_size);
+    std::vector<file_position_type> counts(num_partitions);
+    std::vector<std::atomic<file_position_type>> cursors(num_partitions);
+    auto budget = (file_position_type) (this->index_setting->buffered_memory_size * 1024 * 1024);
+    file_position_type buffered_bytes = 0;
+
+    file_position_type ts_loaded = 0;
+    while (ts_loaded < num_series) {
+        auto count = (long long) std::min(batch_size, num_series - ts_loaded);
+        readBatch(ifile, batch, count, ts_length);
+
+#pragma omp parallel for schedule(static)
+        for (long long i = 0; i < count; i++) {
+            ts_type *ts = batch + i * ts_length;
+            std::vector<TopTreeSketch> &sketches = thread_sketches[omp_get_thread_num()];
+            int entry = root;
+            while (entry >= 0) {
+                Node *node = top_tree[entry].node;
+                ts_type *indicators = sketches[entry].indicators.data();
+                sketchSegments(indicators, node->node_points, node->num_node_points, ts);
+                sketchSegments(indicators + 4 * node->num_node_points, node->hs_node_points,
+                               node->num_hs_node_points, ts);
+                sketches[entry].size++;
+                entry = node->node_split_policy_route_to_left(ts) ? top_tree[entry].left : top_tree[entry].right;
+            }
+            target[i] = -1 - entry;
+        }
+
+        std::fill(counts.begin(), counts.end(), 0);
+        for (long long i = 0; i < count; i++)
+            counts[target[i]]++;
+        if (buffered_bytes + count * ts_bytes > budget && buffered_bytes > 0) {
+#pragma omp parallel for schedule(dynamic, 1)
+            for (int p = 0; p < num_partitions; p++)
+                spillPartition(partitions[p], ts_length);
+            buffered_bytes = 0;
+        }
+        for (int p = 0; p < num_partitions; p++) {
+            cursors[p] = partitions[p].buffered.size() / ts_length;
+            partitions[p].buffered.resize(partitions[p].buffered.size() + counts[p] * ts_length);
+        }
+        buffered_bytes += count * ts_bytes;
+
+#pragma omp parallel for schedule(static)
+        for (long long i = 0; i < count; i++) {
+            file_position_type slot = cursors[target[i]].fetch_add(1, std::memory_order_relaxed);
+            memcpy(partitions[target[i]].buffered.data() + slot * ts_length, batch + i * ts_length, ts_bytes);
+        }
+        ts_loaded += count;
+    }
+
+    for (size_t e = 0; e < top_tree.size(); e++) {
+        Node *node = top_tree[e].node;
+        for (auto &sketches : thread_sketches) {
+            mergeSketches(node->node_segment_sketches, sketches[e].indicators.data(), node->num_node_points);
+            mergeSketches(node->hs_node_segment_sketches, sketches[e].indicators.data() + 4 * node->num_node_points,
+                          node->num_hs_node_points);
+            node->node_size += sketches[e].size;
+        }
+    }
+
+    //the largest partitions are started first, the small ones then fill the gaps at the end of the build
+    std::vector<int> order(num_partitions);
+    std::vector<file_position_type> partition_sizes(num_partitions);
+    for (int p = 0; p < num_partitions; p++) {
+        order[p] = p;
+        partition_sizes[p] = partitions[p].leaf->node_size + partitions[p].num_spilled +
+                             partitions[p].buffered.size() / ts_length;
+    }
+    std::sort(order.begin(), order.end(), [&partition_sizes](int a, int b) {
+        return partition_sizes[a] > partition_sizes[b];
+    });
+
+#pragma omp parallel
+#pragma omp single
+    for (int p : order) {
+#pragma omp task firstprivate(p)
+        {
+            BulkPartition &partition = partitions[p];
+            Node *leaf = partition.leaf;
+
+            //the series inserted in the top tree are copied out of the shared buffers, which are then released
+            file_position_type num_inserted = 0;
+            ts_type **inserted = nullptr;
+            if (leaf->file_buffer != nullptr) {
+                num_inserted = leaf->node_size;
+                inserted = leaf->getTS(this);
+                if (inserted == nullptr) {
+                    cerr << "Error in Index.cpp: could not get the time series of node " << leaf->filename << endl;
+                    exit(-1);
+                }
+#pragma omp critical(buffer_manager)
+                {
+                    if (!leaf->deleteFileBuffer(this)) {
+                        cerr << "Error in Index.cpp: could not delete file buffer for node " << leaf->filename << endl;
+                        exit(-1);
+                    }
+                }
+            }
+
+            std::vector<ts_type> spilled(partition.num_spilled * ts_length);
+            if (partition.num_spilled > 0) {
+                FILE *spill = fopen(partition.spill_filename.c_str(), "rb");
+                if (spill == nullptr || fread(spilled.data(), ts_bytes, partition.num_spilled, spill) !=
+                                        partition.num_spilled) {
+                    cerr << "Error in Index.cpp: Could not read back " << partition.spill_filename << endl;
+                    exit(-1);
+                }
+                fclose(spill);
+                remove(partition.spill_filename.c_str());
+            }
+
+            std::vector<ts_type *> series(inserted, inserted + num_inserted);
+            for (file_position_type i = 0; i < partition.num_spilled; i++) {
+                series.push_back(spilled.data() + i * ts_length);
+                leaf->updateStatistics(series.back());
+            }
+            for (size_t i = 0; i < partition.buffered.size(); i += ts_length) {
+                series.push_back(partition.buffered.data() + i);
+                leaf->updateStatistics(series.back());
+            }
+
+            //the subtrees of the partition are split and graphed by tasks reading these series
+#pragma omp taskgroup
+            this->splitAndGraph(leaf, series);
+
+            for (file_position_type i = 0; i < num_inserted; i++)
+                free(inserted[i]);
+            free(inserted);
+            std::vector<ts_type>().swap(partition.buffered);
+        }
+    }
+}
+
+/**
+ * Splits node, whose statistics already cover series, until every leaf holds less than max_leaf_size series, and
+ * builds the graph of every leaf it reaches.
+ */
+void Index::splitAndGraph(Node *node, std::vector<ts_type *> &series) {
+    if (series.size() < this->index_setting->max_leaf_size) {
+        if (!series.empty())
+            node->buildGraph(this, series.data());
+        return;
+    }
+
+    short *child_node_points;
+    int num_child_node_points;
+    if (!this->chooseSplitPolicy(node, child_node_points, num_child_node_points)) {
+        cerr << "Error in Index.cpp: could not choose the split of node " << node->filename << endl;
+        exit(-1);
+    }
+    bool split;
+    //split_node numbers the new nodes with the global node counters
+#pragma omp critical(node_counters)
+    split = node->split_node(this, child_node_points, num_child_node_points);
+    if (!split) {
+        fprintf(stderr, "Error in Index.cpp: could not split node %lu | %s.\n", node->id, node->filename);
+        exit(-1);
+    }
+    free(child_node_points);
+
+    std::vector<ts_type *> left, right;
+    for (ts_type *ts : series)
+        (node->node_split_policy_route_to_left(ts) ? left : right).push_back(ts);
+    //series with the same sketches cannot be told apart by any policy, they are halved so that the recursion ends
+    if (left.empty() || right.empty()) {
+        std::vector<ts_type *> &all = left.empty() ? right : left;
+        std::vector<ts_type *> &other = left.empty() ? left : right;
+        other.assign(all.begin() + all.size() / 2, all.end());
+        all.resize(all.size() / 2);
+    }
+    std::vector<ts_type *>().swap(series);
+
+    for (ts_type *ts : left)
+        node->left_child->updateStatistics(ts);
+    for (ts_type *ts : right)
+        node->right_child->updateStatistics(ts);
+
+    cout << "[SPLITTING SUCCESS] Node " << node->id << " has been splitted into 2 new leaves of size "
+         << node->left_child->node_size << " and " << node->right_child->node_size << endl;
+
+    Node *left_child = node->left_child;
+#pragma omp task firstprivate(left_child, left)
+    this->splitAndGraph(left_child, left);
+    this->splitAndGraph(node->right_child, right);
+}
+
 /**
  <ol>
  <li>IF node is not leaf, root TS using policies and node & new ts Sketches until to reach the adequate leaf</li>
@@ -187,225 +542,10 @@ bool Index::insertTS(ts_type *ts_new) {
 
 
         if (node->node_size >= this->index_setting->max_leaf_size) {
-            node_split_policy curr_node_split_policy;
-            ts_type max_diff_value = (FLT_MAX *(-1));//set init B to -INF,
-            // and try to find the max split strategy that maximize B
-            ts_type avg_children_range_value;
-            short hs_split_point = -1;
             short *child_node_points;
             int num_child_node_points;
-            const int num_child_segments = 2; //by default split to two subsegments
-
-            for (int i = 0; i < node->num_node_points; ++i) {
-                segment_sketch curr_node_segment_sketch = node->node_segment_sketches[i];
-
-                //This is the QoS of this segment. QoS is the estimation quality evaluated as =
-                //QoS = segment_length * (max_mean_min_mean) * ((max_mean_min_mean) +
-                //     (max_stdev * max_stdev))
-                //The smaller the QoS, the more effective the bounds are for similarity
-                //estimation
-
-                ts_type node_range_value = calculate_mean_std_dev_range(curr_node_segment_sketch, get_segment_length(node->node_points, i));
-
-                //for every split policy
-                for (int j = 0; j < node->num_node_segment_split_policies; ++j) {
-                    struct node_segment_split_policy curr_node_segment_split_policy =
-                            node->node_segment_split_policies[j];
-                    //to hold the two child segments
-
-
-                    auto child_node_segment_sketches = static_cast<segment_sketch *>(malloc(
-                            sizeof(struct segment_sketch) * num_child_segments));
-
-                    if (child_node_segment_sketches == nullptr) {
-                        cerr <<"Error in Index.cpp: could not allocate memory for the child node segment sketches for node "
-                                  << node->filename << endl;
-                        return FAILURE;
-                    }
-
-                    for (int k = 0; k < num_child_segments; ++k) {
-                        child_node_segment_sketches[k].indicators = nullptr;
-                        child_node_segment_sketches[k].indicators = static_cast<ts_type *>(malloc(
-                                sizeof(ts_type) * curr_node_segment_sketch.num_indicators));
-                        if (child_node_segment_sketches[k].indicators == nullptr) {
-                            cerr << "Error in Index.cpp: could not allocate memory for the child node segment sketches "
-                                    "indicators for node " <<node->filename<<endl;
-                            return FAILURE;
-                        }
-
-                    }
-
-
-                    if (is_split_policy_mean(curr_node_segment_split_policy))
-                        mean_node_segment_split_policy_split(&curr_node_segment_split_policy,
-                                                             curr_node_segment_sketch,
-                                                             child_node_segment_sketches);
-                    else if (is_split_policy_stdev(curr_node_segment_split_policy))
-                        stdev_node_segment_split_policy_split(&curr_node_segment_split_policy,
-                                                              curr_node_segment_sketch,
-                                                              child_node_segment_sketches);
-                    else {
-                        cerr << "Error in Index.cpp: Split policy was not set properly for node"<< node->filename<<endl;
-                        return FAILURE;
-                    }
-
-                    ts_type range_values[num_child_segments];
-                    for (int k = 0; k < num_child_segments; ++k) {
-                        struct segment_sketch child_node_segment_sketch = child_node_segment_sketches[k];
-                        range_values[k] = calculate_mean_std_dev_range(child_node_segment_sketch,
-                                                     get_segment_length(node->node_points, i));
-                    }
-
-                    //diff_value represents the splitting benefit
-                    //B = QoS(N) - (QoS_leftNode + QoS_rightNode)/2
-                    //the higher the diff_value, the better is the splitting
-
-                    avg_children_range_value = calc_mean(range_values, 0, num_child_segments);
-                    ts_type diff_value = node_range_value - avg_children_range_value;
-
-                    if (diff_value > max_diff_value) {
-                        max_diff_value = diff_value;
-                        curr_node_split_policy.split_from = get_segment_start(node->node_points, i);
-                        curr_node_split_policy.split_to = get_segment_end(node->node_points, i);
-                        curr_node_split_policy.indicator_split_idx = curr_node_segment_split_policy.indicator_split_idx;
-                        curr_node_split_policy.indicator_split_value = curr_node_segment_split_policy.indicator_split_value;
-                        curr_node_split_policy.curr_node_segment_split_policy = curr_node_segment_split_policy;
-                    }
-                    for (int k = 0; k < num_child_segments; ++k) {
-                        free(child_node_segment_sketches[k].indicators);
-                    }
-                    free(child_node_segment_sketches);
-                }
-            }
-
-            //add trade-off for horizontal split,
-            // we bias for minimize number if segments by giving preference to H split more than V split
-            max_diff_value = max_diff_value * 2;
-
-            //we want to test every possible split policy for each horizontal segment
-            for (int i = 0; i < node->num_hs_node_points; ++i) {
-                struct segment_sketch curr_hs_node_segment_sketch = node->hs_node_segment_sketches[i];
-                ts_type node_range_value = calculate_mean_std_dev_range(curr_hs_node_segment_sketch,
-                                                      get_segment_length(node->hs_node_points, i));
-
-                //for every split policy
-                for (int j = 0; j < node->num_node_segment_split_policies; ++j) {
-                    struct node_segment_split_policy curr_hs_node_segment_split_policy = node->node_segment_split_policies[j];
-
-                     //to hold the two child segments
-                    auto child_node_segment_sketches = static_cast<segment_sketch *>(malloc(sizeof(struct segment_sketch) *
-                                                                                       num_child_segments));
-                    if (child_node_segment_sketches == nullptr) {
-                        cerr <<"Error in INdex.cpp: could not allocate memory \
-                            for the horizontal child node segment sketches for \
-                            node " << node->filename<<endl;
-                        return FAILURE;
-                    }
-
-                    for (int k = 0; k < num_child_segments; ++k) {
-                        child_node_segment_sketches[k].indicators = nullptr;
-                        child_node_segment_sketches[k].indicators = static_cast<ts_type *>(malloc(
-                                sizeof(ts_type) * curr_hs_node_segment_sketch.num_indicators));
-                        if (child_node_segment_sketches[k].indicators == nullptr) {
-                            cerr <<"Error in INdex.cpp: could not allocate memory \
-                            for the horizontal child node segment sketches indicatores for \
-                            node " << node->filename<<endl;
-                            return FAILURE;
-                        }
-                    }
-
-                    if (is_split_policy_mean(curr_hs_node_segment_split_policy))
-                        mean_node_segment_split_policy_split(&curr_hs_node_segment_split_policy,
-                                                             curr_hs_node_segment_sketch,
-                                                             child_node_segment_sketches);
-                    else if (is_split_policy_stdev(curr_hs_node_segment_split_policy))
-                        stdev_node_segment_split_policy_split(&curr_hs_node_segment_split_policy,
-                                                              curr_hs_node_segment_sketch,
-                                                              child_node_segment_sketches);
-                    else
-                        printf("split policy not initialized properly\n");
-
-                    ts_type range_values[num_child_segments];
-                    for (int k = 0; k < num_child_segments; ++k) {
-                        struct segment_sketch child_node_segment_sketch = child_node_segment_sketches[k];
-                        range_values[k] = calculate_mean_std_dev_range(child_node_segment_sketch,
-                                                     get_segment_length(node->hs_node_points, i));
-                    }
-
-                    avg_children_range_value = calc_mean(range_values, 0, num_child_segments);
-
-                    ts_type diff_value = node_range_value - avg_children_range_value;
-
-                    if (diff_value > max_diff_value) {
-                        max_diff_value = diff_value;
-                        curr_node_split_policy.split_from = get_segment_start(node->hs_node_points, i);
-                        curr_node_split_policy.split_to = get_segment_end(node->hs_node_points, i);
-                        curr_node_split_policy.indicator_split_idx = curr_hs_node_segment_split_policy.indicator_split_idx;
-                        curr_node_split_policy.indicator_split_value = curr_hs_node_segment_split_policy.indicator_split_value;
-                        curr_node_split_policy.curr_node_segment_split_policy = curr_hs_node_segment_split_policy;
-                        hs_split_point = get_hs_split_point(node->node_points,
-                                                            curr_node_split_policy.split_from,
-                                                            curr_node_split_policy.split_to,
-                                                            node->num_node_points);
-                    }
-
-                    for (int k = 0; k < num_child_segments; ++k) {
-                        free(child_node_segment_sketches[k].indicators);
-                    }
-
-                    free(child_node_segment_sketches);
-                }
-            }
-
-            // we create node->split_policy for the choosen split policy
-            node->split_policy = nullptr;
-            node->split_policy = static_cast<node_split_policy *>(malloc(sizeof(struct node_split_policy)));
-            if (node->split_policy == nullptr) {
-                cerr <<"Error in Index.cpp: could not allocate memory \
-                        for the split policy of node  "<< node->filename<<endl;
+            if (!this->chooseSplitPolicy(node, child_node_points, num_child_node_points))
                 return FAILURE;
-            }
-            node->split_policy->split_from = curr_node_split_policy.split_from;
-            node->split_policy->split_to = curr_node_split_policy.split_to;
-            node->split_policy->indicator_split_idx = curr_node_split_policy.indicator_split_idx;
-            node->split_policy->indicator_split_value = curr_node_split_policy.indicator_split_value;
-            node->split_policy->curr_node_segment_split_policy = curr_node_split_policy.curr_node_segment_split_policy;
-
-
-            //when hs_split_point stays less than 0, it means that
-            //considering splitting a vertical segment is not worth it
-            //according to the QoS heuristic
-
-            if (hs_split_point < 0) {
-                num_child_node_points = node->num_node_points;
-                child_node_points = static_cast<short *>(malloc(sizeof(short) * num_child_node_points));
-                if (child_node_points == nullptr) {
-                   cerr<<"Error in Index.cpp: could not allocate memory "
-                         "for the child node segment points node  " <<node->filename<<endl;
-                    return FAILURE;
-                }
-                //children will have the same number of segments as parent
-                for (int i = 0; i < num_child_node_points; ++i) {
-                    child_node_points[i] = node->node_points[i];
-                }
-            }
-            else {
-                num_child_node_points = node->num_node_points + 1;
-                child_node_points = static_cast<short *>(malloc(sizeof(short) * num_child_node_points));
-                if (child_node_points == nullptr) {
-                    cerr <<"Error in Index.c: could not allocate memory for the child node segment points node  "<< node->filename<<endl;
-                    return FAILURE;
-                }
-                //children will have one additional segment than the parent
-                for (int i = 0; i < (num_child_node_points - 1); ++i) {
-                    child_node_points[i] = node->node_points[i];
-                }
-                child_node_points[num_child_node_points - 1] = hs_split_point; //initialize newly added point
-
-                qsort(child_node_points, num_child_node_points, sizeof(short),
-                      reinterpret_cast<__compar_fn_t>(compare_short));
-
-            }
 
             //this will put the time series of this node in the file_buffer->buffered_list aray
             //it will include the time series in disk and those in memory
@@ -459,7 +599,7 @@ bool Index::insertTS(ts_type *ts_new) {
             this->nodes.push(node->right_child);
 */
 
-            for (int i = 0; i < this->index_setting->max_leaf_size; free(ts_list[++i]));
+            for (int i = 0; i < this->index_setting->max_leaf_size; ++i) free(ts_list[i]);
 
 
             cout <<"[SPLITTING SUCCESS] Node "<<node->id<<" has been splitted into 2 new leaves of size "<<node->left_child->node_size
@@ -476,6 +616,234 @@ bool Index::insertTS(ts_type *ts_new) {
     }
     return SUCCESS;
 }
+
+/**
+ * Chooses the split of a full leaf: for every vertical and horizontal segment and every split policy (mean or stdev),
+ * the benefit B = QoS(node) - avg(QoS(children)) is computed, and the split with the highest B becomes
+ * node->split_policy. child_node_points receives the segmentation of the children (one more point for a
+ * horizontal split); the caller frees it.
+ */
+bool Index::chooseSplitPolicy(Node *node, short *&child_node_points, int &num_child_node_points) {
+    node_split_policy curr_node_split_policy;
+    ts_type max_diff_value = (FLT_MAX *(-1));//set init B to -INF,
+    // and try to find the max split strategy that maximize B
+    ts_type avg_children_range_value;
+    short hs_split_point = -1;
+    const int num_child_segments = 2; //by default split to two subsegments
+
+    for (int i = 0; i < node->num_node_points; ++i) {
+        segment_sketch curr_node_segment_sketch = node->node_segment_sketches[i];
+
+        //This is the QoS of this segment. QoS is the estimation quality evaluated as =
+        //QoS = segment_length * (max_mean_min_mean) * ((max_mean_min_mean) +
+        //     (max_stdev * max_stdev))
+        //The smaller the QoS, the more effective the bounds are for similarity
+        //estimation
+
+        ts_type node_range_value = calculate_mean_std_dev_range(curr_node_segment_sketch, get_segment_length(node->node_points, i));
+
+        //for every split policy
+        for (int j = 0; j < node->num_node_segment_split_policies; ++j) {
+            struct node_segment_split_policy curr_node_segment_split_policy =
+                    node->node_segment_split_policies[j];
+            //to hold the two child segments
+
+
+            auto child_node_segment_sketches = static_cast<segment_sketch *>(malloc(
+                    sizeof(struct segment_sketch) * num_child_segments));
+
+            if (child_node_segment_sketches == nullptr) {
+                cerr <<"Error in Index.cpp: could not allocate memory for the child node segment sketches for node "
+                          << node->filename << endl;
+                return FAILURE;
+            }
+
+            for (int k = 0; k < num_child_segments; ++k) {
+                child_node_segment_sketches[k].indicators = nullptr;
+                child_node_segment_sketches[k].indicators = static_cast<ts_type *>(malloc(
+                        sizeof(ts_type) * curr_node_segment_sketch.num_indicators));
+                if (child_node_segment_sketches[k].indicators == nullptr) {
+                    cerr << "Error in Index.cpp: could not allocate memory for the child node segment sketches "
+                            "indicators for node " <<node->filename<<endl;
+                    return FAILURE;
+                }
+
+            }
+
+
+            if (is_split_policy_mean(curr_node_segment_split_policy))
+                mean_node_segment_split_policy_split(&curr_node_segment_split_policy,
+                                                     curr_node_segment_sketch,
+                                                     child_node_segment_sketches);
+            else if (is_split_policy_stdev(curr_node_segment_split_policy))
+                stdev_node_segment_split_policy_split(&curr_node_segment_split_policy,
+                                                      curr_node_segment_sketch,
+                                                      child_node_segment_sketches);
+            else {
+                cerr << "Error in Index.cpp: Split policy was not set properly for node"<< node->filename<<endl;
+                return FAILURE;
+            }
+
+            ts_type range_values[num_child_segments];
+            for (int k = 0; k < num_child_segments; ++k) {
+                struct segment_sketch child_node_segment_sketch = child_node_segment_sketches[k];
+                range_values[k] = calculate_mean_std_dev_range(child_node_segment_sketch,
+                                             get_segment_length(node->node_points, i));
+            }
+
+            //diff_value represents the splitting benefit
+            //B = QoS(N) - (QoS_leftNode + QoS_rightNode)/2
+            //the higher the diff_value, the better is the splitting
+
+            avg_children_range_value = calc_mean(range_values, 0, num_child_segments);
+            ts_type diff_value = node_range_value - avg_children_range_value;
+
+            if (diff_value > max_diff_value) {
+                max_diff_value = diff_value;
+                curr_node_split_policy.split_from = get_segment_start(node->node_points, i);
+                curr_node_split_policy.split_to = get_segment_end(node->node_points, i);
+                curr_node_split_policy.indicator_split_idx = curr_node_segment_split_policy.indicator_split_idx;
+                curr_node_split_policy.indicator_split_value = curr_node_segment_split_policy.indicator_split_value;
+                curr_node_split_policy.curr_node_segment_split_policy = curr_node_segment_split_policy;
+            }
+            for (int k = 0; k < num_child_segments; ++k) {
+                free(child_node_segment_sketches[k].indicators);
+            }
+            free(child_node_segment_sketches);
+        }
+    }
+
+    //add trade-off for horizontal split,
+    // we bias for minimize number if segments by giving preference to H split more than V split
+    max_diff_value = max_diff_value * 2;
+
+    //we want to test every possible split policy for each horizontal segment
+    for (int i = 0; i < node->num_hs_node_points; ++i) {
+        struct segment_sketch curr_hs_node_segment_sketch = node->hs_node_segment_sketches[i];
+        ts_type node_range_value = calculate_mean_std_dev_range(curr_hs_node_segment_sketch,
+                                              get_segment_length(node->hs_node_points, i));
+
+        //for every split policy
+        for (int j = 0; j < node->num_node_segment_split_policies; ++j) {
+            struct node_segment_split_policy curr_hs_node_segment_split_policy = node->node_segment_split_policies[j];
+
+             //to hold the two child segments
+            auto child_node_segment_sketches = static_cast<segment_sketch *>(malloc(sizeof(struct segment_sketch) *
+                                                                               num_child_segments));
+            if (child_node_segment_sketches == nullptr) {
+                cerr <<"Error in INdex.cpp: could not allocate memory \
+                    for the horizontal child node segment sketches for \
+                    node " << node->filename<<endl;
+                return FAILURE;
+            }
+
+            for (int k = 0; k < num_child_segments; ++k) {
+                child_node_segment_sketches[k].indicators = nullptr;
+                child_node_segment_sketches[k].indicators = static_cast<ts_type *>(malloc(
+                        sizeof(ts_type) * curr_hs_node_segment_sketch.num_indicators));
+                if (child_node_segment_sketches[k].indicators == nullptr) {
+                    cerr <<"Error in INdex.cpp: could not allocate memory \
+                    for the horizontal child node segment sketches indicatores for \
+                    node " << node->filename<<endl;
+                    return FAILURE;
+                }
+            }
+
+            if (is_split_policy_mean(curr_hs_node_segment_split_policy))
+                mean_node_segment_split_policy_split(&curr_hs_node_segment_split_policy,
+                                                     curr_hs_node_segment_sketch,
+                                                     child_node_segment_sketches);
+            else if (is_split_policy_stdev(curr_hs_node_segment_split_policy))
+                stdev_node_segment_split_policy_split(&curr_hs_node_segment_split_policy,
+                                                      curr_hs_node_segment_sketch,
+                                                      child_node_segment_sketches);
+            else
+                printf("split policy not initialized properly\n");
+
+            ts_type range_values[num_child_segments];
+            for (int k = 0; k < num_child_segments; ++k) {
+                struct segment_sketch child_node_segment_sketch = child_node_segment_sketches[k];
+                range_values[k] = calculate_mean_std_dev_range(child_node_segment_sketch,
+                                             get_segment_length(node->hs_node_points, i));
+            }
+
+            avg_children_range_value = calc_mean(range_values, 0, num_child_segments);
+
+            ts_type diff_value = node_range_value - avg_children_range_value;
+
+            if (diff_value > max_diff_value) {
+                max_diff_value = diff_value;
+                curr_node_split_policy.split_from = get_segment_start(node->hs_node_points, i);
+                curr_node_split_policy.split_to = get_segment_end(node->hs_node_points, i);
+                curr_node_split_policy.indicator_split_idx = curr_hs_node_segment_split_policy.indicator_split_idx;
+                curr_node_split_policy.indicator_split_value = curr_hs_node_segment_split_policy.indicator_split_value;
+                curr_node_split_policy.curr_node_segment_split_policy = curr_hs_node_segment_split_policy;
+                hs_split_point = get_hs_split_point(node->node_points,
+                                                    curr_node_split_policy.split_from,
+                                                    curr_node_split_policy.split_to,
+                                                    node->num_node_points);
+            }
+
+            for (int k = 0; k < num_child_segments; ++k) {
+                free(child_node_segment_sketches[k].indicators);
+            }
+
+            free(child_node_segment_sketches);
+        }
+    }
+
+    // we create node->split_policy for the choosen split policy
+    node->split_policy = nullptr;
+    node->split_policy = static_cast<node_split_policy *>(malloc(sizeof(struct node_split_policy)));
+    if (node->split_policy == nullptr) {
+        cerr <<"Error in Index.cpp: could not allocate memory \
+                for the split policy of node  "<< node->filename<<endl;
+        return FAILURE;
+    }
+    node->split_policy->split_from = curr_node_split_policy.split_from;
+    node->split_policy->split_to = curr_node_split_policy.split_to;
+    node->split_policy->indicator_split_idx = curr_node_split_policy.indicator_split_idx;
+    node->split_policy->indicator_split_value = curr_node_split_policy.indicator_split_value;
+    node->split_policy->curr_node_segment_split_policy = curr_node_split_policy.curr_node_segment_split_policy;
+
+
+    //when hs_split_point stays less than 0, it means that
+    //considering splitting a vertical segment is not worth it
+    //according to the QoS heuristic
+
+    if (hs_split_point < 0) {
+        num_child_node_points = node->num_node_points;
+        child_node_points = static_cast<short *>(malloc(sizeof(short) * num_child_node_points));
+        if (child_node_points == nullptr) {
+           cerr<<"Error in Index.cpp: could not allocate memory "
+                 "for the child node segment points node  " <<node->filename<<endl;
+            return FAILURE;
+        }
+        //children will have the same number of segments as parent
+        for (int i = 0; i < num_child_node_points; ++i) {
+            child_node_points[i] = node->node_points[i];
+        }
+    }
+    else {
+        num_child_node_points = node->num_node_points + 1;
+        child_node_points = static_cast<short *>(malloc(sizeof(short) * num_child_node_points));
+        if (child_node_points == nullptr) {
+            cerr <<"Error in Index.c: could not allocate memory for the child node segment points node  "<< node->filename<<endl;
+            return FAILURE;
+        }
+        //children will have one additional segment than the parent
+        for (int i = 0; i < (num_child_node_points - 1); ++i) {
+            child_node_points[i] = node->node_points[i];
+        }
+        child_node_points[num_child_node_points - 1] = hs_split_point; //initialize newly added point
+
+        qsort(child_node_points, num_child_node_points, sizeof(short),
+              reinterpret_cast<__compar_fn_t>(compare_short));
+
+    }
+    return SUCCESS;
+}
+
 /**
  <center><h3>Add Node's File Buffer to the file buffer map, if the map doesnt exist we init it</h3></center>
  */
@@ -568,10 +936,14 @@ void Index::write() {
     cout << "[Index Storing Finished]" << endl;
 }
 
-Index *Index::Read(char *path, unsigned int mode) {
-    return new Index(path, mode);
+/**
+ * Reads the tree of the index; the leaf graphs are loaded on their first probe and kept within cache_size MB
+ * (0 = no limit), see LeafGraphCache.
+ */
+Index *Index::Read(char *path, unsigned int mode, double cache_size) {
+    return new Index(path, mode, cache_size);
 }
-Index::Index(char *root_directory, unsigned int mode) {
+Index::Index(char *root_directory, unsigned int mode, double cache_size) {
     this->in_memory = mode-1;
     this->time_stats = new timelapse ;
     this->time_stats->index_building_time = 0;
@@ -614,6 +986,7 @@ cerr << index_full_filename << endl;
 
     this -> l2space = new hnswlib::L2Space(index_setting->timeseries_size);
     this -> first_node = Node::Read(this, file);
+    this -> leaf_cache = new LeafGraphCache(this, (unsigned long) (cache_size * 1024 * 1024));
 
 
     if(count_leaves != Node::num_leaf_node){
@@ -632,6 +1005,7 @@ cerr << index_full_filename << endl;
 }
 Index::~Index(){
     delete this->time_stats;delete index_setting;
+    delete leaf_cache;
     delete first_node;
 }
 
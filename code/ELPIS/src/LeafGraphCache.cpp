@@ -0,0 +1,142 @@
+//
+// Leaf graphs loaded on demand within a memory budget.
+//
+
+#include "LeafGraphCache.h"
+#include "Index.h"
+
+LeafGraphCache::LeafGraphCache(Index *index, unsigned long budget_bytes) {
+    this->index = index;
+    this->budget_bytes = budget_bytes;
+    this->used_bytes = 0;
+    this->hits = 0;
+    this->misses = 0;
+    this->prefetched = 0;
+    this->evictions = 0;
+    this->clock_hand = 0;
+    this->stop = false;
+    this->loader = std::thread(&LeafGraphCache::loaderLoop, this);
+}
+
+LeafGraphCache::~LeafGraphCache() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    prefetch_ready.notify_all();
+    loader.join();
+}
+
+hnswlib::HierarchicalNSW<ts_type> *LeafGraphCache::acquire(Node *leaf) {
+    std::unique_lock<std::mutex> lock(mutex);
+    entry &e = entries[leaf];
+    while (e.state == LOADING)
+        loaded.wait(lock);
+    if (e.state == READY) {
+        ++hits;
+        ++e.pins;
+        e.referenced = true;
+    } else {
+        ++misses;
+        load(leaf, e, lock, true);
+    }
+    return leaf->leafgraph;
+}
+
+void LeafGraphCache::release(Node *leaf) {
+    std::lock_guard<std::mutex> lock(mutex);
+    --entries[leaf].pins;
+}
+
+void LeafGraphCache::prefetch(Node *leaf) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        entry &e = entries[leaf];
+        if (e.state != ABSENT || e.queued)
+            return;
+        e.queued = true;
+        prefetch_queue.push_back(leaf);
+    }
+    prefetch_ready.notify_one();
+}
+
+/**
+ * Reads the graph of leaf without holding the lock, then accounts it and evicts other graphs if the budget is
+ * exceeded. The waiting acquire() calls of the same leaf are woken up once it is ready.
+ */
+void LeafGraphCache::load(Node *leaf, entry &e, std::unique_lock<std::mutex> &lock, bool pin) {
+    e.state = LOADING;
+    lock.unlock();
+
+    char *index_full_filename = leaf->getLeafGraphFullFileName(index);
+    struct stat file_stat;
+    unsigned long bytes = stat(index_full_filename, &file_stat) == 0 ? file_stat.st_size : 0;
+    free(index_full_filename);
+    leaf->loadGraph(index);
+
+    lock.lock();
+    e.state = READY;
+    e.bytes = bytes;
+    e.referenced = true;
+    if (pin)
+        ++e.pins;
+    used_bytes += bytes;
+    resident.push_back(leaf);
+    evict();
+    loaded.notify_all();
+}
+
+/** CLOCK: the hand skips the pinned graphs and gives the referenced ones a second chance. */
+void LeafGraphCache::evict() {
+    if (budget_bytes == 0)
+        return;
+    size_t skipped = 0;
+    while (used_bytes > budget_bytes && skipped < 2 * resident.size()) {
+        if (clock_hand >= resident.size())
+            clock_hand = 0;
+        Node *leaf = resident[clock_hand];
+        entry &e = entries[leaf];
+        if (e.pins > 0 || e.referenced) {
+            e.referenced = false;
+            ++clock_hand;
+            ++skipped;
+            continue;
+        }
+        delete leaf->leafgraph;
+        leaf->leafgraph = nullptr;
+        used_bytes -= e.bytes;
+        e.state = ABSENT;
+        resident[clock_hand] = resident.back();
+        resident.pop_back();
+        ++evictions;
+        skipped = 0;
+    }
+}
+
+void LeafGraphCache::loaderLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        prefetch_ready.wait(lock, [this] { return stop || !prefetch_queue.empty(); });
+        if (stop)
+            return;
+        Node *leaf = prefetch_queue.front();
+        prefetch_queue.pop_front();
+        entry &e = entries[leaf];
+        e.queued = false;
+        //acquire() may have loaded it in the meantime
+        if (e.state == ABSENT) {
+            ++prefetched;
+            load(leaf, e, lock, false);
+        }
+    }
+}
+
+void LeafGraphCache::toString() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::cout << "[Leaf Cache] budget " << budget_bytes / (1024.0 * 1024) << "MB"
+              << " - resident " << resident.size() << " leaves, " << used_bytes / (1024.0 * 1024) << "MB"
+              << " - hits " << hits
+              << " - misses " << misses
+              << " - prefetched " << prefetched
+              << " - evictions " << evictions << std::endl;
+}
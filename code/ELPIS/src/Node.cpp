@@ -3,9 +3,13 @@
 //
 
 #include <thread>
+#include <omp.h>
 #include "Node.h"
 #include "hnswlib/hnswlib.h"
 
+//number of insertions per task when a leaf graph is shared among the threads
+#define GRAPH_TASK_GRAINSIZE 512
+
 
 using namespace std;
 
@@ -114,7 +118,7 @@ Node::Node(Index *index, FILE *file, Node * parent) {
                 fread(this->node_segment_sketches[i].indicators, sizeof(ts_type),
                       this->node_segment_sketches[i].num_indicators, file);
             }
-            loadGraph(index);
+            //the graph is loaded on the first probe of the leaf, by index->leaf_cache
             if(node_size > max_leaf_size)max_leaf_size = node_size;
         } else {
             this->filename = nullptr;
@@ -163,36 +167,53 @@ void Node::leafToGraph(Index *index) {
             free(this->file_buffer->buffered_list);
             this->file_buffer->buffered_list = nullptr;//we still can do better by deleting the file buffer, but no problem for the moment
 
-            char *index_full_filename = this->getLeafGraphFullFileName(index);
-
-            this->hnswmetric = new hnswlib::L2Space(index->index_setting->timeseries_size);
-
-            auto *appr_alg = new HierarchicalNSW<ts_type>(this->hnswmetric, this->node_size, index->index_setting->M,
-                                                          index->index_setting->efconstruction);
-            appr_alg->addPoint((void *) (rec[0]), (size_t) 0);
-            free(rec[0]);
-#pragma omp parallel for //num_threads(n2)
-                for (int i = 1; i < this->node_size; i++) {
-                    appr_alg->addPoint((void *) (rec[i]), (size_t) i);
-                    free(rec[i]);
-                }
+            this->buildGraph(index, rec);
 
+            for (int i = 0; i < this->node_size; i++)
+                free(rec[i]);
             free(rec);
-
-            appr_alg->saveIndex(index_full_filename);
-            delete appr_alg;
-            delete hnswmetric;
-
-            this->is_hnswed = true;
-            cout << "[Graphing] Leaf " << this->filename << " has been graph-structured in " << index_full_filename
-                 << endl;
-            free(index_full_filename);
         } else {
             throw std::runtime_error("GetTS() returns nullptr!");
         }
     }
 }
 
+/**
+ * Builds the HNSW graph of the leaf over its node_size series and stores it in the hnsw folder.
+ * The series are only read, the caller keeps ownership of them.
+ * Inside a parallel region, a large leaf is inserted by a taskloop, so that the threads without a leaf of
+ * their own help with it, and the graph is saved by a task, so that the thread goes on with the next leaf.
+ */
+void Node::buildGraph(Index *index, ts_type **series) {
+    char *index_full_filename = this->getLeafGraphFullFileName(index);
+
+    this->hnswmetric = new hnswlib::L2Space(index->index_setting->timeseries_size);
+
+    auto *appr_alg = new HierarchicalNSW<ts_type>(this->hnswmetric, this->node_size, index->index_setting->M,
+                                                  index->index_setting->efconstruction);
+    appr_alg->addPoint((void *) (series[0]), (size_t) 0);
+    if (omp_in_parallel()) {
+#pragma omp taskloop grainsize(GRAPH_TASK_GRAINSIZE) if(this->node_size > 2 * GRAPH_TASK_GRAINSIZE)
+        for (int i = 1; i < this->node_size; i++)
+            appr_alg->addPoint((void *) (series[i]), (size_t) i);
+    } else {
+#pragma omp parallel for //num_threads(n2)
+        for (int i = 1; i < this->node_size; i++)
+            appr_alg->addPoint((void *) (series[i]), (size_t) i);
+    }
+
+    this->is_hnswed = true;
+    hnswlib::L2Space *metric = this->hnswmetric;
+#pragma omp task default(none) firstprivate(appr_alg, metric, index_full_filename)
+    {
+        appr_alg->saveIndex(index_full_filename);
+        delete appr_alg;
+        delete metric;
+        free(index_full_filename);
+    }
+    cout << "[Graphing] Leaf " << this->filename << " has been graph-structured" << endl;
+}
+
 
 
 bool Node::clearFileBuffer(Index *index) {
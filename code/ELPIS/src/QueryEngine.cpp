@@ -6,14 +6,15 @@
 QueryEngine::~QueryEngine() {
     free(pq);
     free(results);
-    delete flags;
-    if(parallel and nprobes > 1){
+    free(answers);
+    delete[] flags;
+    if(nprobes > 1){
         for(int i=1;i<nworker;i++){
             free(qwdata[i].stats);
             delete qwdata[i].top_candidates;
-            free(qwdata[i].localknn);
-            free(qwdata[i].flags);
+            delete[] qwdata[i].flags;
         }
+        for(int i=0;i<nworker;i++)free(qwdata[i].knn);
         free(qwdata);
     }
 
@@ -27,6 +28,7 @@ QueryEngine::QueryEngine(const char *query_filename, Index *index, int ef, unsig
     this->parallel = parallel;
     this->nworker = nworker;
     this->results = static_cast<float *>(malloc(sizeof(float) * k));
+    this->answers = static_cast<knn_answer *>(malloc(sizeof(knn_answer) * k));
 
     this->flags = new hnswlib::vl_type [Node::max_leaf_size];
     memset(this->flags, 0, sizeof(hnswlib::vl_type) * Node::max_leaf_size);
@@ -38,30 +40,34 @@ QueryEngine::QueryEngine(const char *query_filename, Index *index, int ef, unsig
 
     //sometimes std::thread return 0 so, we use sysconf(LINUX)
     unsigned short local_nprobes = 0;
+    this->query_threads = (std::thread::hardware_concurrency() == 0) ? sysconf(_SC_NPROCESSORS_ONLN) :
+                          std::thread::hardware_concurrency();
 
-    if(parallel and nprobes >1){
+    if(nprobes >1){
         this->candidate_leaves =  pqueue_init(nprobes-1,
                                               cmp_pri, get_pri, set_pri, get_pos, set_pos);
 
 
-        this->nworker = (std::thread::hardware_concurrency()==0)? sysconf(_SC_NPROCESSORS_ONLN) : std::thread::hardware_concurrency() -1;
-        if(this->nworker>nprobes-1)this->nworker = nprobes-1;//to ensure that in balanced load no worker will remain idle
+        if(parallel) {
+            this->nworker = (std::thread::hardware_concurrency() == 0) ? sysconf(_SC_NPROCESSORS_ONLN) :
+                            std::thread::hardware_concurrency() - 1;
+            if (this->nworker > nprobes - 1)this->nworker = nprobes - 1;//to ensure that in balanced load no worker will remain idle
+        }
+        if(this->nworker < 1 or !parallel)this->nworker = 1;
         this->qwdata = static_cast<worker_backpack__ *>(malloc(sizeof(worker_backpack__) * this->nworker));
 
         local_nprobes = (nprobes-1) / this->nworker;
         for(int i=1;i<this->nworker;i++){
             qwdata[i].stats = static_cast<querying_stats *>(malloc(sizeof(querying_stats)));
             qwdata[i].top_candidates = new std::priority_queue<std::pair<float, unsigned int>, std::vector<std::pair<float, unsigned int>>>();
-            qwdata[i].local_nprobes = (local_nprobes);
-            qwdata[i].localknn = static_cast<float*>(malloc(k*sizeof(float)));
             qwdata[i].flags = new hnswlib::vl_type [Node::max_leaf_size];
             memset(qwdata[i].flags, 0, sizeof(hnswlib::vl_type) * Node::max_leaf_size);
             qwdata[i].curr_flag = 0;
 
 
         }
-//        qwdata[0].localknn = static_cast<float *>(malloc(k*sizeof(float)));
-        qwdata[0].local_nprobes += (nprobes-1)%this->nworker;
+        for(int i=0;i<this->nworker;i++)
+            qwdata[i].knn = static_cast<knn_answer *>(malloc(sizeof(knn_answer) * k));
         qwdata[0].stats = &stats;
         qwdata[0].top_candidates = &top_candidates;
 
@@ -88,7 +94,8 @@ QueryEngine::QueryEngine(const char *query_filename, Index *index, int ef, unsig
 
 
 void QueryEngine::setEF(Node * node, int ef){
-    if(node->is_leaf)node->leafgraph->setEf(ef);
+    //the graphs loaded later get index->ef
+    if(node->is_leaf){if(node->leafgraph != nullptr)node->leafgraph->setEf(ef);}
     else{
         setEF(node->left_child,ef);
         setEF(node->right_child,ef);
@@ -121,25 +128,86 @@ void QueryEngine::queryBinaryFile(int q_num, unsigned int k, int mode) {
     unsigned int q_loaded = 0;
     unsigned int ts_length = this->index->index_setting->timeseries_size;
 
-    ts_type *query_ts = static_cast<ts_type *>(malloc_search( sizeof(ts_type) * ts_length));
     cout << query_filename<<endl;
 
-     while(q_loaded < q_num){
-        q_loaded++;
-        fread(query_ts, sizeof(ts_type), ts_length, this->query_file);
-        searchNpLeafParallel(query_ts,k,nprobes);
+    int query_schedule = chooseSchedule(q_num);
+    if(query_schedule == SCHEDULE_INTER_QUERY){
+        //every thread picks whole queries, they are all read beforehand
+        ts_type *queries = static_cast<ts_type *>(malloc_search(sizeof(ts_type) * ts_length * q_num));
+        fread(queries, sizeof(ts_type), (size_t) ts_length * q_num, this->query_file);
+        queryInterParallel(queries, q_num, k);
+        free(queries);
+    }
+    else{
+        ts_type *query_ts = static_cast<ts_type *>(malloc_search( sizeof(ts_type) * ts_length));
+         while(q_loaded < q_num){
+            query_id = q_loaded;
+            q_loaded++;
+            fread(query_ts, sizeof(ts_type), ts_length, this->query_file);
+            searchNpLeafParallel(query_ts,k,nprobes);
+        }
+        free(query_ts);
     }
-
-    free(query_ts);
 
     this->closeFile();
 
 
 
     index->time_stats->querying_time = getElapsedTime(start);
+    cout << "[Throughput] " << (query_schedule == SCHEDULE_INTER_QUERY ? "inter-query" : "intra-query")
+         << " - threads " << (query_schedule == SCHEDULE_INTER_QUERY ? query_threads : (parallel ? nworker : 1))
+         << " - QPS " << q_num / index->time_stats->querying_time << endl;
 
 }
 
+/**
+ * Intra-query parallelism spreads the leaves of a query over the workers, so it leaves them idle when nprobes is
+ * small, while the inter-query schedule needs at least one query per thread. The auto schedule runs whole queries on
+ * each thread unless every worker gets INTRA_QUERY_MIN_LEAVES_PER_WORKER leaves of a query.
+ */
+int QueryEngine::chooseSchedule(unsigned int q_num) {
+    if (!parallel) return SCHEDULE_INTRA_QUERY;
+    if (schedule != SCHEDULE_AUTO) return schedule;
+    if (q_num < query_threads) return SCHEDULE_INTRA_QUERY;
+    if (nprobes > 1 and nworker > 1 and nprobes - 1 >= nworker * INTRA_QUERY_MIN_LEAVES_PER_WORKER)
+        return SCHEDULE_INTRA_QUERY;
+    return SCHEDULE_INTER_QUERY;
+}
+
+void QueryEngine::queryInterParallel(ts_type *queries, unsigned int q_num, unsigned int k) {
+    unsigned int ts_length = this->index->index_setting->timeseries_size;
+#pragma omp parallel num_threads(query_threads)
+    {
+        query_thread_data thread;
+        thread.flags = new hnswlib::vl_type [Node::max_leaf_size];
+        memset(thread.flags, 0, sizeof(hnswlib::vl_type) * Node::max_leaf_size);
+        thread.curr_flag = 0;
+        thread.pq = pqueue_init(Node::num_leaf_node, cmp_pri, get_pri, set_pri, get_pos, set_pos);
+        thread.candidates = static_cast<query_result *>(calloc(Node::num_leaf_node + 1, sizeof(struct query_result)));
+        thread.answers = static_cast<knn_answer *>(malloc(sizeof(knn_answer) * k));
+        thread.results = static_cast<float *>(malloc(sizeof(float) * k));
+
+#pragma omp for schedule(dynamic, 1)
+        for (unsigned int q = 0; q < q_num; q++) {
+            Time start = now();
+            searchQuery(queries + (size_t) q * ts_length, k, nprobes, &thread);
+            double time = getElapsedTime(start);
+            if (evaluator != nullptr)
+                evaluator->record(q, thread.results, time);
+            else {
+#pragma omp critical(print_knn)
+                printKNN(thread.results, thread.answers, thread.answers_size, k, time, thread.stats, visited, q, 1);
+            }
+        }
+
+        delete[] thread.flags;
+        pqueue_free(thread.pq);
+        free(thread.candidates);
+        free(thread.answers);
+        free(thread.results);
+    }
+}
+
 
 void QueryEngine::closeFile(){
     if (fclose(this->query_file)) {
@@ -158,6 +226,10 @@ void searchflat(Node * node, unsigned int entrypoint, const void *data_point, si
                 float & bsf,querying_stats & stats, unsigned short *threadvisits, unsigned short & round_visit) {
     auto g = node->leafgraph;
     round_visit++;
+    if (round_visit == 0) {//the marks of the previous rounds wrapped around
+        memset(threadvisits, 0, sizeof(unsigned short) * Node::max_leaf_size);
+        round_visit = 1;
+    }
     std::priority_queue<std::pair<float, unsigned int>, std::vector<std::pair<float, unsigned int>>, CompareByFirst> candidate_set;
 
     float LBGRAPH;
@@ -169,7 +241,7 @@ void searchflat(Node * node, unsigned int entrypoint, const void *data_point, si
     LBGRAPH = dist;
     top_candidates.emplace(dist, entrypoint);
     candidate_set.emplace(-dist, entrypoint);
-    threadvisits[round_visit] = round_visit;
+    threadvisits[entrypoint] = round_visit;
 
     while (candidate_set.size() > 0) {
 
@@ -272,16 +344,44 @@ void searchGraphLeaf(Node * node,const void *query_data, size_t k,
 
 
 
-void QueryEngine::searchNpLeafParallel(ts_type *query_ts, unsigned int k, unsigned int nprobes) {
-
-    stats.reset();
+/**
+ * Seeds the beam queue of a leaf search with the current answers of the worker, as labels from seed_label on, so
+ * that the search starts bounded by them.
+ */
+static inline void seedAnswers(std::priority_queue<std::pair<float, unsigned int>> &queue, const knn_answer *knn,
+                               unsigned int knn_size, unsigned int seed_label) {
+    for (unsigned int i = 0; i < knn_size; i++)
+        queue.emplace(knn[i].distance, seed_label + i);
+}
 
-    Time start = now();
+/**
+ * Empties the queue of a search of leaf into the sorted answers knn: the seeds keep their answer, the other entries
+ * are internal ids of the leaf graph, stored with their label in the leaf.
+ */
+static inline void collectAnswers(std::priority_queue<std::pair<float, unsigned int>> &queue, Node *leaf,
+                                  unsigned int seed_label, knn_answer *knn, unsigned int &knn_size, unsigned int k) {
+    while (queue.size() > k)queue.pop();
+    std::vector<knn_answer> merged(queue.size());
+    for (size_t i = merged.size(); i-- > 0; queue.pop()) {
+        auto p = queue.top();
+        if (p.second >= seed_label)
+            merged[i] = knn[p.second - seed_label];
+        else
+            merged[i] = knn_answer{p.first, leaf->id, (unsigned int) leaf->leafgraph->getExternalLabel(p.second)};
+    }
+    std::copy(merged.begin(), merged.end(), knn);
+    knn_size = merged.size();
+}
 
-    ts_type kth_bsf = FLT_MAX;
+/** Lowers bound to value if value is smaller (CAS loop, the bound only decreases). */
+static inline void atomicMin(std::atomic<ts_type> &bound, ts_type value) {
+    ts_type current = bound.load(std::memory_order_relaxed);
+    while (value < current && !bound.compare_exchange_weak(current, value, std::memory_order_relaxed));
+}
 
+/** Descends the tree with the split policies down to the leaf of query_ts. */
+Node *QueryEngine::routeToLeaf(ts_type *query_ts) {
     Node *App_node = this->index->first_node;
-    ts_type App_bsf;
     if (App_node == nullptr) throw std::runtime_error("Error : First node == nullptr!");
     while (!App_node->is_leaf) {
         if (App_node->node_split_policy_route_to_left(query_ts)) {
@@ -290,180 +390,190 @@ void QueryEngine::searchNpLeafParallel(ts_type *query_ts, unsigned int k, unsign
             App_node = App_node->right_child;
         }
     }
+    return App_node;
+}
 
+/**
+ * Traverses the tree by increasing lower bound with pq and stores in candidates, sorted by lower bound, the leaves
+ * other than App_node that are not farther than kth_bsf. Returns their number.
+ */
+unsigned int QueryEngine::collectCandidates(ts_type *query_ts, Node *App_node, ts_type kth_bsf, pqueue_t *pq,
+                                            query_result *candidates, querying_stats &stats) {
+    auto *root_pq_item = static_cast<query_result *>(malloc_search(sizeof(struct query_result)));
 
+    root_pq_item->node = this->index->first_node;
+    root_pq_item->distance = this->index->first_node->calculate_node_min_distance(this->index, query_ts, stats);
 
-    searchGraphLeaf(App_node,query_ts, k,
-                    top_candidates,App_bsf, stats, flags,
-                    curr_flag);
+    pqueue_insert(pq, root_pq_item);
 
+    struct query_result *n;
+    ts_type child_distance;
 
+    unsigned int candidates_count = 0;
+    int pos;
+    while ((n = static_cast<query_result *>(pqueue_pop(pq)))) {
+        if (n->distance > kth_bsf) {//getting through two pruning process is tricky...
+            free(n);
+            break;
+        }
+        if (n->node->is_leaf) // n is a leaf
+        {
 
-    nprobes--;
-    if (nprobes == 0) {
-        while (top_candidates.size() > k)top_candidates.pop();
+            pos = candidates_count - 1;
 
-        while (top_candidates.size() > 0) {
-            results[top_candidates.size() - 1] = top_candidates.top().first;
-            top_candidates.pop();
+            if (pos >= 0)
+                while (pos >= 0 and n->distance < candidates[pos].distance) {
+                    candidates[pos + 1].node = candidates[pos].node;
+                    candidates[pos + 1].distance = candidates[pos].distance;
+                    pos--;
+                }
+            candidates[pos + 1].node = n->node;
+            candidates[pos + 1].distance = n->distance;
+            candidates_count++;
+        } else
+        {
+            child_distance = n->node->left_child->calculate_node_min_distance(this->index, query_ts, stats);
+            if ((child_distance < kth_bsf) &&
+                (n->node->left_child != App_node)) //add epsilon
+            {
+                auto *mindist_result_left = static_cast<query_result *>(malloc_search(
+                        sizeof(struct query_result)));
+                mindist_result_left->node = n->node->left_child;
+                mindist_result_left->distance = child_distance;
+                pqueue_insert(pq, mindist_result_left);
+            }
+
+            child_distance = n->node->right_child->calculate_node_min_distance(this->index, query_ts, stats);
+            if ((child_distance < kth_bsf) &&
+                (n->node->right_child != App_node)) //add epsilon
+            {
+                auto *mindist_result_right = static_cast<query_result *>(malloc_search(
+                        sizeof(struct query_result)));
+                mindist_result_right->node = n->node->right_child;
+                mindist_result_right->distance = child_distance;
+                pqueue_insert(pq, mindist_result_right);
+            }
         }
-        double time = getElapsedTime(start);
-        printKNN(results, k, time, visited, 0);
 
+        free(n);
     }
-    else{
-        auto *root_pq_item = static_cast<query_result *>(malloc_search(sizeof(struct query_result)));
+    // Free the nodes that were not popped.
+    while ((n = static_cast<query_result *>(pqueue_pop(pq))))free(n);
+    return candidates_count;
+}
 
-        root_pq_item->node = this->index->first_node;
-        root_pq_item->distance = this->index->first_node->calculate_node_min_distance(this->index, query_ts, stats);
+void QueryEngine::searchNpLeafParallel(ts_type *query_ts, unsigned int k, unsigned int nprobes) {
 
-        pqueue_insert(pq, root_pq_item);
+    stats.reset();
 
-        struct query_result *n;
-        ts_type child_distance;
-        ts_type bsf = FLT_MAX;
+    Time start = now();
 
+    ts_type kth_bsf = FLT_MAX;
+    //labels of the leaf graphs are below Node::max_leaf_size, the seeds of a search are numbered from there
+    const unsigned int seed_label = Node::max_leaf_size;
 
-        query_result * candidates =  static_cast<query_result *>(calloc(Node::num_leaf_node+1, sizeof(struct query_result)));
-        unsigned int candidates_count = 0;
-        int pos;
-        kth_bsf = top_candidates.top().first;
-        while ((n = static_cast<query_result *>(pqueue_pop(pq)))) {
-            if (n->distance > kth_bsf) {//getting through two pruning process is tricky...
-                break;
-            }
-            if (n->node->is_leaf) // n is a leaf
-            {
+    Node *App_node = routeToLeaf(query_ts);
+    ts_type App_bsf;
 
-                pos = candidates_count - 1;
 
-                if (pos >= 0)
-                    while (pos >= 0 and n->distance < candidates[pos].distance) {
-                        candidates[pos + 1].node = candidates[pos].node;
-                        candidates[pos + 1].distance = candidates[pos].distance;
-                        pos--;
-                    }
-                candidates[pos + 1].node = n->node;
-                candidates[pos + 1].distance = n->distance;
-                candidates_count++;
-            } else
-            {
-                child_distance = n->node->left_child->calculate_node_min_distance(this->index, query_ts, stats);
-                if ((child_distance < kth_bsf) &&
-                    (n->node->left_child != App_node)) //add epsilon
-                {
-                    auto *mindist_result_left = static_cast<query_result *>(malloc_search(
-                            sizeof(struct query_result)));
-                    mindist_result_left->node = n->node->left_child;
-                    mindist_result_left->distance = child_distance;
-                    pqueue_insert(pq, mindist_result_left);
-                }
+    LeafGraphCache *cache = this->index->leaf_cache;
+    unsigned int answers_size = 0;
+    cache->acquire(App_node);
+    searchGraphLeaf(App_node,query_ts, k,
+                    top_candidates,App_bsf, stats, flags,
+                    curr_flag);
+    collectAnswers(top_candidates, App_node, seed_label, answers, answers_size, k);
+    cache->release(App_node);
 
-                child_distance = n->node->right_child->calculate_node_min_distance(this->index, query_ts, stats);
-                if ((child_distance < kth_bsf) &&
-                    (n->node->right_child != App_node)) //add epsilon
-                {
-                    auto *mindist_result_right = static_cast<query_result *>(malloc_search(
-                            sizeof(struct query_result)));
-                    mindist_result_right->node = n->node->right_child;
-                    mindist_result_right->distance = child_distance;
-                    pqueue_insert(pq, mindist_result_right);
-                }
-            }
 
-            free(n);
-        }
-        stats.num_candidates = candidates_count;
 
-        for (int i = 1; i < nworker; i++) {
-            qwdata[i].id = i;
-            qwdata[i].kth_bsf = &kth_bsf;
+    nprobes--;
+    if (nprobes == 0) {
+        for (unsigned int i = 0; i < answers_size; i++)
+            results[i] = answers[i].distance;
+        for (unsigned int i = answers_size; i < k; i++)
+            results[i] = FLT_MAX;
+        double time = getElapsedTime(start);
+        printKNN(results, answers, answers_size, k, time, stats, visited, query_id, 0);
+
+    }
+    else{
+        query_result * candidates =  static_cast<query_result *>(calloc(Node::num_leaf_node+1, sizeof(struct query_result)));
+        if (answers_size > 0) kth_bsf = answers[answers_size - 1].distance;
+        unsigned int candidates_count = collectCandidates(query_ts, App_node, kth_bsf, pq, candidates, stats);
+        stats.num_candidates = candidates_count;
+        unsigned int num_probes = std::min(candidates_count, nprobes);
+        //the candidates are read in the background while the first ones are searched
+        for (int i = 0; i < num_probes; i++)
+            cache->prefetch(candidates[i].node);
+
+        //every worker starts from the answers of the first leaf, and publishes its k-th distance in the shared bound
+        std::atomic<ts_type> shared_kth_bsf(kth_bsf);
+        std::atomic<unsigned int> next_candidate(0);
+        for (int i = 1; i < nworker; i++)
             qwdata[i].stats->reset();
-            qwdata[i].bsf = FLT_MAX;
-        }
-        qwdata[0].kth_bsf = &kth_bsf;
-        qwdata[0].bsf = FLT_MAX;
-        qwdata[0].id=0;
         qwdata[0].flags = flags;
         qwdata[0].curr_flag = curr_flag;
+        for (int i = 0; i < nworker; i++) {
+            qwdata[i].id = i;
+            qwdata[i].kth_bsf = &shared_kth_bsf;
+            qwdata[i].bsf = FLT_MAX;
+            std::copy(answers, answers + answers_size, qwdata[i].knn);
+            qwdata[i].knn_size = answers_size;
+        }
 
-        copypq(qwdata, top_candidates);
-
-
-
-        pthread_rwlock_t lock_bsf = PTHREAD_RWLOCK_INITIALIZER;
-
-        query_result node;
         query_worker_data *worker;
 
         {
-#pragma omp parallel num_threads(nworker) private(node, bsf, worker) shared(qwdata, candidates_count, candidates,  query_ts, k)
+#pragma omp parallel num_threads(nworker) private(worker) shared(qwdata, candidates, query_ts, k, cache, next_candidate, num_probes, seed_label)
             {
-                bsf = FLT_MAX;
                 worker = qwdata+omp_get_thread_num();
-#pragma omp for schedule(static, 1)
-                for (int i = 0; i < std::min(candidates_count,nprobes); i++) {
+                //the leaves are pulled in the order of their lower bound, whatever the search time of each
+                for (unsigned int i = next_candidate.fetch_add(1, std::memory_order_relaxed); i < num_probes;
+                     i = next_candidate.fetch_add(1, std::memory_order_relaxed)) {
 
-                    node = candidates[i];
-                    pthread_rwlock_rdlock(&lock_bsf);
-                    bsf = *worker->kth_bsf;
-                    pthread_rwlock_unlock(&lock_bsf);
+                    query_result &node = candidates[i];
                     worker->stats->num_leaf_checked++;
-                    //                    worker->checked_leaf.push(node.node->id);
-                    if (node.distance <=worker->bsf) {
+                    if (node.distance <= worker->bsf and
+                        node.distance <= worker->kth_bsf->load(std::memory_order_relaxed)) {
                         worker->stats->num_leaf_searched++;
 
+                        seedAnswers(*(worker->top_candidates), worker->knn, worker->knn_size, seed_label);
+                        cache->acquire(node.node);
                         searchGraphLeaf(node.node,query_ts, k,
                                         *(worker->top_candidates),worker->bsf, *(worker->stats), worker->flags,
                                         worker->curr_flag);
+                        collectAnswers(*(worker->top_candidates), node.node, seed_label, worker->knn,
+                                       worker->knn_size, k);
+                        cache->release(node.node);
 
-                        if (worker->top_candidates->top().first < bsf) {
-                            pthread_rwlock_wrlock(&lock_bsf);
-                            *(worker->kth_bsf) = worker->top_candidates->top().first;
-                            pthread_rwlock_unlock(&lock_bsf);
-                        }
-
-                    }
-                }
-#pragma omp for schedule(static, 1)
-                for(int i=1;i<nworker;i++){
-                    if(qwdata[i].stats->num_leaf_searched==0)while(qwdata[i].top_candidates->size()>0)qwdata[i].top_candidates->pop();
-
-                    else {
-
-                        for (int j = k - 1; j >= 0; j--) {
-
-                            if(qwdata[i].top_candidates->top().second ==this->index->index_setting->max_leaf_size + 1)
-                                qwdata[i].localknn[j] = FLT_MAX;
-                            else{qwdata[i].localknn[j] = qwdata[i].top_candidates->top().first;}
-
-                            qwdata[i].top_candidates->pop();
-                        }
+                        if (worker->knn_size == k)
+                            atomicMin(*(worker->kth_bsf), worker->knn[k - 1].distance);
                     }
                 }
             }
         }
-
-
-        for(int i=1;i<nworker;i++){
-            if(qwdata[i].stats->num_leaf_searched==0)continue;
-            for(int j = 0;j<k;j++){
-                if(qwdata[i].localknn[j]==FLT_MAX)continue;
-                if(qwdata[i].localknn[j] < top_candidates.top().first) {
-                    top_candidates.emplace(qwdata[i].localknn[j], 0);
-                    top_candidates.pop();
-                } else {
-                    break;
-                }
-            }
-        }
-
-
-        while(top_candidates.size()>k)top_candidates.pop();
-        while (top_candidates.size() > 0) {
-            results[top_candidates.size() - 1] = top_candidates.top().first;
-            top_candidates.pop();
+        curr_flag = qwdata[0].curr_flag;
+
+        //merge of the answers of the workers, the answers of the first leaf are in all of them
+        std::vector<knn_answer> merged;
+        for (int i = 0; i < nworker; i++)
+            merged.insert(merged.end(), qwdata[i].knn, qwdata[i].knn + qwdata[i].knn_size);
+        std::sort(merged.begin(), merged.end(), [](const knn_answer &a, const knn_answer &b) {
+            return a.distance < b.distance or
+                   (a.distance == b.distance and (a.leaf_id < b.leaf_id or (a.leaf_id == b.leaf_id and a.label < b.label)));
+        });
+        answers_size = 0;
+        for (size_t i = 0; i < merged.size() and answers_size < k; i++) {
+            if (answers_size > 0 and answers[answers_size - 1].leaf_id == merged[i].leaf_id and
+                answers[answers_size - 1].label == merged[i].label)
+                continue;
+            answers[answers_size++] = merged[i];
         }
+        for (unsigned int i = 0; i < answers_size; i++)
+            results[i] = answers[i].distance;
+        for (unsigned int i = answers_size; i < k; i++)
+            results[i] = FLT_MAX;
 
         double time = getElapsedTime(start);
 
@@ -480,20 +590,80 @@ void QueryEngine::searchNpLeafParallel(ts_type *query_ts, unsigned int k, unsign
         }
 
 
-        printKNN(results, k, time, visited, 1);
+        printKNN(results, answers, answers_size, k, time, stats, visited, query_id, 1);
 
 
 
-        // Free the nodes that were not popped.
-        while ((n = static_cast<query_result *>(pqueue_pop(pq))))free(n);
+        struct query_result *n;
         while ((n = static_cast<query_result *>(pqueue_pop(candidate_leaves))))free(n);
+        free(candidates);
 
     }
 
 }
 
 
-inline void QueryEngine::printKNN(float * results, int k, double time,queue<unsigned int> & visited, bool para){
+/**
+ * Runs one query with the state of the calling thread only: the leaf of the query, then up to nprobes - 1 candidate
+ * leaves one after the other, as a single worker of searchNpLeafParallel would. The answers end up in thread.
+ */
+void QueryEngine::searchQuery(ts_type *query_ts, unsigned int k, unsigned int nprobes, query_thread_data *thread) {
+    thread->stats.reset();
+    const unsigned int seed_label = Node::max_leaf_size;
+    LeafGraphCache *cache = this->index->leaf_cache;
+
+    Node *App_node = routeToLeaf(query_ts);
+    ts_type bsf = FLT_MAX;
+    thread->answers_size = 0;
+    cache->acquire(App_node);
+    searchGraphLeaf(App_node, query_ts, k, thread->top_candidates, bsf, thread->stats, thread->flags,
+                    thread->curr_flag);
+    collectAnswers(thread->top_candidates, App_node, seed_label, thread->answers, thread->answers_size, k);
+    cache->release(App_node);
+
+    if (nprobes > 1) {
+        ts_type kth_bsf = (thread->answers_size > 0) ? thread->answers[thread->answers_size - 1].distance : FLT_MAX;
+        unsigned int candidates_count = collectCandidates(query_ts, App_node, kth_bsf, thread->pq,
+                                                          thread->candidates, thread->stats);
+        thread->stats.num_candidates = candidates_count;
+        unsigned int num_probes = std::min(candidates_count, nprobes - 1);
+        for (unsigned int i = 0; i < num_probes; i++)
+            cache->prefetch(thread->candidates[i].node);
+
+        bsf = FLT_MAX;
+        for (unsigned int i = 0; i < num_probes; i++) {
+            query_result &node = thread->candidates[i];
+            thread->stats.num_leaf_checked++;
+            if (thread->answers_size == k)
+                kth_bsf = thread->answers[k - 1].distance;
+            if (node.distance > bsf or node.distance > kth_bsf)
+                continue;
+            thread->stats.num_leaf_searched++;
+
+            seedAnswers(thread->top_candidates, thread->answers, thread->answers_size, seed_label);
+            cache->acquire(node.node);
+            searchGraphLeaf(node.node, query_ts, k, thread->top_candidates, bsf, thread->stats, thread->flags,
+                            thread->curr_flag);
+            collectAnswers(thread->top_candidates, node.node, seed_label, thread->answers, thread->answers_size, k);
+            cache->release(node.node);
+        }
+    }
+
+    for (unsigned int i = 0; i < thread->answers_size; i++)
+        thread->results[i] = thread->answers[i].distance;
+    for (unsigned int i = thread->answers_size; i < k; i++)
+        thread->results[i] = FLT_MAX;
+}
+
+
+inline void QueryEngine::printKNN(float * results, knn_answer * answers, unsigned int answers_size, int k, double time, querying_stats & stats,
+                                  queue<unsigned int> & visited, unsigned int query_id, bool para){
+    if(evaluator != nullptr){
+        evaluator->record(query_id, results, time);
+        for(;!visited.empty();visited.pop());
+        stats.reset();
+        return;
+    }
     cout << "----------"<<k<<"-NN RESULTS----------- | "<<para;
     if(para)cout<<" - num candidates "<<stats.num_candidates
                 << " - num leaf checked "<<stats.num_leaf_checked
@@ -502,9 +672,10 @@ inline void QueryEngine::printKNN(float * results, int k, double time,queue<unsi
     cout<<" | visited nodes : ";
     for(;!visited.empty();visited.pop())cout<< visited.front() << " ";
     cout << endl;
-    for(int i = 0 ; i < k ; i++){
-        printf( " K N°%i  => Distance : %f | Node ID : %lu | Time  : %f |Total DC : %lu | HDC : %lu | BDC : %lu \n",i+1,sqrt(results[i]),
-                0,time,stats.distance_computations_hrl+stats.distance_computations_bsl,stats.distance_computations_hrl,stats.distance_computations_bsl);
+    //only the first answers_size answers are set, the others are padding
+    for(unsigned int i = 0 ; i < answers_size ; i++){
+        printf( " K N°%i  => Distance : %f | Node ID : %lu | Label : %u | Time  : %f |Total DC : %lu | HDC : %lu | BDC : %lu \n",i+1,sqrt(results[i]),
+                answers[i].leaf_id,answers[i].label,time,stats.distance_computations_hrl+stats.distance_computations_bsl,stats.distance_computations_hrl,stats.distance_computations_bsl);
         stats.reset();
         /*    cout << " K N°"<<i+1<<" => Distance : "<<sqrt(results[i])
                  << " | Node ID : "<< 0
@@ -524,16 +695,5 @@ inline void QueryEngine::printKNN(float * results, int k, double time,queue<unsi
                  << " | Num DC(lb): " << stats.distance_computations_lb*/
         time = 0;
     }
+    stats.reset();
 }
-
-inline void QueryEngine::copypq(query_worker_data *pData, priority_queue<pair<float, unsigned int>> queue) {
-    while(!queue.empty()){
-        auto p = queue.top();
-        p.second  =  this->index->index_setting->max_leaf_size + 1;
-        for(int i =1; i<nworker;i++){//0 is reserved to top_candidates itself, AND worker 0 has a reference to PQ
-            pData[i].top_candidates->emplace(p);
-        }
-        queue.pop();
-    }
-}
-
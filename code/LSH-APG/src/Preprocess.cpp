@@ -11,29 +11,48 @@
 #include <numeric>
 #include <algorithm>
 #include <omp.h>
+#include <cstring>
+#include <immintrin.h>
 #define E 2.718281746
 #define PI 3.1415926
 
 #define min(a,b)            (((a) < (b)) ? (a) : (b))
 #define max(a,b)            (((a) > (b)) ? (a) : (b))
 
-Preprocess::Preprocess(const std::string& path, const std::string& ben_file_, const std::string& query_path, int datadim, int datasize)
+Preprocess::Preprocess(const std::string& path, const std::string& ben_file_, const std::string& query_path, int datadim, int datasize, int querysize)
 {
 	lsh::timer timer;
 	std::cout << "LOADING DATA..." << std::endl;
 	timer.restart();
-	load_data(path, query_path, datadim, datasize);
+	load_data(path, query_path, datadim, datasize, querysize);
 	std::cout << "LOADING TIME: " << timer.elapsed() << "s." << std::endl << std::endl;
 
 	data_file = path;
 	ben_file = ben_file_;
 	query_file = query_path;
-	if (data.N > 500) {
+	if (!ben_file.empty() && data.numQuery > 0 && data.N > 500) {
 		ben_create();
 	}
 }
 
-void Preprocess::load_data(const std::string& data_path, const std::string& query_path, int datadim, int datasize)
+// Reads n rows of dim floats into one aligned block. The file is read at once at the start of the block,
+// then the rows are moved to their padded place from the last one, so that no row is overwritten before it is moved
+static bool load_matrix(std::ifstream& in, DataMatrix& m, unsigned dim, unsigned n)
+{
+	size_t row_floats = DATA_ALIGNMENT / sizeof(float);
+	m.stride = (dim + row_floats - 1) / row_floats * row_floats;
+	m.base = (float*)_mm_malloc(sizeof(float) * m.stride * n, DATA_ALIGNMENT);
+	in.read((char*)m.base, sizeof(float) * dim * n);
+	if (m.stride != dim) {
+		for (size_t i = n; i-- > 0;) {
+			memmove(m[i], m.base + i * dim, sizeof(float) * dim);
+			memset(m[i] + dim, 0, sizeof(float) * (m.stride - dim));
+		}
+	}
+	return (bool)in;
+}
+
+void Preprocess::load_data(const std::string& data_path, const std::string& query_path, int datadim, int datasize, int querysize)
 {
 	std::string data_file = data_path;
 	std::ifstream in(data_file.c_str(), std::ios::binary);
@@ -44,33 +63,29 @@ void Preprocess::load_data(const std::string& data_path, const std::string& quer
 
 	data.N = datasize;
 	data.dim = datadim;
-
-	data.val = new float* [data.N];
-	for (int i = 0; i < data.N; ++i) {
-		data.val[i] = new float[data.dim];
-		//in.seekg(sizeof(float), std::ios::cur);
-		in.read((char*)data.val[i], sizeof(float) * data.dim);
-	}
-
-	std::string query_file = query_path;
-	std::ifstream query_in(query_file.c_str(), std::ios::binary);
-	while (!query_in) {
-		printf("Fail to find query file!\n");
+	if (!load_matrix(in, data.val, data.dim, data.N)) {
+		printf("The data file holds fewer than %d points!\n", datasize);
 		exit(0);
 	}
 
-	data.query = new float* [100];
-	for (int i = 0; i < 100; ++i) {
-		data.query[i] = new float[data.dim];
-		//in.seekg(sizeof(float), std::ios::cur);
-		query_in.read((char*)data.query[i], sizeof(float) * data.dim);
+	if (!query_path.empty()) {
+		std::string query_file = query_path;
+		std::ifstream query_in(query_file.c_str(), std::ios::binary);
+		while (!query_in) {
+			printf("Fail to find query file!\n");
+			exit(0);
+		}
+		data.numQuery = querysize;
+		if (!load_matrix(query_in, data.query, data.dim, data.numQuery)) {
+			printf("The query file holds fewer than %d queries!\n", querysize);
+			exit(0);
+		}
 	}
 
-
-
 	std::cout << "Load from new file: " << data_file << "\n";
 	std::cout << "N=    " << data.N << "\n";
-	std::cout << "dim=  " << data.dim << "\n\n";
+	std::cout << "dim=  " << data.dim << "\n";
+	std::cout << "nq=   " << data.numQuery << "\n\n";
 
 	in.close();
 }
@@ -88,10 +103,7 @@ bool comp(const Tuple& a, const Tuple& b)
 
 void Preprocess::ben_make()
 {
-	int MaxQueryNum = min(200, (int)data.N - 201);
-	benchmark.N = MaxQueryNum, benchmark.num = 100;
-
-	benchmark.N += 200;
+	benchmark.N = data.numQuery, benchmark.num = 100;
 
 	benchmark.indice = new int* [benchmark.N];
 	benchmark.dist = new float* [benchmark.N];
@@ -190,8 +202,9 @@ void Preprocess::ben_load()
 {
 	std::ifstream in(ben_file.c_str(), std::ios::binary);
 
-	benchmark.dist = new float* [100];
-	for (unsigned j = 0; j < 100; j++) {
+	benchmark.N = data.numQuery;
+	benchmark.dist = new float* [benchmark.N];
+	for (unsigned j = 0; j < benchmark.N; j++) {
 		benchmark.dist[j] = new float [50];
 		in.read((char*)benchmark.dist[j], sizeof(float) * 50);
 	}
@@ -268,8 +281,8 @@ void Preprocess::showDataset()
 
 Preprocess::~Preprocess()
 {
-	int MaxQueryNum = min(200, (int)data.N - 201);
-	clear_2d_array(data.query, data.N + MaxQueryNum);
+	_mm_free(data.val.base);
+	_mm_free(data.query.base);
 	//clear_2d_array(Dists, MaxQueryNum);
 	clear_2d_array(benchmark.indice, benchmark.N);
 	clear_2d_array(benchmark.dist, benchmark.N);
@@ -21,8 +21,9 @@ public:
 	float beta = 0.1f;
 	
 public:
-	Preprocess(const std::string& path, const std::string& ben_file_, const std::string& query_path, int datadim, int datasize);
-	void load_data(const std::string& data_path, const std::string& query_path, int datadim, int datasize);
+	// No query is loaded when query_path is empty, and no benchmark is made or loaded when ben_file_ is empty
+	Preprocess(const std::string& path, const std::string& ben_file_, const std::string& query_path, int datadim, int datasize, int querysize = 100);
+	void load_data(const std::string& data_path, const std::string& query_path, int datadim, int datasize, int querysize);
 	void ben_make();
 	void ben_save();
 	void ben_correct();
@@ -31,7 +31,7 @@ void graphSearch(float c, int k, Graph* myGraph, Preprocess& prep, float beta, s
 	if (!myGraph) return;
 
 	lsh::timer timer;
-	int Qnum = 100;
+	int Qnum = prep.data.numQuery;
 	Performance perform;
 
 	for (unsigned j = 0; j < Qnum; j++)
@@ -143,7 +143,7 @@ void zlshKnn(float c, int k, e2lsh& myLsh, Preprocess& prep, float beta, std::st
 
 	lsh::timer timer;
 	std::cout << std::endl << "RUNNING ZQUERY ..." << std::endl;
-	int Qnum = 100;
+	int Qnum = prep.data.numQuery;
 	lsh::progress_display pd(Qnum);
 	Performance perform;
 	for (unsigned j = 0; j < Qnum; j++)
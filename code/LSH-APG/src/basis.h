@@ -249,6 +249,7 @@ void setW(std::string& datatsetName, float& R_min);
 template <class T>
 void clear_2d_array(T** array, int n)
 {
+	if (!array) return;
 	for (int i = 0; i < n; ++i) {
 		delete[] array[i];
 	}
@@ -328,6 +329,32 @@ namespace threadPoollib
 			//delete[] mass; 
 		}
 	};
+
+	// Visited marks of the searches of fastGraph: a node is visited when its entry equals curV, so a
+	// search starts by incrementing curV instead of clearing the array
+	class VisitedArray {
+	public:
+		vl_type curV;
+		vl_type* mass;
+		unsigned int numelements;
+
+		VisitedArray(int numelements1) {
+			curV = -1;
+			numelements = numelements1;
+			mass = new vl_type[numelements];
+		}
+
+		void reset() {
+			curV++;
+			if (curV == 0) {
+				memset(mass, 0, sizeof(vl_type) * numelements);
+				curV++;
+			}
+		};
+
+		~VisitedArray() { delete[] mass; }
+	};
+
 	///////////////////////////////////////////////////////////
 	//
 	// Class for multi-threaded pool-management of VisitedLists
@@ -335,20 +362,21 @@ namespace threadPoollib
 	/////////////////////////////////////////////////////////
 
 
-	class VisitedListPool {
-		std::deque<VisitedList*> pool;
+	template <class List>
+	class BasicVisitedListPool {
+		std::deque<List*> pool;
 		std::mutex poolguard;
 		int numelements;
 
 	public:
-		VisitedListPool(int initmaxpools, int numelements1) {
+		BasicVisitedListPool(int initmaxpools, int numelements1) {
 			numelements = numelements1;
 			for (int i = 0; i < initmaxpools; i++)
-				pool.push_front(new VisitedList(numelements));
+				pool.push_front(new List(numelements));
 		}
 
-		VisitedList* getFreeVisitedList() {
-			VisitedList* rez;
+		List* getFreeVisitedList() {
+			List* rez;
 			{
 				std::unique_lock <std::mutex> lock(poolguard);
 				if (pool.size() > 0) {
@@ -356,24 +384,26 @@ namespace threadPoollib
 					pool.pop_front();
 				}
 				else {
-					rez = new VisitedList(numelements);
+					rez = new List(numelements);
 				}
 			}
 			rez->reset();
 			return rez;
 		};
 
-		void releaseVisitedList(VisitedList* vl) {
+		void releaseVisitedList(List* vl) {
 			std::unique_lock <std::mutex> lock(poolguard);
 			pool.push_front(vl);
 		};
 
-		~VisitedListPool() {
+		~BasicVisitedListPool() {
 			while (pool.size()) {
-				VisitedList* rez = pool.front();
+				List* rez = pool.front();
 				pool.pop_front();
 				delete rez;
 			}
 		};
 	};
+	typedef BasicVisitedListPool<VisitedList> VisitedListPool;
+	typedef BasicVisitedListPool<VisitedArray> VisitedArrayPool;
 }
\ No newline at end of file
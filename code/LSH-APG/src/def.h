@@ -1,7 +1,22 @@
 #pragma once
+#include <cstddef>
 
 #define USE_SQRDIST //use sqrDist to reduce the sqrt computation
 
+// Alignment of the data matrix and of each of its rows, in bytes
+#define DATA_ALIGNMENT 64
+
+// Points stored row by row in one aligned block. The rows are padded with zeros to a multiple of
+// DATA_ALIGNMENT bytes, so m[i] is aligned and is found by a multiplication rather than a pointer load.
+struct DataMatrix
+{
+	float* base = nullptr;
+	// Number of floats between two rows
+	size_t stride = 0;
+
+	inline float* operator[](size_t i) const { return base + i * stride; }
+};
+
 struct Data
 {
 	// Dimension of data
@@ -9,8 +24,11 @@ struct Data
 	// Number of data
 	unsigned N = 0;
 	// Data matrix
-	float** val = nullptr;
-	float** query=nullptr; // NO MORE THAN 200 POINTS
+	DataMatrix val;
+	// Number of queries
+	unsigned numQuery = 0;
+	// Query matrix, laid out as val
+	DataMatrix query;
 };
 
 struct Ben
@@ -152,14 +152,14 @@ public:
 	int step = 10;
 	int nnD = 0;
 	int lowDim = -1;
-	float** myData = nullptr;
+	DataMatrix myData;
 	std::string flagStates;
 	std::vector<Node2*> linkLists;
 
 	threadPoollib::VisitedListPool* visited_list_pool_ = nullptr;
 	std::vector<mp_mutex> link_list_locks_;
-	std::vector<mp_mutex> hash_locks_;
-	mp_mutex hash_lock;
+	//Only for construction: the points already in the graph, the others are skipped in the hash tables
+	std::vector<std::atomic<bool>> inGraph;
 	int ef = -1;
 	int first_id = 0;
 	uint64_t getKey(int u, int v);
@@ -175,6 +175,8 @@ public:
 	//int searchLSH(std::vector<zint>& keys, std::priority_queue<Res>& candTable, threadPoollib::vl_type* checkedArrs_local, threadPoollib::vl_type tag);
 	//int searchLSH(std::vector<zint>& keys, std::priority_queue<Res>& candTable);
 	void insertLSHRefine(int pId);
+	hashTable::iterator nextInGraph(const hashTable& table, hashTable::iterator pos);
+	bool prevInGraph(const hashTable& table, hashTable::iterator& pos);
 	//int searchInBuilding(int pId, int ep, Res* arr, int& size_res);
 	int searchInBuilding(int p, std::priority_queue<Res, std::vector<Res>, std::greater<Res>>& eps, Res* arr, int& size_res, std::unordered_set<int>& checkedArrs_local, threadPoollib::vl_type tag);
 	void chooseNN_simple(Res* arr, int& size_res);
@@ -296,17 +298,9 @@ divGraph::divGraph(Preprocess* prep, const std::string& path, double probQ):link
 
 	//Index
 	hashTables.resize(L);
-	zint key;
-	int pointId;
 	std::cout << "Loading hash..." << std::endl;
-	lsh::progress_display pd((size_t)N * L);
 	for (int i = 0; i != L; ++i) {
-		for (int j = 0; j < N; ++j) {
-			in.read((char*)&(key), sizeof(zint));
-			in.read((char*)&((pointId)), sizeof(int));
-			hashTables[i].insert({ key,pointId });
-			++pd;
-		}
+		hashTables[i].read(in, N);
 	}
 
 	/**********************************************************************/
@@ -335,7 +329,7 @@ divGraph::divGraph(Preprocess* prep, const std::string& path, double probQ):link
 	in.read((char*)&len, sizeof(int));
 	char* buf = new char[len];
 	in.read((char*)buf, sizeof(char) * len);
-	flagStates.assign(buf);
+	flagStates.assign(buf, len);
 	delete[] buf;
 
 	in.read((char*)&len, sizeof(int));
@@ -345,8 +339,7 @@ divGraph::divGraph(Preprocess* prep, const std::string& path, double probQ):link
 	linkLists.resize(N, nullptr);
 	std::cout << "Loading graph..." << std::endl;
 	linkListBase.resize((size_t)N * (size_t)maxT);
-	//std::swap(pd,lsh::progress_display(N));
-	pd.restart(N);
+	lsh::progress_display pd(N);
 	for (size_t i = 0; i < N; ++i) {
 		linkLists[i] = new Node2(i, (Res*)(&(linkListBase[i * (size_t)maxT])));
 		linkLists[i]->readFromFile(in);
@@ -356,17 +349,29 @@ divGraph::divGraph(Preprocess* prep, const std::string& path, double probQ):link
 
 	std::cout << "LOADING TIME: " << timer.elapsed() << "s." << std::endl << std::endl;
 
-	showInfo(prep);
+	//the graph recall needs the exact neighbors of the points
+	if (prep->benchmark.indice) showInfo(prep);
 }
 
-int  divGraph::searchLSH(int pId, std::vector<zint>& keys, std::priority_queue<Res>& candTable, std::unordered_set<int>& checkedArrs_local, threadPoollib::vl_type tag)
+// The tables hold all the points from the start of the construction: the entries of the points that are
+// not inserted yet are skipped, as if they were not in the tables.
+hashTable::iterator divGraph::nextInGraph(const hashTable& table, hashTable::iterator pos)
 {
-	read_lock lock_hr(hash_lock);
-	std::vector<read_lock> lock_hs;
-	for (int i = 0; i < L; ++i) {
-		lock_hs.push_back(read_lock(hash_locks_[i]));
+	while (pos != table.end() && !inGraph[pos->id].load(std::memory_order_acquire)) ++pos;
+	return pos;
+}
+
+bool divGraph::prevInGraph(const hashTable& table, hashTable::iterator& pos)
+{
+	while (pos != table.begin()) {
+		--pos;
+		if (inGraph[pos->id].load(std::memory_order_acquire)) return true;
 	}
+	return false;
+}
 
+int  divGraph::searchLSH(int pId, std::vector<zint>& keys, std::priority_queue<Res>& candTable, std::unordered_set<int>& checkedArrs_local, threadPoollib::vl_type tag)
+{
 	Res res_pair;
 
 	int lshUB = N / 200;
@@ -374,20 +379,19 @@ int  divGraph::searchLSH(int pId, std::vector<zint>& keys, std::priority_queue<R
 	int step = 2;
 
 	std::vector<int> numAccess(L);
-	std::vector<std::multimap<zint, int>::iterator> lpos(L), rpos(L), qpos(L);
+	std::vector<hashTable::iterator> lpos(L), rpos(L), qpos(L);
 
 	std::priority_queue<posInfo> lEntries, rEntries;
 
 
 	for (int j = 0; j < L; j++) {
-		qpos[j] = hashTables[j].lower_bound(keys[j]);
-		if (qpos[j] != hashTables[j].begin()) {
-			lpos[j] = qpos[j];
-			--lpos[j];
+		qpos[j] = nextInGraph(hashTables[j], hashTables[j].lower_bound(keys[j]));
+		lpos[j] = qpos[j];
+		if (prevInGraph(hashTables[j], lpos[j])) {
 #ifdef USE_LCCP
-			lEntries.push(posInfo(j, getLLCP(lpos[j]->first, keys[j])));
+			lEntries.push(posInfo(j, getLLCP(lpos[j]->val, keys[j])));
 #else
-			lEntries.push(posInfo(j, getLevel(lpos[j]->first, qpos[j]->first)));
+			lEntries.push(posInfo(j, getLevel(lpos[j]->val, qpos[j]->val)));
 #endif // USE_LCCP
 
 		}
@@ -395,9 +399,9 @@ int  divGraph::searchLSH(int pId, std::vector<zint>& keys, std::priority_queue<R
 		rpos[j] = qpos[j];
 		if (rpos[j] != hashTables[j].end()) {
 #ifdef USE_LCCP
-			rEntries.push(posInfo(j, getLLCP(rpos[j]->first, keys[j])));
+			rEntries.push(posInfo(j, getLLCP(rpos[j]->val, keys[j])));
 #else
-			rEntries.push(posInfo(j, getLevel(rpos[j]->first, qpos[j]->first)));
+			rEntries.push(posInfo(j, getLevel(rpos[j]->val, qpos[j]->val)));
 #endif // USE_LCCP
 		}
 	}
@@ -412,28 +416,23 @@ int  divGraph::searchLSH(int pId, std::vector<zint>& keys, std::priority_queue<R
 		if (f) {
 			t = lEntries.top();
 			lEntries.pop();
-			for (int i = 0; i < step; ++i) {
+			bool more = true;
+			for (int i = 0; i < step && more; ++i) {
 				++numAccess[t.id];
-				res_pair.id = lpos[t.id]->second;
+				res_pair.id = lpos[t.id]->id;
 				if (checkedArrs_local.find(res_pair.id)==checkedArrs_local.end()) {
 					res_pair.dist = cal_dist(myData[pId], myData[res_pair.id], dim);
 					candTable.push(res_pair);
 					//checkedArrs_local[res_pair.id] = tag;
 					checkedArrs_local.emplace(res_pair.id);
 				}
-
-				if (lpos[t.id] != hashTables[t.id].begin()) {
-					--lpos[t.id];
-				}
-				else {
-					break;
-				}
+				more = prevInGraph(hashTables[t.id], lpos[t.id]);
 			}
-			if (lpos[t.id] != hashTables[t.id].begin()) {
+			if (more) {
 #ifdef USE_LCCP
-				t.dist = getLLCP(lpos[t.id]->first, keys[t.id]);
+				t.dist = getLLCP(lpos[t.id]->val, keys[t.id]);
 #else
-				t.dist = getLevel(lpos[t.id]->first, qpos[t.id]->first);
+				t.dist = getLevel(lpos[t.id]->val, qpos[t.id]->val);
 #endif // USE_LCCP
 				lEntries.push(t);
 			}
@@ -442,25 +441,25 @@ int  divGraph::searchLSH(int pId, std::vector<zint>& keys, std::priority_queue<R
 		else {
 			t = rEntries.top();
 			rEntries.pop();
-			//read_lock lock_h(hash_locks_[t.id]);
 			for (int i = 0; i < step; ++i) {
 				++numAccess[t.id];
-				res_pair.id = rpos[t.id]->second;
+				res_pair.id = rpos[t.id]->id;
 				if (checkedArrs_local.find(res_pair.id)==checkedArrs_local.end()) {
 					res_pair.dist = cal_dist(myData[pId], myData[res_pair.id], dim);
 					candTable.push(res_pair);
 					//checkedArrs_local[res_pair.id] = tag;
 					checkedArrs_local.emplace(res_pair.id);
 				}
-				if (++rpos[t.id] == hashTables[t.id].end()) {
+				rpos[t.id] = nextInGraph(hashTables[t.id], rpos[t.id] + 1);
+				if (rpos[t.id] == hashTables[t.id].end()) {
 					break;
 				}
 			}
 			if (rpos[t.id] != hashTables[t.id].end()) {
 #ifdef USE_LCCP
-				t.dist = getLLCP(rpos[t.id]->first, keys[t.id]);
+				t.dist = getLLCP(rpos[t.id]->val, keys[t.id]);
 #else
-				t.dist = getLevel(rpos[t.id]->first, qpos[t.id]->first);
+				t.dist = getLevel(rpos[t.id]->val, qpos[t.id]->val);
 #endif // USE_LCCP
 				rEntries.push(t);
 			}
@@ -522,10 +521,7 @@ void divGraph::insertLSHRefine(int pId)
 		chooseNN(linkLists[qId]->neighbors, linkLists[qId]->out, Res(pId, dist));
 	}
 
-	for (int j = 0; j < L; j++) {
-		write_lock lock_h(hash_locks_[j]);
-		hashTables[j].insert({ keys[j],pId });
-	}
+	inGraph[pId].store(true, std::memory_order_release);
 }
 
 int divGraph::searchInBuilding(int p, std::priority_queue<Res, std::vector<Res>, std::greater<Res>>& eps, Res* arr, int& size_res,
@@ -776,8 +772,8 @@ void divGraph::oneByOneInsert()
 
 	flagStates.resize(N, 'E');
 
-	hashTables.resize(L);
-	std::vector<mp_mutex>(L).swap(hash_locks_);
+	buildTables();
+	std::vector<std::atomic<bool>>(N).swap(inGraph);
 
 	int* idx = new int[N];
 	for (int j = 0; j < N; ++j) {
@@ -808,6 +804,7 @@ void divGraph::oneByOneInsert()
 //	}
 
 	//refine();
+	std::vector<std::atomic<bool>>().swap(inGraph);
 }
 
 void divGraph::refine()
@@ -924,7 +921,7 @@ void divGraph::knn(queryN* q)
 	int cal_num = 0;
 	lsh::timer timer;
 	timer.restart();
-	q->hashval = calHash(q->queryPoint);
+	calHash(q);
 
 	std::string flag_(N, 'U');
 	std::vector<float> visitedDists(N);
@@ -938,7 +935,7 @@ void divGraph::knn(queryN* q)
 	int step = 1;
 	if(_lsh_UB>0) lshUB=_lsh_UB;
 	std::vector<int> numAccess(L);
-	std::vector<std::multimap<zint, int>::iterator> lpos(L), rpos(L), qpos(L);
+	std::vector<hashTable::iterator> lpos(L), rpos(L), qpos(L);
 	std::priority_queue<posInfo> lEntries, rEntries;
 	std::vector<zint> keys(L);
 	for (int j = 0; j < L; j++) {
@@ -948,9 +945,9 @@ void divGraph::knn(queryN* q)
 			lpos[j] = qpos[j];
 			--lpos[j];
 #ifdef USE_LCCP
-			lEntries.push(posInfo(j, getLLCP(lpos[j]->first, keys[j])));
+			lEntries.push(posInfo(j, getLLCP(lpos[j]->val, keys[j])));
 #else
-			lEntries.push(posInfo(j, getLevel(lpos[j]->first, qpos[j]->first)));
+			lEntries.push(posInfo(j, getLevel(lpos[j]->val, qpos[j]->val)));
 #endif // USE_LCCP
 
 		}
@@ -958,9 +955,9 @@ void divGraph::knn(queryN* q)
 		rpos[j] = qpos[j];
 		if (rpos[j] != hashTables[j].end()) {
 #ifdef USE_LCCP
-			rEntries.push(posInfo(j, getLLCP(rpos[j]->first, keys[j])));
+			rEntries.push(posInfo(j, getLLCP(rpos[j]->val, keys[j])));
 #else
-			rEntries.push(posInfo(j, getLevel(rpos[j]->first, qpos[j]->first)));
+			rEntries.push(posInfo(j, getLevel(rpos[j]->val, qpos[j]->val)));
 #endif // USE_LCCP
 		}
 	}
@@ -977,7 +974,7 @@ void divGraph::knn(queryN* q)
 			lEntries.pop();
 			for (int i = 0; i < step; ++i) {
 				++numAccess[t.id];
-				res_pair.id = lpos[t.id]->second;
+				res_pair.id = lpos[t.id]->id;
 				if (flag_[res_pair.id] == 'U') {
 					res_pair.dist = cal_dist(q->queryPoint, q->myData[res_pair.id], dim);
 					cal_num++;
@@ -995,9 +992,9 @@ void divGraph::knn(queryN* q)
 
 			if (lpos[t.id] != hashTables[t.id].begin()) {
 #ifdef USE_LCCP
-				t.dist = getLLCP(lpos[t.id]->first, keys[t.id]);
+				t.dist = getLLCP(lpos[t.id]->val, keys[t.id]);
 #else
-				t.dist = getLevel(lpos[t.id]->first, qpos[t.id]->first);
+				t.dist = getLevel(lpos[t.id]->val, qpos[t.id]->val);
 #endif // USE_LCCP
 				lEntries.push(t);
 			}
@@ -1007,7 +1004,7 @@ void divGraph::knn(queryN* q)
 			rEntries.pop();
 			for (int i = 0; i < step; ++i) {
 				++numAccess[t.id];
-				res_pair.id = rpos[t.id]->second;
+				res_pair.id = rpos[t.id]->id;
 				if (flag_[res_pair.id] == 'U')
 				{
 					res_pair.dist = cal_dist(q->queryPoint, q->myData[res_pair.id], dim);
@@ -1021,9 +1018,9 @@ void divGraph::knn(queryN* q)
 			}
 			if (rpos[t.id] != hashTables[t.id].end()) {
 #ifdef USE_LCCP
-				t.dist = getLLCP(rpos[t.id]->first, keys[t.id]);
+				t.dist = getLLCP(rpos[t.id]->val, keys[t.id]);
 #else
-				t.dist = getLevel(rpos[t.id]->first, qpos[t.id]->first);
+				t.dist = getLevel(rpos[t.id]->val, qpos[t.id]->val);
 #endif // USE_LCCP
 				rEntries.push(t);
 			}
@@ -1065,7 +1062,7 @@ void divGraph::knnHNSW(queryN* q)
 {
 	std::cout << "!!!!!!!!!!!!!!!!!!!!!!!" << std::endl;
 	lsh::timer timer;
-	q->hashval = calHash(q->queryPoint);
+	calHash(q);
 #ifdef USE_SSE
 	_mm_prefetch((char*)(q->queryPoint), _MM_HINT_T0);
 #endif
@@ -1187,7 +1184,7 @@ void divGraph::showInfo(Preprocess* prep)
 	}
 
 	float ratio = 0.0f;
-	for (int u = 0; u < prep->benchmark.N - 200; ++u) {
+	for (int u = 0; u + 200 < (int)prep->benchmark.N; ++u) {
 		std::set<unsigned> set1, set2;
 		std::vector<unsigned> set_intersection;
 		set_intersection.clear();
@@ -1365,10 +1362,7 @@ void divGraph::save(const std::string & file)
 	for (int i = 0; i < L; ++i) {
 		if (hashTables[i].size() != N)
 			throw std::runtime_error("Size error in hashTables!\n");
-		for (auto iter = hashTables[i].begin(); iter != hashTables[i].end(); ++iter) {
-			out.write((char*)&(iter->first), sizeof(zint));
-			out.write((char*)&((iter->second)), sizeof(int));
-		}
+		hashTables[i].write(out);
 	}
 
 	/*****************************graph************************/
@@ -81,10 +81,26 @@ void hashBase::setHash()
 float* hashBase::calHash(float* point)
 {
 	float* res = new float[S];
+	calHash(point, res);
+	return res;
+}
+
+void hashBase::calHash(float* point, float* res)
+{
 	for (int i = 0; i < S; i++) {
 		res[i] = (cal_inner_product(point, hashPar.rndAs[i], dim) + hashPar.rndBs[i]) / W;
 	}
-	return res;
+}
+
+void hashBase::calHash(queryN* q)
+{
+	if (q->ownsHashval) {
+		delete[] q->hashval;
+		q->hashval = calHash(q->queryPoint);
+	}
+	else {
+		calHash(q->queryPoint, q->hashval);
+	}
 }
 
 void hashBase::getHash(Preprocess& prep)
@@ -152,7 +168,7 @@ void e2lsh::knn(queryN* q)
 	lsh::timer timer;
 
 	timer.restart();
-	q->hashval = calHash(q->queryPoint);
+	calHash(q);
 	q->timeHash = timer.elapsed();
 
 	timer.restart();
@@ -342,14 +358,8 @@ zlsh::zlsh(const std::string& file)
 
 	//Index
 	hashTables.resize(L);
-	zint key;
-	int pointId;
 	for (int i = 0; i != L; ++i) {
-		for (int j = 0; j < N; ++j) {
-			in.read((char*)&(key), sizeof(zint));
-			in.read((char*)&((pointId)), sizeof(int));
-			hashTables[i].insert({ key,pointId });
-		}
+		hashTables[i].read(in, N);
 	}
 	in.close();
 
@@ -443,15 +453,116 @@ void zlsh::normalizeHash()
 void zlsh::getIndexes()
 {
 	normalizeHash();
+	buildTables();
+}
 
+void zlsh::buildTables()
+{
 	hashTables.resize(L);
+	std::vector<hashPair> pairs(N);
 	for (int j = 0; j < L; j++)
 	{
+#pragma omp parallel for
 		for (int i = 0; i < N; i++)
 		{
-			zint key = getZ(hashval[i] + j * K);
-			hashTables[j].insert({ key,i });
+			pairs[i] = hashPair(getZ(hashval[i] + j * K), i);
+		}
+		hashTables[j].build(pairs);
+		pairs.resize(N);
+	}
+}
+
+#define RADIX_BITS 8
+#define RADIX_SLICES 64
+
+// LSD radix sort on the keys, RADIX_BITS per pass. The array is cut in slices that count their digits and
+// scatter them in parallel; a slice writes at the offsets following those of the previous slices, so the
+// sort is stable. The passes where every key has the same digit (the high bits of short keys) are skipped.
+void hashTable::build(std::vector<hashPair>& pairs_)
+{
+	const size_t buckets = (size_t)1 << RADIX_BITS;
+	size_t n = pairs_.size();
+	int slices = (int)std::min<size_t>(RADIX_SLICES, n / 4096 + 1);
+	std::vector<hashPair> buf(n);
+	std::vector<size_t> offsets(slices * buckets);
+	for (int shift = 0; shift < _ZINT_LEN; shift += RADIX_BITS) {
+		std::fill(offsets.begin(), offsets.end(), 0);
+#pragma omp parallel for
+		for (int s = 0; s < slices; ++s) {
+			size_t* count = &offsets[s * buckets];
+			for (size_t i = n * s / slices; i < n * (s + 1) / slices; ++i) {
+				++count[(pairs_[i].val >> shift) & (buckets - 1)];
+			}
+		}
+
+		bool sorted = false;
+		size_t sum = 0;
+		for (size_t d = 0; d < buckets; ++d) {
+			size_t start = sum;
+			for (int s = 0; s < slices; ++s) {
+				size_t c = offsets[s * buckets + d];
+				offsets[s * buckets + d] = sum;
+				sum += c;
+			}
+			if (sum - start == n) sorted = true;
+		}
+		if (sorted) continue;
+
+#pragma omp parallel for
+		for (int s = 0; s < slices; ++s) {
+			size_t* offset = &offsets[s * buckets];
+			for (size_t i = n * s / slices; i < n * (s + 1) / slices; ++i) {
+				buf[offset[(pairs_[i].val >> shift) & (buckets - 1)]++] = pairs_[i];
+			}
 		}
+		pairs_.swap(buf);
+	}
+	pairs.swap(pairs_);
+	pairs_.clear();
+}
+
+// Branch-free binary search: the loop always runs log(n) times and the comparison only selects the next base
+hashTable::iterator hashTable::lower_bound(zint key) const
+{
+	iterator base = pairs.data();
+	size_t n = pairs.size();
+	if (n == 0) return base;
+	while (n > 1) {
+		size_t half = n / 2;
+		base = (base[half - 1].val < key) ? base + half : base;
+		n -= half;
+	}
+	return base + (base->val < key);
+}
+
+std::pair<hashTable::iterator, hashTable::iterator> hashTable::equal_range(zint key) const
+{
+	iterator first = lower_bound(key);
+	iterator last = first;
+	while (last != end() && last->val == key) ++last;
+	return std::make_pair(first, last);
+}
+
+void hashTable::write(std::ofstream& out) const
+{
+	const size_t record = sizeof(zint) + sizeof(int);
+	std::vector<char> buf(pairs.size() * record);
+	for (size_t i = 0; i < pairs.size(); ++i) {
+		memcpy(&buf[i * record], &pairs[i].val, sizeof(zint));
+		memcpy(&buf[i * record + sizeof(zint)], &pairs[i].id, sizeof(int));
+	}
+	out.write(buf.data(), buf.size());
+}
+
+void hashTable::read(std::ifstream& in, size_t n)
+{
+	const size_t record = sizeof(zint) + sizeof(int);
+	std::vector<char> buf(n * record);
+	in.read(buf.data(), buf.size());
+	pairs.resize(n);
+	for (size_t i = 0; i < n; ++i) {
+		memcpy(&pairs[i].val, &buf[i * record], sizeof(zint));
+		memcpy(&pairs[i].id, &buf[i * record + sizeof(zint)], sizeof(int));
 	}
 }
 
@@ -505,10 +616,7 @@ void zlsh::save(const std::string& file)
 	}
 
 	for (int i = 0; i != L; ++i) {
-		for (auto iter = hashTables[i].begin(); iter != hashTables[i].end(); ++iter) {
-			out.write((char*)&(iter->first), sizeof(zint));
-			out.write((char*)&((iter->second)), sizeof(int));
-		}
+		hashTables[i].write(out);
 	}
 	out.close();
 }
@@ -536,7 +644,7 @@ void zlsh::knn(queryN* q)
 	lsh::timer timer;
 
 	timer.restart();
-	q->hashval = calHash(q->queryPoint);
+	calHash(q);
 	q->timeHash = timer.elapsed();
 
 	timer.restart();
@@ -562,12 +670,12 @@ void zlsh::knn(queryN* q)
 		auto pr = hashTables[j].equal_range(key); // pair of begin & end iterators returned
 		while (pr.first != pr.second)
 		{
-			if (flag_[pr.first->second] == false)
+			if (flag_[pr.first->id] == false)
 			{
-				res_pair.id = pr.first->second;
+				res_pair.id = pr.first->id;
 				res_pair.dist = cal_dist(q->queryPoint, q->myData[res_pair.id], dim);
 				candidate.push_back(res_pair);
-				flag_[pr.first->second] = true;
+				flag_[pr.first->id] = true;
 				
 			}
 			++pr.first; // Increment begin iterator
@@ -594,7 +702,7 @@ void zlsh::knnBestFirst(queryN* q)
 	lsh::timer timer;
 
 	timer.restart();
-	q->hashval = calHash(q->queryPoint);
+	calHash(q);
 	q->timeHash = timer.elapsed();
 
 	timer.restart();
@@ -611,7 +719,7 @@ void zlsh::knnBestFirst(queryN* q)
 
 	std::vector<int> numAccess(L);
 
-	std::vector<std::multimap<zint, int>::iterator> lpos(L), rpos(L), qpos(L);
+	std::vector<hashTable::iterator> lpos(L), rpos(L), qpos(L);
 	std::priority_queue<posInfo> lEntries, rEntries;
 	for (int j = 0; j < L; j++)
 	{
@@ -621,9 +729,9 @@ void zlsh::knnBestFirst(queryN* q)
 			lpos[j] = qpos[j];
 			--lpos[j];
 #ifdef USE_LCCP
-			lEntries.push(posInfo(j, getLLCP(lpos[j]->first, qpos[j]->first)));
+			lEntries.push(posInfo(j, getLLCP(lpos[j]->val, qpos[j]->val)));
 #else
-			lEntries.push(posInfo(j, getLevel(lpos[j]->first, qpos[j]->first)));
+			lEntries.push(posInfo(j, getLevel(lpos[j]->val, qpos[j]->val)));
 #endif // USE_LCCP
 			
 		}
@@ -631,9 +739,9 @@ void zlsh::knnBestFirst(queryN* q)
 		rpos[j] = qpos[j];
 		if (rpos[j] != hashTables[j].end()) {
 #ifdef USE_LCCP
-			rEntries.push(posInfo(j, getLLCP(rpos[j]->first, qpos[j]->first)));
+			rEntries.push(posInfo(j, getLLCP(rpos[j]->val, qpos[j]->val)));
 #else
-			rEntries.push(posInfo(j, getLevel(rpos[j]->first, qpos[j]->first)));
+			rEntries.push(posInfo(j, getLevel(rpos[j]->val, qpos[j]->val)));
 #endif // USE_LCCP
 		}
 	}
@@ -650,7 +758,7 @@ void zlsh::knnBestFirst(queryN* q)
 			lEntries.pop();
 			for (int i = 0; i < step; ++i) {
 				++numAccess[t.id];
-				res_pair.id = lpos[t.id]->second;
+				res_pair.id = lpos[t.id]->id;
 				if (flag_[res_pair.id] == false)
 				{
 					res_pair.dist = cal_dist(q->queryPoint, q->myData[res_pair.id], dim);
@@ -668,9 +776,9 @@ void zlsh::knnBestFirst(queryN* q)
 			
 			if (lpos[t.id] != hashTables[t.id].begin()) {
 #ifdef USE_LCCP
-				t.dist = getLLCP(lpos[t.id]->first, qpos[t.id]->first);
+				t.dist = getLLCP(lpos[t.id]->val, qpos[t.id]->val);
 #else
-				t.dist = getLevel(lpos[t.id]->first, qpos[t.id]->first);
+				t.dist = getLevel(lpos[t.id]->val, qpos[t.id]->val);
 #endif // USE_LCCP
 				lEntries.push(t);
 			}
@@ -680,7 +788,7 @@ void zlsh::knnBestFirst(queryN* q)
 			rEntries.pop();
 			for (int i = 0; i < step; ++i) {
 				++numAccess[t.id];
-				res_pair.id = rpos[t.id]->second;
+				res_pair.id = rpos[t.id]->id;
 				if (flag_[res_pair.id] == false)
 				{
 					res_pair.dist = cal_dist(q->queryPoint, q->myData[res_pair.id], dim);
@@ -693,9 +801,9 @@ void zlsh::knnBestFirst(queryN* q)
 			}
 			if (rpos[t.id] != hashTables[t.id].end()) {
 #ifdef USE_LCCP
-				t.dist = getLLCP(rpos[t.id]->first, qpos[t.id]->first);
+				t.dist = getLLCP(rpos[t.id]->val, qpos[t.id]->val);
 #else
-				t.dist = getLevel(rpos[t.id]->first, qpos[t.id]->first);
+				t.dist = getLevel(rpos[t.id]->val, qpos[t.id]->val);
 #endif // USE_LCCP
 				rEntries.push(t);
 			}
@@ -717,8 +825,12 @@ void zlsh::knnBestFirst(queryN* q)
 	q->costs = numAccess;
 }
 
-queryN::queryN(unsigned id, float c_, unsigned k_, Preprocess& prep, float beta_)
+queryN::queryN(unsigned id, float c_, unsigned k_, Preprocess& prep, float beta_, float* hashBuffer)
 {
+	if (hashBuffer) {
+		hashval = hashBuffer;
+		ownsHashval = false;
+	}
 	flag = id;
 	c = c_;
 	k = k_;
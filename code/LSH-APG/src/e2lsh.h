@@ -9,6 +9,7 @@
 #include <queue>
 #include <map>
 #include <unordered_set>
+#include <fstream>
 #include "GenericTool.h"
 //
 // One of these three settings should be set externally (by the compiler).
@@ -30,7 +31,9 @@ public:
 
 	float* queryPoint = NULL;
 	float* hashval = NULL;
-	float** myData = NULL;
+	// False when hashval is a buffer of the caller, reused across queries
+	bool ownsHashval = true;
+	DataMatrix myData;
 	int dim = 1;
 
 	int UB = 0;
@@ -68,11 +71,11 @@ public:
 	std::vector<Res> res;
 
 public:
-	queryN(unsigned id, float c_, unsigned k_, Preprocess& prep, float beta);
+	queryN(unsigned id, float c_, unsigned k_, Preprocess& prep, float beta, float* hashBuffer = NULL);
 
 	//void search();
 
-	~queryN() { delete hashval; }
+	~queryN() { if (ownsHashval) delete[] hashval; }
 };
 
 class hashBase
@@ -97,6 +100,10 @@ public:
 	hashBase(hashBase* hash_);
 	void setHash();
 	float* calHash(float* point);
+	// Writes the S hash values of point to res
+	void calHash(float* point, float* res);
+	// Sets q->hashval, in the buffer of the caller if q has one
+	void calHash(queryN* q);
 	void getHash(Preprocess& prep);
 	virtual void getIndexes() = 0;
 	//bool isBuilt(const std::string& file);
@@ -125,6 +132,38 @@ public:
 using zint = uint64_t;
 const int _ZINT_LEN = sizeof(zint) * 8;
 
+struct hashPair
+{
+	zint val;
+	int id;
+	hashPair() = default;
+	hashPair(zint v_, int id_) :val(v_), id(id_) {}
+	bool operator < (const hashPair& rhs) const {
+		return val < rhs.val;
+	}
+};
+
+// One LSH table: the (key, id) pairs of all the points sorted by key in a single array.
+// It is built at once and never modified, so it can be read by several threads without locks.
+class hashTable
+{
+private:
+	std::vector<hashPair> pairs;
+public:
+	using iterator = const hashPair*;
+	iterator begin() const { return pairs.data(); }
+	iterator end() const { return pairs.data() + pairs.size(); }
+	size_t size() const { return pairs.size(); }
+	// Sorts pairs_ by key (equal keys keep their order) and takes them
+	void build(std::vector<hashPair>& pairs_);
+	// First pair whose key is not less than key
+	iterator lower_bound(zint key) const;
+	std::pair<iterator, iterator> equal_range(zint key) const;
+	// The pairs are stored as in the former index files: key (8 bytes) then id (4 bytes)
+	void write(std::ofstream& out) const;
+	void read(std::ifstream& in, size_t n);
+};
+
 
 
 //
@@ -153,13 +192,14 @@ private:
 	
 public:
 	int u = 0;//u bits per hash value
-	// Index structure: RB-Tree
+	// Index structure: one sorted array per table
 
 public:
 	zint getZ(float* _h);
 	zint getZ(int* _h);
 	void normalizeHash();
-	std::vector< std::multimap<zint, int> > hashTables;
+	std::vector<hashTable> hashTables;
+	void buildTables();
 public:
 	zlsh() = default;
 	zlsh(Preprocess& prep_, Parameter& param_, const std::string& file, bool notInheritance = false);
@@ -16,17 +16,6 @@ extern int _lsh_UB;
  	}
  };
 
- struct hashPair
- {
-     zint val;
-     int id;
-     hashPair() = default;
-     hashPair(zint v_, int id_) :val(v_), id(id_) {}
-     bool operator < (const hashPair& rhs) const {
-         return val < rhs.val;
-     }
- };
-
 struct fastGraph
  {
  	std::string file;
@@ -35,13 +24,14 @@ struct fastGraph
  	size_t dim = 0;
  	size_t maxT = 0;
  	size_t size_data_per_element_;
- 	float** dataset = nullptr;
+ 	DataMatrix dataset;
     float** hashval = nullptr;
-    hashPair** hashTables = nullptr;
+    const hashTable* hashTables = nullptr;//shared with divG
     divGraph* myhash = nullptr;//for computing q's hash values 
  	//size_t max_elements_;
  	const size_t sint = sizeof(int);
- 	threadPoollib::VisitedListPool* visited_list_pool_ = nullptr;
+ 	//one visited array per concurrent query
+ 	threadPoollib::VisitedArrayPool* visited_list_pool_ = nullptr;
  public:
  	int ef = 0;
  	int T = 0;
@@ -61,7 +51,7 @@ struct fastGraph
  		size_data_per_element_ = (size_t)(maxT + 1) * sint;
  		dataset = divG->myData;
  		dim = divG->dim;
- 		visited_list_pool_ = new VisitedListPool(1, N);
+ 		visited_list_pool_ = new VisitedArrayPool(1, N);
  		loadLite(divG);
  	}
 
@@ -83,16 +73,7 @@ struct fastGraph
         myhash = divG;
         hashval = divG->hashval;
         u = myhash->u;
-        hashTables = new hashPair * [L];
-        for (int i = 0; i < L; ++i) {
-            hashTables[i] = new hashPair[N];
-            int cnt = 0;
-            auto pt = divG->hashTables[i].begin();
-            while (pt != divG->hashTables[i].end()) {
-                hashTables[i][cnt++] = hashPair(pt->first, pt->second);
-                pt++;
-            }
-        }
+        hashTables = divG->hashTables.data();
  	}
 
  	void knnHNSW1(queryN* q){
@@ -110,8 +91,8 @@ struct fastGraph
  		int ep_id = 0;
  		dist_t curdist = cal_dist(q->queryPoint, dataset[ep_id], dim);
  		q->cost++;
- 		VisitedList* vl = visited_list_pool_->getFreeVisitedList();
- 		auto visited_array = vl->mass;
+ 		VisitedArray* vl = visited_list_pool_->getFreeVisitedList();
+ 		vl_type* visited_array = vl->mass;
  		vl_type visited_array_tag = vl->curV;
 
  		std::priority_queue<std::pair<dist_t, tableint>> top_candidates;
@@ -125,8 +106,7 @@ struct fastGraph
  		top_candidates.emplace(dist, ep_id);
  		candidate_set.emplace(-dist, ep_id);
 
- 		//visited_array[ep_id] = visited_array_tag;
-        visited_array.emplace(ep_id);
+ 		visited_array[ep_id] = visited_array_tag;
 
  		while (!candidate_set.empty()) {
 
@@ -157,10 +137,9 @@ struct fastGraph
  				//_mm_prefetch((char*)(visited_array + *(data + j + 1)), _MM_HINT_T0);
  				//_mm_prefetch((char*)(dataset[*(data + j + 1)]), _MM_HINT_T0);
  #endif
- 				if ((visited_array.find(candidate_id) == visited_array.end())) {
+ 				if (visited_array[candidate_id] != visited_array_tag) {
 
- 					//visited_array[candidate_id] = visited_array_tag;
-                    visited_array.emplace(candidate_id);
+ 					visited_array[candidate_id] = visited_array_tag;
 
  					float* currObj1 = dataset[*(data + j)];
  					dist_t dist = cal_dist(q->queryPoint, currObj1, dim);
@@ -236,9 +215,9 @@ struct fastGraph
 
     }
 
-    void searchLSHQuery(queryN * q, std::priority_queue<Res>& candTable, std::vector<bool>& flag_)
+    void searchLSHQuery(queryN * q, std::priority_queue<Res>& candTable, vl_type* visited_array, vl_type visited_array_tag)
     {
-        q->hashval = myhash->calHash(q->queryPoint);
+        myhash->calHash(q);
         //std::vector<bool> flag_(N, false);
         //std::vector<float> visitedDists(N);
         
@@ -251,14 +230,13 @@ struct fastGraph
         int step = 1;
         if(_lsh_UB>0) lshUB=_lsh_UB;
         //std::vector<int> numAccess(L);
-        std::vector<hashPair*> lpos(L), rpos(L), qpos(L);
+        std::vector<hashTable::iterator> lpos(L), rpos(L), qpos(L);
         std::priority_queue<posInfo> lEntries, rEntries;
         std::vector<zint> keys(L);
         for (int j = 0; j < L; j++) {
             keys[j] = getZ(q->hashval + j * K);
-            qpos[j] = std::lower_bound(hashTables[j], hashTables[j] + N, hashPair(keys[j], -1));
-            //qpos[j] = hashTables[j].lower_bound(keys[j]);
-            if (qpos[j] != hashTables[j]) {
+            qpos[j] = hashTables[j].lower_bound(keys[j]);
+            if (qpos[j] != hashTables[j].begin()) {
                 lpos[j] = qpos[j];
                 --lpos[j];
 #ifdef USE_LCCP
@@ -270,7 +248,7 @@ struct fastGraph
             }
             //
             rpos[j] = qpos[j];
-            if (rpos[j] != hashTables[j]+N) {
+            if (rpos[j] != hashTables[j].end()) {
 #ifdef USE_LCCP
                 rEntries.emplace(j, getLLCP(rpos[j]->val, keys[j]));
 #else
@@ -293,13 +271,13 @@ struct fastGraph
                     //++numAccess[t.id];
                     //res_pair.id = lpos[t.id]->second;
                     int rid = lpos[t.id]->id;
-                    if (!flag_[rid]) {
+                    if (visited_array[rid] != visited_array_tag) {
                         //res_pair.dist = cal_dist(q->queryPoint, q->myData[res_pair.id], dim);
                         //visitedDists[res_pair.id] = res_pair.dist;
                         candTable.emplace(rid, cal_dist(q->queryPoint, q->myData[rid], dim));
-                        flag_[rid] = true;
+                        visited_array[rid] = visited_array_tag;
                     }
-                    if (lpos[t.id] != hashTables[t.id]) {
+                    if (lpos[t.id] != hashTables[t.id].begin()) {
                         --lpos[t.id];
                     }
                     else {
@@ -307,7 +285,7 @@ struct fastGraph
                     }
                 }
 
-                if (lpos[t.id] != hashTables[t.id]) {
+                if (lpos[t.id] != hashTables[t.id].begin()) {
 #ifdef USE_LCCP
                     t.dist = getLLCP(lpos[t.id]->val, keys[t.id]);
 #else
@@ -323,13 +301,13 @@ struct fastGraph
                     //++numAccess[t.id];
 
                     int rid = rpos[t.id]->id;
-                    if (!flag_[rid]) {
+                    if (visited_array[rid] != visited_array_tag) {
                         //res_pair.dist = cal_dist(q->queryPoint, q->myData[res_pair.id], dim);
                         //visitedDists[res_pair.id] = res_pair.dist;
                         candTable.emplace(rid, cal_dist(q->queryPoint, q->myData[rid], dim));
-                        flag_[rid] = true;
+                        visited_array[rid] = visited_array_tag;
                     }
-                    if (++rpos[t.id] == hashTables[t.id] + N) {
+                    if (++rpos[t.id] == hashTables[t.id].end()) {
                         break;
                     }
 
@@ -345,7 +323,7 @@ struct fastGraph
                     //    break;
                     //}
                 }
-                if (rpos[t.id] != hashTables[t.id]+N) {
+                if (rpos[t.id] != hashTables[t.id].end()) {
 #ifdef USE_LCCP
                     t.dist = getLLCP(rpos[t.id]->val, keys[t.id]);
 #else
@@ -370,10 +348,12 @@ struct fastGraph
         
         //entryHeap pqEntries;
         std::priority_queue<Res> candTable;
-        std::vector<bool> flag_(N, false);
+        VisitedArray* vl = visited_list_pool_->getFreeVisitedList();
+        vl_type* visited_array = vl->mass;
+        vl_type visited_array_tag = vl->curV;
 
         timer.restart();
-        searchLSHQuery(q, candTable,flag_);
+        searchLSHQuery(q, candTable, visited_array, visited_array_tag);
         q->timeHash = timer.elapsed();
 
         //std::priority_queue<std::pair<dist_t, labeltype >> result;
@@ -385,9 +365,6 @@ struct fastGraph
         //int ep_id = 0;
         //dist_t curdist = cal_dist(q->queryPoint, dataset[ep_id], dim);
         //q->cost++;
-        //VisitedList* vl = visited_list_pool_->getFreeVisitedList();
-        //auto visited_array = vl->mass;
-        //vl_type visited_array_tag = vl->curV;
 
         std::priority_queue<std::pair<dist_t, tableint>> top_candidates;
         std::priority_queue<std::pair<dist_t, tableint>> candidate_set;
@@ -439,10 +416,9 @@ struct fastGraph
                //_mm_prefetch((char*)(visited_array + *(data + j + 1)), _MM_HINT_T0);
                //_mm_prefetch((char*)(dataset[*(data + j + 1)]), _MM_HINT_T0);
 #endif
-                if (!flag_[candidate_id]) {
+                if (visited_array[candidate_id] != visited_array_tag) {
 
-                    //visited_array[candidate_id] = visited_array_tag;
-                    flag_[candidate_id] = true;
+                    visited_array[candidate_id] = visited_array_tag;
 
                     if (0 || cal_dist(q->hashval, hashval[candidate_id], lowDim) * myhash->coeffq < lowerBound) {
                         float* currObj1 = dataset[*(data + j)];
@@ -471,7 +447,7 @@ struct fastGraph
             }
         }
 
-        //visited_list_pool_->releaseVisitedList(vl);
+        visited_list_pool_->releaseVisitedList(vl);
 
         while (top_candidates.size() > q->k) {
             top_candidates.pop();
@@ -491,12 +467,14 @@ struct fastGraph
 
         //entryHeap pqEntries;
         std::priority_queue<Res> candTable;
-        std::vector<bool> flag_(N, false);
+        VisitedArray* vl = visited_list_pool_->getFreeVisitedList();
+        vl_type* visited_array = vl->mass;
+        vl_type visited_array_tag = vl->curV;
         std::priority_queue<Res, std::vector<Res>, std::greater<Res>> candidate_set;
         Res top_candidates[500];
 
         timer.restart();
-        searchLSHQuery(q, candTable, flag_);
+        searchLSHQuery(q, candTable, visited_array, visited_array_tag);
         q->timeHash = timer.elapsed();
 
         //std::priority_queue<std::pair<dist_t, labeltype >> result;
@@ -508,9 +486,6 @@ struct fastGraph
         //int ep_id = 0;
         //dist_t curdist = cal_dist(q->queryPoint, dataset[ep_id], dim);
         //q->cost++;
-        //VisitedList* vl = visited_list_pool_->getFreeVisitedList();
-        //auto visited_array = vl->mass;
-        //vl_type visited_array_tag = vl->curV;
 
         //std::priority_queue<std::pair<dist_t, tableint>> top_candidates;
         //std::priority_queue<std::pair<dist_t, tableint>> candidate_set;
@@ -569,10 +544,9 @@ struct fastGraph
                //_mm_prefetch((char*)(visited_array + *(data + j + 1)), _MM_HINT_T0);
                //_mm_prefetch((char*)(dataset[*(data + j + 1)]), _MM_HINT_T0);
 #endif
-                if (!flag_[candidate_id]) {
+                if (visited_array[candidate_id] != visited_array_tag) {
 
-                    //visited_array[candidate_id] = visited_array_tag;
-                    flag_[candidate_id] = true;
+                    visited_array[candidate_id] = visited_array_tag;
 
                     if (0 || cal_dist(q->hashval, hashval[candidate_id], lowDim) * myhash->coeffq < lowerBound) {
                         float* currObj1 = dataset[*(data + j)];
@@ -611,7 +585,7 @@ struct fastGraph
             }
         }
 
-        //visited_list_pool_->releaseVisitedList(vl);
+        visited_list_pool_->releaseVisitedList(vl);
 
         while (size_c > q->k) {
             std::pop_heap(top_candidates, top_candidates + size_c);
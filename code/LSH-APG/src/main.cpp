@@ -3,6 +3,10 @@
 //
 
 #include "alg.h"
+#include <getopt.h>
+#include <thread>
+#include "Evaluation.h"
+
 int _lsh_UB=0;
 //double _chi2inv;
 //double _chi2invSqr;
@@ -43,253 +47,227 @@ static size_t getCurrentRSS() {
 #endif
 }
 
-int datadim, datasize;
+// Answers the queries of prep with the given number of threads. Each thread reuses one buffer for the hash values
+// of its queries and fsG hands a visited array to every running query. The answers are printed (or recorded by
+// the evaluator) in query order once all queries are answered, so that the threads do not wait on the output.
+static void queryWorkload(fastGraph* fsG, Preprocess& prep, float c, unsigned k, float beta, unsigned threads,
+	evaluation::Evaluator* evaluator, const std::string& summary_file)
+{
+	int nq = prep.data.numQuery;
+	std::vector<std::vector<Res>> results(nq);
+	std::vector<float> latencies(nq);
+	std::vector<unsigned> costs(nq), prunings(nq);
+
+	lsh::timer timer;
+#pragma omp parallel num_threads(threads)
+	{
+		std::vector<float> hashBuffer(fsG->S);
+#pragma omp for schedule(dynamic)
+		for (int j = 0; j < nq; ++j) {
+			queryN q(j, c, k, prep, beta, hashBuffer.data());
+			fsG->knn(&q);
+			results[j].swap(q.res);
+			latencies[j] = q.timeTotal;
+			costs[j] = q.cost;
+			prunings[j] = q.prunings;
+		}
+	}
+	float search_time = timer.elapsed();
+
+	std::vector<int> ids(k);
+	std::vector<float> dists(k);
+	for (int j = 0; j < nq; ++j) {
+		auto& res = results[j];
+		if (evaluator) {
+			for (unsigned i = 0; i < k; ++i) {
+				ids[i] = res[i].id;
+				dists[i] = res[i].dist;
+			}
+			evaluator->record(j, ids.data(), dists.data(), latencies[j]);
+			continue;
+		}
+		std::cout << "----------" << k << "-NN RESULTS----------- | query : " << j << "\n";
+		for (unsigned i = 0; i < k; ++i) {
+#ifdef USE_SQRDIST
+			float dist = sqrt(res[i].dist);
+#else
+			float dist = res[i].dist;
+#endif
+			if (i == 0)
+				printf(" K N°%u  => Distance : %f | Node ID : %d | Time  : %f | Total DC : %u | Prunings : %u \n",
+					i + 1, dist, res[i].id, latencies[j], costs[j], prunings[j]);
+			else
+				printf(" K N°%u  => Distance : %f | Node ID : %d | Time  : 0 | Total DC : 0 | Prunings : 0 \n",
+					i + 1, dist, res[i].id);
+		}
+	}
+
+	std::cout << "[Throughput] threads " << threads << " - QPS " << nq / search_time << std::endl;
+	if (evaluator)
+		evaluator->report("LSH-APG", search_time, summary_file);
+}
 
-int main(int argc, char const* argv[])
+int main(int argc, char** argv)
 {
+	static char* dataset = nullptr;
+	static char* queries = nullptr;
+	static char* index_path = nullptr;
+	static char* groundtruth_file = nullptr;
+	static char* summary_file = nullptr;
+	unsigned dataset_size = 0;
+	unsigned queries_size = 0;
+	unsigned ts_length = 0;
+	int mode = 0;
+	// --K and --L are the max outdegree and the construction beam width when building (mode 0),
+	// k and the search beam width when querying (mode 1)
+	int K_opt = -1, L_opt = -1;
+	unsigned nhashtab = 2, lowdim = 18;
+	unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+
 	float c = 1.5;
-	unsigned k = 50;
-	unsigned L = 8, K = 10;//NUS
-	//L = 10, K = 5;
 	float beta = 0.1;
-	unsigned Qnum = 100;
-	float W = 1.0f;
-	int T = 24;
-	int efC = 80;
-	L = 2;
-	K = 18;
 	double pC = 0.95, pQ = 0.9;
-	bool isbuilt = 0;
-	_lsh_UB=0;
-
-	std::string datapath, datasetName, querypath, benchmarkpath;
-
-	datapath = argv[1];
-	datasetName = argv[2];
-	datadim = std::atoi(argv[3]);
-	datasize = std::atoi(argv[4]);
-	querypath = argv[5];
-	benchmarkpath = argv[6];
-
-	// if (argc > 1) datasetName = argv[1];
-	// if (argc > 2) isbuilt = std::atoi(argv[2]);
-	// if (argc > 3) k = std::atoi(argv[3]);
-	// if (argc > 4) L = std::atoi(argv[4]);
-	// if (argc > 5) K = std::atoi(argv[5]);
-	// if (argc > 6) T = std::atoi(argv[6]);
-	// if (argc > 7) efC = std::atoi(argv[7]);
-	// if (argc > 8) pC = std::atof(argv[8]);
-	// if (argc > 9) pQ = std::atof(argv[9]);
-	// if (argc > 10) _lsh_UB = std::atoi(argv[10]);
-	// if (argc == 1) {
-	// 	const std::string datas[] = { "audio","mnist","cifar","NUS","Trevi","gist","deep1m","skew_10M_8d","gauss_8d","gauss_25w_128" };
-	// 	datasetName = datas[6];
-	// 	//datasetName = "sift1B"; 
-	// 	setW(datasetName, W);
-	// 	std::cout << "Using the default configuration!\n\n";
-	// }
-
-	#if defined(unix) || defined(__unix__)
-		std::string data_fold = "../../dataset/", index_fold = "./indexes/";
-	#else
-		std::string data_fold = "E:/Dataset_for_c/", index_fold = data_fold + "graphIndex/";
-	#endif
-
-
-	
-	std::cout << "Using LSH-Graph for " << datasetName << " ..." << std::endl;
-	std::cout << "c=        " << c << std::endl;
-	std::cout << "k=        " << k << std::endl;
-	std::cout << "L=        " << L << std::endl;
-	std::cout << "K=        " << K << std::endl;
-	std::cout << "T=        " << T << std::endl;
-	std::cout << "lsh_UB=   " << _lsh_UB << std::endl;
-	// Preprocess prep(data_fold + datasetName + ".data", data_fold + "ANN/" + datasetName + ".bench_graph");
-	Preprocess prep(datapath, benchmarkpath, querypath, datadim, datasize);
-
-	//return 0;
-
-	showMemoryInfo();
-
-	cout << "Actual memory usage before indexing divG: " << getCurrentRSS() / 1000000 << " Mb \n";
-
-	std::string path = index_fold + datasetName + ".index";
-	Parameter param1(prep, L, K, 1.0f);
-	// param1.W = 0.3f;
-	zlsh* gLsh= nullptr;
-	divGraph* divG = nullptr;
-	// if (isbuilt&&find_file(path + "_divGraph")) {
-	// 	divG = new divGraph(&prep, path + "_divGraph", pQ);
-		
-	// 	divG->L = L;
-	// 	if (L == 0) divG->coeffq = 0;
-	// }
-	// else {
-	// 	if (!GenericTool::CheckPathExistence(index_fold.c_str())) {
-	// 		GenericTool::EnsurePathExistence(index_fold.c_str());
-	// 	}
-	// 	divG = new divGraph(prep, param1, path + "_divGraph", T, efC, pC, pQ);
-	// }
-
-	divG = new divGraph(prep, param1, path + "_divGraph", T, efC, pC, pQ);
-
-	cout << "Actual memory usage after indexing divG: " << getCurrentRSS() / 1000000 << " Mb \n";
-
-	//divG->traverse();
-	//return 0;
-
-	std::cout << "Loading FastGraph...\n";
-	fastGraph* fsG = new fastGraph(divG);
-
-	cout << "Actual memory usage after indexing fsG: " << getCurrentRSS() / 1000000 << " Mb \n";
-
-	divG->save("lshapg.bin");
-
-	std::stringstream ss;
-	ss  << "*******************************************************************************************************\n"
-		<< "The result of LSH-G for " << datasetName << " is as follow: "<< "k=" << k<< ", probQ = " << pQ << ", L = " << L << ", K = " << K << ", T = " << T
-		<< "\n"
-		<< "******************************************************************************************************\n";
-
-	ss << std::setw(_lspace) << "algName"
-		<< std::setw(_sspace) << "k"
-		<< std::setw(_sspace) << "ef"
-		<< std::setw(_lspace) << "Time"
-		<< std::setw(_lspace) << "Recall"
-		//<< std::setw(_lspace) << "Ratio"
-		<< std::setw(_lspace) << "Cost"
-		<< std::setw(_lspace) << "CPQ1"
-		<< std::setw(_lspace) << "CPQ2"
-		<< std::setw(_lspace) << "Pruning"
-		//<< std::setw(_lspace) << "MaxHop"
-		<< std::endl
-		<< std::endl;
-
-	std::cout << ss.str();
-
-	// std::string query_result(divG->getFilename());
-	// auto idx = query_result.rfind('/');
-	// query_result.assign(query_result.begin(), query_result.begin() + idx + 1);
-	// query_result += "result.txt";
-	// std::ofstream os(query_result, std::ios_base::app);
-	// os.seekp(0, std::ios_base::end);
-	// os << ss.str();
-	// os.close();
-
-	std::vector<size_t> efs;
-	for (int i = 100; i < 6000; i += 100) {
-		efs.push_back(i);
+	_lsh_UB = 0;
+
+	while (1) {
+		static struct option long_options[] = {
+				{"dataset",         required_argument, 0, 'd'},
+				{"dataset-size",    required_argument, 0, 'z'},
+				{"queries",         required_argument, 0, 'q'},
+				{"queries-size",    required_argument, 0, 'g'},
+				{"timeseries-size", required_argument, 0, 't'},
+				{"index-path",      required_argument, 0, 'p'},
+				{"K",               required_argument, 0, 'k'},
+				{"L",               required_argument, 0, 'l'},
+				{"nhashtab",        required_argument, 0, 'n'},
+				{"lowdim",          required_argument, 0, 'w'},
+				{"mode",            required_argument, 0, 'x'},
+				{"threads",         required_argument, 0, 'r'},
+				{"groundtruth",     required_argument, 0, 'a'},
+				{"summary",         required_argument, 0, 's'},
+				{"help",            no_argument,       0, '?'},
+				{0, 0, 0, 0}
+		};
+
+		int option_index = 0;
+		int opt = getopt_long(argc, argv, "", long_options, &option_index);
+		if (opt == -1)
+			break;
+		switch (opt) {
+		case 'd':
+			dataset = optarg;
+			break;
+		case 'z':
+			dataset_size = atoi(optarg);
+			break;
+		case 'q':
+			queries = optarg;
+			break;
+		case 'g':
+			queries_size = atoi(optarg);
+			break;
+		case 't':
+			ts_length = atoi(optarg);
+			break;
+		case 'p':
+			index_path = optarg;
+			break;
+		case 'k':
+			K_opt = atoi(optarg);
+			break;
+		case 'l':
+			L_opt = atoi(optarg);
+			break;
+		case 'n':
+			nhashtab = atoi(optarg);
+			break;
+		case 'w':
+			lowdim = atoi(optarg);
+			break;
+		case 'x':
+			mode = atoi(optarg);
+			break;
+		case 'r':
+			threads = atoi(optarg);
+			if (threads < 1) {
+				fprintf(stderr, "Please change the number of threads to be greater than 0.\n");
+				exit(-1);
+			}
+			break;
+		case 'a':
+			groundtruth_file = optarg;
+			break;
+		case 's':
+			summary_file = optarg;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s --dataset data.bin --dataset-size n --timeseries-size dim --index-path dir/ "
+				"--mode 0 [--K R] [--L efc] [--nhashtab nh] [--lowdim ld]\n"
+				"       %s --dataset data.bin --dataset-size n --timeseries-size dim --index-path dir/ "
+				"--mode 1 --queries q.bin --queries-size nq [--K k] [--L ef] [--threads t] "
+				"[--groundtruth gt] [--summary file]\n", argv[0], argv[0]);
+			exit(-1);
+		}
 	}
-	// for (int i = k; i < 1000; i += 10) {
-	// 	efs.push_back(i);
-	// }
-	// for (int i = 1100; i < 2000; i += 100) {
-	// 	efs.push_back(i);
-	// }
 
-	// for (int i = 100; i < 250; i += 10) {
-	// 	efs.push_back(i);
-	// }
-	// for (int i = 250; i < 300; i += 50) {
-	// 	efs.push_back(i);
-	// }
-
-// #ifdef _DEBUG
-// #else
-// 	for (int i = 100; i < 500; i += 10) {
-// 		efs.push_back(i);
-// 	}
-// 	// for (int i = 250; i < 300; i += 50) {
-// 	// 	efs.push_back(i);
-// 	// }
-// 	//for (int i = 500; i < 3000; i += 300) {
-// 	//	efs.push_back(i);
-// 	//}
-// 	//if (datasetName == "mnist") {
-// 	//	for (int i = 500; i < 6000; i += 300) {
-// 	//		efs.push_back(i);
-// 	//	}
-// 	//}
-// #endif // _DEBUG
-	if (k == 50) {
-		// for (auto& ef : efs) {
-		// 	if (divG) divG->ef = ef;
-		// 	graphSearch(c, k, divG, prep, beta, datasetName, data_fold, 2);
-		// }
-		// std::cout << std::endl;
+	if (dataset == nullptr || dataset_size == 0 || ts_length == 0 || index_path == nullptr) {
+		fprintf(stderr, "Please give the dataset, its size, the dimension and the index path.\n");
+		exit(-1);
 	}
-	else {
-		std::vector<int> ks = { 1,10,20,30,40,50,60,70,80,90,100 };
-
-		for (auto& kk : ks) {
-			k = kk;
-
-			if (divG) divG->ef = k + 150;
-			graphSearch(c, k, divG, prep, beta, datasetName, data_fold, 2);
-
-			//for (auto& ef : efs) {
-			//	if (ef < k) continue;
-			//	if (divG) divG->ef = ef;
-			//	graphSearch(c, kk, divG, prep, beta, datasetName, data_fold, 2);
-			//}
-			std::cout << std::endl;
+	std::vector<char> index_file(GenericTool::GetCombinedPath(index_path, "index.bin", NULL));
+	GenericTool::GetCombinedPath(index_path, "index.bin", index_file.data());
+
+	if (mode == 0) {
+		int T = K_opt > 0 ? K_opt : 24;
+		int efC = L_opt > 0 ? L_opt : 80;
+		if (GenericTool::CheckPathExistence(index_path)) {
+			fprintf(stderr, "The index folder %s already exists, please give a non existing path.\n", index_path);
+			exit(-1);
 		}
+		GenericTool::EnsurePathExistence(index_path);
+
+		std::cout << "Using LSH-Graph for " << dataset << " ..." << std::endl;
+		std::cout << "L=        " << nhashtab << std::endl;
+		std::cout << "K=        " << lowdim << std::endl;
+		std::cout << "T=        " << T << std::endl;
+		std::cout << "efC=      " << efC << std::endl;
+		Preprocess prep(dataset, "", "", ts_length, dataset_size);
+		Parameter param(prep, nhashtab, lowdim, 1.0f);
+		divGraph divG(prep, param, index_file.data(), T, efC, pC, pQ);
+		cout << "Actual memory usage after indexing divG: " << getCurrentRSS() / 1000000 << " Mb \n";
+
+		lsh::timer timer;
+		std::cout << "SAVING GRAPH..." << std::endl;
+		divG.save(index_file.data());
+		std::cout << "SAVING TIME: " << timer.elapsed() << "s." << std::endl << std::endl;
 	}
-	
+	else if (mode == 1) {
+		unsigned k = K_opt > 0 ? K_opt : 10;
+		int ef = L_opt > 0 ? L_opt : 100;
+		if (queries == nullptr || queries_size == 0) {
+			fprintf(stderr, "Please give the queries and their number.\n");
+			exit(-1);
+		}
+		if (ef < (int)k) {
+			fprintf(stderr, "Please change L to be at least K.\n");
+			exit(-1);
+		}
 
-	//for (auto& ef : efs) {
-	//	if (divG) divG->ef = ef;
-	//	graphSearch(c, k, divG, prep, beta, datasetName, data_fold, 3);
-	//}
-	//std::cout << std::endl;
-	// efs={200};
-	std::cout << "-------------------begin searching-----------------" << std::endl;
-	for (auto& ef : efs) {
-		if (fsG) fsG->ef = ef;
-		graphSearch(c, k, fsG, prep, beta, datasetName, data_fold, 0);
+		Preprocess prep(dataset, "", queries, ts_length, dataset_size, queries_size);
+		divGraph* divG = new divGraph(&prep, index_file.data(), pQ);
+		fastGraph* fsG = new fastGraph(divG);
+		fsG->ef = ef;
+		cout << "Actual memory usage after loading fsG: " << getCurrentRSS() / 1000000 << " Mb \n";
+
+		evaluation::Evaluator* evaluator = nullptr;
+		if (groundtruth_file != nullptr)
+			evaluator = new evaluation::Evaluator(groundtruth_file, queries_size, k);
+		queryWorkload(fsG, prep, c, k, beta, threads, evaluator, summary_file ? summary_file : "");
+		delete evaluator;
 	}
-
-	std::vector<float> pts={0.5,0.55,0.6,0.65,0.7,0.75,0.8,0.85,0.9,0.95};
-
-	std::cout << std::endl;
-
-	//for (auto& ef : efs) {
-	//	if (fsG) fsG->ef = ef;
-	//	graphSearch(c, k, fsG, prep, beta, datasetName, data_fold, 1);
-	//}
-	//std::cout << std::endl;
-
-	time_t now = time(0);
-	
-	
-	time_t zero_point = 1635153971 - 17 * 3600 - 27 * 60;//Let me set the time at 2021.10.25. 17:27 as the zero point
-	size_t diff = (size_t)(now - zero_point);
-
-	//ss.flush();
-	//ss.erase_event();
-	ss.str("");
-#if defined(unix) || defined(__unix__)
-	llt lt(diff);
-#endif
-
-#if defined(unix) || defined(__unix__)
-	ss << "\n******************************************************************************************************\n"
-		<< "                                                                                    "
-		<< lt.date << '-' << lt.h << ':' << lt.m << ':' << lt.s
-		<< "\n*****************************************************************************************************\n\n\n";
-#else
-	tm* ltm = new tm[1];
-	localtime_s(ltm, &now);
-	ss << "\n******************************************************************************************************\n"
-		<< "                                                                                    "
-		<< ltm->tm_mon + 1 << '-' << ltm->tm_mday << ' ' << ltm->tm_hour << ':' << ltm->tm_min
-		<< "\n*****************************************************************************************************\n\n\n";
-#endif
-	// std::ofstream os1(query_result, std::ios_base::app);
-	// os1.seekp(0, std::ios_base::end);
-	// os1 << ss.str();
-	// os1.close();
-	// std::cout << ss.str();
-	// return 0;
+	else {
+		fprintf(stderr, "Unknown mode %d (0: build, 1: search).\n", mode);
+		exit(-1);
+	}
+	return 0;
 }
-
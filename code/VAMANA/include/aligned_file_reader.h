@@ -12,7 +12,15 @@
 #include <fcntl.h>
 #include <libaio.h>
 #include <unistd.h>
-typedef io_context_t IOContext;
+
+struct UringContext;
+
+// Context of one thread: its libaio context with LinuxAlignedFileReader, its
+// ring with UringAlignedFileReader
+struct IOContext {
+  io_context_t  aio_ctx = 0;
+  UringContext* uring = nullptr;
+};
 #else
 #include <Windows.h>
 #include <minwinbase.h>
@@ -81,7 +89,8 @@ class AlignedFileReader {
 
  public:
   // returns the thread-specific context
-  // returns (io_context_t)(-1) if thread is not registered
+  // returns a context with aio_ctx (io_context_t)(-1) if thread is not
+  // registered
   virtual IOContext& get_ctx() = 0;
 
   virtual ~AlignedFileReader(){};
@@ -100,4 +109,23 @@ class AlignedFileReader {
   // NOTE :: blocking call
   virtual void read(std::vector<AlignedRead>& read_reqs, IOContext& ctx,
                     bool async = false) = 0;
+
+  // declares buf as the scratch most reads of ctx go to, for readers that can
+  // map it once for all reads (io_uring fixed buffers)
+  virtual void register_buffer(IOContext& ctx, void* buf, uint64_t len) {
+  }
+
+  // Split form of read() for the pipelined search: submit_reads() issues the
+  // requests and returns at once, reap_reads() waits until at least min_nr
+  // of the issued reads completed and appends the buf of each completed read
+  // to done_bufs. Only available when supports_async_reads() is true.
+  virtual bool supports_async_reads() {
+    return false;
+  }
+  virtual void submit_reads(std::vector<AlignedRead>& read_reqs,
+                            IOContext&                ctx) {
+  }
+  virtual void reap_reads(IOContext& ctx, uint64_t min_nr,
+                          std::vector<void*>& done_bufs) {
+  }
 };
@@ -38,6 +38,7 @@ namespace diskann {
   const uint32_t NUM_NODES_TO_CACHE = 250000;
   const uint32_t WARMUP_L = 20;
   const uint32_t NUM_KMEANS_REPS = 12;
+  const uint32_t NUM_OPQ_ITERS = 8;
 
   template<typename T>
   class PQFlashIndex;
@@ -86,11 +87,14 @@ DISKANN_DLLEXPORT double calculate_range_search_recall(unsigned num_queries, std
       _u64 tuning_sample_num, _u64 tuning_sample_aligned_dim, uint32_t L,
       uint32_t nthreads, uint32_t start_bw = 2);
 
+  // use_opq: learn a rotation along with the in-memory PQ pivots
+  // (generate_opq_pivots)
   template<typename T>
   DISKANN_DLLEXPORT bool build_disk_index(const char *    dataFilePath,
                                           const char *    indexFilePath,
                                           const char *    indexBuildParameters,
-                                          diskann::Metric _compareMetric);
+                                          diskann::Metric _compareMetric,
+                                          bool            use_opq = false);
 
   template<typename T>
   DISKANN_DLLEXPORT void create_disk_layout(const std::string base_file,
@@ -9,6 +9,7 @@
 #include <stack>
 #include <string>
 #include <unordered_map>
+#include <boost/dynamic_bitset.hpp>
 #include "tsl/robin_set.h"
 
 #include "distance.h"
@@ -65,6 +66,16 @@ namespace diskann {
         const T *query, const uint64_t K, const unsigned L,
         std::vector<unsigned> init_ids, uint64_t *indices, float *distances);
 
+    // Searches the num_queries queries stored query_aligned_dim apart with
+    // num_threads threads, each reusing one scratch for all its queries.
+    // latencies, if given, receives the time of every query in seconds.
+    DISKANN_DLLEXPORT void batch_search(const T *queries, const size_t num_queries,
+                                        const size_t   query_aligned_dim,
+                                        const uint64_t K, const unsigned L,
+                                        uint64_t *indices, float *distances,
+                                        const unsigned num_threads,
+                                        double *       latencies = nullptr);
+
     DISKANN_DLLEXPORT std::pair<uint32_t, uint32_t> search_with_tags(
         const T *query, const size_t K, const unsigned L, TagT *tags,
         unsigned *indices_buffer = NULL);
@@ -107,6 +118,13 @@ namespace diskann {
     DISKANN_DLLEXPORT void search_with_opt_graph(const T *query, size_t K,
                                                  size_t L, unsigned *indices);
 
+    // batch_search() over the graph of optimize_graph()
+    DISKANN_DLLEXPORT void batch_search_with_opt_graph(
+        const T *queries, const size_t num_queries,
+        const size_t query_aligned_dim, const size_t K, const size_t L,
+        unsigned *indices, const unsigned num_threads,
+        double *latencies = nullptr);
+
     /*  Internals of the library */
  
     typedef std::vector<SimpleNeighbor>        vecNgh;
@@ -114,6 +132,17 @@ namespace diskann {
     CompactGraph                               _final_graph;
     CompactGraph                               _in_graph;
   protected:
+    // Buffers of one search, kept by batch_search() across the queries of a
+    // thread so that nothing is allocated per query
+    struct SearchScratch {
+      std::vector<unsigned>    init_ids;
+      std::vector<Neighbor>    best_L_nodes;
+      std::vector<Neighbor>    expanded_nodes_info;
+      tsl::robin_set<unsigned> expanded_nodes_ids;
+      tsl::robin_set<unsigned> inserted_into_pool;
+      boost::dynamic_bitset<>  flags;  // visited nodes of the optimized graph
+    };
+
     // determines navigating node of the graph by calculating medoid of data
     unsigned calculate_entry_point();
     // called only when _eager_delete is to be supported
@@ -126,6 +155,19 @@ namespace diskann {
         tsl::robin_set<unsigned> &   expanded_nodes_ids,
         std::vector<Neighbor> &      best_L_nodes);
 
+    // same, with the set of the nodes already inserted in best_L_nodes given
+    // by the caller (cleared here)
+    std::pair<uint32_t, uint32_t> iterate_to_fixed_point(
+        const T *node_coords, const unsigned Lindex,
+        const std::vector<unsigned> &init_ids,
+        std::vector<Neighbor> &      expanded_nodes_info,
+        tsl::robin_set<unsigned> &   expanded_nodes_ids,
+        std::vector<Neighbor> &      best_L_nodes,
+        tsl::robin_set<unsigned> &   inserted_into_pool);
+
+    void search_with_opt_graph(const T *query, size_t K, size_t L,
+                               unsigned *indices, SearchScratch &scratch);
+
     void get_expanded_nodes(const size_t node, const unsigned Lindex,
                             std::vector<unsigned>     init_ids,
                             std::vector<Neighbor> &   expanded_nodes_info,
@@ -8,9 +8,9 @@
 
 class LinuxAlignedFileReader : public AlignedFileReader {
  private:
-  uint64_t     file_sz;
-  FileHandle   file_desc;
-  io_context_t bad_ctx = (io_context_t) -1;
+  uint64_t   file_sz;
+  FileHandle file_desc;
+  IOContext  bad_ctx;
 
  public:
   LinuxAlignedFileReader();
@@ -33,6 +33,17 @@ class LinuxAlignedFileReader : public AlignedFileReader {
   // NOTE :: blocking call
   void read(std::vector<AlignedRead> &read_reqs, IOContext &ctx,
             bool async = false);
+
+  bool supports_async_reads() {
+    return true;
+  }
+  void submit_reads(std::vector<AlignedRead> &read_reqs, IOContext &ctx);
+  void reap_reads(IOContext &ctx, uint64_t min_nr,
+                  std::vector<void *> &done_bufs);
 };
 
+// Reader of the given backend: "aio" (LinuxAlignedFileReader), "uring" or
+// "uring_sqpoll" (UringAlignedFileReader, when built with USE_IO_URING)
+AlignedFileReader *create_linux_aligned_file_reader(const std::string &backend);
+
 #endif
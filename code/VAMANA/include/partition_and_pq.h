@@ -64,6 +64,12 @@ DISKANN_DLLEXPORT int generate_pq_pivots(
     unsigned num_centers, unsigned num_pq_chunks, unsigned max_k_means_reps,
     std::string pq_pivots_path, bool make_zero_mean = false);
 
+DISKANN_DLLEXPORT int generate_opq_pivots(
+    const float *train_data, size_t num_train, unsigned dim,
+    unsigned num_centers, unsigned num_pq_chunks, unsigned max_k_means_reps,
+    unsigned num_opq_iters, std::string pq_pivots_path,
+    bool make_zero_mean = false);
+
 template<typename T>
 int generate_pq_data_from_pivots(const std::string data_file,
                                  unsigned num_centers, unsigned num_pq_chunks,
@@ -24,7 +24,7 @@ namespace diskann {
     double n_12k = 0;         // # of 12kB reads
     double n_ios = 0;         // total # of IOs issued
     double read_size = 0;     // total # of bytes read
-    double io_us = 0;         // total time spent in IO
+    double io_us = 0;         // total time spent waiting for IO
     double cpu_us = 0;        // total time spent in CPU
     double n_cmps_saved = 0;  // # cmps saved
     double n_cmps = 0;        // # cmps
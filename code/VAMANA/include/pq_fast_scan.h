@@ -0,0 +1,226 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#pragma once
+
+#include <immintrin.h>
+#include "pq_table.h"
+#include "utils.h"
+
+// 4-bit codes: the distance table of a chunk fits in one 16-byte register
+#define NUM_FAST_SCAN_CENTERS 16
+// points scored together, one per byte of a 32-byte register
+#define FAST_SCAN_BLOCK 32
+// the quantized distances (at most 255 per chunk) are summed in 16 bits
+#define MAX_FAST_SCAN_CHUNKS 256
+
+namespace diskann {
+  // Quantized distance table of one query: the distance of a point is
+  // bias + (sum of its lut entries) / scale.
+  struct FastScanQuery {
+    const _u8* lut = nullptr;
+    float      scale = 1;
+    float      bias = 0;
+  };
+
+  // PQ with 16 centers per chunk, scored with in-register table lookups
+  // ("fast scan"): the per-query distances to the centers of a chunk are
+  // quantized to 8 bits so that they fit in one SSE register, and pshufb
+  // looks up the codes of 32 points at once. The codes are kept packed, two
+  // chunks per byte; compute_dists() transposes the codes of the scored
+  // points into blocks of FAST_SCAN_BLOCK points, in which the 16 bytes of a
+  // chunk hold the code of point j in the low nibble of byte j and the code of
+  // point j + 16 in its high nibble.
+  class FastScanPQTable {
+    FixedChunkPQTable pq_table;
+    _u8* codes = nullptr;  // [num_points][code_bytes], chunk 2i in low nibble
+    _u64 num_points = 0;
+    _u64 n_chunks = 0;
+    _u64 n_chunks_padded = 0;  // even, the padding chunk has a zero table
+
+   public:
+    FastScanPQTable() {
+    }
+
+    ~FastScanPQTable() {
+      if (codes != nullptr)
+        delete[] codes;
+    }
+
+    // pq_prefix_fs: prefix of the _pivots.bin and _compressed.bin files
+    // written for NUM_FAST_SCAN_CENTERS centers
+#ifdef EXEC_ENV_OLS
+    void load(MemoryMappedFiles& files, const char* pq_prefix_fs) {
+#else
+    void load(const char* pq_prefix_fs) {
+#endif
+      std::string pivots_file = std::string(pq_prefix_fs) + "_pivots.bin";
+      std::string compressed_file =
+          std::string(pq_prefix_fs) + "_compressed.bin";
+
+      _u8*   raw_codes = nullptr;
+      size_t npts_u64, nchunks_u64;
+#ifdef EXEC_ENV_OLS
+      diskann::load_bin<_u8>(files, compressed_file, raw_codes, npts_u64,
+                             nchunks_u64);
+      pq_table.load_pq_centroid_bin(files, pivots_file.c_str(), nchunks_u64);
+#else
+      diskann::load_bin<_u8>(compressed_file, raw_codes, npts_u64,
+                             nchunks_u64);
+      pq_table.load_pq_centroid_bin(pivots_file.c_str(), nchunks_u64);
+#endif
+      if (pq_table.get_num_centers() != NUM_FAST_SCAN_CENTERS ||
+          nchunks_u64 > MAX_FAST_SCAN_CHUNKS) {
+#ifndef EXEC_ENV_OLS
+        delete[] raw_codes;
+#endif
+        std::stringstream stream;
+        stream << "Fast-scan PQ needs " << NUM_FAST_SCAN_CENTERS
+               << " centers and at most " << MAX_FAST_SCAN_CHUNKS
+               << " chunks, " << pivots_file << " has "
+               << pq_table.get_num_centers() << " centers and " << nchunks_u64
+               << " chunks" << std::endl;
+        throw diskann::ANNException(stream.str(), -1, __FUNCSIG__, __FILE__,
+                                    __LINE__);
+      }
+
+      num_points = npts_u64;
+      n_chunks = nchunks_u64;
+      n_chunks_padded = ROUND_UP(n_chunks, 2);
+      _u64 code_bytes = n_chunks_padded / 2;
+      codes = new _u8[num_points * code_bytes];
+      memset(codes, 0, num_points * code_bytes);
+      for (_u64 i = 0; i < num_points; i++) {
+        const _u8* raw = raw_codes + i * n_chunks;
+        _u8*       packed = codes + i * code_bytes;
+        for (_u64 chunk = 0; chunk < n_chunks; chunk++)
+          packed[chunk / 2] |= (raw[chunk] & 0x0f) << (4 * (chunk % 2));
+      }
+#ifndef EXEC_ENV_OLS
+      delete[] raw_codes;
+#endif
+      diskann::cout << "Loaded fast-scan PQ: #points: " << num_points
+                    << " #chunks: " << n_chunks << " (" << code_bytes
+                    << " bytes per point)" << std::endl;
+    }
+
+    _u64 get_num_chunks() {
+      return n_chunks;
+    }
+
+    // size of the lut of a query, and of a block of transposed codes
+    _u64 scratch_bytes() {
+      return n_chunks_padded * NUM_FAST_SCAN_CENTERS;
+    }
+
+    // float_scratch: [NUM_FAST_SCAN_CENTERS * n_chunks] floats,
+    // lut: scratch_bytes(), 32-byte aligned
+    FastScanQuery populate_lut(const float* query_vec, float* float_scratch,
+                               _u8* lut) {
+      pq_table.populate_chunk_distances(query_vec, float_scratch);
+
+      // one scale for all the chunks, so that the sums stay comparable
+      float bias = 0, max_range = 0;
+      for (_u64 chunk = 0; chunk < n_chunks; chunk++) {
+        const float* chunk_dists =
+            float_scratch + NUM_FAST_SCAN_CENTERS * chunk;
+        float min_d = chunk_dists[0], max_d = chunk_dists[0];
+        for (_u64 idx = 1; idx < NUM_FAST_SCAN_CENTERS; idx++) {
+          min_d = (std::min)(min_d, chunk_dists[idx]);
+          max_d = (std::max)(max_d, chunk_dists[idx]);
+        }
+        bias += min_d;
+        max_range = (std::max)(max_range, max_d - min_d);
+      }
+      float scale = max_range > 0 ? 255.0f / max_range : 1.0f;
+
+      memset(lut, 0, scratch_bytes());
+      for (_u64 chunk = 0; chunk < n_chunks; chunk++) {
+        const float* chunk_dists =
+            float_scratch + NUM_FAST_SCAN_CENTERS * chunk;
+        float min_d = chunk_dists[0];
+        for (_u64 idx = 1; idx < NUM_FAST_SCAN_CENTERS; idx++)
+          min_d = (std::min)(min_d, chunk_dists[idx]);
+        for (_u64 idx = 0; idx < NUM_FAST_SCAN_CENTERS; idx++) {
+          float q = (chunk_dists[idx] - min_d) * scale + 0.5f;
+          lut[NUM_FAST_SCAN_CENTERS * chunk + idx] =
+              (_u8)(std::min)(q, 255.0f);
+        }
+      }
+
+      FastScanQuery query;
+      query.lut = lut;
+      query.scale = scale;
+      query.bias = bias;
+      return query;
+    }
+
+    // block: scratch_bytes(), 32-byte aligned
+    void compute_dists(const FastScanQuery& query, const unsigned* ids,
+                       const _u64 n_ids, _u8* block, float* dists_out) {
+      _u16 sums[FAST_SCAN_BLOCK];
+      for (_u64 begin = 0; begin < n_ids; begin += FAST_SCAN_BLOCK) {
+        _u64 n_block = (std::min)(n_ids - begin, (_u64) FAST_SCAN_BLOCK);
+        transpose_block(ids + begin, n_block, block);
+        scan_block(query.lut, block, sums);
+        float inv_scale = 1.0f / query.scale;
+        for (_u64 i = 0; i < n_block; i++)
+          dists_out[begin + i] = query.bias + sums[i] * inv_scale;
+      }
+    }
+
+   private:
+    void transpose_block(const unsigned* ids, const _u64 n_ids, _u8* block) {
+      _u64 code_bytes = n_chunks_padded / 2;
+      memset(block, 0, scratch_bytes());
+      for (_u64 i = 0; i < n_ids; i++) {
+        const _u8* code = codes + (_u64) ids[i] * code_bytes;
+        _u64       byte = i % 16;
+        _u64       shift = 4 * (i / 16);
+        for (_u64 pair = 0; pair < code_bytes; pair++) {
+          block[32 * pair + byte] |= (code[pair] & 0x0f) << shift;
+          block[32 * pair + 16 + byte] |= (code[pair] >> 4) << shift;
+        }
+      }
+    }
+
+    // sums[i] = sum over the chunks of lut[chunk][code of point i]
+    void scan_block(const _u8* lut, const _u8* block, _u16* sums) {
+#ifdef USE_AVX2
+      // a register holds two chunks, one per 128-bit lane, as pshufb looks up
+      // within lanes; the lanes are added at the end
+      const __m256i low_mask = _mm256_set1_epi8(0x0f);
+      const __m256i zero = _mm256_setzero_si256();
+      __m256i       acc0 = zero, acc1 = zero, acc2 = zero, acc3 = zero;
+      for (_u64 pair = 0; pair < n_chunks_padded / 2; pair++) {
+        __m256i c = _mm256_load_si256((const __m256i*) (block + 32 * pair));
+        __m256i l = _mm256_load_si256((const __m256i*) (lut + 32 * pair));
+        __m256i lo = _mm256_and_si256(c, low_mask);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(c, 4), low_mask);
+        __m256i d_lo = _mm256_shuffle_epi8(l, lo);  // points 0..15
+        __m256i d_hi = _mm256_shuffle_epi8(l, hi);  // points 16..31
+        acc0 = _mm256_add_epi16(acc0, _mm256_unpacklo_epi8(d_lo, zero));
+        acc1 = _mm256_add_epi16(acc1, _mm256_unpackhi_epi8(d_lo, zero));
+        acc2 = _mm256_add_epi16(acc2, _mm256_unpacklo_epi8(d_hi, zero));
+        acc3 = _mm256_add_epi16(acc3, _mm256_unpackhi_epi8(d_hi, zero));
+      }
+      __m256i accs[4] = {acc0, acc1, acc2, acc3};
+      for (int i = 0; i < 4; i++) {
+        __m128i sum = _mm_add_epi16(_mm256_castsi256_si128(accs[i]),
+                                    _mm256_extracti128_si256(accs[i], 1));
+        _mm_storeu_si128((__m128i*) (sums + 8 * i), sum);
+      }
+#else
+      memset(sums, 0, FAST_SCAN_BLOCK * sizeof(_u16));
+      for (_u64 chunk = 0; chunk < n_chunks_padded; chunk++) {
+        const _u8* chunk_lut = lut + NUM_FAST_SCAN_CENTERS * chunk;
+        const _u8* chunk_codes = block + 16 * chunk;
+        for (_u64 byte = 0; byte < 16; byte++) {
+          sums[byte] += chunk_lut[chunk_codes[byte] & 0x0f];
+          sums[byte + 16] += chunk_lut[chunk_codes[byte] >> 4];
+        }
+      }
+#endif
+    }
+  };
+}  // namespace diskann
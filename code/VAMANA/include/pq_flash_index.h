@@ -2,10 +2,15 @@
 // Licensed under the MIT license.
 
 #pragma once
+#include <atomic>
 #include <cassert>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <stack>
 #include <string>
+#include <thread>
 #include "tsl/robin_map.h"
 #include "tsl/robin_set.h"
 
@@ -14,6 +19,7 @@
 #include "neighbor.h"
 #include "parameters.h"
 #include "percentile_stats.h"
+#include "pq_fast_scan.h"
 #include "pq_table.h"
 #include "utils.h"
 #include "windows_customizations.h"
@@ -40,8 +46,11 @@ namespace diskann {
         nullptr;  // MUST BE AT LEAST diskann MAX_DEGREE
     _u8 *aligned_pq_coord_scratch =
         nullptr;  // MUST BE AT LEAST  [N_CHUNKS * MAX_DEGREE]
+    _u8 *aligned_fast_scan_lut = nullptr;    // fast-scan scratch_bytes()
+    _u8 *aligned_fast_scan_codes = nullptr;  // fast-scan scratch_bytes()
     T *    aligned_query_T = nullptr;
     float *aligned_query_float = nullptr;
+    float *aligned_rotated_query = nullptr;  // query for OPQ [aligned_dim]
 
     void reset() {
       coord_idx = 0;
@@ -49,6 +58,32 @@ namespace diskann {
     }
   };
 
+  // Nodes served from memory: their neighbors (nhood_cache) and full precision
+  // coordinates (coord_cache). A published cache is never modified, the
+  // adaptive cache replaces it with a new one.
+  template<typename T>
+  struct NodeCache {
+    unsigned *                                    nhood_cache_buf = nullptr;
+    tsl::robin_map<_u32, std::pair<_u32, _u32 *>> nhood_cache;
+    T *                                           coord_cache_buf = nullptr;
+    tsl::robin_map<_u32, T *>                     coord_cache;
+
+    ~NodeCache() {
+      if (nhood_cache_buf != nullptr) {
+        delete[] nhood_cache_buf;
+        diskann::aligned_free(coord_cache_buf);
+      }
+    }
+  };
+
+  struct NodeCacheStats {
+    _u64 lookups = 0;       // nodes expanded by the searches
+    _u64 hits = 0;          // of which served from the cache
+    _u64 cached_nodes = 0;  // nodes in the current cache
+    _u64 refreshes = 0;     // caches published by the adaptive cache
+    _u64 promotions = 0;    // nodes read into the cache by the refreshes
+  };
+
   template<typename T>
   struct ThreadData {
     QueryScratch<T> scratch;
@@ -74,14 +109,19 @@ namespace diskann {
         diskann::Metric                     metric = diskann::Metric::L2);
     DISKANN_DLLEXPORT ~PQFlashIndex();
 
+    // fast_scan: score the neighbors with the 4-bit PQ codes of
+    // <pq_prefix>_fs_pivots.bin and <pq_prefix>_fs_compressed.bin (see
+    // FastScanPQTable) instead of the 8-bit ones
 #ifdef EXEC_ENV_OLS
     DISKANN_DLLEXPORT int load(diskann::MemoryMappedFiles &files,
                                uint32_t num_threads, const char *pq_prefix,
-                               const char *disk_index_file);
+                               const char *disk_index_file,
+                               bool        fast_scan = false);
 #else
     // load compressed data, and obtains the handle to the disk-resident index
     DISKANN_DLLEXPORT int  load(uint32_t num_threads, const char *pq_prefix,
-                                const char *disk_index_file);
+                                const char *disk_index_file,
+                                bool        fast_scan = false);
 #endif
 
     DISKANN_DLLEXPORT void load_cache_list(std::vector<uint32_t> &node_list);
@@ -101,6 +141,18 @@ namespace diskann {
     DISKANN_DLLEXPORT void cache_bfs_levels(_u64 num_nodes_to_cache,
                                             std::vector<uint32_t> &node_list);
 
+    // Online cache mode: the searches count the nodes they expand, and every
+    // period_ms a background thread replaces the node cache with the most
+    // accessed nodes that fit in budget_bytes (counts are halved at each
+    // refresh so that the cache follows the workload). The searches keep
+    // using the previous cache until the new one is published, so both are
+    // in memory during a refresh.
+    DISKANN_DLLEXPORT void enable_adaptive_cache(_u64 budget_bytes,
+                                                 _u32 period_ms);
+    DISKANN_DLLEXPORT void disable_adaptive_cache();
+
+    DISKANN_DLLEXPORT NodeCacheStats get_cache_stats();
+
     //    DISKANN_DLLEXPORT void cache_from_samples(const std::string
     //    sample_file, _u64 num_nodes_to_cache, std::vector<uint32_t>
     //    &node_list);
@@ -115,6 +167,13 @@ namespace diskann {
         const T *query, const _u64 k_search, const _u64 l_search, _u64 *res_ids,
         float *res_dists, const _u64 beam_width, QueryStats *stats = nullptr);
 
+    // keeps up to beam_width reads in flight and expands the nodes as their
+    // sectors arrive; falls back to cached_beam_search if the reader cannot
+    // issue reads asynchronously
+    DISKANN_DLLEXPORT void pipelined_beam_search(
+        const T *query, const _u64 k_search, const _u64 l_search, _u64 *res_ids,
+        float *res_dists, const _u64 beam_width, QueryStats *stats = nullptr);
+
 
   DISKANN_DLLEXPORT _u32 range_search(const T *query1, const double range,
                                      const _u64          min_l_search,
@@ -130,6 +189,15 @@ namespace diskann {
     DISKANN_DLLEXPORT void setup_thread_data(_u64 nthreads);
     DISKANN_DLLEXPORT void destroy_thread_data();
 
+    // reads the nodes of node_list into a new cache, copying the ones already
+    // in old instead of reading them
+    std::shared_ptr<NodeCache<T>> read_node_cache(
+        const std::vector<uint32_t> &node_list, IOContext &ctx,
+        const NodeCache<T> *old);
+    std::shared_ptr<const NodeCache<T>> get_node_cache();
+    void                                refresh_adaptive_cache(IOContext &ctx);
+    void                                adaptive_cache_loop();
+
    private:
     // index info
     // nhood of node `i` is in sector: [i / nnodes_per_sector]
@@ -162,6 +230,10 @@ namespace diskann {
     _u64              n_chunks;
     FixedChunkPQTable pq_table;
 
+    // 4-bit PQ data, used instead of the above if use_fast_scan
+    bool            use_fast_scan = false;
+    FastScanPQTable fast_scan_table;
+
     // distance comparator
     Distance<T> *    dist_cmp = nullptr;
     Distance<float> *dist_cmp_float = nullptr;
@@ -181,13 +253,25 @@ namespace diskann {
                   // centroids, we pick the medoid corresponding to the
                   // closest centroid as the starting point of search
 
-    // nhood_cache
-    unsigned *                                    nhood_cache_buf = nullptr;
-    tsl::robin_map<_u32, std::pair<_u32, _u32 *>> nhood_cache;
+    // node cache; a search takes a snapshot of it (get_node_cache) for its
+    // whole duration, so that publishing a new cache never blocks it and the
+    // old cache is freed by its last reader
+    std::shared_ptr<const NodeCache<T>> node_cache =
+        std::make_shared<NodeCache<T>>();
+    std::atomic<_u64> cache_lookups{0};
+    std::atomic<_u64> cache_hits{0};
 
-    // coord_cache
-    T *                       coord_cache_buf = nullptr;
-    tsl::robin_map<_u32, T *> coord_cache;
+    // adaptive cache
+    bool                    adaptive_cache = false;
+    std::vector<_u32>       node_access_counts;  // incremented atomically
+    _u64                    adaptive_cache_budget = 0;
+    _u32                    adaptive_cache_period_ms = 0;
+    _u64                    cache_refreshes = 0;
+    _u64                    cache_promotions = 0;
+    std::thread             cache_refresher;
+    std::mutex              cache_refresher_mut;
+    std::condition_variable cache_refresher_cv;
+    bool                    cache_refresher_stop = false;
 
     // thread-specific scratch
     ConcurrentQueue<ThreadData<T>> thread_data;
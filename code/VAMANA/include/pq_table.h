@@ -8,16 +8,18 @@
 namespace diskann {
   class FixedChunkPQTable {
     // data_dim = n_chunks * chunk_size;
-    float* tables =
-        nullptr;  // pq_tables = float* [[2^8 * [chunk_size]] * n_chunks]
+    float* tables = nullptr;  // pq_tables = float* [[num_centers *
+                              // [chunk_size]] * n_chunks]
     //    _u64   n_chunks;    // n_chunks = # of chunks ndims is split into
     //    _u64   chunk_size;  // chunk_size = chunk size of each dimension chunk
     _u64   ndims = 0;  // ndims = chunk_size * n_chunks
     _u64   n_chunks = 0;
+    _u64   num_centers = 256;  // 2^8, or 2^4 for the fast-scan tables
     _u32*  chunk_offsets = nullptr;
     _u32*  rearrangement = nullptr;
     float* centroid = nullptr;
     float* tables_T = nullptr;  // same as pq_tables, but col-major
+    float* rotmat_tr = nullptr;  // OPQ rotation R [ndims][ndims], if any
    public:
     FixedChunkPQTable() {
     }
@@ -34,6 +36,8 @@ namespace diskann {
         delete[] chunk_offsets;
       if (centroid != nullptr)
         delete[] centroid;
+      if (rotmat_tr != nullptr)
+        delete[] rotmat_tr;
 #endif
     }
 
@@ -48,8 +52,10 @@ namespace diskann {
     std::string chunk_offset_file =
         std::string(pq_table_file) + "_chunk_offsets.bin";
     std::string centroid_file = std::string(pq_table_file) + "_centroid.bin";
+    std::string rotmat_file =
+        std::string(pq_table_file) + "_rotation_matrix.bin";
 
-    // bin structure: [256][ndims][ndims(float)]
+    // bin structure: [num_centers][ndims][ndims(float)]
     uint64_t numr, numc;
     size_t   npts_u64, ndims_u64;
 #ifdef EXEC_ENV_OLS
@@ -58,6 +64,7 @@ namespace diskann {
       diskann::load_bin<float>(pq_table_file, tables, npts_u64, ndims_u64);
 #endif
     this->ndims = ndims_u64;
+    this->num_centers = npts_u64;
 
     if (file_exists(chunk_offset_file)) {
 #ifdef EXEC_ENV_OLS
@@ -113,15 +120,34 @@ namespace diskann {
       std::memset(centroid, 0, ndims * sizeof(float));
     }
 
+    // OPQ: the pivots are in the space of (x - centroid) * R, so the query is
+    // rotated by preprocess_query and the centroid is moved to that space
+    if (file_exists(rotmat_file)) {
+#ifdef EXEC_ENV_OLS
+      diskann::load_bin<float>(files, rotmat_file, rotmat_tr, numr, numc);
+#else
+      diskann::load_bin<float>(rotmat_file, rotmat_tr, numr, numc);
+#endif
+      if (numr != ndims_u64 || numc != ndims_u64) {
+        diskann::cerr << "Error loading rotation matrix file" << std::endl;
+        throw diskann::ANNException("Error loading rotation matrix file", -1,
+                                    __FUNCSIG__, __FILE__, __LINE__);
+      }
+      std::vector<float> rotated_centroid(ndims);
+      rotate(centroid, rotated_centroid.data());
+      std::memcpy(centroid, rotated_centroid.data(), ndims * sizeof(float));
+      diskann::cout << "Loaded OPQ rotation matrix" << std::endl;
+    }
+
     diskann::cout << "PQ Pivots: #ctrs: " << npts_u64
                   << ", #dims: " << ndims_u64 << ", #chunks: " << n_chunks
                   << std::endl;
     //      assert((_u64) ndims_u32 == n_chunks * chunk_size);
     // alloc and compute transpose
-    tables_T = new float[256 * ndims_u64];
-    for (_u64 i = 0; i < 256; i++) {
+    tables_T = new float[num_centers * ndims_u64];
+    for (_u64 i = 0; i < num_centers; i++) {
       for (_u64 j = 0; j < ndims_u64; j++) {
-        tables_T[j * 256 + i] = tables[i * ndims_u64 + j];
+        tables_T[j * num_centers + i] = tables[i * ndims_u64 + j];
       }
     }
   }
@@ -130,16 +156,35 @@ namespace diskann {
   get_num_chunks() {
     return n_chunks;
   }
+
+  _u64 get_num_centers() {
+    return num_centers;
+  }
+
+  bool use_rotation() {
+    return rotmat_tr != nullptr;
+  }
+
+  // with OPQ, the query to give to the functions below: query_vec * R
+  // (rotated: [ndims])
+  void preprocess_query(const float* query_vec, float* rotated) {
+    if (rotmat_tr == nullptr)
+      std::memcpy(rotated, query_vec, ndims * sizeof(float));
+    else
+      rotate(query_vec, rotated);
+  }
+
+  // dist_vec: [num_centers] distances per chunk
   void populate_chunk_distances(const float* query_vec, float* dist_vec) {
-    memset(dist_vec, 0, 256 * n_chunks * sizeof(float));
+    memset(dist_vec, 0, num_centers * n_chunks * sizeof(float));
     // chunk wise distance computation
     for (_u64 chunk = 0; chunk < n_chunks; chunk++) {
       // sum (q-c)^2 for the dimensions associated with this chunk
-      float* chunk_dists = dist_vec + (256 * chunk);
+      float* chunk_dists = dist_vec + (num_centers * chunk);
       for (_u64 j = chunk_offsets[chunk]; j < chunk_offsets[chunk + 1]; j++) {
         _u64         permuted_dim_in_query = rearrangement[j];
-        const float* centers_dim_vec = tables_T + (256 * j);
-        for (_u64 idx = 0; idx < 256; idx++) {
+        const float* centers_dim_vec = tables_T + (num_centers * j);
+        for (_u64 idx = 0; idx < num_centers; idx++) {
           double diff =
               centers_dim_vec[idx] - (query_vec[permuted_dim_in_query] -
                                       centroid[permuted_dim_in_query]);
@@ -154,7 +199,7 @@ namespace diskann {
     for (_u64 chunk = 0; chunk < n_chunks; chunk++) {
       for (_u64 j = chunk_offsets[chunk]; j < chunk_offsets[chunk + 1]; j++) {
         _u64         permuted_dim_in_query = rearrangement[j];
-        const float* centers_dim_vec = tables_T + (256 * j);
+        const float* centers_dim_vec = tables_T + (num_centers * j);
         float        diff = centers_dim_vec[base_vec[chunk]] -
                      (query_vec[permuted_dim_in_query] -
                       centroid[permuted_dim_in_query]);
@@ -169,7 +214,7 @@ namespace diskann {
     for (_u64 chunk = 0; chunk < n_chunks; chunk++) {
       for (_u64 j = chunk_offsets[chunk]; j < chunk_offsets[chunk + 1]; j++) {
         _u64         permuted_dim_in_query = rearrangement[j];
-        const float* centers_dim_vec = tables_T + (256 * j);
+        const float* centers_dim_vec = tables_T + (num_centers * j);
         float        diff =
             centers_dim_vec[base_vec[chunk]] *
             query_vec[permuted_dim_in_query];  // assumes centroid is 0 to
@@ -182,26 +227,36 @@ namespace diskann {
   }
 
   void inflate_vector(_u8* base_vec, float* out_vec) {
+    std::vector<float> rotated(rotmat_tr != nullptr ? ndims : 0);
+    float*             inflated = rotmat_tr != nullptr ? rotated.data() : out_vec;
     for (_u64 chunk = 0; chunk < n_chunks; chunk++) {
       for (_u64 j = chunk_offsets[chunk]; j < chunk_offsets[chunk + 1]; j++) {
         _u64         original_dim = rearrangement[j];
-        const float* centers_dim_vec = tables_T + (256 * j);
-        out_vec[original_dim] =
+        const float* centers_dim_vec = tables_T + (num_centers * j);
+        inflated[original_dim] =
             centers_dim_vec[base_vec[chunk]] + centroid[original_dim];
       }
     }
+    // back from the rotated space: R is orthogonal, so its inverse is R^T
+    if (rotmat_tr != nullptr) {
+      for (_u64 d = 0; d < ndims; d++) {
+        out_vec[d] = 0;
+        for (_u64 j = 0; j < ndims; j++)
+          out_vec[d] += rotmat_tr[d * ndims + j] * rotated[j];
+      }
+    }
   }
 
   void populate_chunk_inner_products(const float* query_vec, float* dist_vec) {
-    memset(dist_vec, 0, 256 * n_chunks * sizeof(float));
+    memset(dist_vec, 0, num_centers * n_chunks * sizeof(float));
     // chunk wise distance computation
     for (_u64 chunk = 0; chunk < n_chunks; chunk++) {
       // sum (q-c)^2 for the dimensions associated with this chunk
-      float* chunk_dists = dist_vec + (256 * chunk);
+      float* chunk_dists = dist_vec + (num_centers * chunk);
       for (_u64 j = chunk_offsets[chunk]; j < chunk_offsets[chunk + 1]; j++) {
         _u64         permuted_dim_in_query = rearrangement[j];
-        const float* centers_dim_vec = tables_T + (256 * j);
-        for (_u64 idx = 0; idx < 256; idx++) {
+        const float* centers_dim_vec = tables_T + (num_centers * j);
+        for (_u64 idx = 0; idx < num_centers; idx++) {
           double prod =
               centers_dim_vec[idx] *
               query_vec[permuted_dim_in_query];  // assumes that we are not
@@ -215,5 +270,17 @@ namespace diskann {
       }
     }
   }
+
+ private:
+  // out = in * R
+  void rotate(const float* in, float* out) {
+    for (_u64 j = 0; j < ndims; j++)
+      out[j] = 0;
+    for (_u64 d = 0; d < ndims; d++) {
+      const float* row = rotmat_tr + d * ndims;
+      for (_u64 j = 0; j < ndims; j++)
+        out[j] += in[d] * row[j];
+    }
+  }
 };  // namespace diskann
 }  // namespace diskann
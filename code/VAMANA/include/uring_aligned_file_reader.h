@@ -0,0 +1,69 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#pragma once
+#if !defined(_WINDOWS) && defined(USE_IO_URING)
+
+#include <liburing.h>
+#include <unordered_map>
+#include "aligned_file_reader.h"
+
+// Ring of one thread, with the file and the scratch buffer registered on it
+struct UringContext {
+  struct io_uring ring;
+  bool            fixed_file = false;  // the index file is fixed file 0
+  char*           fixed_buf = nullptr;  // fixed buffer 0, if registered
+  uint64_t        fixed_len = 0;
+  // length of every read submitted by submit_reads(), by buffer, until reaped
+  std::unordered_map<void*, uint64_t> pending_len;
+};
+
+// AlignedFileReader over io_uring. Every registered thread owns a ring on
+// which the index file and the sector scratch of the thread are registered,
+// so the kernel does not look them up and map them again on every read.
+// read() queues all its requests and enters the kernel once to submit them
+// and wait for them. With sqpoll, a kernel thread (shared by all the rings)
+// polls the submission queues and the completions are polled as well, so a
+// read does not need any system call.
+class UringAlignedFileReader : public AlignedFileReader {
+ private:
+  FileHandle file_desc;
+  bool       sqpoll;
+  int        sq_owner_fd;  // ring whose kernel threads the others attach to
+  IOContext  bad_ctx;
+
+  void destroy_ctx(IOContext &ctx);
+
+ public:
+  UringAlignedFileReader(bool sqpoll = false);
+  ~UringAlignedFileReader();
+
+  IOContext &get_ctx();
+
+  // register thread-id for a context
+  void register_thread();
+
+  // de-register thread-id for a context
+  void deregister_thread();
+
+  // Open & close ops
+  // Blocking calls
+  void open(const std::string &fname);
+  void close();
+
+  // process batch of aligned requests in parallel
+  // NOTE :: blocking call
+  void read(std::vector<AlignedRead> &read_reqs, IOContext &ctx,
+            bool async = false);
+
+  bool supports_async_reads() {
+    return true;
+  }
+  void submit_reads(std::vector<AlignedRead> &read_reqs, IOContext &ctx);
+  void reap_reads(IOContext &ctx, uint64_t min_nr,
+                  std::vector<void *> &done_bufs);
+
+  void register_buffer(IOContext &ctx, void *buf, uint64_t len);
+};
+
+#endif
@@ -639,7 +639,7 @@ namespace diskann {
   template<typename T>
   bool build_disk_index(const char *dataFilePath, const char *indexFilePath,
                         const char *    indexBuildParameters,
-                        diskann::Metric compareMetric) {
+                        diskann::Metric compareMetric, bool use_opq) {
     std::stringstream parser;
     parser << std::string(indexBuildParameters);
     std::string              cur_param;
@@ -647,14 +647,15 @@ namespace diskann {
     while (parser >> cur_param)
       param_list.push_back(cur_param);
 
-    if (param_list.size() != 5 && param_list.size() != 6) {
+    if (param_list.size() < 5 || param_list.size() > 7) {
       diskann::cout
           << "Correct usage of parameters is R (max degree) "
              "L (indexing list size, better if >= R) B (RAM limit of final "
              "index in "
              "GB) M (memory limit while indexing) T (number of threads for "
              "indexing) B' (PQ bytes for disk index: optional parameter for "
-             "very large dimensional data)"
+             "very large dimensional data) F (4-bit PQ chunks for fast-scan "
+             "search: optional parameter)"
           << std::endl;
       return false;
     }
@@ -674,19 +675,28 @@ namespace diskann {
     // if there is a 6th parameter, it means we compress the disk index vectors
     // also using PQ data (for very large dimensionality data). If the provided
     // parameter is 0, it means we store full vectors.
-    if (param_list.size() == 6) {
+    if (param_list.size() >= 6) {
       disk_pq_dims = atoi(param_list[5].c_str());
       use_disk_pq = true;
       if (disk_pq_dims == 0)
         use_disk_pq = false;
     }
 
+    // a 7th parameter > 0 also compresses the vectors into that many 4-bit
+    // codes, for the fast-scan distance tables of the search
+    _u32 fast_scan_chunks = 0;
+    if (param_list.size() == 7)
+      fast_scan_chunks = atoi(param_list[6].c_str());
+
     std::string base_file(dataFilePath);
     std::string data_file_to_use = base_file;
     std::string index_prefix_path(indexFilePath);
     std::string pq_pivots_path = index_prefix_path + "_pq_pivots.bin";
     std::string pq_compressed_vectors_path =
         index_prefix_path + "_pq_compressed.bin";
+    std::string fast_scan_pivots_path = index_prefix_path + "_pq_fs_pivots.bin";
+    std::string fast_scan_compressed_vectors_path =
+        index_prefix_path + "_pq_fs_compressed.bin";
     std::string mem_index_path = index_prefix_path + "_mem.index";
     std::string disk_index_path = index_prefix_path + "_disk.index";
     std::string medoids_path = disk_index_path + "_medoids.bin";
@@ -797,14 +807,35 @@ namespace diskann {
     if (compareMetric == diskann::Metric::INNER_PRODUCT)
       make_zero_mean = false;
 
-    generate_pq_pivots(train_data, train_size, (uint32_t) dim, 256,
-                       (uint32_t) num_pq_chunks, NUM_KMEANS_REPS,
-                       pq_pivots_path, make_zero_mean);
+    if (use_opq)
+      generate_opq_pivots(train_data, train_size, (uint32_t) dim, 256,
+                          (uint32_t) num_pq_chunks, NUM_KMEANS_REPS,
+                          NUM_OPQ_ITERS, pq_pivots_path, make_zero_mean);
+    else
+      generate_pq_pivots(train_data, train_size, (uint32_t) dim, 256,
+                         (uint32_t) num_pq_chunks, NUM_KMEANS_REPS,
+                         pq_pivots_path, make_zero_mean);
 
     generate_pq_data_from_pivots<T>(data_file_to_use.c_str(), 256,
                                     (uint32_t) num_pq_chunks, pq_pivots_path,
                                     pq_compressed_vectors_path);
 
+    if (fast_scan_chunks > 0) {
+      fast_scan_chunks = (std::min)(fast_scan_chunks, (_u32) dim);
+      fast_scan_chunks =
+          (std::min)(fast_scan_chunks, (_u32) MAX_FAST_SCAN_CHUNKS);
+      diskann::cout << "Compressing " << dim << "-dimensional data into "
+                    << fast_scan_chunks << " 4-bit codes per vector for "
+                    << "fast-scan search." << std::endl;
+      generate_pq_pivots(train_data, train_size, (uint32_t) dim,
+                         NUM_FAST_SCAN_CENTERS, fast_scan_chunks,
+                         NUM_KMEANS_REPS, fast_scan_pivots_path,
+                         make_zero_mean);
+      generate_pq_data_from_pivots<T>(
+          data_file_to_use.c_str(), NUM_FAST_SCAN_CENTERS, fast_scan_chunks,
+          fast_scan_pivots_path, fast_scan_compressed_vectors_path);
+    }
+
     delete[] train_data;
 
     train_data = nullptr;
@@ -887,13 +918,16 @@ namespace diskann {
 
   template DISKANN_DLLEXPORT bool build_disk_index<int8_t>(
       const char *dataFilePath, const char *indexFilePath,
-      const char *indexBuildParameters, diskann::Metric compareMetric);
+      const char *indexBuildParameters, diskann::Metric compareMetric,
+      bool use_opq);
   template DISKANN_DLLEXPORT bool build_disk_index<uint8_t>(
       const char *dataFilePath, const char *indexFilePath,
-      const char *indexBuildParameters, diskann::Metric compareMetric);
+      const char *indexBuildParameters, diskann::Metric compareMetric,
+      bool use_opq);
   template DISKANN_DLLEXPORT bool build_disk_index<float>(
       const char *dataFilePath, const char *indexFilePath,
-      const char *indexBuildParameters, diskann::Metric compareMetric);
+      const char *indexBuildParameters, diskann::Metric compareMetric,
+      bool use_opq);
 
   template DISKANN_DLLEXPORT int build_merged_vamana_index<int8_t>(
       std::string base_file, diskann::Metric compareMetric, unsigned L,
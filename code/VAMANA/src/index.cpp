@@ -430,13 +430,27 @@ namespace diskann {
       std::vector<Neighbor> &      expanded_nodes_info,
       tsl::robin_set<unsigned> &   expanded_nodes_ids,
       std::vector<Neighbor> &      best_L_nodes) {
+    tsl::robin_set<unsigned> inserted_into_pool;
+    return iterate_to_fixed_point(node_coords, Lsize, init_ids,
+                                  expanded_nodes_info, expanded_nodes_ids,
+                                  best_L_nodes, inserted_into_pool);
+  }
+
+  template<typename T, typename TagT>
+  std::pair<unsigned int, unsigned int> Index<T, TagT>::iterate_to_fixed_point(
+      const T *node_coords, const unsigned Lsize,
+      const std::vector<unsigned> &init_ids,
+      std::vector<Neighbor> &      expanded_nodes_info,
+      tsl::robin_set<unsigned> &   expanded_nodes_ids,
+      std::vector<Neighbor> &      best_L_nodes,
+      tsl::robin_set<unsigned> &   inserted_into_pool) {
     best_L_nodes.resize(Lsize + 1);
     expanded_nodes_info.reserve(10 * Lsize);
     expanded_nodes_ids.reserve(10 * Lsize);
 
-    unsigned                 l = 0;
-    Neighbor                 nn;
-    tsl::robin_set<unsigned> inserted_into_pool;
+    unsigned l = 0;
+    Neighbor nn;
+    inserted_into_pool.clear();
     inserted_into_pool.reserve(Lsize * 20);
     unsigned int hops = 0;
     unsigned int cmps = 0;
@@ -1122,6 +1136,47 @@ float dist;
     return retval;
   }
 
+  template<typename T, typename TagT>
+  void Index<T, TagT>::batch_search(const T *queries, const size_t num_queries,
+                                    const size_t   query_aligned_dim,
+                                    const uint64_t K, const unsigned L,
+                                    uint64_t *indices, float *distances,
+                                    const unsigned num_threads,
+                                    double *       latencies) {
+    // 0 threads (e.g. hardware_concurrency() - 1 on one core) runs serially
+    const unsigned n_threads = (std::max)(1u, num_threads);
+    std::vector<SearchScratch> scratch(n_threads);
+#pragma omp parallel num_threads(n_threads)
+    {
+      SearchScratch &s = scratch[omp_get_thread_num()];
+#pragma omp for schedule(dynamic, 1)
+      for (int64_t i = 0; i < (int64_t) num_queries; i++) {
+        auto qs = std::chrono::high_resolution_clock::now();
+        s.init_ids.clear();
+        s.init_ids.emplace_back(_ep);
+        s.expanded_nodes_info.clear();
+        s.expanded_nodes_ids.clear();
+        iterate_to_fixed_point(queries + i * query_aligned_dim, L, s.init_ids,
+                               s.expanded_nodes_info, s.expanded_nodes_ids,
+                               s.best_L_nodes, s.inserted_into_pool);
+
+        uint64_t *query_indices = indices + i * K;
+        float *   query_distances = distances + i * K;
+        for (uint64_t pos = 0; pos < K && pos < s.best_L_nodes.size(); pos++) {
+          query_indices[pos] = s.best_L_nodes[pos].id;
+          query_distances[pos] = s.best_L_nodes[pos].distance;
+          if (_metric == diskann::INNER_PRODUCT)
+            query_distances[pos] = -query_distances[pos];
+        }
+        if (latencies != nullptr) {
+          std::chrono::duration<double> latency =
+              std::chrono::high_resolution_clock::now() - qs;
+          latencies[i] = latency.count();
+        }
+      }
+    }
+  }
+
   template<typename T, typename TagT>
   std::pair<uint32_t, uint32_t> Index<T, TagT>::search_with_tags(
       const T *query, const size_t K, const unsigned L, TagT *tags,
@@ -1164,15 +1219,54 @@ float dist;
   template<typename T, typename TagT>
   void Index<T, TagT>::search_with_opt_graph(const T *query, size_t K, size_t L,
                                              unsigned *indices) {
+    SearchScratch scratch;
+    search_with_opt_graph(query, K, L, indices, scratch);
+  }
+
+  template<typename T, typename TagT>
+  void Index<T, TagT>::batch_search_with_opt_graph(
+      const T *queries, const size_t num_queries,
+      const size_t query_aligned_dim, const size_t K, const size_t L,
+      unsigned *indices, const unsigned num_threads, double *latencies) {
+    // 0 threads (e.g. hardware_concurrency() - 1 on one core) runs serially
+    const unsigned n_threads = (std::max)(1u, num_threads);
+    std::vector<SearchScratch> scratch(n_threads);
+#pragma omp parallel num_threads(n_threads)
+    {
+      SearchScratch &s = scratch[omp_get_thread_num()];
+#pragma omp for schedule(dynamic, 1)
+      for (int64_t i = 0; i < (int64_t) num_queries; i++) {
+        auto qs = std::chrono::high_resolution_clock::now();
+        search_with_opt_graph(queries + i * query_aligned_dim, K, L,
+                              indices + i * K, s);
+        if (latencies != nullptr) {
+          std::chrono::duration<double> latency =
+              std::chrono::high_resolution_clock::now() - qs;
+          latencies[i] = latency.count();
+        }
+      }
+    }
+  }
+
+  template<typename T, typename TagT>
+  void Index<T, TagT>::search_with_opt_graph(const T *query, size_t K, size_t L,
+                                             unsigned *      indices,
+                                             SearchScratch &scratch) {
     DistanceFastL2<T> *dist_fast = (DistanceFastL2<T> *) _distance;
 
-    std::vector<Neighbor> retset(L + 1);
-    std::vector<unsigned> init_ids(L);
+    std::vector<Neighbor> &retset = scratch.best_L_nodes;
+    std::vector<unsigned> &init_ids = scratch.init_ids;
+    retset.assign(L + 1, Neighbor());
+    init_ids.resize(L);
     // std::mt19937 rng(rand());
     // GenRandom(rng, init_ids.data(), L, (unsigned) nd_);
 
-    boost::dynamic_bitset<> flags{_nd, 0};
-    unsigned                tmp_l = 0;
+    // cleared in place, it is only allocated by the first query of a scratch
+    boost::dynamic_bitset<> &flags = scratch.flags;
+    if (flags.size() != _nd)
+      flags.resize(_nd);
+    flags.reset();
+    unsigned tmp_l = 0;
     unsigned *              neighbors =
         (unsigned *) (_opt_graph + _node_size * _ep + _data_len);
     unsigned MaxM_ep = *neighbors;
@@ -2,10 +2,14 @@
 // Licensed under the MIT license.
 
 #include "linux_aligned_file_reader.h"
+#ifdef USE_IO_URING
+#include "uring_aligned_file_reader.h"
+#endif
 
 #include <cassert>
 #include <cstdio>
 #include <iostream>
+#include "ann_exception.h"
 #include "tsl/robin_map.h"
 #include "utils.h"
 #define MAX_EVENTS 1024
@@ -93,6 +97,7 @@ namespace {
 
 LinuxAlignedFileReader::LinuxAlignedFileReader() {
   this->file_desc = -1;
+  this->bad_ctx.aio_ctx = (io_context_t) -1;
 }
 
 LinuxAlignedFileReader::~LinuxAlignedFileReader() {
@@ -113,7 +118,7 @@ LinuxAlignedFileReader::~LinuxAlignedFileReader() {
   }
 }
 
-io_context_t &LinuxAlignedFileReader::get_ctx() {
+IOContext &LinuxAlignedFileReader::get_ctx() {
   std::unique_lock<std::mutex> lk(ctx_mut);
   // perform checks only in DEBUG mode
   if (ctx_map.find(std::this_thread::get_id()) == ctx_map.end()) {
@@ -132,8 +137,8 @@ void LinuxAlignedFileReader::register_thread() {
               << std::endl;
     return;
   }
-  io_context_t ctx = 0;
-  int          ret = io_setup(MAX_EVENTS, &ctx);
+  IOContext ctx;
+  int       ret = io_setup(MAX_EVENTS, &ctx.aio_ctx);
   if (ret != 0) {
     lk.unlock();
     assert(errno != EAGAIN);
@@ -141,8 +146,8 @@ void LinuxAlignedFileReader::register_thread() {
     std::cerr << "io_setup() failed; returned " << ret << ", errno=" << errno
               << ":" << ::strerror(errno) << std::endl;
   } else {
-    diskann::cout << "allocating ctx: " << ctx << " to thread-id:" << my_id
-                  << std::endl;
+    diskann::cout << "allocating ctx: " << ctx.aio_ctx
+                  << " to thread-id:" << my_id << std::endl;
     ctx_map[my_id] = ctx;
   }
   lk.unlock();
@@ -154,7 +159,7 @@ void LinuxAlignedFileReader::deregister_thread() {
   assert(ctx_map.find(my_id) != ctx_map.end());
 
   lk.unlock();
-  io_context_t ctx = this->get_ctx();
+  io_context_t ctx = this->get_ctx().aio_ctx;
   io_destroy(ctx);
   //  assert(ret == 0);
   lk.lock();
@@ -183,11 +188,79 @@ void LinuxAlignedFileReader::close() {
 }
 
 void LinuxAlignedFileReader::read(std::vector<AlignedRead> &read_reqs,
-                                  io_context_t &ctx, bool async) {
+                                  IOContext &ctx, bool async) {
   assert(this->file_desc != -1);
   //#pragma omp critical
   //	std::cout << "thread: " << std::this_thread::get_id() << ", crtx: " <<
   // ctx
   //<< "\n";
-  execute_io(ctx, this->file_desc, read_reqs);
+  execute_io(ctx.aio_ctx, this->file_desc, read_reqs);
+}
+
+// The control blocks must live until their reads complete, so each one is
+// allocated here and released by reap_reads() through the event.
+void LinuxAlignedFileReader::submit_reads(std::vector<AlignedRead> &read_reqs,
+                                          IOContext &               ctx) {
+  assert(this->file_desc != -1);
+  if (read_reqs.empty())
+    return;
+  std::vector<iocb_t *> cbs(read_reqs.size());
+  for (uint64_t j = 0; j < read_reqs.size(); j++) {
+    cbs[j] = new iocb_t;
+    io_prep_pread(cbs[j], this->file_desc, read_reqs[j].buf, read_reqs[j].len,
+                  read_reqs[j].offset);
+    cbs[j]->data = read_reqs[j].buf;
+  }
+  int64_t ret = io_submit(ctx.aio_ctx, (int64_t) cbs.size(), cbs.data());
+  if (ret != (int64_t) cbs.size()) {
+    std::cerr << "io_submit() failed; returned " << ret
+              << ", expected=" << cbs.size() << ", ernno=" << errno << "="
+              << ::strerror(-ret) << std::endl;
+    exit(-1);
+  }
+}
+
+void LinuxAlignedFileReader::reap_reads(IOContext &ctx, uint64_t min_nr,
+                                        std::vector<void *> &done_bufs) {
+  io_event_t evts[MAX_IO_DEPTH];
+  int64_t    ret = io_getevents(ctx.aio_ctx, (int64_t) min_nr, MAX_IO_DEPTH,
+                             evts, nullptr);
+  if (ret < (int64_t) min_nr) {
+    std::cerr << "io_getevents() failed; returned " << ret
+              << ", expected>=" << min_nr << ", ernno=" << errno << "="
+              << ::strerror(-ret) << std::endl;
+    exit(-1);
+  }
+  for (int64_t i = 0; i < ret; i++) {
+    // res is the byte count, or -errno, of the read
+    int64_t  res = (int64_t) evts[i].res;
+    uint64_t nbytes = evts[i].obj->u.c.nbytes;
+    delete evts[i].obj;
+    if (res != (int64_t) nbytes) {
+      std::cerr << "io_getevents() read failed; returned " << res
+                << ", expected=" << nbytes << ", ernno=" << -res << "="
+                << (res < 0 ? ::strerror(-res) : "short read") << std::endl;
+      exit(-1);
+    }
+    done_bufs.push_back(evts[i].data);
+  }
+}
+
+AlignedFileReader *create_linux_aligned_file_reader(const std::string &backend) {
+  if (backend == "aio")
+    return new LinuxAlignedFileReader();
+#ifdef USE_IO_URING
+  if (backend == "uring")
+    return new UringAlignedFileReader(false);
+  if (backend == "uring_sqpoll")
+    return new UringAlignedFileReader(true);
+#else
+  if (backend == "uring" || backend == "uring_sqpoll")
+    throw diskann::ANNException(
+        "The io_uring reader is not built, configure with -DUSE_IO_URING=ON",
+        -1, __FUNCSIG__, __FILE__, __LINE__);
+#endif
+  throw diskann::ANNException("Unknown IO backend " + backend +
+                                  " (expected aio, uring or uring_sqpoll)",
+                              -1, __FUNCSIG__, __FILE__, __LINE__);
 }
@@ -361,6 +361,200 @@ int generate_pq_pivots(const float *passed_train_data, size_t num_train,
   return 0;
 }
 
+// OPQ: learns a rotation R of the (centered) data along with the PQ pivots, so
+// that correlated dimensions do not end up quantized in the same chunk.
+// Alternates k-means in every chunk of the rotated training data X * R with
+// the rotation minimizing the reconstruction error ||X * R - Y||, where Y is
+// the reconstruction of X * R from the pivots: R = U * V^T for the SVD
+// U * S * V^T of X^T * Y. The chunks are contiguous dimensions of the rotated
+// space (identity rearrangement), the pivots are saved in that space and R in
+// <pq_pivots_path>_rotation_matrix.bin; generate_pq_data_from_pivots and
+// FixedChunkPQTable rotate the data and the queries accordingly.
+int generate_opq_pivots(const float *passed_train_data, size_t num_train,
+                        unsigned dim, unsigned num_centers,
+                        unsigned num_pq_chunks, unsigned max_k_means_reps,
+                        unsigned num_opq_iters, std::string pq_pivots_path,
+                        bool make_zero_mean) {
+  if (num_pq_chunks > dim) {
+    diskann::cout << " Error: number of chunks more than dimension"
+                  << std::endl;
+    return -1;
+  }
+
+  std::unique_ptr<float[]> train_data =
+      std::make_unique<float[]>(num_train * dim);
+  std::memcpy(train_data.get(), passed_train_data,
+              num_train * dim * sizeof(float));
+
+  std::unique_ptr<float[]> full_pivot_data;
+
+  if (file_exists(pq_pivots_path)) {
+    size_t file_dim, file_num_centers;
+    diskann::load_bin<float>(pq_pivots_path, full_pivot_data, file_num_centers,
+                             file_dim);
+    if (file_dim == dim && file_num_centers == num_centers &&
+        file_exists(pq_pivots_path + "_rotation_matrix.bin")) {
+      diskann::cout << "OPQ pivot file exists. Not generating again"
+                    << std::endl;
+      return -1;
+    }
+  }
+
+  // Calculate centroid and center the training data, see generate_pq_pivots
+  std::unique_ptr<float[]> centroid = std::make_unique<float[]>(dim);
+  for (uint64_t d = 0; d < dim; d++) {
+    centroid[d] = 0;
+  }
+  if (make_zero_mean) {
+    for (uint64_t d = 0; d < dim; d++) {
+      for (uint64_t p = 0; p < num_train; p++) {
+        centroid[d] += train_data[p * dim + d];
+      }
+      centroid[d] /= num_train;
+    }
+
+    for (uint64_t d = 0; d < dim; d++) {
+      for (uint64_t p = 0; p < num_train; p++) {
+        train_data[p * dim + d] -= centroid[d];
+      }
+    }
+  }
+
+  std::vector<uint32_t> rearrangement(dim);
+  std::vector<uint32_t> chunk_offsets(num_pq_chunks + 1);
+  for (uint32_t d = 0; d < dim; d++)
+    rearrangement[d] = d;
+  for (uint32_t b = 0; b <= num_pq_chunks; b++)
+    chunk_offsets[b] = (uint32_t)(((uint64_t) b * dim) / num_pq_chunks);
+
+  full_pivot_data.reset(new float[num_centers * dim]);
+  std::unique_ptr<float[]> rotmat_tr = std::make_unique<float[]>(dim * dim);
+  std::unique_ptr<float[]> rotated_train_data =
+      std::make_unique<float[]>(num_train * dim);
+  std::unique_ptr<float[]> reconstructed_train_data =
+      std::make_unique<float[]>(num_train * dim);
+  std::unique_ptr<float[]> correlation_matrix =
+      std::make_unique<float[]>(dim * dim);
+  std::unique_ptr<float[]> singular_values = std::make_unique<float[]>(dim);
+  std::unique_ptr<float[]> u_matrix = std::make_unique<float[]>(dim * dim);
+  std::unique_ptr<float[]> vt_matrix = std::make_unique<float[]>(dim * dim);
+
+  std::memset(rotmat_tr.get(), 0, dim * dim * sizeof(float));
+  for (uint64_t d = 0; d < dim; d++)
+    rotmat_tr[d * dim + d] = 1;
+
+  for (unsigned iter = 0; iter < num_opq_iters; iter++) {
+    // rotated_train_data = train_data * R
+    cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, (MKL_INT) num_train,
+                (MKL_INT) dim, (MKL_INT) dim, 1.0f, train_data.get(),
+                (MKL_INT) dim, rotmat_tr.get(), (MKL_INT) dim, 0.0f,
+                rotated_train_data.get(), (MKL_INT) dim);
+
+    for (size_t i = 0; i < num_pq_chunks; i++) {
+      size_t cur_chunk_size = chunk_offsets[i + 1] - chunk_offsets[i];
+
+      if (cur_chunk_size == 0)
+        continue;
+      std::unique_ptr<float[]> cur_pivot_data =
+          std::make_unique<float[]>(num_centers * cur_chunk_size);
+      std::unique_ptr<float[]> cur_data =
+          std::make_unique<float[]>(num_train * cur_chunk_size);
+      std::unique_ptr<uint32_t[]> closest_center =
+          std::make_unique<uint32_t[]>(num_train);
+
+#pragma omp parallel for schedule(static, 65536)
+      for (int64_t j = 0; j < (_s64) num_train; j++) {
+        std::memcpy(cur_data.get() + j * cur_chunk_size,
+                    rotated_train_data.get() + j * dim + chunk_offsets[i],
+                    cur_chunk_size * sizeof(float));
+      }
+
+      // the pivots of the previous rotation are a good start for the next one
+      if (iter == 0) {
+        kmeans::kmeanspp_selecting_pivots(cur_data.get(), num_train,
+                                          cur_chunk_size, cur_pivot_data.get(),
+                                          num_centers);
+      } else {
+        for (uint64_t j = 0; j < num_centers; j++) {
+          std::memcpy(cur_pivot_data.get() + j * cur_chunk_size,
+                      full_pivot_data.get() + j * dim + chunk_offsets[i],
+                      cur_chunk_size * sizeof(float));
+        }
+      }
+
+      kmeans::run_lloyds(cur_data.get(), num_train, cur_chunk_size,
+                         cur_pivot_data.get(), num_centers, max_k_means_reps,
+                         NULL, closest_center.get());
+
+      for (uint64_t j = 0; j < num_centers; j++) {
+        std::memcpy(full_pivot_data.get() + j * dim + chunk_offsets[i],
+                    cur_pivot_data.get() + j * cur_chunk_size,
+                    cur_chunk_size * sizeof(float));
+      }
+
+#pragma omp parallel for schedule(static, 65536)
+      for (int64_t j = 0; j < (_s64) num_train; j++) {
+        std::memcpy(reconstructed_train_data.get() + j * dim + chunk_offsets[i],
+                    cur_pivot_data.get() + closest_center[j] * cur_chunk_size,
+                    cur_chunk_size * sizeof(float));
+      }
+    }
+
+    double error = 0;
+    for (uint64_t j = 0; j < num_train * dim; j++) {
+      double diff = rotated_train_data[j] - reconstructed_train_data[j];
+      error += diff * diff;
+    }
+    diskann::cout << "OPQ iteration " << iter + 1 << "/" << num_opq_iters
+                  << ": mean squared quantization error "
+                  << error / num_train << std::endl;
+
+    // the pivots of the last iteration are trained on the final rotation
+    if (iter + 1 == num_opq_iters)
+      break;
+
+    // correlation_matrix = train_data^T * reconstructed_train_data
+    cblas_sgemm(CblasRowMajor, CblasTrans, CblasNoTrans, (MKL_INT) dim,
+                (MKL_INT) dim, (MKL_INT) num_train, 1.0f, train_data.get(),
+                (MKL_INT) dim, reconstructed_train_data.get(), (MKL_INT) dim,
+                0.0f, correlation_matrix.get(), (MKL_INT) dim);
+
+    MKL_INT ret = LAPACKE_sgesdd(
+        LAPACK_ROW_MAJOR, 'A', (MKL_INT) dim, (MKL_INT) dim,
+        correlation_matrix.get(), (MKL_INT) dim, singular_values.get(),
+        u_matrix.get(), (MKL_INT) dim, vt_matrix.get(), (MKL_INT) dim);
+    if (ret != 0) {
+      std::stringstream stream;
+      stream << "SVD of the OPQ correlation matrix failed, returned " << ret
+             << std::endl;
+      throw diskann::ANNException(stream.str(), -1, __FUNCSIG__, __FILE__,
+                                  __LINE__);
+    }
+
+    // R = U * V^T
+    cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, (MKL_INT) dim,
+                (MKL_INT) dim, (MKL_INT) dim, 1.0f, u_matrix.get(),
+                (MKL_INT) dim, vt_matrix.get(), (MKL_INT) dim, 0.0f,
+                rotmat_tr.get(), (MKL_INT) dim);
+  }
+
+  diskann::save_bin<float>(pq_pivots_path.c_str(), full_pivot_data.get(),
+                           (size_t) num_centers, dim);
+  std::string centroids_path = pq_pivots_path + "_centroid.bin";
+  diskann::save_bin<float>(centroids_path.c_str(), centroid.get(), (size_t) dim,
+                           1);
+  std::string rearrangement_path = pq_pivots_path + "_rearrangement_perm.bin";
+  diskann::save_bin<uint32_t>(rearrangement_path.c_str(), rearrangement.data(),
+                              rearrangement.size(), 1);
+  std::string chunk_offsets_path = pq_pivots_path + "_chunk_offsets.bin";
+  diskann::save_bin<uint32_t>(chunk_offsets_path.c_str(), chunk_offsets.data(),
+                              chunk_offsets.size(), 1);
+  std::string rotmat_path = pq_pivots_path + "_rotation_matrix.bin";
+  diskann::save_bin<float>(rotmat_path.c_str(), rotmat_tr.get(), (size_t) dim,
+                           dim);
+  return 0;
+}
+
 // streams the base file (data_file), and computes the closest centers in each
 // chunk to generate the compressed data_file and stores it in
 // pq_compressed_vectors_path.
@@ -384,6 +578,7 @@ int generate_pq_data_from_pivots(const std::string data_file,
   std::unique_ptr<float[]>    centroid;
   std::unique_ptr<uint32_t[]> rearrangement;
   std::unique_ptr<uint32_t[]> chunk_offsets;
+  std::unique_ptr<float[]>    rotmat_tr;  // OPQ rotation, if any
 
   std::string inflated_pq_file = pq_compressed_vectors_path + "_inflated.bin";
 
@@ -442,6 +637,15 @@ int generate_pq_data_from_pivots(const std::string data_file,
       throw diskann::ANNException(stream.str(), -1, __FUNCSIG__, __FILE__,
                                   __LINE__);
     }
+    std::string rotmat_path = pq_pivots_path + "_rotation_matrix.bin";
+    if (file_exists(rotmat_path)) {
+      diskann::load_bin<float>(rotmat_path.c_str(), rotmat_tr, numr, numc);
+      if (numr != dim || numc != dim) {
+        diskann::cout << "Error reading rotation matrix file." << std::endl;
+        throw diskann::ANNException("Error reading rotation matrix file.", -1,
+                                    __FUNCSIG__, __FILE__, __LINE__);
+      }
+    }
     diskann::cout << "Loaded PQ pivot information" << std::endl;
   }
 
@@ -496,6 +700,15 @@ int generate_pq_data_from_pivots(const std::string data_file,
       }
     }
 
+    if (rotmat_tr != nullptr) {
+      cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans,
+                  (MKL_INT) cur_blk_size, (MKL_INT) dim, (MKL_INT) dim, 1.0f,
+                  block_data_tmp.get(), (MKL_INT) dim, rotmat_tr.get(),
+                  (MKL_INT) dim, 0.0f, block_data_float.get(), (MKL_INT) dim);
+      std::memcpy(block_data_tmp.get(), block_data_float.get(),
+                  cur_blk_size * dim * sizeof(float));
+    }
+
     for (uint64_t p = 0; p < cur_blk_size; p++) {
       for (uint64_t d = 0; d < dim; d++) {
         block_data_float[p * dim + d] =
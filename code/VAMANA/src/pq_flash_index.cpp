@@ -182,6 +182,8 @@ namespace diskann {
 
   template<typename T>
   PQFlashIndex<T>::~PQFlashIndex() {
+    // the refresher reads through the reader, which is closed below
+    this->disable_adaptive_cache();
 #ifndef EXEC_ENV_OLS
     if (data != nullptr) {
       delete[] data;
@@ -190,11 +192,6 @@ namespace diskann {
 
     if (centroid_data != nullptr)
       aligned_free(centroid_data);
-    // delete backing bufs for nhood and coord cache
-    if (nhood_cache_buf != nullptr) {
-      delete[] nhood_cache_buf;
-      diskann::aligned_free(coord_cache_buf);
-    }
 
     delete this->dist_cmp;
     delete this->dist_cmp_float;
@@ -225,12 +222,21 @@ namespace diskann {
         // //Gopal. Commenting out the reallocation!
         diskann::alloc_aligned((void **) &scratch.sector_scratch,
                                MAX_N_SECTOR_READS * SECTOR_LEN, SECTOR_LEN);
+        this->reader->register_buffer(ctx, scratch.sector_scratch,
+                                      MAX_N_SECTOR_READS * SECTOR_LEN);
         diskann::alloc_aligned((void **) &scratch.aligned_scratch,
                                256 * sizeof(float), 256);
         diskann::alloc_aligned((void **) &scratch.aligned_pq_coord_scratch,
                                25600 * sizeof(_u8), 256);
         diskann::alloc_aligned((void **) &scratch.aligned_pqtable_dist_scratch,
                                25600 * sizeof(float), 256);
+        if (this->use_fast_scan) {
+          _u64 fast_scan_size = ROUND_UP(fast_scan_table.scratch_bytes(), 256);
+          diskann::alloc_aligned((void **) &scratch.aligned_fast_scan_lut,
+                                 fast_scan_size, 256);
+          diskann::alloc_aligned((void **) &scratch.aligned_fast_scan_codes,
+                                 fast_scan_size, 256);
+        }
         diskann::alloc_aligned((void **) &scratch.aligned_dist_scratch,
                                512 * sizeof(float), 256);
         diskann::alloc_aligned((void **) &scratch.aligned_query_T,
@@ -238,12 +244,17 @@ namespace diskann {
         diskann::alloc_aligned((void **) &scratch.aligned_query_float,
                                this->aligned_dim * sizeof(float),
                                8 * sizeof(float));
+        diskann::alloc_aligned((void **) &scratch.aligned_rotated_query,
+                               this->aligned_dim * sizeof(float),
+                               8 * sizeof(float));
 
         memset(scratch.aligned_scratch, 0, 256 * sizeof(float));
         memset(scratch.coord_scratch, 0, MAX_N_CMPS * this->aligned_dim);
         memset(scratch.aligned_query_T, 0, this->aligned_dim * sizeof(T));
         memset(scratch.aligned_query_float, 0,
                this->aligned_dim * sizeof(float));
+        memset(scratch.aligned_rotated_query, 0,
+               this->aligned_dim * sizeof(float));
 
         ThreadData<T> data;
         data.ctx = ctx;
@@ -270,8 +281,11 @@ namespace diskann {
       diskann::aligned_free((void *) scratch.aligned_scratch);
       diskann::aligned_free((void *) scratch.aligned_pq_coord_scratch);
       diskann::aligned_free((void *) scratch.aligned_pqtable_dist_scratch);
+      diskann::aligned_free((void *) scratch.aligned_fast_scan_lut);
+      diskann::aligned_free((void *) scratch.aligned_fast_scan_codes);
       diskann::aligned_free((void *) scratch.aligned_dist_scratch);
       diskann::aligned_free((void *) scratch.aligned_query_float);
+      diskann::aligned_free((void *) scratch.aligned_rotated_query);
       diskann::aligned_free((void *) scratch.aligned_query_T);
     }
   }
@@ -279,7 +293,6 @@ namespace diskann {
   template<typename T>
   void PQFlashIndex<T>::load_cache_list(std::vector<uint32_t> &node_list) {
     diskann::cout << "Loading the cache list into memory.." << std::flush;
-    _u64 num_cached_nodes = node_list.size();
 
     // borrow thread data
     ThreadData<T> this_thread_data = this->thread_data.pop();
@@ -288,62 +301,199 @@ namespace diskann {
       this_thread_data = this->thread_data.pop();
     }
 
-    IOContext &ctx = this_thread_data.ctx;
+    IOContext &                         ctx = this_thread_data.ctx;
+    std::shared_ptr<const NodeCache<T>> cache =
+        read_node_cache(node_list, ctx, nullptr);
+    std::atomic_store(&this->node_cache, cache);
 
-    nhood_cache_buf = new unsigned[num_cached_nodes * (max_degree + 1)];
-    memset(nhood_cache_buf, 0, num_cached_nodes * (max_degree + 1));
+    // return thread data
+    this->thread_data.push(this_thread_data);
+    diskann::cout << "..done." << std::endl;
+  }
+
+  template<typename T>
+  std::shared_ptr<NodeCache<T>> PQFlashIndex<T>::read_node_cache(
+      const std::vector<uint32_t> &node_list, IOContext &ctx,
+      const NodeCache<T> *old) {
+    std::shared_ptr<NodeCache<T>> cache = std::make_shared<NodeCache<T>>();
+    _u64                          num_cached_nodes = node_list.size();
+    if (num_cached_nodes == 0)
+      return cache;
+
+    cache->nhood_cache_buf = new unsigned[num_cached_nodes * (max_degree + 1)];
+    memset(cache->nhood_cache_buf, 0,
+           num_cached_nodes * (max_degree + 1) * sizeof(unsigned));
 
     _u64 coord_cache_buf_len = num_cached_nodes * aligned_dim;
-    diskann::alloc_aligned((void **) &coord_cache_buf,
+    diskann::alloc_aligned((void **) &cache->coord_cache_buf,
                            coord_cache_buf_len * sizeof(T), 8 * sizeof(T));
-    memset(coord_cache_buf, 0, coord_cache_buf_len * sizeof(T));
-
-    size_t BLOCK_SIZE = 8;
-    size_t num_blocks = DIV_ROUND_UP(num_cached_nodes, BLOCK_SIZE);
-
-    for (_u64 block = 0; block < num_blocks; block++) {
-      _u64 start_idx = block * BLOCK_SIZE;
-      _u64 end_idx = (std::min)(num_cached_nodes, (block + 1) * BLOCK_SIZE);
-      std::vector<AlignedRead>             read_reqs;
-      std::vector<std::pair<_u32, char *>> nhoods;
-      for (_u64 node_idx = start_idx; node_idx < end_idx; node_idx++) {
-        AlignedRead read;
-        char *      buf = nullptr;
-        alloc_aligned((void **) &buf, SECTOR_LEN, SECTOR_LEN);
-        nhoods.push_back(std::make_pair(node_list[node_idx], buf));
-        read.len = SECTOR_LEN;
-        read.buf = buf;
-        read.offset = NODE_SECTOR_NO(node_list[node_idx]) * SECTOR_LEN;
-        read_reqs.push_back(read);
+    memset(cache->coord_cache_buf, 0, coord_cache_buf_len * sizeof(T));
+
+    // copies the node of node_list[node_idx] into the slots of node_idx
+    auto insert = [this, &cache, &node_list](_u64 node_idx, const T *coords,
+                                             _u32            nnbrs,
+                                             const unsigned *nbrs) {
+      T *cached_coords = cache->coord_cache_buf + node_idx * aligned_dim;
+      memcpy(cached_coords, coords, disk_bytes_per_point);
+      cache->coord_cache.insert(
+          std::make_pair(node_list[node_idx], cached_coords));
+
+      std::pair<_u32, unsigned *> cnhood;
+      cnhood.first = nnbrs;
+      cnhood.second = cache->nhood_cache_buf + node_idx * (max_degree + 1);
+      memcpy(cnhood.second, nbrs, nnbrs * sizeof(unsigned));
+      cache->nhood_cache.insert(std::make_pair(node_list[node_idx], cnhood));
+    };
+
+    const size_t BLOCK_SIZE = MAX_N_SECTOR_READS;
+    char *       sector_buf = nullptr;
+    alloc_aligned((void **) &sector_buf, BLOCK_SIZE * SECTOR_LEN, SECTOR_LEN);
+    std::vector<AlignedRead> read_reqs;
+    std::vector<_u64>        read_idx;
+    for (_u64 node_idx = 0; node_idx < num_cached_nodes; node_idx++) {
+      _u32 id = node_list[node_idx];
+      if (old != nullptr) {
+        auto iter = old->nhood_cache.find(id);
+        if (iter != old->nhood_cache.end()) {
+          insert(node_idx, old->coord_cache.find(id)->second,
+                 iter->second.first, iter->second.second);
+          continue;
+        }
       }
+      read_reqs.emplace_back(NODE_SECTOR_NO(id) * SECTOR_LEN, SECTOR_LEN,
+                             sector_buf + read_reqs.size() * SECTOR_LEN);
+      read_idx.push_back(node_idx);
+      if (read_reqs.size() < BLOCK_SIZE && node_idx + 1 < num_cached_nodes)
+        continue;
 
       reader->read(read_reqs, ctx);
-
-      _u64 node_idx = start_idx;
-      for (auto &nhood : nhoods) {
-        char *node_buf = OFFSET_TO_NODE(nhood.second, nhood.first);
-        T *   node_coords = OFFSET_TO_NODE_COORDS(node_buf);
-        T *   cached_coords = coord_cache_buf + node_idx * aligned_dim;
-        memcpy(cached_coords, node_coords, disk_bytes_per_point);
-        coord_cache.insert(std::make_pair(nhood.first, cached_coords));
-
-        // insert node nhood into nhood_cache
+      for (size_t i = 0; i < read_reqs.size(); i++) {
+        _u32      read_id = node_list[read_idx[i]];
+        char *    node_buf = OFFSET_TO_NODE(read_reqs[i].buf, read_id);
         unsigned *node_nhood = OFFSET_TO_NODE_NHOOD(node_buf);
-        auto      nnbrs = *node_nhood;
-        unsigned *nbrs = node_nhood + 1;
-        // diskann::cout << "CACHE: nnbrs = " << nnbrs << "\n";
-        std::pair<_u32, unsigned *> cnhood;
-        cnhood.first = nnbrs;
-        cnhood.second = nhood_cache_buf + node_idx * (max_degree + 1);
-        memcpy(cnhood.second, nbrs, nnbrs * sizeof(unsigned));
-        nhood_cache.insert(std::make_pair(nhood.first, cnhood));
-        aligned_free(nhood.second);
-        node_idx++;
+        insert(read_idx[i], OFFSET_TO_NODE_COORDS(node_buf), *node_nhood,
+               node_nhood + 1);
       }
+      read_reqs.clear();
+      read_idx.clear();
     }
-    // return thread data
-    this->thread_data.push(this_thread_data);
-    diskann::cout << "..done." << std::endl;
+    aligned_free(sector_buf);
+    return cache;
+  }
+
+  template<typename T>
+  std::shared_ptr<const NodeCache<T>> PQFlashIndex<T>::get_node_cache() {
+    return std::atomic_load(&this->node_cache);
+  }
+
+  template<typename T>
+  void PQFlashIndex<T>::enable_adaptive_cache(_u64 budget_bytes,
+                                              _u32 period_ms) {
+    this->disable_adaptive_cache();
+    if (this->node_access_counts.size() != this->num_points)
+      this->node_access_counts.assign(this->num_points, 0);
+    this->adaptive_cache_budget = budget_bytes;
+    this->adaptive_cache_period_ms = period_ms;
+    this->cache_refresher_stop = false;
+    this->adaptive_cache = true;
+    this->cache_refresher =
+        std::thread(&PQFlashIndex<T>::adaptive_cache_loop, this);
+  }
+
+  template<typename T>
+  void PQFlashIndex<T>::disable_adaptive_cache() {
+    if (!this->cache_refresher.joinable())
+      return;
+    {
+      std::lock_guard<std::mutex> lock(this->cache_refresher_mut);
+      this->cache_refresher_stop = true;
+    }
+    this->cache_refresher_cv.notify_all();
+    this->cache_refresher.join();
+    this->adaptive_cache = false;
+  }
+
+  template<typename T>
+  NodeCacheStats PQFlashIndex<T>::get_cache_stats() {
+    NodeCacheStats stats;
+    stats.lookups = this->cache_lookups.load();
+    stats.hits = this->cache_hits.load();
+    stats.cached_nodes = this->get_node_cache()->nhood_cache.size();
+    std::lock_guard<std::mutex> lock(this->cache_refresher_mut);
+    stats.refreshes = this->cache_refreshes;
+    stats.promotions = this->cache_promotions;
+    return stats;
+  }
+
+  template<typename T>
+  void PQFlashIndex<T>::adaptive_cache_loop() {
+    this->reader->register_thread();
+    IOContext &ctx = this->reader->get_ctx();
+
+    std::unique_lock<std::mutex> lock(this->cache_refresher_mut);
+    while (!this->cache_refresher_stop) {
+      this->cache_refresher_cv.wait_for(
+          lock, std::chrono::milliseconds(this->adaptive_cache_period_ms),
+          [this] { return this->cache_refresher_stop; });
+      if (this->cache_refresher_stop)
+        break;
+      lock.unlock();
+      this->refresh_adaptive_cache(ctx);
+      lock.lock();
+    }
+    lock.unlock();
+    this->reader->deregister_thread();
+  }
+
+  template<typename T>
+  void PQFlashIndex<T>::refresh_adaptive_cache(IOContext &ctx) {
+    _u64 node_bytes =
+        (max_degree + 1) * sizeof(unsigned) + aligned_dim * sizeof(T);
+    _u64 max_nodes = this->adaptive_cache_budget / node_bytes;
+
+    // (count, id) of the accessed nodes; the counts decay by half
+    std::vector<std::pair<_u32, _u32>> accessed;
+    for (_u32 i = 0; i < this->num_points; i++) {
+      auto &count =
+          reinterpret_cast<std::atomic<_u32> &>(this->node_access_counts[i]);
+      _u32 c = count.load(std::memory_order_relaxed);
+      if (c == 0)
+        continue;
+      accessed.push_back(std::make_pair(c, i));
+      count.fetch_sub(c - c / 2, std::memory_order_relaxed);
+    }
+    if (accessed.size() > max_nodes) {
+      std::nth_element(accessed.begin(), accessed.begin() + max_nodes,
+                       accessed.end(),
+                       [](const std::pair<_u32, _u32> &left,
+                          const std::pair<_u32, _u32> &right) {
+                         return left.first > right.first;
+                       });
+      accessed.resize(max_nodes);
+    }
+    if (accessed.empty())
+      return;
+
+    // the nodes still hot are copied from the current cache
+    std::shared_ptr<const NodeCache<T>> old = this->get_node_cache();
+    std::vector<uint32_t>               node_list;
+    node_list.reserve(accessed.size());
+    _u64 promoted = 0;
+    for (auto &node : accessed) {
+      node_list.push_back(node.second);
+      if (old->nhood_cache.find(node.second) == old->nhood_cache.end())
+        promoted++;
+    }
+    // in sector order
+    std::sort(node_list.begin(), node_list.end());
+
+    std::shared_ptr<const NodeCache<T>> cache =
+        read_node_cache(node_list, ctx, old.get());
+    std::atomic_store(&this->node_cache, cache);
+
+    std::lock_guard<std::mutex> lock(this->cache_refresher_mut);
+    this->cache_refreshes++;
+    this->cache_promotions += promoted;
   }
 
 #ifdef EXEC_ENV_OLS
@@ -587,12 +737,12 @@ namespace diskann {
 #ifdef EXEC_ENV_OLS
   template<typename T>
   int PQFlashIndex<T>::load(MemoryMappedFiles &files, uint32_t num_threads,
-                            const char *pq_prefix,
-                            const char *disk_index_file) {
+                            const char *pq_prefix, const char *disk_index_file,
+                            bool fast_scan) {
 #else
   template<typename T>
   int PQFlashIndex<T>::load(uint32_t num_threads, const char *pq_prefix,
-                            const char *disk_index_file) {
+                            const char *disk_index_file, bool fast_scan) {
 #endif
     std::string pq_table_bin = std::string(pq_prefix) + "_pivots.bin";
     std::string pq_compressed_vectors =
@@ -649,6 +799,23 @@ namespace diskann {
         << " #aligned_dim: " << aligned_dim << " #chunks: " << n_chunks
         << std::endl;
 
+    if (fast_scan) {
+      std::string fast_scan_prefix = std::string(pq_prefix) + "_fs";
+      if (!file_exists(fast_scan_prefix + "_pivots.bin")) {
+        diskann::cout << "Error. Fast-scan PQ data " << fast_scan_prefix
+                      << "_pivots.bin not found, build the index with "
+                         "fast-scan chunks. Exitting."
+                      << std::endl;
+        return -1;
+      }
+#ifdef EXEC_ENV_OLS
+      fast_scan_table.load(files, fast_scan_prefix.c_str());
+#else
+      fast_scan_table.load(fast_scan_prefix.c_str());
+#endif
+      this->use_fast_scan = true;
+    }
+
     std::string disk_pq_pivots_path = this->disk_index_file + "_pq_pivots.bin";
     if (file_exists(disk_pq_pivots_path)) {
       use_disk_index_pq = true;
@@ -866,6 +1033,7 @@ namespace diskann {
 
     IOContext &ctx = data.ctx;
     auto       query_scratch = &(data.scratch);
+    std::shared_ptr<const NodeCache<T>> cache = this->get_node_cache();
 
     // reset query
     query_scratch->reset();
@@ -883,18 +1051,35 @@ namespace diskann {
     char *sector_scratch = query_scratch->sector_scratch;
     _u64 &sector_scratch_idx = query_scratch->sector_idx;
 
-    // query <-> PQ chunk centers distances
-    float *pq_dists = query_scratch->aligned_pqtable_dist_scratch;
-    pq_table.populate_chunk_distances(query_float, pq_dists);
+    // query <-> PQ chunk centers distances; with OPQ, the query is rotated
+    // once here
+    float *       pq_dists = query_scratch->aligned_pqtable_dist_scratch;
+    FastScanQuery fast_scan_query;
+    if (use_fast_scan) {
+      fast_scan_query = fast_scan_table.populate_lut(
+          query_float, pq_dists, query_scratch->aligned_fast_scan_lut);
+    } else if (pq_table.use_rotation()) {
+      float *rotated_query = query_scratch->aligned_rotated_query;
+      pq_table.preprocess_query(query_float, rotated_query);
+      pq_table.populate_chunk_distances(rotated_query, pq_dists);
+    } else {
+      pq_table.populate_chunk_distances(query_float, pq_dists);
+    }
 
     // query <-> neighbor list
     float *dist_scratch = query_scratch->aligned_dist_scratch;
     _u8 *  pq_coord_scratch = query_scratch->aligned_pq_coord_scratch;
+    _u8 *  fast_scan_codes = query_scratch->aligned_fast_scan_codes;
 
     // lambda to batch compute query<-> node distances in PQ space
-    auto compute_dists = [this, pq_coord_scratch, pq_dists](const unsigned *ids,
-                                                            const _u64 n_ids,
-                                                            float *dists_out) {
+    auto compute_dists = [this, pq_coord_scratch, pq_dists, &fast_scan_query,
+                          fast_scan_codes](const unsigned *ids,
+                                           const _u64 n_ids, float *dists_out) {
+      if (this->use_fast_scan) {
+        this->fast_scan_table.compute_dists(fast_scan_query, ids, n_ids,
+                                            fast_scan_codes, dists_out);
+        return;
+      }
       ::aggregate_coords(ids, n_ids, this->data, this->n_chunks,
                          pq_coord_scratch);
       ::pq_dist_lookup(pq_coord_scratch, n_ids, this->n_chunks, pq_dists,
@@ -936,6 +1121,7 @@ namespace diskann {
     unsigned hops = 0;
     unsigned num_ios = 0;
     unsigned k = 0;
+    _u64     n_lookups = 0, n_hits = 0;
 
     // cleared every iteration
     std::vector<unsigned>                    frontier;
@@ -963,10 +1149,12 @@ namespace diskann {
              num_seen < beam_width + 2) {
         if (retset[marker].flag) {
           num_seen++;
-          auto iter = nhood_cache.find(retset[marker].id);
-          if (iter != nhood_cache.end()) {
+          auto iter = cache->nhood_cache.find(retset[marker].id);
+          n_lookups++;
+          if (iter != cache->nhood_cache.end()) {
             cached_nhoods.push_back(
                 std::make_pair(retset[marker].id, iter->second));
+            n_hits++;
             if (stats != nullptr) {
               stats->n_cache_hits++;
             }
@@ -979,6 +1167,11 @@ namespace diskann {
                 this->node_visit_counter[retset[marker].id].second)
                 .fetch_add(1);
           }
+          if (this->adaptive_cache) {
+            reinterpret_cast<std::atomic<_u32> &>(
+                this->node_access_counts[retset[marker].id])
+                .fetch_add(1, std::memory_order_relaxed);
+          }
         }
         marker++;
       }
@@ -1016,7 +1209,7 @@ namespace diskann {
 
       // process cached nhoods
       for (auto &cached_nhood : cached_nhoods) {
-        auto  global_cache_iter = coord_cache.find(cached_nhood.first);
+        auto  global_cache_iter = cache->coord_cache.find(cached_nhood.first);
         T *   node_fp_coords_copy = global_cache_iter->second;
         float cur_expanded_dist;
         if (!use_disk_index_pq) {
@@ -1205,6 +1398,266 @@ namespace diskann {
 
     this->thread_data.push(data);
     this->thread_data.push_notify_all();
+    this->cache_lookups.fetch_add(n_lookups, std::memory_order_relaxed);
+    this->cache_hits.fetch_add(n_hits, std::memory_order_relaxed);
+
+    if (stats != nullptr) {
+      stats->total_us = (double) query_timer.elapsed();
+    }
+  }
+
+  // Same search as cached_beam_search, but the reads of the beam are not
+  // processed in lock-step: up to beam_width sector reads stay in flight, a
+  // node is expanded as soon as its sector arrives, and the freed slot is
+  // used right away to read the best candidate not read yet. stats->io_us
+  // is the time spent waiting for completions, stats->cpu_us the time spent
+  // expanding nodes and stats->n_hops the number of such waits.
+  template<typename T>
+  void PQFlashIndex<T>::pipelined_beam_search(
+      const T *query1, const _u64 k_search, const _u64 l_search, _u64 *indices,
+      float *distances, const _u64 beam_width, QueryStats *stats) {
+    if (!this->reader->supports_async_reads()) {
+      this->cached_beam_search(query1, k_search, l_search, indices, distances,
+                               beam_width, stats);
+      return;
+    }
+    ThreadData<T> data = this->thread_data.pop();
+    while (data.scratch.sector_scratch == nullptr) {
+      this->thread_data.wait_for_push_notify();
+      data = this->thread_data.pop();
+    }
+
+    float        query_norm = 0;
+    const T *    query = data.scratch.aligned_query_T;
+    const float *query_float = data.scratch.aligned_query_float;
+
+    for (uint32_t i = 0; i < this->data_dim; i++) {
+      data.scratch.aligned_query_float[i] = query1[i];
+      data.scratch.aligned_query_T[i] = query1[i];
+      query_norm += query1[i] * query1[i];
+    }
+
+    if (metric == diskann::Metric::INNER_PRODUCT) {
+      query_norm = std::sqrt(query_norm);
+      data.scratch.aligned_query_T[this->data_dim - 1] = 0;
+      data.scratch.aligned_query_float[this->data_dim - 1] = 0;
+      for (uint32_t i = 0; i < this->data_dim - 1; i++) {
+        data.scratch.aligned_query_T[i] /= query_norm;
+        data.scratch.aligned_query_float[i] /= query_norm;
+      }
+    }
+
+    IOContext &ctx = data.ctx;
+    auto       query_scratch = &(data.scratch);
+    std::shared_ptr<const NodeCache<T>> cache = this->get_node_cache();
+    query_scratch->reset();
+
+    T *   data_buf = query_scratch->coord_scratch;
+    _u64 &data_buf_idx = query_scratch->coord_idx;
+    char *sector_scratch = query_scratch->sector_scratch;
+
+    float *       pq_dists = query_scratch->aligned_pqtable_dist_scratch;
+    FastScanQuery fast_scan_query;
+    if (use_fast_scan) {
+      fast_scan_query = fast_scan_table.populate_lut(
+          query_float, pq_dists, query_scratch->aligned_fast_scan_lut);
+    } else if (pq_table.use_rotation()) {
+      float *rotated_query = query_scratch->aligned_rotated_query;
+      pq_table.preprocess_query(query_float, rotated_query);
+      pq_table.populate_chunk_distances(rotated_query, pq_dists);
+    } else {
+      pq_table.populate_chunk_distances(query_float, pq_dists);
+    }
+
+    float *dist_scratch = query_scratch->aligned_dist_scratch;
+    _u8 *  pq_coord_scratch = query_scratch->aligned_pq_coord_scratch;
+    _u8 *  fast_scan_codes = query_scratch->aligned_fast_scan_codes;
+
+    auto compute_dists = [this, pq_coord_scratch, pq_dists, &fast_scan_query,
+                          fast_scan_codes](const unsigned *ids,
+                                           const _u64 n_ids, float *dists_out) {
+      if (this->use_fast_scan) {
+        this->fast_scan_table.compute_dists(fast_scan_query, ids, n_ids,
+                                            fast_scan_codes, dists_out);
+        return;
+      }
+      ::aggregate_coords(ids, n_ids, this->data, this->n_chunks,
+                         pq_coord_scratch);
+      ::pq_dist_lookup(pq_coord_scratch, n_ids, this->n_chunks, pq_dists,
+                       dists_out);
+    };
+    Timer                 query_timer, io_timer, cpu_timer;
+    std::vector<Neighbor> retset(l_search + 1);
+    tsl::robin_set<_u64>  visited(4096);
+
+    std::vector<Neighbor> full_retset;
+    full_retset.reserve(4096);
+
+    _u32  best_medoid = 0;
+    float best_dist = (std::numeric_limits<float>::max)();
+    for (_u64 cur_m = 0; cur_m < num_medoids; cur_m++) {
+      float cur_expanded_dist = dist_cmp_float->compare(
+          query_float, centroid_data + aligned_dim * cur_m,
+          (unsigned) aligned_dim);
+      if (cur_expanded_dist < best_dist) {
+        best_medoid = medoids[cur_m];
+        best_dist = cur_expanded_dist;
+      }
+    }
+
+    compute_dists(&best_medoid, 1, dist_scratch);
+    retset[0].id = best_medoid;
+    retset[0].distance = dist_scratch[0];
+    retset[0].flag = true;
+    visited.insert(best_medoid);
+    unsigned cur_list_size = 1;
+    _u64     n_lookups = 0, n_hits = 0;
+
+    // computes the full precision distance of a node and inserts its
+    // unvisited neighbors in retset
+    auto expand = [&](unsigned id, T *node_fp_coords, _u64 nnbrs,
+                      unsigned *node_nbrs) {
+      cpu_timer.reset();
+      float cur_expanded_dist;
+      if (!use_disk_index_pq) {
+        cur_expanded_dist =
+            dist_cmp->compare(query, node_fp_coords, (unsigned) aligned_dim);
+      } else {
+        if (metric == diskann::Metric::INNER_PRODUCT)
+          cur_expanded_dist = disk_pq_table.inner_product(
+              query_float, (_u8 *) node_fp_coords);
+        else
+          cur_expanded_dist =
+              disk_pq_table.l2_distance(query_float, (_u8 *) node_fp_coords);
+      }
+      full_retset.push_back(Neighbor(id, cur_expanded_dist, true));
+
+      compute_dists(node_nbrs, nnbrs, dist_scratch);
+      if (stats != nullptr)
+        stats->n_cmps += nnbrs;
+      for (_u64 m = 0; m < nnbrs; ++m) {
+        unsigned nbr = node_nbrs[m];
+        if (visited.find(nbr) != visited.end())
+          continue;
+        visited.insert(nbr);
+        float dist = dist_scratch[m];
+        if (dist >= retset[cur_list_size - 1].distance &&
+            (cur_list_size == l_search))
+          continue;
+        InsertIntoPool(retset.data(), cur_list_size,
+                       Neighbor(nbr, dist, true));
+        if (cur_list_size < l_search)
+          ++cur_list_size;
+      }
+      if (stats != nullptr)
+        stats->cpu_us += cpu_timer.elapsed();
+    };
+
+    // one sector slot per read in flight
+    const _u64 max_in_flight =
+        (std::min)((_u64) beam_width, (_u64) MAX_N_SECTOR_READS);
+    std::vector<char *> free_bufs;
+    for (_u64 i = 0; i < max_in_flight; i++)
+      free_bufs.push_back(sector_scratch + i * SECTOR_LEN);
+    tsl::robin_map<char *, unsigned> in_flight;
+    std::vector<AlignedRead>         read_reqs;
+    std::vector<void *>              done_bufs;
+
+    while (true) {
+      // fill the free slots with the best candidates not read yet; the
+      // cached ones are expanded directly, which may insert better candidates
+      read_reqs.clear();
+      _u32 marker = 0;
+      while (in_flight.size() < max_in_flight) {
+        while (marker < cur_list_size && !retset[marker].flag)
+          marker++;
+        if (marker == cur_list_size)
+          break;
+        unsigned id = retset[marker].id;
+        retset[marker].flag = false;
+        if (this->count_visited_nodes) {
+          reinterpret_cast<std::atomic<_u32> &>(
+              this->node_visit_counter[id].second)
+              .fetch_add(1);
+        }
+        if (this->adaptive_cache) {
+          reinterpret_cast<std::atomic<_u32> &>(this->node_access_counts[id])
+              .fetch_add(1, std::memory_order_relaxed);
+        }
+        auto iter = cache->nhood_cache.find(id);
+        n_lookups++;
+        if (iter != cache->nhood_cache.end()) {
+          n_hits++;
+          if (stats != nullptr)
+            stats->n_cache_hits++;
+          expand(id, cache->coord_cache.find(id)->second, iter->second.first,
+                 iter->second.second);
+          marker = 0;
+          continue;
+        }
+        char *buf = free_bufs.back();
+        free_bufs.pop_back();
+        in_flight.insert(std::make_pair(buf, id));
+        read_reqs.emplace_back(NODE_SECTOR_NO(((size_t) id)) * SECTOR_LEN,
+                               SECTOR_LEN, buf);
+        if (stats != nullptr) {
+          stats->n_4k++;
+          stats->n_ios++;
+        }
+      }
+      if (!read_reqs.empty())
+        reader->submit_reads(read_reqs, ctx);
+      if (in_flight.empty())
+        break;
+
+      // wait for at least one sector, then expand all the arrived ones
+      done_bufs.clear();
+      io_timer.reset();
+      reader->reap_reads(ctx, 1, done_bufs);
+      if (stats != nullptr) {
+        stats->io_us += io_timer.elapsed();
+        stats->n_hops++;
+      }
+      for (void *done : done_bufs) {
+        char *   buf = (char *) done;
+        auto     iter = in_flight.find(buf);
+        unsigned id = iter->second;
+        in_flight.erase(iter);
+
+        char *    node_disk_buf = OFFSET_TO_NODE(buf, id);
+        unsigned *node_buf = OFFSET_TO_NODE_NHOOD(node_disk_buf);
+        if (data_buf_idx == MAX_N_CMPS)
+          data_buf_idx = 0;
+        T *node_fp_coords_copy = data_buf + (data_buf_idx * aligned_dim);
+        data_buf_idx++;
+        memcpy(node_fp_coords_copy, OFFSET_TO_NODE_COORDS(node_disk_buf),
+               disk_bytes_per_point);
+        expand(id, node_fp_coords_copy, (_u64) *node_buf, node_buf + 1);
+        free_bufs.push_back(buf);
+      }
+    }
+
+    std::sort(full_retset.begin(), full_retset.end(),
+              [](const Neighbor &left, const Neighbor &right) {
+                return left.distance < right.distance;
+              });
+
+    for (_u64 i = 0; i < k_search; i++) {
+      indices[i] = full_retset[i].id;
+      if (distances != nullptr) {
+        distances[i] = full_retset[i].distance;
+        if (metric == diskann::Metric::INNER_PRODUCT) {
+          distances[i] = (-distances[i]);
+          if (max_base_norm != 0)
+            distances[i] *= (max_base_norm * query_norm);
+        }
+      }
+    }
+
+    this->thread_data.push(data);
+    this->thread_data.push_notify_all();
+    this->cache_lookups.fetch_add(n_lookups, std::memory_order_relaxed);
+    this->cache_hits.fetch_add(n_hits, std::memory_order_relaxed);
 
     if (stats != nullptr) {
       stats->total_us = (double) query_timer.elapsed();
@@ -0,0 +1,308 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT license.
+
+#ifdef USE_IO_URING
+#include "uring_aligned_file_reader.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sys/uio.h>
+#include "utils.h"
+
+// milliseconds without submission after which the polling thread sleeps
+#define SQ_THREAD_IDLE_MS 2000
+
+namespace {
+  // creates ring with the options of the reader, attached to the kernel
+  // threads of owner_fd when there is one. Returns 0 or -errno.
+  int init_ring(struct io_uring *ring, bool sqpoll, int owner_fd) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    if (sqpoll) {
+      params.flags |= IORING_SETUP_SQPOLL;
+      params.sq_thread_idle = SQ_THREAD_IDLE_MS;
+    }
+    if (owner_fd >= 0) {
+      params.flags |= IORING_SETUP_ATTACH_WQ;
+      params.wq_fd = owner_fd;
+    }
+    return io_uring_queue_init_params(MAX_IO_DEPTH, ring, &params);
+  }
+
+  // a short read would hand a partly filled buffer to the search
+  void check_completion(struct io_uring_cqe *cqe, uint64_t len) {
+    if (cqe->res < 0) {
+      std::cerr << "io_uring read failed; errno=" << -cqe->res << ":"
+                << ::strerror(-cqe->res) << std::endl;
+      exit(-1);
+    }
+    if ((uint64_t) cqe->res != len) {
+      std::cerr << "io_uring short read; returned " << cqe->res
+                << ", expected=" << len << std::endl;
+      exit(-1);
+    }
+  }
+}  // namespace
+
+UringAlignedFileReader::UringAlignedFileReader(bool sqpoll) {
+  this->file_desc = -1;
+  this->sqpoll = sqpoll;
+  this->sq_owner_fd = -1;
+}
+
+UringAlignedFileReader::~UringAlignedFileReader() {
+  if (this->file_desc != -1) {
+    std::cerr << "close() not called" << std::endl;
+    this->close();
+  }
+}
+
+IOContext &UringAlignedFileReader::get_ctx() {
+  std::unique_lock<std::mutex> lk(ctx_mut);
+  if (ctx_map.find(std::this_thread::get_id()) == ctx_map.end()) {
+    std::cerr << "bad thread access; returning a context without ring"
+              << std::endl;
+    return this->bad_ctx;
+  } else {
+    return ctx_map[std::this_thread::get_id()];
+  }
+}
+
+void UringAlignedFileReader::register_thread() {
+  auto                         my_id = std::this_thread::get_id();
+  std::unique_lock<std::mutex> lk(ctx_mut);
+  if (ctx_map.find(my_id) != ctx_map.end()) {
+    std::cerr << "multiple calls to register_thread from the same thread"
+              << std::endl;
+    return;
+  }
+  UringContext *uctx = new UringContext();
+  int           ret = init_ring(&uctx->ring, this->sqpoll, this->sq_owner_fd);
+  if (ret < 0 && this->sq_owner_fd >= 0)
+    ret = init_ring(&uctx->ring, this->sqpoll, -1);
+  if (ret < 0 && this->sqpoll) {
+    std::cerr << "io_uring SQPOLL setup failed; errno=" << -ret << ":"
+              << ::strerror(-ret) << ", polling disabled" << std::endl;
+    this->sqpoll = false;
+    ret = init_ring(&uctx->ring, false, -1);
+  }
+  if (ret < 0) {
+    std::cerr << "io_uring_queue_init() failed; returned " << ret << ":"
+              << ::strerror(-ret) << std::endl;
+    delete uctx;
+    return;
+  }
+  if (this->sq_owner_fd < 0)
+    this->sq_owner_fd = uctx->ring.ring_fd;
+  if (this->file_desc != -1)
+    uctx->fixed_file =
+        io_uring_register_files(&uctx->ring, &this->file_desc, 1) == 0;
+
+  IOContext ctx;
+  ctx.uring = uctx;
+  ctx_map[my_id] = ctx;
+  diskann::cout << "allocating ring: " << uctx->ring.ring_fd
+                << " to thread-id:" << my_id << std::endl;
+}
+
+void UringAlignedFileReader::destroy_ctx(IOContext &ctx) {
+  if (ctx.uring == nullptr)
+    return;
+  io_uring_queue_exit(&ctx.uring->ring);
+  delete ctx.uring;
+  ctx.uring = nullptr;
+}
+
+void UringAlignedFileReader::deregister_thread() {
+  auto                         my_id = std::this_thread::get_id();
+  std::unique_lock<std::mutex> lk(ctx_mut);
+  auto                         iter = ctx_map.find(my_id);
+  assert(iter != ctx_map.end());
+  destroy_ctx(iter.value());
+  ctx_map.erase(my_id);
+  std::cerr << "returned ring from thread-id:" << my_id << std::endl;
+}
+
+void UringAlignedFileReader::register_buffer(IOContext &ctx, void *buf,
+                                             uint64_t len) {
+  UringContext *uctx = ctx.uring;
+  if (uctx == nullptr)
+    return;
+  if (uctx->fixed_buf != nullptr) {
+    io_uring_unregister_buffers(&uctx->ring);
+    uctx->fixed_buf = nullptr;
+    uctx->fixed_len = 0;
+  }
+  struct iovec iov;
+  iov.iov_base = buf;
+  iov.iov_len = len;
+  int ret = io_uring_register_buffers(&uctx->ring, &iov, 1);
+  // reads into buf are still served, just not as fixed buffer reads
+  if (ret < 0) {
+    std::cerr << "io_uring_register_buffers() failed; returned " << ret << ":"
+              << ::strerror(-ret) << std::endl;
+    return;
+  }
+  uctx->fixed_buf = (char *) buf;
+  uctx->fixed_len = len;
+}
+
+void UringAlignedFileReader::open(const std::string &fname) {
+  int flags = O_DIRECT | O_RDONLY | O_LARGEFILE;
+  this->file_desc = ::open(fname.c_str(), flags);
+  // error checks
+  assert(this->file_desc != -1);
+  std::cerr << "Opened file : " << fname << std::endl;
+
+  // threads registered before the file was opened
+  std::unique_lock<std::mutex> lk(ctx_mut);
+  for (auto iter = ctx_map.begin(); iter != ctx_map.end(); ++iter) {
+    UringContext *uctx = iter->second.uring;
+    if (uctx != nullptr && !uctx->fixed_file)
+      uctx->fixed_file =
+          io_uring_register_files(&uctx->ring, &this->file_desc, 1) == 0;
+  }
+}
+
+// The thread data of the index is shared by all the query threads, so the
+// rings are released here rather than in deregister_thread().
+void UringAlignedFileReader::close() {
+  std::unique_lock<std::mutex> lk(ctx_mut);
+  for (auto iter = ctx_map.begin(); iter != ctx_map.end(); ++iter)
+    destroy_ctx(iter.value());
+  ctx_map.clear();
+  this->sq_owner_fd = -1;
+  lk.unlock();
+
+  ::close(this->file_desc);
+  this->file_desc = -1;
+}
+
+void UringAlignedFileReader::read(std::vector<AlignedRead> &read_reqs,
+                                  IOContext &ctx, bool async) {
+  assert(this->file_desc != -1);
+  UringContext *uctx = ctx.uring;
+  assert(uctx != nullptr);
+  struct io_uring *ring = &uctx->ring;
+  int              fd = uctx->fixed_file ? 0 : this->file_desc;
+
+  struct io_uring_cqe *cqes[MAX_IO_DEPTH];
+  for (uint64_t begin = 0; begin < read_reqs.size(); begin += MAX_IO_DEPTH) {
+    unsigned n_ops = (unsigned) std::min((uint64_t) read_reqs.size() - begin,
+                                         (uint64_t) MAX_IO_DEPTH);
+    for (unsigned j = 0; j < n_ops; j++) {
+      AlignedRead &        req = read_reqs[begin + j];
+      char *               buf = (char *) req.buf;
+      struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+      if (buf >= uctx->fixed_buf &&
+          buf + req.len <= uctx->fixed_buf + uctx->fixed_len)
+        io_uring_prep_read_fixed(sqe, fd, buf, (unsigned) req.len, req.offset,
+                                 0);
+      else
+        io_uring_prep_read(sqe, fd, buf, (unsigned) req.len, req.offset);
+      if (uctx->fixed_file)
+        io_uring_sqe_set_flags(sqe, IOSQE_FIXED_FILE);
+      io_uring_sqe_set_data(sqe, &req);
+    }
+
+    // with sqpoll, submitting only wakes the polling thread if it sleeps
+    int ret = this->sqpoll ? io_uring_submit(ring)
+                           : io_uring_submit_and_wait(ring, n_ops);
+    if (ret != (int) n_ops) {
+      std::cerr << "io_uring_submit() failed; returned " << ret
+                << ", expected=" << n_ops << std::endl;
+      exit(-1);
+    }
+
+    unsigned n_done = 0;
+    while (n_done < n_ops) {
+      unsigned n = io_uring_peek_batch_cqe(ring, cqes, n_ops - n_done);
+      if (n == 0) {
+        if (this->sqpoll)
+          continue;
+        ret = io_uring_wait_cqe(ring, cqes);
+        if (ret < 0) {
+          std::cerr << "io_uring_wait_cqe() failed; returned " << ret << ":"
+                    << ::strerror(-ret) << std::endl;
+          exit(-1);
+        }
+        continue;
+      }
+      for (unsigned j = 0; j < n; j++)
+        check_completion(cqes[j],
+                         ((AlignedRead *) io_uring_cqe_get_data(cqes[j]))->len);
+      io_uring_cq_advance(ring, n);
+      n_done += n;
+    }
+  }
+}
+
+void UringAlignedFileReader::submit_reads(std::vector<AlignedRead> &read_reqs,
+                                          IOContext &               ctx) {
+  assert(this->file_desc != -1);
+  UringContext *uctx = ctx.uring;
+  assert(uctx != nullptr);
+  struct io_uring *ring = &uctx->ring;
+  int              fd = uctx->fixed_file ? 0 : this->file_desc;
+
+  for (auto &req : read_reqs) {
+    char *               buf = (char *) req.buf;
+    struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+    if (sqe == nullptr) {
+      std::cerr << "io_uring submission queue full, more than "
+                << MAX_IO_DEPTH << " reads in flight" << std::endl;
+      exit(-1);
+    }
+    if (buf >= uctx->fixed_buf &&
+        buf + req.len <= uctx->fixed_buf + uctx->fixed_len)
+      io_uring_prep_read_fixed(sqe, fd, buf, (unsigned) req.len, req.offset,
+                               0);
+    else
+      io_uring_prep_read(sqe, fd, buf, (unsigned) req.len, req.offset);
+    if (uctx->fixed_file)
+      io_uring_sqe_set_flags(sqe, IOSQE_FIXED_FILE);
+    io_uring_sqe_set_data(sqe, buf);
+    uctx->pending_len[buf] = req.len;
+  }
+  int ret = io_uring_submit(ring);
+  if (ret != (int) read_reqs.size()) {
+    std::cerr << "io_uring_submit() failed; returned " << ret
+              << ", expected=" << read_reqs.size() << std::endl;
+    exit(-1);
+  }
+}
+
+void UringAlignedFileReader::reap_reads(IOContext &ctx, uint64_t min_nr,
+                                        std::vector<void *> &done_bufs) {
+  UringContext *       uctx = ctx.uring;
+  struct io_uring *    ring = &uctx->ring;
+  struct io_uring_cqe *cqes[MAX_IO_DEPTH];
+  uint64_t             n_done = 0;
+  while (true) {
+    unsigned n = io_uring_peek_batch_cqe(ring, cqes, MAX_IO_DEPTH);
+    for (unsigned j = 0; j < n; j++) {
+      void *buf = io_uring_cqe_get_data(cqes[j]);
+      auto  iter = uctx->pending_len.find(buf);
+      assert(iter != uctx->pending_len.end());
+      check_completion(cqes[j], iter->second);
+      uctx->pending_len.erase(iter);
+      done_bufs.push_back(buf);
+    }
+    io_uring_cq_advance(ring, n);
+    n_done += n;
+    if (n_done >= min_nr)
+      break;
+    if (n == 0 && !this->sqpoll) {
+      int ret = io_uring_wait_cqe(ring, cqes);
+      if (ret < 0) {
+        std::cerr << "io_uring_wait_cqe() failed; returned " << ret << ":"
+                  << ::strerror(-ret) << std::endl;
+        exit(-1);
+      }
+    }
+  }
+}
+
+#endif
@@ -11,20 +11,27 @@
 
 template<typename T>
 bool build_index(const char* dataFilePath, const char* indexFilePath,
-                 const char* indexBuildParameters, diskann::Metric metric) {
+                 const char* indexBuildParameters, diskann::Metric metric,
+                 bool use_opq) {
   return diskann::build_disk_index<T>(dataFilePath, indexFilePath,
-                                      indexBuildParameters, metric);
+                                      indexBuildParameters, metric, use_opq);
 }
 
 int main(int argc, char** argv) {
-  if (argc != 11) {
+  bool use_opq = false;
+  if (argc > 1 && std::string(argv[argc - 1]) == "--use_opq") {
+    use_opq = true;
+    argc--;
+  }
+  if (argc != 11 && argc != 12) {
     std::cout << "Usage: " << argv[0]
               << "  [data_type<float/int8/uint8>]  [dist_fn: l2/mips] "
                  "[data_file.bin]  "
                  "[index_prefix_path]  "
                  "[R]  [L]  [B]  [M]  [T] [PQ_disk_bytes (for very large "
-                 "dimensionality, use 0 for full vectors)]. See README for "
-                 "more information on "
+                 "dimensionality, use 0 for full vectors)] "
+                 "[fast_scan_chunks (optional, 4-bit PQ for --fast_scan "
+                 "search)] [--use_opq]. See README for more information on "
                  "parameters."
               << std::endl;
   } else {
@@ -37,12 +44,14 @@ int main(int argc, char** argv) {
                          " " + std::string(argv[7]) + " " +
                          std::string(argv[8]) + " " + std::string(argv[9]) +
                          " " + std::string(argv[10]);
+    if (argc == 12)
+      params += " " + std::string(argv[11]);
     if (std::string(argv[1]) == std::string("float"))
-      build_index<float>(argv[3], argv[4], params.c_str(), metric);
+      build_index<float>(argv[3], argv[4], params.c_str(), metric, use_opq);
     else if (std::string(argv[1]) == std::string("int8"))
-      build_index<int8_t>(argv[3], argv[4], params.c_str(), metric);
+      build_index<int8_t>(argv[3], argv[4], params.c_str(), metric, use_opq);
     else if (std::string(argv[1]) == std::string("uint8"))
-      build_index<uint8_t>(argv[3], argv[4], params.c_str(), metric);
+      build_index<uint8_t>(argv[3], argv[4], params.c_str(), metric, use_opq);
     else
       std::cout << "Error. wrong file type" << std::endl;
   }
@@ -91,9 +91,30 @@ int search_disk_index(int argc, char** argv) {
   _u64        recall_at = std::atoi(argv[ctr++]);
   std::string result_output_prefix(argv[ctr++]);
 
-  bool calc_recall_flag = false;
+  bool        calc_recall_flag = false;
+  std::string io_backend = "aio";
+  bool        pipelined = false;
+  _u64        adaptive_cache_mb = 0;
+  bool        fast_scan = false;
 
   for (; ctr < (_u32) argc; ctr++) {
+    if (std::string(argv[ctr]) == "--io_backend" && ctr + 1 < (_u32) argc) {
+      io_backend = argv[++ctr];
+      continue;
+    }
+    if (std::string(argv[ctr]) == "--pipelined") {
+      pipelined = true;
+      continue;
+    }
+    if (std::string(argv[ctr]) == "--fast_scan") {
+      fast_scan = true;
+      continue;
+    }
+    if (std::string(argv[ctr]) == "--adaptive_cache" &&
+        ctr + 1 < (_u32) argc) {
+      adaptive_cache_mb = std::atoi(argv[++ctr]);
+      continue;
+    }
     _u64 curL = std::atoi(argv[ctr]);
     if (curL >= recall_at)
       Lvec.push_back(curL);
@@ -133,14 +154,16 @@ int search_disk_index(int argc, char** argv) {
   reader.reset(new diskann::BingAlignedFileReader());
 #endif
 #else
-  reader.reset(new LinuxAlignedFileReader());
+  reader.reset(create_linux_aligned_file_reader(io_backend));
+  diskann::cout << "IO backend: " << io_backend
+                << (pipelined ? ", pipelined search" : "") << std::endl;
 #endif
 
   std::unique_ptr<diskann::PQFlashIndex<T>> _pFlashIndex(
       new diskann::PQFlashIndex<T>(reader, metric));
 
   int res = _pFlashIndex->load(num_threads, pq_prefix.c_str(),
-                               disk_index_file.c_str());
+                               disk_index_file.c_str(), fast_scan);
 
   if (res != 0) {
     return res;
@@ -155,6 +178,12 @@ int search_disk_index(int argc, char** argv) {
   _pFlashIndex->load_cache_list(node_list);
   node_list.clear();
   node_list.shrink_to_fit();
+  if (adaptive_cache_mb > 0) {
+    diskann::cout << "Adaptive cache of " << adaptive_cache_mb << "MB"
+                  << std::endl;
+    _pFlashIndex->enable_adaptive_cache(adaptive_cache_mb * 1024 * 1024,
+                                        1000);
+  }
 
   omp_set_num_threads(num_threads);
 
@@ -204,7 +233,9 @@ int search_disk_index(int argc, char** argv) {
   diskann::cout << std::setw(6) << "L" << std::setw(12) << "Beamwidth"
                 << std::setw(16) << "QPS" << std::setw(16) << "Mean Latency"
                 << std::setw(16) << "99.9 Latency" << std::setw(16)
-                << "Mean IOs" << std::setw(16) << "CPU (s)";
+                << "Mean IOs" << std::setw(16) << "IOPS" << std::setw(16)
+                << "IO lat (us)" << std::setw(16) << "IO wait (us)"
+                << std::setw(16) << "CPU (us)";
   if (calc_recall_flag) {
     diskann::cout << std::setw(16) << recall_string << std::endl;
   } else
@@ -212,6 +243,7 @@ int search_disk_index(int argc, char** argv) {
   diskann::cout
       << "==============================================================="
          "==========================================="
+         "================================================"
       << std::endl;
 
   std::vector<std::vector<uint32_t>> query_result_ids(Lvec.size());
@@ -239,11 +271,18 @@ int search_disk_index(int argc, char** argv) {
     auto                  s = std::chrono::high_resolution_clock::now();
 #pragma omp parallel for schedule(dynamic, 1)
     for (_s64 i = 0; i < (int64_t) query_num; i++) {
-      _pFlashIndex->cached_beam_search(
-          query + (i * query_aligned_dim), recall_at, L,
-          query_result_ids_64.data() + (i * recall_at),
-          query_result_dists[test_id].data() + (i * recall_at),
-          optimized_beamwidth, stats + i);
+      if (pipelined)
+        _pFlashIndex->pipelined_beam_search(
+            query + (i * query_aligned_dim), recall_at, L,
+            query_result_ids_64.data() + (i * recall_at),
+            query_result_dists[test_id].data() + (i * recall_at),
+            optimized_beamwidth, stats + i);
+      else
+        _pFlashIndex->cached_beam_search(
+            query + (i * query_aligned_dim), recall_at, L,
+            query_result_ids_64.data() + (i * recall_at),
+            query_result_dists[test_id].data() + (i * recall_at),
+            optimized_beamwidth, stats + i);
     }
     auto                          e = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> diff = e - s;
@@ -265,6 +304,21 @@ int search_disk_index(int argc, char** argv) {
         stats, query_num,
         [](const diskann::QueryStats& stats) { return stats.n_ios; });
 
+    // IOPS over the wall time of all the threads; the reads of a hop are
+    // issued together, so the latency of a read is the time of its batch
+    double total_ios = 0, total_io_us = 0, total_hops = 0;
+    for (_u64 i = 0; i < query_num; i++) {
+      total_ios += stats[i].n_ios;
+      total_io_us += stats[i].io_us;
+      total_hops += stats[i].n_hops;
+    }
+    float iops = total_ios / diff.count();
+    float io_latency = total_hops > 0 ? total_io_us / total_hops : 0;
+
+    float mean_io_us = diskann::get_mean_stats(
+        stats, query_num,
+        [](const diskann::QueryStats& stats) { return stats.io_us; });
+
     float mean_cpuus = diskann::get_mean_stats(
         stats, query_num,
         [](const diskann::QueryStats& stats) { return stats.cpu_us; });
@@ -279,13 +333,23 @@ int search_disk_index(int argc, char** argv) {
     diskann::cout << std::setw(6) << L << std::setw(12) << optimized_beamwidth
                   << std::setw(16) << qps << std::setw(16) << mean_latency
                   << std::setw(16) << latency_999 << std::setw(16) << mean_ios
-                  << std::setw(16) << mean_cpuus;
+                  << std::setw(16) << iops << std::setw(16) << io_latency
+                  << std::setw(16) << mean_io_us << std::setw(16) << mean_cpuus;
     if (calc_recall_flag) {
       diskann::cout << std::setw(16) << recall << std::endl;
     } else
       diskann::cout << std::endl;
   }
 
+  diskann::NodeCacheStats cache_stats = _pFlashIndex->get_cache_stats();
+  diskann::cout << "Node cache: " << cache_stats.cached_nodes << " nodes, hit "
+                << "rate "
+                << (cache_stats.lookups > 0
+                        ? 100.0 * cache_stats.hits / cache_stats.lookups
+                        : 0)
+                << "%, " << cache_stats.refreshes << " refreshes, "
+                << cache_stats.promotions << " nodes promoted" << std::endl;
+
   diskann::cout << "Done searching. Now saving results " << std::endl;
   _u64 test_id = 0;
   for (auto L : Lvec) {
@@ -316,7 +380,8 @@ int main(int argc, char** argv) {
            "optimize internally)] "
            " [query_file.bin]  [truthset.bin (use \"null\" for none)] "
            " [K]  [result_output_prefix] "
-           " [L1]  [L2] etc.  See README for more information on parameters."
+           " [L1]  [L2] etc.  [--io_backend aio/uring/uring_sqpoll]  "
+           "[--pipelined]  [--adaptive_cache budget_MB]  [--fast_scan]  See README for more information on parameters."
         << std::endl;
     exit(-1);
   }
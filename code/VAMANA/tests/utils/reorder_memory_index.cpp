@@ -0,0 +1,173 @@
+// Relabels an in-memory Vamana index with a locality-improving order, so that the neighbors fetched
+// during a beam search are close in memory. The graph is rewritten in place, the vectors in the new
+// order go to <index>.data (the dataset itself is left untouched, other indexes may share it), and
+// the dataset id of every node is kept in <index>.idmap, which the search drivers use to report the
+// original ids.
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "index.h"
+#include "utils.h"
+#include "CacheCounters.h"
+#include "Reordering.h"
+
+// Runs the queries on the index and prints the QPS and cache misses per query. Returns the QPS.
+double measure(const std::string& label, const std::string& data_file,
+               unsigned num_data, unsigned dim, const std::string& index_file,
+               const float* query, size_t num_query, size_t query_aligned_dim,
+               unsigned L, unsigned K) {
+  diskann::Index<float> index(diskann::Metric::L2, data_file.c_str(), num_data,
+                              dim);
+  index.load(index_file.c_str());
+  std::vector<unsigned> ids(K);
+
+  evaluation::CacheCounters counters;
+  auto                      s = std::chrono::high_resolution_clock::now();
+  counters.start();
+  for (size_t i = 0; i < num_query; i++)
+    index.search(query + i * query_aligned_dim, K, L, ids.data());
+  counters.stop();
+  std::chrono::duration<double> diff =
+      std::chrono::high_resolution_clock::now() - s;
+  double qps = num_query / diff.count();
+  std::cout << label << ": qps=" << qps << ", "
+            << counters.describe(num_query) << std::endl;
+  return qps;
+}
+
+int main(int argc, char** argv) {
+  if (argc != 6 && argc != 7 && argc != 11) {
+    std::cout << argv[0]
+              << " data_file num_data dim index_file bfs|rcm|gorder [window] "
+                 "[query_file num_query L K]"
+              << std::endl;
+    exit(-1);
+  }
+  std::string data_file(argv[1]);
+  unsigned    num_data = (unsigned) atoi(argv[2]);
+  unsigned    dim = (unsigned) atoi(argv[3]);
+  std::string index_file(argv[4]);
+  reordering::Method method = reordering::parseMethod(argv[5]);
+  size_t             window = argc >= 7 ? atoi(argv[6]) : 5;
+
+  float* query = nullptr;
+  size_t num_query = 0, query_aligned_dim = 0;
+  unsigned L = 0, K = 0;
+  double   qps_before = 0;
+  if (argc == 11) {
+    num_query = atoi(argv[8]);
+    L = atoi(argv[9]);
+    K = atoi(argv[10]);
+    diskann::load_data<float>(argv[7], query, num_query, dim,
+                              query_aligned_dim);
+    qps_before = measure("original ", data_file, num_data, dim, index_file,
+                         query, num_query, query_aligned_dim, L, K);
+  }
+
+  // graph: uint64 file size, uint32 max degree, uint32 entry point, then per
+  // node its degree and neighbors (see Index::save)
+  std::ifstream in(index_file, std::ios::binary);
+  if (!in.is_open()) {
+    std::cout << "Index file " << index_file << " not found!" << std::endl;
+    exit(-1);
+  }
+  _u64     file_size;
+  unsigned width, ep;
+  in.read((char*) &file_size, sizeof(_u64));
+  in.read((char*) &width, sizeof(unsigned));
+  in.read((char*) &ep, sizeof(unsigned));
+  reordering::Graph     graph;
+  std::vector<unsigned> neighbors;
+  unsigned              degree;
+  while (in.read((char*) &degree, sizeof(unsigned))) {
+    neighbors.resize(degree);
+    in.read((char*) neighbors.data(), degree * sizeof(unsigned));
+    graph.addNode(neighbors.data(), degree);
+  }
+  in.close();
+  if (graph.size() != num_data) {
+    std::cout << "The graph has " << graph.size() << " nodes but num_data is "
+              << num_data << std::endl;
+    exit(-1);
+  }
+
+  auto s = std::chrono::high_resolution_clock::now();
+  std::vector<unsigned> order =
+      reordering::computeOrder(graph, ep, method, window);
+  std::vector<unsigned> rank = reordering::inverse(order);
+  std::chrono::duration<double> diff =
+      std::chrono::high_resolution_clock::now() - s;
+  std::vector<unsigned> identity(num_data);
+  for (unsigned i = 0; i < num_data; i++)
+    identity[i] = i;
+  std::cout << argv[5] << " order computed in " << diff.count()
+            << "s, average edge gap "
+            << reordering::averageGap(graph, identity) << " -> "
+            << reordering::averageGap(graph, rank) << std::endl;
+
+  // the graph is written next to the original and swapped once complete
+  std::ofstream out(index_file + ".tmp", std::ios::binary);
+  unsigned      new_ep = rank[ep];
+  out.write((char*) &file_size, sizeof(_u64));
+  out.write((char*) &width, sizeof(unsigned));
+  out.write((char*) &new_ep, sizeof(unsigned));
+  for (unsigned i = 0; i < num_data; i++) {
+    degree = (unsigned) graph.degree(order[i]);
+    neighbors.assign(graph.neighbors(order[i]),
+                     graph.neighbors(order[i]) + degree);
+    for (auto& id : neighbors)
+      id = rank[id];
+    out.write((char*) &degree, sizeof(unsigned));
+    out.write((char*) neighbors.data(), degree * sizeof(unsigned));
+  }
+  out.close();
+
+  std::ifstream data_in(data_file, std::ios::binary);
+  std::vector<float> data((size_t) num_data * dim);
+  data_in.read((char*) data.data(), data.size() * sizeof(float));
+  if (!data_in) {
+    std::cout << "Data file " << data_file << " holds fewer than " << num_data
+              << " points!" << std::endl;
+    exit(-1);
+  }
+  data_in.close();
+  std::string    reordered_data_file = index_file + ".data";
+  std::ofstream data_out(reordered_data_file, std::ios::binary);
+  for (unsigned i = 0; i < num_data; i++)
+    data_out.write((char*) (data.data() + (size_t) order[i] * dim),
+                   dim * sizeof(float));
+  data_out.close();
+
+  if (rename((index_file + ".tmp").c_str(), index_file.c_str()) != 0) {
+    std::cout << "Cannot replace " << index_file << std::endl;
+    exit(-1);
+  }
+
+  // the id map always leads back to the dataset order, across repeated
+  // reorderings
+  std::vector<unsigned> id_map = order;
+  if (file_exists(index_file + ".idmap")) {
+    std::vector<unsigned> previous =
+        reordering::readIdMap(index_file + ".idmap");
+    if (previous.size() == order.size())
+      for (unsigned i = 0; i < num_data; i++)
+        id_map[i] = previous[order[i]];
+  }
+  reordering::writeIdMap(index_file + ".idmap", id_map);
+  std::cout << "Search the reordered index with " << reordered_data_file
+            << " as the data file" << std::endl;
+
+  if (argc == 11) {
+    double qps_after = measure("reordered", reordered_data_file, num_data, dim,
+                               index_file, query, num_query, query_aligned_dim,
+                               L, K);
+    std::cout << "qps change: " << (qps_after / qps_before - 1) * 100 << "%"
+              << std::endl;
+    diskann::aligned_free(query);
+  }
+  return 0;
+}
@@ -16,6 +16,8 @@
 #include <iostream>
 #include <boost/program_options.hpp>
 #include <thread>
+#include "Evaluation.h"
+#include "Reordering.h"
 
 #include "sys/stat.h"
 
@@ -40,6 +42,28 @@ void peak_memory_footprint() {
     info.close();
 
 }
+// an index relabeled by reorder_memory_index keeps in index.bin.idmap the dataset id of every node
+std::vector<unsigned> load_id_map(const std::string& memory_index_file) {
+  if (!file_exists(memory_index_file + ".idmap"))
+    return std::vector<unsigned>();
+  return reordering::readIdMap(memory_index_file + ".idmap");
+}
+
+// mean and percentiles of the per-query latencies (seconds) of a batch search, printed in microseconds
+void print_latencies(std::vector<double> latencies) {
+  if (latencies.empty())
+    return;
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&latencies](double p) {
+    size_t rank = (size_t) std::ceil(p * latencies.size());
+    return latencies[rank == 0 ? 0 : rank - 1] * 1e6;
+  };
+  double sum = 0;
+  for (auto l : latencies) sum += l;
+  std::cout << "[Latency] mean " << sum / latencies.size() * 1e6 << "us - p50 " << percentile(0.50)
+            << "us - p95 " << percentile(0.95) << "us - p99 " << percentile(0.99) << "us" << std::endl;
+}
+
 int build_in_memory_index(const std::string&     data_path, const unsigned num_data, const unsigned dim,
                           const diskann::Metric& metric, const unsigned R,                           const unsigned L, const unsigned C, const float alpha,
                           const std::string& save_path,
@@ -71,7 +95,9 @@ diff =
 }
 
 int search_memory_index(string data_file, unsigned num_data,string memory_index_file, unsigned dim,
-                        string query_bin, unsigned num_query, _u64 L, _u64 K) {
+                        string query_bin, unsigned num_query, _u64 L, _u64 K,
+                        unsigned num_threads,
+                        string groundtruth_file = "", string summary_file = "") {
   float*                query = nullptr;
 
   size_t            query_num, query_dim, query_aligned_dim;
@@ -98,6 +124,7 @@ int search_memory_index(string data_file, unsigned num_data,string memory_index_
   diskann::Index<float> index(metric, data_file.c_str(),num_data,dim);
   index.load(memory_index_file.c_str());  // to load NSG
   std::cout << "Index loaded" << std::endl;
+  std::vector<unsigned> id_map = load_id_map(memory_index_file);
 
   if (metric == diskann::FAST_L2)
     index.optimize_graph();
@@ -105,22 +132,34 @@ int search_memory_index(string data_file, unsigned num_data,string memory_index_
   diskann::Parameters paras;
 
 
-  std::vector<std::vector<uint32_t>> query_result_ids(1);
-  std::vector<std::vector<float>>    query_result_dists(1);
-
-    query_result_ids[0].resize(recall_at * query_num);
-    //    omp_set_num_threads(num_threads);
-    //#pragma omp parallel for schedule(dynamic, 1)
-    for (int64_t i = 0; i < (int64_t) query_num; i++) {
-        index.search(query + i * query_aligned_dim, recall_at, L,
-                     query_result_ids[0].data() + i * recall_at);
-  }
+    // batch_search() is silent, runs the queries on num_threads threads and returns the distances
+    std::unique_ptr<evaluation::Evaluator> evaluator;
+    if (!groundtruth_file.empty())
+        evaluator.reset(new evaluation::Evaluator(groundtruth_file, query_num, recall_at));
+    std::vector<uint64_t> ids(recall_at * query_num);
+    std::vector<float>    dists(recall_at * query_num);
+    std::vector<double>   latencies(query_num);
+    auto s = std::chrono::high_resolution_clock::now();
+    index.batch_search(query, query_num, query_aligned_dim, recall_at, L, ids.data(), dists.data(),
+                       num_threads, latencies.data());
+    std::chrono::duration<double> total = std::chrono::high_resolution_clock::now() - s;
+    if (!id_map.empty())
+        for (auto& id : ids) id = id_map[id];
+    std::cout << "[Throughput] threads " << num_threads << " - QPS " << query_num / total.count() << std::endl;
+    print_latencies(latencies);
+    if (evaluator) {
+        for (int64_t i = 0; i < (int64_t) query_num; i++)
+            evaluator->record(i, ids.data() + i * recall_at, dists.data() + i * recall_at, latencies[i]);
+        evaluator->report("VAMANA", total.count(), summary_file);
+    }
     peak_memory_footprint();
   diskann::aligned_free(query);
   return 0;
 }
 int search_memory_index_opt(string data_file, unsigned num_data,string memory_index_file, unsigned dim,
-                        string query_bin, unsigned num_query, _u64 L, _u64 K) {
+                        string query_bin, unsigned num_query, _u64 L, _u64 K,
+                        unsigned num_threads,
+                        string groundtruth_file = "", string summary_file = "") {
     float*                query = nullptr;
 
     size_t            query_num, query_dim, query_aligned_dim;
@@ -146,6 +185,7 @@ int search_memory_index_opt(string data_file, unsigned num_data,string memory_in
     diskann::Index<float> index(metric, data_file.c_str(),num_data,dim);
     index.load(memory_index_file.c_str());  // to load NSG
     std::cout << "Index loaded" << std::endl;
+    std::vector<unsigned> id_map = load_id_map(memory_index_file);
 
     if (metric == diskann::FAST_L2)
         index.optimize_graph();
@@ -157,12 +197,22 @@ int search_memory_index_opt(string data_file, unsigned num_data,string memory_in
     std::vector<std::vector<float>>    query_result_dists(1);
 
     query_result_ids[0].resize(recall_at * query_num);
-    //    omp_set_num_threads(num_threads);
-    //#pragma omp parallel for schedule(dynamic, 1)
-    for (int64_t i = 0; i < (int64_t) query_num; i++) {
-        index.search_with_opt_graph(
-                query + i * query_aligned_dim, recall_at, L,
-                query_result_ids[0].data() + i * recall_at);
+    std::unique_ptr<evaluation::Evaluator> evaluator;
+    if (!groundtruth_file.empty())
+        evaluator.reset(new evaluation::Evaluator(groundtruth_file, query_num, recall_at));
+    std::vector<double> latencies(query_num);
+    auto s = std::chrono::high_resolution_clock::now();
+    index.batch_search_with_opt_graph(query, query_num, query_aligned_dim, recall_at, L,
+                                      query_result_ids[0].data(), num_threads, latencies.data());
+    std::chrono::duration<double> total = std::chrono::high_resolution_clock::now() - s;
+    if (!id_map.empty())
+        for (auto& id : query_result_ids[0]) id = id_map[id];
+    std::cout << "[Throughput] threads " << num_threads << " - QPS " << query_num / total.count() << std::endl;
+    print_latencies(latencies);
+    if (evaluator) {
+        for (int64_t i = 0; i < (int64_t) query_num; i++)
+            evaluator->record(i, query_result_ids[0].data() + i * recall_at, nullptr, latencies[i]);
+        evaluator->report("VAMANA", total.count(), summary_file);
     }
 
     diskann::aligned_free(query);
@@ -282,6 +332,8 @@ int main (int argc, char *argv[]) {
   string                  data_file;
   string                  index_file;
   string                  query_file;
+  string                  groundtruth_file;
+  string                  summary_file;
   int                     L;
   int                     K;
   float                   alpha;
@@ -301,7 +353,9 @@ int main (int argc, char *argv[]) {
       "dataset_size", po::value(&num_data), "datasetsize")(
       "query_size", po::value(&num_query), "queyrsize")(
       "timeseries_size", po::value(&dim), "dim")(
-      "mode", po::value(&mode), "mode : 0 build index, 1 search");
+      "mode", po::value(&mode), "mode : 0 build index, 1 search")(
+      "groundtruth", po::value(&groundtruth_file), "ground truth (ivecs or bin) to evaluate the search in-process")(
+      "summary", po::value(&summary_file), "file the evaluation summary is appended to (CSV for .csv, JSON otherwise)");
 
 
     auto osthreads = (std::thread::hardware_concurrency()==0)? sysconf(_SC_NPROCESSORS_ONLN) : std::thread::hardware_concurrency() -1;
@@ -327,9 +381,11 @@ int main (int argc, char *argv[]) {
     build_in_memory_index(data_file,num_data,dim, metric, K, L, C, alpha, index_file,
                                  num_threads);
   }else if(mode==1){
-    search_memory_index(data_file,num_data,index_file+"index.bin",dim, query_file,num_query,L,K);
+    search_memory_index(data_file,num_data,index_file+"index.bin",dim, query_file,num_query,L,K,
+                        num_threads, groundtruth_file, summary_file);
   } else if(mode==2){
-      search_memory_index_opt(data_file,num_data,index_file+"index.bin",dim, query_file,num_query,L,K);
+      search_memory_index_opt(data_file,num_data,index_file+"index.bin",dim, query_file,num_query,L,K,
+                              num_threads, groundtruth_file, summary_file);
 
   }
 
@@ -14,12 +14,21 @@
 #include <iomanip>
 #include <type_traits>
 #include <iostream>
+#include "Evaluation.h"
+#include "Reordering.h"
 //#include <boost/program_options.hpp>
 
 #include "sys/stat.h"
 
 using namespace std;
 
+// an index relabeled by reorder_memory_index keeps in index.bin.idmap the dataset id of every node
+std::vector<unsigned> load_id_map(const std::string& memory_index_file) {
+  if (!file_exists(memory_index_file + ".idmap"))
+    return std::vector<unsigned>();
+  return reordering::readIdMap(memory_index_file + ".idmap");
+}
+
 int build_in_memory_index(const std::string&     data_path, const unsigned num_data, const unsigned dim,
                           const diskann::Metric& metric, const unsigned R,                           const unsigned L, const unsigned C, const float alpha,
                           const std::string& save_path,
@@ -50,7 +59,9 @@ diff =
 }
 
 int search_memory_index(string data_file, unsigned num_data,string memory_index_file, unsigned dim,
-                        string query_bin, unsigned num_query, _u64 L, _u64 K) {
+                        string query_bin, unsigned num_query, _u64 L, _u64 K,
+                        unsigned num_threads,
+                        string groundtruth_file = "", string summary_file = "") {
   float*                query = nullptr;
 
   size_t            query_num, query_dim, query_aligned_dim;
@@ -76,6 +87,7 @@ int search_memory_index(string data_file, unsigned num_data,string memory_index_
   diskann::Index<float> index(metric, data_file.c_str(),num_data,dim);
   index.load(memory_index_file.c_str());  // to load NSG
   std::cout << "Index loaded" << std::endl;
+  std::vector<unsigned> id_map = load_id_map(memory_index_file);
 
 
 
@@ -89,8 +101,23 @@ int search_memory_index(string data_file, unsigned num_data,string memory_index_
   std::vector<std::vector<float>>    query_result_dists(1);
 
     query_result_ids[0].resize(recall_at * query_num);
-    //    omp_set_num_threads(num_threads);
-    //#pragma omp parallel for schedule(dynamic, 1)
+    if (!groundtruth_file.empty()) {
+        // batch_search() is silent, runs the queries on num_threads threads and returns the distances
+        evaluation::Evaluator evaluator(groundtruth_file, query_num, recall_at);
+        std::vector<uint64_t> ids(recall_at * query_num);
+        std::vector<float>    dists(recall_at * query_num);
+        std::vector<double>   latencies(query_num);
+        auto s = std::chrono::high_resolution_clock::now();
+        index.batch_search(query, query_num, query_aligned_dim, recall_at, L, ids.data(), dists.data(),
+                           num_threads, latencies.data());
+        std::chrono::duration<double> total = std::chrono::high_resolution_clock::now() - s;
+        if (!id_map.empty())
+            for (auto& id : ids) id = id_map[id];
+        for (int64_t i = 0; i < (int64_t) query_num; i++)
+            evaluator.record(i, ids.data() + i * recall_at, dists.data() + i * recall_at, latencies[i]);
+        std::cout << "[Throughput] threads " << num_threads << " - QPS " << query_num / total.count() << std::endl;
+        evaluator.report("VAMANA", total.count(), summary_file);
+    } else
     for (int64_t i = 0; i < (int64_t) query_num; i++) {
         index.search(query + i * query_aligned_dim, recall_at, L,
                      query_result_ids[0].data() + i * recall_at);
@@ -214,10 +241,12 @@ int main(int argc, char *argv[]){
     string                  data_file;
     string                  index_file;
     string                  query_file;
+    string                  groundtruth_file;
+    string                  summary_file;
     int                     L=200;
     int                     K=100;
     float                   alpha=1.5;
-    unsigned                num_threads;
+    unsigned                num_threads = omp_get_num_procs();
     bool                    mode;
     unsigned C = 500;
     unsigned num_data,num_query,dim;
@@ -236,6 +265,8 @@ int main(int argc, char *argv[]){
                 {"alpha",                required_argument, 0, 'a'},
                 {"nthrds",                required_argument, 0, 'th'},
                 {"mode",             required_argument, 0, 'x'},
+                {"groundtruth",      required_argument, 0, 'gt'},
+                {"summary",          required_argument, 0, 'sm'},
         };
 
         int option_index = 0;
@@ -280,6 +311,12 @@ int main(int argc, char *argv[]){
             case 't':
                 dim = atoi(optarg);
                 break;
+            case 'gt':
+                groundtruth_file = optarg;
+                break;
+            case 'sm':
+                summary_file = optarg;
+                break;
             default:
                 exit(-1);
                 break;
@@ -294,7 +331,8 @@ int main(int argc, char *argv[]){
         build_in_memory_index(data_file,num_data,dim, metric, K, L, C, alpha, index_file,
                               num_threads);
     }else if(mode==1){
-        search_memory_index(data_file,num_data,index_file+"index.bin",dim, query_file,num_query,L,K);
+        search_memory_index(data_file,num_data,index_file+"index.bin",dim, query_file,num_query,L,K,
+                            num_threads, groundtruth_file, summary_file);
     } else if(mode ==20){
       diskann::Metric metric;
       metric = diskann::Metric::L2;
@@ -6,6 +6,7 @@
 #define WEAVESS_BUILDER_H
 
 #include "index.h"
+#include "Evaluation.h"
 
 namespace weavess {
     class IndexBuilder {
@@ -54,6 +55,10 @@ namespace weavess {
 
         Index *final_index_;
 
+        // when set, search() records the answers instead of printing them
+        evaluation::Evaluator *evaluator = nullptr;
+        double search_time = 0;
+
         std::chrono::high_resolution_clock::time_point s;
         std::chrono::high_resolution_clock::time_point e;
     };
@@ -222,6 +222,16 @@ namespace weavess {
                     auto end  = std::chrono::high_resolution_clock::now();
                     std::chrono::duration<double> diff = end - start;
                     auto time = diff.count();
+                    if (evaluator != nullptr) {
+                        std::vector<unsigned> ids(K);
+                        std::vector<float> dists(K);
+                        for (size_t j = 0; j < K; j++) {
+                            ids[j] = pool[j].id;
+                            dists[j] = pool[j].distance;
+                        }
+                        evaluator->record(i, ids.data(), dists.data(), time);
+                        continue;
+                    }
                     std::cout << "----------"<<K<<"-NN RESULTS----------- "<<std::endl;
                     for(size_t j=0; j < K; j++){
                         printf(" K N°%lu  => Distance : %f | Node ID : %u | Time  : %f | TOTAL DC : %i | Total hops : %i  \n",
@@ -234,6 +244,7 @@ namespace weavess {
 
                 auto e1 = std::chrono::high_resolution_clock::now();
                 std::chrono::duration<double> diff = e1 - s1;
+                search_time = diff.count();
                 std::cout << "search time: " << diff.count() << "\n";
 
         e = std::chrono::high_resolution_clock::now();
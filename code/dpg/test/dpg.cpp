@@ -46,6 +46,8 @@ int main(int argc, char** argv) {
     string data_path;
     string index_path;
     string query_path;
+    string groundtruth_path;
+    string summary_path;
 
     unsigned int num_points;
     unsigned int num_query;
@@ -76,6 +78,8 @@ int main(int argc, char** argv) {
             ("S", po::value(&S)->default_value(25), "S")
             ("L", po::value(&L)->default_value(140), "Size of the candidate set, larger  is more accurate, but slower, L>=Knn ")
             ("numthreads", po::value(&numthreads)->default_value(osthreads), "num threads for parallel indexing ")
+            ("groundtruth", po::value(&groundtruth_path), "ground truth (ivecs or bin) to evaluate the search in-process")
+            ("summary", po::value(&summary_path), "file the evaluation summary is appended to (CSV for .csv, JSON otherwise)")
             ;
 
     po::options_description desc("Allowed options");
@@ -147,10 +151,17 @@ int main(int argc, char** argv) {
         index->setQueryLen(num_query);
         index->setQueryDim(ts_len);
 
+        if(!groundtruth_path.empty())
+            builder->evaluator = new evaluation::Evaluator(groundtruth_path, num_query, K);
+
         char idx[graph_path.size() + 30];
         memcpy(idx,graph_path.c_str(),graph_path.size()+4);
         builder -> load_graph(weavess::TYPE::INDEX_DPG, idx)
                 -> search(weavess::TYPE::SEARCH_ENTRY_RAND, weavess::TYPE::ROUTER_GREEDY, weavess::TYPE::L_SEARCH_ASSIGN);
+        if(builder->evaluator != nullptr){
+            builder->evaluator->report("DPG", builder->search_time, summary_path);
+            delete builder->evaluator;
+        }
 	peak_memory_footprint();
     }
 
@@ -2,6 +2,7 @@
 
 #include "visited_list_pool.h"
 #include "hnswlib.h"
+#include <algorithm>
 #include <atomic>
 #include <random>
 #include <stdlib.h>
@@ -11,8 +12,13 @@
 #include <chrono>
 #include <omp.h>
 #include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "TREESEP.h"
+#include "level0_layout.h"
+#include "node_lock.h"
 #include "../tsl/robin_set.h"
 
 struct Neighbor {
@@ -76,6 +82,13 @@ namespace hnswlib {
     typedef unsigned int tableint;
     typedef unsigned int linklistsizeint;
     using namespace PTK;
+
+    /**
+     * How loadIndex brings level 0 in memory: read into the interleaved hnswlib layout, map it from index.bin,
+     * or split it into an adjacency block and a vector block (kept in index.bin.split, see level0_layout.h).
+     */
+    enum Level0Load { LEVEL0_READ = 0, LEVEL0_MMAP = 1, LEVEL0_SPLIT = 2 };
+
     template<typename dist_t>
     class HierarchicalNSW : public AlgorithmInterface<dist_t> {
     public:
@@ -84,8 +97,12 @@ namespace hnswlib {
 
         }
 
-        HierarchicalNSW(SpaceInterface<dist_t> *s, const std::string &location, size_t ef = 10, size_t max_elements=0) {
-            loadIndex(location, s, ef, max_elements);
+        HierarchicalNSW(SpaceInterface<dist_t> *s, const std::string &location, size_t ef = 10, size_t max_elements=0,
+                        Level0Load level0 = LEVEL0_READ) {
+            if (level0 == LEVEL0_MMAP)
+                loadIndexMmap(location, s, ef);
+            else
+                loadIndex(location, s, ef, max_elements, level0 == LEVEL0_SPLIT);
         }
 
         HierarchicalNSW(SpaceInterface<dist_t> *s,
@@ -105,6 +122,7 @@ namespace hnswlib {
             ef_construction_ = std::max(ef_construction,M_);
             ef_ = 10;
 
+            random_seed_ = random_seed;
             level_generator_.seed(random_seed);
             update_probability_generator_.seed(random_seed + 1);
             //data_size defined at L2Space by dim * sizeof(float)
@@ -151,12 +169,10 @@ namespace hnswlib {
 
         ~HierarchicalNSW() {
 
-            if(data_level0_memory_ != nullptr)
+            if(mapped_index_ != nullptr)
+                munmap(mapped_index_, mapped_size_);
+            else if(data_level0_memory_ != nullptr)
             free(data_level0_memory_);
-            else{
-                free(data_);
-                delete final_graph_;
-            }
             for (tableint i = 0; i < cur_element_count; i++) {
                 if (element_levels_[i] > 0)
                     free(linkLists_[i]);
@@ -182,7 +198,7 @@ namespace hnswlib {
         VisitedListPool *visited_list_pool_;
         std::mutex cur_element_count_guard_;
 
-        std::vector<std::mutex> link_list_locks_;
+        std::vector<NodeLock> link_list_locks_;
 
         // Locks to prevent race condition during update/insert of an element at same time.
         // Note: Locks for additions can also be used to prevent this race condition if the querying of KNN is not exposed along with update/inserts i.e multithread insert/update/query in parallel.
@@ -196,6 +212,8 @@ namespace hnswlib {
 
         char *data_level0_memory_;
         char **linkLists_;
+        char *mapped_index_ = nullptr; // whole index file when loaded by loadIndexMmap, level 0 points into it
+        size_t mapped_size_ = 0;
         std::vector<int> element_levels_;
 
         size_t data_size_;
@@ -211,12 +229,17 @@ namespace hnswlib {
 
         std::default_random_engine level_generator_;
         std::default_random_engine update_probability_generator_;
+        size_t random_seed_ = 100;
+
+        // bulk build state (see addPointBulk): next internal id, and the entry point with its level,
+        // packed by packBulkEntry (0 until the first point)
+        std::atomic<size_t> bulk_next_id_{0};
+        std::atomic<uint64_t> bulk_entry_{0};
 
 
 
-        float * data_;
         size_t dim_;
-        std::vector<std::vector<unsigned>> * final_graph_;
+        SplitLevel0Storage split_level0_; // level 0 when loaded with LEVEL0_SPLIT, data_level0_memory_ is then null
 
         inline labeltype getExternalLabel(tableint internal_id) const {
             labeltype return_label;
@@ -241,6 +264,21 @@ namespace hnswlib {
             double r = -log(distribution(level_generator_)) * reverse_size;
             return (int) r;
         }
+
+        /** Level of a node drawn from a hash (splitmix64) of its id, so that inserting threads share no generator. */
+        int getBulkLevel(tableint internal_id) const {
+            uint64_t z = (uint64_t) random_seed_ + ((uint64_t) internal_id + 1) * 0x9E3779B97F4A7C15ULL;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            z ^= z >> 31;
+            double u = ((z >> 11) + 0.5) / 9007199254740992.0; // in (0, 1)
+            return (int) (-log(u) * mult_);
+        }
+
+        static inline uint64_t packBulkEntry(tableint entry_point, int level) {
+            return ((uint64_t) (level + 1) << 32) | entry_point;
+        }
+
 int getL(size_t size) {
     int base_p = 4;
     int increment = static_cast<int>(log10(size / 1000));
@@ -298,7 +336,7 @@ int getL(size_t size) {
                 tableint curNodeNum = 0;
                 curNodeNum = curr_el_pair.second;
 
-                std::unique_lock <std::mutex> lock(link_list_locks_[curNodeNum]);
+                std::unique_lock <NodeLock> lock(link_list_locks_[curNodeNum]);
 
                 int *data;// = (int *)(linkList0_ + curNodeNum * size_links_per_element0_);
                 data = (int*)get_linklist0(curNodeNum);
@@ -349,6 +387,8 @@ int getL(size_t size) {
             return top_candidates;
         }
 
+        // lock_lists = false when no list can change during the search (the search phase of addPointsBatched)
+        template <bool lock_lists = true>
         std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst>
         searchBaseLayer(tableint ep_id, const void *data_point, int layer) {
             VisitedList *vl = visited_list_pool_->getFreeVisitedList();
@@ -379,7 +419,9 @@ int getL(size_t size) {
 
                 tableint curNodeNum = curr_el_pair.second;
 
-                std::unique_lock <std::mutex> lock(link_list_locks_[curNodeNum]);
+                std::unique_lock <NodeLock> lock(link_list_locks_[curNodeNum], std::defer_lock);
+                if (lock_lists)
+                    lock.lock();
 
                 int *data;// = (int *)(linkList0_ + curNodeNum * size_links_per_element0_);
                 if (layer == 0) {
@@ -465,7 +507,7 @@ int getL(size_t size) {
 
                 tableint curNodeNum = curr_el_pair.second;
 
-                std::unique_lock <std::mutex> lock(link_list_locks_[curNodeNum]);
+                std::unique_lock <NodeLock> lock(link_list_locks_[curNodeNum]);
 
                 int *data;// = (int *)(linkList0_ + curNodeNum * size_links_per_element0_);
                 if (layer == 0) {
@@ -1027,6 +1069,22 @@ int getL(size_t size) {
             }
         }
 
+        /** Keeps at most M of the candidates with the ND method rng (RND, RRND, MOND or NoND); upper levels always use RND. */
+        void selectNeighbors(
+                std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> &candidates,
+                const size_t M, int level, int rng, float prune) {
+            if(level!=0)
+                getNeighborsByHeuristic2(candidates, M);
+            else if(rng==0)
+                getNeighborsByHeuristic2(candidates, M);
+            else if(rng==1)
+                getNeighborsByRNGALPHA(candidates, M, prune);
+            else if(rng == 2)
+                getNeighborsByANGLE(candidates, M, prune);
+            else if(rng == 3)
+                getNeighbor(candidates, M);
+        }
+
         linklistsizeint *get_linklist0(tableint internal_id) const {
             return (linklistsizeint *) (data_level0_memory_ + internal_id * size_data_per_element_ + offsetLevel0_);
         };
@@ -1053,18 +1111,7 @@ int getL(size_t size) {
             if(level==0)size = top_candidates.size() < M_?top_candidates.size():M_;
 #endif
             size_t Mcurmax = level ? maxM_ : maxM0_;
-            if(level!=0)
-                getNeighborsByHeuristic2(top_candidates, M_);
-            else if(rng==0)
-                getNeighborsByHeuristic2(top_candidates, M_);
-            else if(rng==1)
-                getNeighborsByRNGALPHA(top_candidates, M_, prune);
-            else if(rng == 2)
-                getNeighborsByANGLE(top_candidates, M_, prune);
-            else if(rng == 3) {
-//                std::cerr << "her"<<std::endl;
-                getNeighbor(top_candidates, M_);
-            }
+            selectNeighbors(top_candidates, M_, level, rng, prune);
 #ifdef STATSND
 #pragma omp critical
             if(level==0)std::cerr<<"[ PR :" << (float)(size - top_candidates.size())/size <<" ]"<< std::endl;
@@ -1106,7 +1153,7 @@ int getL(size_t size) {
 
             for (size_t idx = 0; idx < selectedNeighbors.size(); idx++) {
 
-                std::unique_lock <std::mutex> lock(link_list_locks_[selectedNeighbors[idx]]);
+                std::unique_lock <NodeLock> lock(link_list_locks_[selectedNeighbors[idx]]);
 
                 linklistsizeint *ll_other;
                 if (level == 0)
@@ -1153,16 +1200,7 @@ int getL(size_t size) {
                                     fstdistfunc_(getDataByInternalId(data[j]), getDataByInternalId(selectedNeighbors[idx]),
                                                  dist_func_param_), data[j]);
                         }
-                        if(level!=0)
-                            getNeighborsByHeuristic2(candidates, Mcurmax);
-                        else if(rng==0)
-                            getNeighborsByHeuristic2(candidates, Mcurmax);
-                        else if(rng==1)
-                            getNeighborsByRNGALPHA(candidates, Mcurmax, prune);
-                        else if(rng == 2)
-                            getNeighborsByANGLE(candidates, Mcurmax, prune);
-                        else if(rng ==3)
-                            getNeighbor(candidates,Mcurmax);
+                        selectNeighbors(candidates, Mcurmax, level, rng, prune);
 
                         int indx = 0;
                         while (candidates.size() > 0) {
@@ -1235,6 +1273,8 @@ int getL(size_t size) {
         };
 
         void resizeIndex(size_t new_max_elements){
+            if (mapped_index_ != nullptr)
+                throw std::runtime_error("A memory-mapped index is read-only and cannot be resized");
             if (new_max_elements<cur_element_count)
                 throw std::runtime_error("Cannot resize, max element is less than the current number of elements");
 
@@ -1246,7 +1286,7 @@ int getL(size_t size) {
 
             element_levels_.resize(new_max_elements);
 
-            std::vector<std::mutex>(new_max_elements).swap(link_list_locks_);
+            std::vector<NodeLock>(new_max_elements).swap(link_list_locks_);
 
             // Reallocate base layer
             char * data_level0_memory_new = (char *) malloc(new_max_elements * size_data_per_element_);
@@ -1298,7 +1338,67 @@ int getL(size_t size) {
             output.close();
         }
 
-        void loadIndex(const std::string &location, SpaceInterface<dist_t> *s, size_t ef, size_t max_elements_i=0) {
+        /**
+         * Writes the index like saveIndex with the nodes relabeled: order[new_id] = old_id. Links and the entry
+         * point are remapped, the external labels stay in the records so the search results do not change.
+         */
+        void saveIndexReordered(const std::string &location, const std::vector<tableint> &order) {
+            if (data_level0_memory_ == nullptr || order.size() != cur_element_count)
+                throw std::runtime_error("Reordering needs the interleaved level 0 and one entry per element");
+            std::vector<tableint> rank(cur_element_count);
+            for (size_t i = 0; i < cur_element_count; i++)
+                rank[order[i]] = i;
+
+            std::ofstream output(location, std::ios::binary);
+            if (!output.is_open())
+                throw std::runtime_error("Cannot write the reordered index to " + location);
+            tableint enterpoint = rank[enterpoint_node_];
+
+            writeBinaryPOD(output, offsetLevel0_);
+            writeBinaryPOD(output, max_elements_);
+            writeBinaryPOD(output, cur_element_count);
+            writeBinaryPOD(output, size_data_per_element_);
+            writeBinaryPOD(output, label_offset_);
+            writeBinaryPOD(output, offsetData_);
+            writeBinaryPOD(output, maxlevel_);
+            writeBinaryPOD(output, enterpoint);
+            writeBinaryPOD(output, maxM_);
+
+            writeBinaryPOD(output, maxM0_);
+            writeBinaryPOD(output, M_);
+            writeBinaryPOD(output, mult_);
+            writeBinaryPOD(output, ef_construction_);
+
+            auto remap = [&rank](char *list) {
+                linklistsizeint *data = (linklistsizeint *) list;
+                size_t size = *((unsigned short int *) data);
+                tableint *links = (tableint *) (data + 1);
+                for (size_t j = 0; j < size; j++)
+                    links[j] = rank[links[j]];
+            };
+            std::vector<char> element(std::max(size_data_per_element_, size_links_per_element_ * (maxlevel_ + 1)));
+            for (size_t i = 0; i < cur_element_count; i++) {
+                memcpy(element.data(), data_level0_memory_ + order[i] * size_data_per_element_, size_data_per_element_);
+                remap(element.data() + offsetLevel0_);
+                output.write(element.data(), size_data_per_element_);
+            }
+
+            for (size_t i = 0; i < cur_element_count; i++) {
+                tableint old_id = order[i];
+                unsigned int linkListSize = element_levels_[old_id] > 0 ? size_links_per_element_ * element_levels_[old_id] : 0;
+                writeBinaryPOD(output, linkListSize);
+                if (linkListSize) {
+                    memcpy(element.data(), linkLists_[old_id], linkListSize);
+                    for (int level = 0; level < element_levels_[old_id]; level++)
+                        remap(element.data() + level * size_links_per_element_);
+                    output.write(element.data(), linkListSize);
+                }
+            }
+            output.close();
+        }
+
+        void loadIndex(const std::string &location, SpaceInterface<dist_t> *s, size_t ef, size_t max_elements_i=0,
+                       bool split_level0=false) {
 
 
             std::ifstream input(location, std::ios::binary);
@@ -1364,29 +1464,28 @@ int getL(size_t size) {
 
             input.seekg(pos,input.beg);
 
-if(ef==7){
-    this->dim_ = *((size_t *)s->get_dist_func_param());
-    this->data_ = (float *) aligned_alloc(8*sizeof(float ),cur_element_count*(this->dim_)* sizeof(float));
-    this->final_graph_ = new std::vector<std::vector<unsigned>>(cur_element_count);
-
-    char * buffer = static_cast<char *>(malloc(sizeof(char) * size_data_per_element_)); //new char[];
-
-    unsigned short int outdegree;
-    unsigned * data_element;
-
-    for(int i=0;i<cur_element_count;i++){
-        input.read(buffer,size_data_per_element_);
-
-        data_element = (unsigned*)buffer;
-        memcpy(&data_[dim_ * i], buffer + offsetData_,
-               dim_*sizeof(float ));
-        outdegree = *((unsigned short int *)(data_element));
-        std::vector<unsigned> tmp(outdegree);
-        memcpy(tmp.data(),data_element+1, outdegree * sizeof(unsigned));
-        final_graph_->at(i) = tmp;
+if(split_level0){
+    dim_ = *((size_t *)s->get_dist_func_param());
+    std::string split_location = location + ".split";
+    if (split_level0_.load(split_location, cur_element_count, dim_, maxM0_)) {
+        input.seekg(cur_element_count * size_data_per_element_, input.cur);
+    } else {
+        split_level0_.allocate(cur_element_count, dim_, maxM0_);
+        char * buffer = static_cast<char *>(malloc(sizeof(char) * size_data_per_element_));
+        // a stride of 0 makes the single element in buffer answer for any id
+        InterleavedLevel0 element{buffer, 0, offsetLevel0_, offsetData_, data_size_};
+        for (size_t i = 0; i < cur_element_count; i++) {
+            input.read(buffer, size_data_per_element_);
+            split_level0_.copyNode(i, element);
+        }
+        free(buffer);
+        try {
+            split_level0_.save(split_location);
+        } catch (std::runtime_error &e) {
+            std::cerr << e.what() << ", the split level 0 will be rebuilt at the next load" << std::endl;
+        }
     }
     data_level0_memory_ = nullptr;
-    std::cout << "Loading 7 : final_graph_, data_, dim_  \n";
 }
 else{
     data_level0_memory_ = (char *) malloc(max_elements * size_data_per_element_);
@@ -1397,7 +1496,7 @@ else{
 }
             size_links_per_element_ = maxM_ * sizeof(tableint) + sizeof(linklistsizeint);
             size_links_level0_ = maxM0_ * sizeof(tableint) + sizeof(linklistsizeint);
-            std::vector<std::mutex>(max_elements).swap(link_list_locks_);
+            std::vector<NodeLock>(max_elements).swap(link_list_locks_);
             std::vector<std::mutex>(max_update_element_locks).swap(link_list_update_locks_);
 
             visited_list_pool_ = new VisitedListPool(1, max_elements);
@@ -1437,6 +1536,91 @@ if(data_level0_memory_ != nullptr)
             return;
         }
 
+        /**
+         * Loads an index written by saveIndex without copying level 0: the file is mapped read-only and
+         * data_level0_memory_ points into the mapping, so processes searching the same index share its page-cache copy.
+         * The validation pass of loadIndex is skipped, and only the upper-level link lists are materialized.
+         * The index cannot be modified (no insertion, deletion or resize).
+         */
+        void loadIndexMmap(const std::string &location, SpaceInterface<dist_t> *s, size_t ef) {
+            int fd = open(location.c_str(), O_RDONLY);
+            if (fd < 0)
+                throw std::runtime_error("Cannot open file");
+            mapped_size_ = lseek(fd, 0, SEEK_END);
+            void *mapped = mmap(nullptr, mapped_size_, PROT_READ, MAP_SHARED, fd, 0);
+            close(fd);
+            if (mapped == MAP_FAILED)
+                throw std::runtime_error("Cannot map the index file");
+            mapped_index_ = (char *) mapped;
+
+            char *position = mapped_index_;
+            auto readPOD = [&position](auto &pod) {
+                memcpy(&pod, position, sizeof(pod));
+                position += sizeof(pod);
+            };
+            readPOD(offsetLevel0_);
+            readPOD(max_elements_);
+            readPOD(cur_element_count);
+            max_elements_ = cur_element_count;
+            readPOD(size_data_per_element_);
+            readPOD(label_offset_);
+            readPOD(offsetData_);
+            readPOD(maxlevel_);
+            readPOD(enterpoint_node_);
+            readPOD(maxM_);
+            readPOD(maxM0_);
+            readPOD(M_);
+            readPOD(mult_);
+            readPOD(ef_construction_);
+
+            data_size_ = s->get_data_size();
+            fstdistfunc_ = s->get_dist_func();
+            dist_func_param_ = s->get_dist_func_param();
+
+            size_t level0_size = cur_element_count * size_data_per_element_;
+            if (position + level0_size > mapped_index_ + mapped_size_)
+                throw std::runtime_error("Index seems to be corrupted or unsupported");
+            data_level0_memory_ = position;
+            madvise(data_level0_memory_, level0_size, MADV_RANDOM);
+            position += level0_size;
+
+            size_links_per_element_ = maxM_ * sizeof(tableint) + sizeof(linklistsizeint);
+            size_links_level0_ = maxM0_ * sizeof(tableint) + sizeof(linklistsizeint);
+            std::vector<NodeLock>(max_elements_).swap(link_list_locks_);
+            std::vector<std::mutex>(max_update_element_locks).swap(link_list_update_locks_);
+
+            visited_list_pool_ = new VisitedListPool(1, max_elements_);
+
+            linkLists_ = (char **) malloc(sizeof(void *) * max_elements_);
+            if (linkLists_ == nullptr)
+                throw std::runtime_error("Not enough memory: loadIndex failed to allocate linklists");
+            element_levels_ = std::vector<int>(max_elements_);
+            revSize_ = 1.0 / mult_;
+            ef_ = ef;
+            for (size_t i = 0; i < cur_element_count; i++) {
+                label_lookup_[i]=i;
+                unsigned int linkListSize;
+                if (position + sizeof(linkListSize) > mapped_index_ + mapped_size_)
+                    throw std::runtime_error("Index seems to be corrupted or unsupported");
+                readPOD(linkListSize);
+                if (linkListSize == 0) {
+                    element_levels_[i] = 0;
+                    linkLists_[i] = nullptr;
+                } else {
+                    if (position + linkListSize > mapped_index_ + mapped_size_)
+                        throw std::runtime_error("Index seems to be corrupted or unsupported");
+                    element_levels_[i] = linkListSize / size_links_per_element_;
+                    linkLists_[i] = (char *) malloc(linkListSize);
+                    if (linkLists_[i] == nullptr)
+                        throw std::runtime_error("Not enough memory: loadIndex failed to allocate linklist");
+                    memcpy(linkLists_[i], position, linkListSize);
+                    position += linkListSize;
+                }
+            }
+            // scanning the deletion marks would fault in all of level 0, and the drivers never delete
+            has_deletions_=false;
+        }
+
         template<typename data_t>
         std::vector<data_t> getDataByLabel(labeltype label)
         {
@@ -1580,7 +1764,7 @@ if(data_level0_memory_ != nullptr)
                     getNeighborsByHeuristic2(candidates, layer == 0 ? maxM0_ : maxM_);
 
                     {
-                        std::unique_lock <std::mutex> lock(link_list_locks_[neigh]);
+                        std::unique_lock <NodeLock> lock(link_list_locks_[neigh]);
                         linklistsizeint *ll_cur;
                         ll_cur = get_linklist_at_level(neigh, layer);
                         size_t candSize = candidates.size();
@@ -1606,7 +1790,7 @@ if(data_level0_memory_ != nullptr)
                     while (changed) {
                         changed = false;
                         unsigned int *data;
-                        std::unique_lock <std::mutex> lock(link_list_locks_[currObj]);
+                        std::unique_lock <NodeLock> lock(link_list_locks_[currObj]);
                         data = get_linklist_at_level(currObj,level);
                         int size = getListCount(data);
                         tableint *datal = (tableint *) (data + 1);
@@ -1660,7 +1844,7 @@ if(data_level0_memory_ != nullptr)
         }
 
         std::vector<tableint> getConnectionsWithLock(tableint internalId, int level) {
-            std::unique_lock <std::mutex> lock(link_list_locks_[internalId]);
+            std::unique_lock <NodeLock> lock(link_list_locks_[internalId]);
             unsigned int *data = get_linklist_at_level(internalId, level);
             int size = getListCount(data);
             std::vector<tableint> result(size);
@@ -1698,7 +1882,7 @@ if(data_level0_memory_ != nullptr)
 
             // Take update lock to prevent race conditions on an element with insertion/update at the same time.
             std::unique_lock <std::mutex> lock_el_update(link_list_update_locks_[(cur_c & (max_update_element_locks - 1))]);
-            std::unique_lock <std::mutex> lock_el(link_list_locks_[cur_c]);
+            std::unique_lock <NodeLock> lock_el(link_list_locks_[cur_c]);
             int curlevel = getRandomLevel(mult_);
             if (level > 0)
                 curlevel = level;
@@ -1740,7 +1924,7 @@ if(data_level0_memory_ != nullptr)
                         while (changed) {
                             changed = false;
                             unsigned int *data;
-                            std::unique_lock <std::mutex> lock(link_list_locks_[currObj]);
+                            std::unique_lock <NodeLock> lock(link_list_locks_[currObj]);
                             data = get_linklist(currObj,level);
                             int size = getListCount(data);
 
@@ -1801,6 +1985,258 @@ if(data_level0_memory_ != nullptr)
             return cur_c;
         };
 
+        /**
+         * Bulk build for dense labels (0..max_elements-1, each added once), without concurrent searches, updates
+         * or deletions. Unlike addPoint, no lock is shared by all the inserts: the label map and the update locks
+         * are skipped, the internal id is reserved with an atomic counter, the level comes from getBulkLevel, and
+         * the entry point and max level are read and raised with a compare-and-swap instead of the global mutex.
+         * Concurrent inserts only meet on the locks of the nodes they link. Call finishBulkBuild() once all the
+         * points are added.
+         */
+        tableint addPointBulk(const void *data_point, labeltype label, int rng, float prune, int cnt, int range) {
+            if (label >= max_elements_)
+                throw std::runtime_error("addPointBulk needs dense labels, below max_elements");
+            tableint cur_c = (tableint) bulk_next_id_.fetch_add(1, std::memory_order_relaxed);
+            if (cur_c >= max_elements_)
+                throw std::runtime_error("The number of elements exceeds the specified limit");
+
+            // held until cur_c is linked at every level, as in addPoint
+            std::unique_lock <NodeLock> lock_el(link_list_locks_[cur_c]);
+            int curlevel = getBulkLevel(cur_c);
+            element_levels_[cur_c] = curlevel;
+
+            memset(data_level0_memory_ + cur_c * size_data_per_element_ + offsetLevel0_, 0, size_data_per_element_);
+            memcpy(getExternalLabeLp(cur_c), &label, sizeof(labeltype));
+            memcpy(getDataByInternalId(cur_c), data_point, data_size_);
+
+            if (curlevel) {
+                linkLists_[cur_c] = (char *) malloc(size_links_per_element_ * curlevel + 1);
+                if (linkLists_[cur_c] == nullptr)
+                    throw std::runtime_error("Not enough memory: addPointBulk failed to allocate linklist");
+                memset(linkLists_[cur_c], 0, size_links_per_element_ * curlevel + 1);
+            }
+
+            // the first point becomes the entry point; otherwise the failed exchange loads the current one
+            uint64_t entry = bulk_entry_.load(std::memory_order_acquire);
+            if (entry == 0 && bulk_entry_.compare_exchange_strong(entry, packBulkEntry(cur_c, curlevel)))
+                return cur_c;
+            int maxlevelcopy = (int) (entry >> 32) - 1;
+            tableint currObj = (tableint) entry;
+
+            if (curlevel < maxlevelcopy) {
+                dist_t curdist = fstdistfunc_(data_point, getDataByInternalId(currObj), dist_func_param_);
+                for (int level = maxlevelcopy; level > curlevel; level--) {
+                    bool changed = true;
+                    while (changed) {
+                        changed = false;
+                        std::unique_lock <NodeLock> lock(link_list_locks_[currObj]);
+                        unsigned int *data = get_linklist(currObj, level);
+                        int size = getListCount(data);
+                        tableint *datal = (tableint *) (data + 1);
+                        for (int i = 0; i < size; i++) {
+                            tableint cand = datal[i];
+                            dist_t d = fstdistfunc_(data_point, getDataByInternalId(cand), dist_func_param_);
+                            if (d < curdist) {
+                                curdist = d;
+                                currObj = cand;
+                                changed = true;
+                            }
+                        }
+                    }
+                }
+            }
+
+            for (int level = std::min(curlevel, maxlevelcopy); level >= 0; level--) {
+                std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates;
+                if (level == 0 && range > 0)
+                    top_candidates = searchBaseLayervisited(currObj, data_point, range);
+                else
+                    top_candidates = searchBaseLayer(currObj, data_point, level);
+                currObj = mutuallyConnectNewElement(data_point, cur_c, top_candidates, level, false, rng, prune, cnt);
+            }
+
+            // a higher level makes cur_c the entry point, unless another insert went even higher meanwhile
+            while ((int) (entry >> 32) - 1 < curlevel &&
+                   !bulk_entry_.compare_exchange_weak(entry, packBulkEntry(cur_c, curlevel))) {
+            }
+            return cur_c;
+        }
+
+        /** Ends a bulk build: sets the element count, the entry point and the label map from its state. */
+        void finishBulkBuild() {
+            cur_element_count = std::min(bulk_next_id_.load(), max_elements_);
+            uint64_t entry = bulk_entry_.load();
+            if (entry != 0) {
+                enterpoint_node_ = (tableint) entry;
+                maxlevel_ = (int) (entry >> 32) - 1;
+            }
+            label_lookup_.reserve(cur_element_count);
+            for (tableint i = 0; i < cur_element_count; i++)
+                label_lookup_[getExternalLabel(i)] = i;
+        }
+
+        /**
+         * Batched construction: inserts count points (stored back to back, labels label_offset..label_offset+count-1)
+         * in batches of at most max_batch points, each in three phases separated by barriers:
+         * 1. every point of the batch searches the graph as it was before the batch, which no thread modifies, so
+         *    the searches take no lock;
+         * 2. its neighbors are selected with the ND method rng and written to its own (still unreachable) lists;
+         * 3. the reverse edges are grouped by target node, and each target merges all its new sources at once,
+         *    with at most one prune.
+         * The ids, levels (getBulkLevel) and the order of every merge only depend on the input and the seed, so the
+         * graph is the same for any number of threads. Points of a batch cannot select each other, so the batches
+         * grow with the graph (at most its size) up to max_batch.
+         */
+        void addPointsBatched(const void *data_points, size_t count, labeltype label_offset, int rng, float prune,
+                              size_t max_batch) {
+            if (max_batch == 0)
+                throw std::runtime_error("The batch size of addPointsBatched must be positive");
+            if (cur_element_count + count > max_elements_)
+                throw std::runtime_error("The number of elements exceeds the specified limit");
+            const char *points = (const char *) data_points;
+            size_t done = 0;
+            if (cur_element_count == 0 && count > 0) {
+                initBatchedPoint(points, label_offset);
+                enterpoint_node_ = 0;
+                maxlevel_ = element_levels_[0];
+                done = 1;
+            }
+
+            while (done < count) {
+                size_t batch = std::min(std::min(max_batch, (size_t) cur_element_count), count - done);
+                tableint first = (tableint) cur_element_count;
+                for (size_t i = 0; i < batch; i++)
+                    initBatchedPoint(points + (done + i) * data_size_, label_offset + done + i);
+                tableint entry_point = enterpoint_node_;
+                int maxlevel = maxlevel_;
+
+                // phases 1 and 2: lock-free search of the frozen graph, then neighbor selection
+#pragma omp parallel for schedule(dynamic, 16)
+                for (long i = 0; i < (long) batch; i++) {
+                    tableint cur_c = first + (tableint) i;
+                    const void *data_point = getDataByInternalId(cur_c);
+                    int curlevel = element_levels_[cur_c];
+                    tableint currObj = entry_point;
+                    dist_t curdist = fstdistfunc_(data_point, getDataByInternalId(currObj), dist_func_param_);
+                    for (int level = maxlevel; level > curlevel; level--) {
+                        bool changed = true;
+                        while (changed) {
+                            changed = false;
+                            unsigned int *data = get_linklist(currObj, level);
+                            int size = getListCount(data);
+                            tableint *datal = (tableint *) (data + 1);
+                            for (int j = 0; j < size; j++) {
+                                dist_t d = fstdistfunc_(data_point, getDataByInternalId(datal[j]), dist_func_param_);
+                                if (d < curdist) {
+                                    curdist = d;
+                                    currObj = datal[j];
+                                    changed = true;
+                                }
+                            }
+                        }
+                    }
+                    for (int level = std::min(curlevel, maxlevel); level >= 0; level--) {
+                        std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> top_candidates =
+                                searchBaseLayer<false>(currObj, data_point, level);
+                        selectNeighbors(top_candidates, M_, level, rng, prune);
+                        linklistsizeint *ll_cur = get_linklist_at_level(cur_c, level);
+                        tableint *datal = (tableint *) (ll_cur + 1);
+                        size_t size = 0;
+                        while (!top_candidates.empty()) {
+                            datal[size++] = top_candidates.top().second;
+                            top_candidates.pop();
+                        }
+                        setListCount(ll_cur, size);
+                        // the closest neighbor, popped last, starts the search of the level below
+                        currObj = datal[size - 1];
+                    }
+                }
+
+                // phase 3: reverse edges (target, source) sorted by target, then by source
+                for (int level = maxlevel; level >= 0; level--) {
+                    std::vector<std::pair<tableint, tableint>> edges;
+                    for (tableint cur_c = first; cur_c < first + batch; cur_c++) {
+                        if (element_levels_[cur_c] < level)
+                            continue;
+                        linklistsizeint *ll_cur = get_linklist_at_level(cur_c, level);
+                        tableint *datal = (tableint *) (ll_cur + 1);
+                        for (size_t j = 0; j < getListCount(ll_cur); j++)
+                            edges.emplace_back(datal[j], cur_c);
+                    }
+                    std::sort(edges.begin(), edges.end());
+                    std::vector<size_t> group_begin;
+                    for (size_t j = 0; j < edges.size(); j++)
+                        if (j == 0 || edges[j].first != edges[j - 1].first)
+                            group_begin.push_back(j);
+                    group_begin.push_back(edges.size());
+
+#pragma omp parallel for schedule(dynamic, 16)
+                    for (long g = 0; g < (long) group_begin.size() - 1; g++)
+                        addReverseEdges(edges.data() + group_begin[g], group_begin[g + 1] - group_begin[g], level,
+                                        rng, prune);
+                }
+
+                // the highest new level (first id on ties) becomes the entry point
+                for (tableint cur_c = first; cur_c < first + batch; cur_c++) {
+                    if (element_levels_[cur_c] > maxlevel_) {
+                        maxlevel_ = element_levels_[cur_c];
+                        enterpoint_node_ = cur_c;
+                    }
+                }
+                done += batch;
+            }
+        }
+
+        /** Takes the next internal id for a point of addPointsBatched, with its level, record and label. */
+        void initBatchedPoint(const void *data_point, labeltype label) {
+            tableint cur_c = (tableint) cur_element_count++;
+            int curlevel = getBulkLevel(cur_c);
+            element_levels_[cur_c] = curlevel;
+            memset(data_level0_memory_ + cur_c * size_data_per_element_ + offsetLevel0_, 0, size_data_per_element_);
+            memcpy(getExternalLabeLp(cur_c), &label, sizeof(labeltype));
+            memcpy(getDataByInternalId(cur_c), data_point, data_size_);
+            if (curlevel) {
+                linkLists_[cur_c] = (char *) malloc(size_links_per_element_ * curlevel + 1);
+                if (linkLists_[cur_c] == nullptr)
+                    throw std::runtime_error("Not enough memory: addPointsBatched failed to allocate linklist");
+                memset(linkLists_[cur_c], 0, size_links_per_element_ * curlevel + 1);
+            }
+            label_lookup_[label] = cur_c;
+        }
+
+        /**
+         * Links the n sources of edges (all with the same target) from the target at level: they are appended while
+         * there is room, otherwise the current neighbors and all the sources are pruned together once.
+         */
+        void addReverseEdges(const std::pair<tableint, tableint> *edges, size_t n, int level, int rng, float prune) {
+            tableint target = edges[0].first;
+            size_t Mcurmax = level ? maxM_ : maxM0_;
+            linklistsizeint *ll_other = get_linklist_at_level(target, level);
+            size_t size = getListCount(ll_other);
+            tableint *data = (tableint *) (ll_other + 1);
+            if (size + n <= Mcurmax) {
+                for (size_t j = 0; j < n; j++)
+                    data[size + j] = edges[j].second;
+                setListCount(ll_other, size + n);
+                return;
+            }
+
+            const char *target_data = getDataByInternalId(target);
+            std::priority_queue<std::pair<dist_t, tableint>, std::vector<std::pair<dist_t, tableint>>, CompareByFirst> candidates;
+            for (size_t j = 0; j < size; j++)
+                candidates.emplace(fstdistfunc_(getDataByInternalId(data[j]), target_data, dist_func_param_), data[j]);
+            for (size_t j = 0; j < n; j++)
+                candidates.emplace(fstdistfunc_(getDataByInternalId(edges[j].second), target_data, dist_func_param_),
+                                   edges[j].second);
+            selectNeighbors(candidates, Mcurmax, level, rng, prune);
+            size_t indx = 0;
+            while (!candidates.empty()) {
+                data[indx++] = candidates.top().second;
+                candidates.pop();
+            }
+            setListCount(ll_other, indx);
+        }
+
         tableint addPoint_ksrep(const void *data_point, labeltype label, int level, int rng, float prune) {
 
             tableint cur_c = 0;
@@ -1829,7 +2265,7 @@ if(data_level0_memory_ != nullptr)
             }
             // Take update lock to prevent race conditions on an element with insertion/update at the same time.
             std::unique_lock <std::mutex> lock_el_update(link_list_update_locks_[(cur_c & (max_update_element_locks - 1))]);
-            std::unique_lock <std::mutex> lock_el(link_list_locks_[cur_c]);
+            std::unique_lock <NodeLock> lock_el(link_list_locks_[cur_c]);
             int curlevel = 0;
             if (level > 0)
                 curlevel = level;
@@ -1871,7 +2307,7 @@ if(data_level0_memory_ != nullptr)
                         while (changed) {
                             changed = false;
                             unsigned int *data;
-                            std::unique_lock <std::mutex> lock(link_list_locks_[currObj]);
+                            std::unique_lock <NodeLock> lock(link_list_locks_[currObj]);
                             data = get_linklist(currObj,level);
                             int size = getListCount(data);
 
@@ -2151,7 +2587,7 @@ if(data_level0_memory_ != nullptr)
             while ( top_candidates.size() > 0) {
                 std::pair<dist_t, tableint> rez = top_candidates.top();
                 result[i] = rez.first;
-                ids[i] = rez.second;
+                ids[i] = (unsigned int) getExternalLabel(rez.second);
                 top_candidates.pop();
                 --i;
             }
@@ -2228,7 +2664,7 @@ if(data_level0_memory_ != nullptr)
             while ( top_candidates.size() > 0) {
                 std::pair<dist_t, tableint> rez = top_candidates.top();
                 result[i] = rez.first;
-                ids[i] = rez.second;
+                ids[i] = (unsigned int) getExternalLabel(rez.second);
                 top_candidates.pop();
                 --i;
             }
@@ -2316,132 +2752,20 @@ if(data_level0_memory_ != nullptr)
 
         };
 
-        float * searchGraphBSFSPQ(const void *query_data, size_t K, querying_stats & stats) const {
-            float *  result = nullptr;
-            if (cur_element_count == 0) return result;
-            result = static_cast<float *>(malloc(sizeof(float) * K));
-            auto start = new PTK::Timer();
-            auto stime = std::chrono::high_resolution_clock::now();
-
-            tableint currObj = enterpoint_node_;
-            dist_t curdist = fstdistfunc_(query_data, data_ + dim_*enterpoint_node_, dist_func_param_);
-//            __RESET_NUM_DISTCAL
-            for (int level = maxlevel_; level > 0; level--) {
-                bool changed = true;
-                while (changed) {
-                    changed = false;
-                    unsigned int *data;
-
-                    data = (unsigned int *) get_linklist(currObj, level);
-                    int size = getListCount(data);
-//                    metric_hops++;
-//                    metric_distance_computations+=size;
-                    stats.distance_computations_hrl +=size;
-                    stats.num_hops_hrl++;
-                    tableint *datal = (tableint *) (data + 1);
-                    for (int i = 0; i < size; i++) {
-                        tableint cand = datal[i];
-                        if (cand < 0 || cand > max_elements_)
-                            throw std::runtime_error("cand error");
-                        dist_t d = fstdistfunc_(query_data,  data_ + dim_*cand, dist_func_param_);
-//                        __COUNT_NUM_DISTCAL
-                        if (d < curdist) {
-                            curdist = d;
-                            currObj = cand;
-                            changed = true;
-                        }
-                    }
-                }
-            }
-
-
-//std::cout << currObj;
-
-            auto finish = std::chrono::high_resolution_clock::now();
-            auto elapsed = finish - stime;
-
-            stats.time_layer0+=elapsed.count();
-
-            stime = std::chrono::high_resolution_clock::now();
-            int i = K-1;
-
-            unsigned l =0;
-            
-            tsl::robin_set<unsigned> inserted_into_pool;
-            inserted_into_pool.reserve(ef_ * 20);
-            Neighbor nn = Neighbor(currObj,curdist, true);
-
-            inserted_into_pool.insert(currObj);
-            std::vector<Neighbor> best_L_nodes;
-            
-            best_L_nodes.reserve(ef_+1);
-            best_L_nodes[l++] = nn;
-
-            std::sort( best_L_nodes.begin(),  best_L_nodes.begin() +  l);
-            unsigned k = 0;
-            while (k <  l) {
-                unsigned nk =  l;
-                if ( best_L_nodes[k].flag) {
-                     best_L_nodes[k].flag = false;
-                    auto n =  best_L_nodes[k].id;
-
-                     stats.num_hops_bsl++;
-
-                    for (unsigned m = 0; m < (*final_graph_)[n].size(); m++) {
-                        unsigned id = (*( final_graph_))[n][m];
-                        if(inserted_into_pool.find(id) == inserted_into_pool.end()) {
-                            inserted_into_pool.insert(id);
-
-                            if ((m + 1) < (*( final_graph_))[n].size()) {
-                                auto nextn = (*( final_graph_))[n][m + 1];
-                                prefetch_vector(
-                                        (const char *) ( data_ + nextn*dim_),
-                                        sizeof(float) * dim_);
-                            }
-
-                             stats.distance_computations_bsl++;
-
-                            float dist =  fstdistfunc_(query_data, data_ + dim_*id, dist_func_param_);
-                            if (dist >=  best_L_nodes[ l - 1].distance && ( l == ef_))
-                                continue;
-
-                            Neighbor nn(id, dist, true);
-                            unsigned r = InsertIntoPool( best_L_nodes.data(),  l, nn);
-                            if ( l < ef_)
-                                ++ l;
-                            if (r < nk)
-                                nk = r;
-                        }
-                    }
-
-                    if (nk <= k)
-                        k = nk;
-                    else
-                        ++k;
-                }
-                else
-                    k++;
-            }
-
-            for(int i = 0;i<K;i++)
-                result[i] = best_L_nodes[i].distance;
-
-//            finish = std::chrono::high_resolution_clock::now();
-//            elapsed = finish - stime;
-            stats.time_leaves_search = start->getElapsedTime();
-            return result;
-
-        };
-        float * searchGraphBSFSPQALIGNMEM(const void *query_data, size_t K, querying_stats & stats) const {
+        /**
+         * Greedy descent through the upper levels followed by the beam search of level 0 over the given layout
+         * (InterleavedLevel0 or SplitLevel0). Only the returned distances are reported.
+         */
+        template<typename Level0>
+        float * searchLevel0Beam(const Level0 &level0, const void *query_data, size_t K, querying_stats & stats) const {
             float *  result = nullptr;
             if (cur_element_count == 0) return result;
             result = static_cast<float *>(malloc(sizeof(float) * K));
-            auto start = new PTK::Timer();
+            PTK::Timer start;
             auto stime = std::chrono::high_resolution_clock::now();
 
             tableint currObj = enterpoint_node_;
-            dist_t curdist = fstdistfunc_(query_data,  getDataByInternalId(currObj), dist_func_param_);
-//            __RESET_NUM_DISTCAL
+            dist_t curdist = fstdistfunc_(query_data, level0.vector(currObj), dist_func_param_);
             for (int level = maxlevel_; level > 0; level--) {
                 bool changed = true;
                 while (changed) {
@@ -2450,8 +2774,6 @@ if(data_level0_memory_ != nullptr)
 
                     data = (unsigned int *) get_linklist(currObj, level);
                     int size = getListCount(data);
-//                    metric_hops++;
-//                    metric_distance_computations+=size;
                     stats.distance_computations_hrl +=size;
                     stats.num_hops_hrl++;
                     tableint *datal = (tableint *) (data + 1);
@@ -2459,8 +2781,7 @@ if(data_level0_memory_ != nullptr)
                         tableint cand = datal[i];
                         if (cand < 0 || cand > max_elements_)
                             throw std::runtime_error("cand error");
-                        dist_t d = fstdistfunc_(query_data,  getDataByInternalId(cand), dist_func_param_);
-//                        __COUNT_NUM_DISTCAL
+                        dist_t d = fstdistfunc_(query_data, level0.vector(cand), dist_func_param_);
                         if (d < curdist) {
                             curdist = d;
                             currObj = cand;
@@ -2470,15 +2791,11 @@ if(data_level0_memory_ != nullptr)
                 }
             }
 
-
             auto finish = std::chrono::high_resolution_clock::now();
             auto elapsed = finish - stime;
 
             stats.time_layer0+=elapsed.count();
 
-            stime = std::chrono::high_resolution_clock::now();
-            int i = K-1;
-
             unsigned l =0;
 
             tsl::robin_set<unsigned> inserted_into_pool;
@@ -2486,12 +2803,9 @@ if(data_level0_memory_ != nullptr)
             Neighbor nn = Neighbor(currObj,curdist, true);
 
             inserted_into_pool.insert(currObj);
-            std::vector<Neighbor> best_L_nodes;
-
-            best_L_nodes.reserve(ef_+1);
+            std::vector<Neighbor> best_L_nodes(std::max(ef_, K) + 1);
             best_L_nodes[l++] = nn;
 
-            std::sort( best_L_nodes.begin(),  best_L_nodes.begin() +  l);
             unsigned k = 0;
             while (k <  l) {
                 unsigned nk =  l;
@@ -2500,27 +2814,20 @@ if(data_level0_memory_ != nullptr)
                     auto n =  best_L_nodes[k].id;
 
                     stats.num_hops_bsl++;
-                    int *data = (int *) get_linklist0(n);
-                    size_t size = getListCount((linklistsizeint*)data);
+                    size_t size;
+                    const unsigned int *links = level0.links(n, size);
 
-                    for (size_t j = 1; j <= size; j++) {
-                        int id = *(data + j);
+                    for (size_t j = 0; j < size; j++) {
+                        unsigned id = links[j];
                         if(inserted_into_pool.find(id) == inserted_into_pool.end()) {
                             inserted_into_pool.insert(id);
 
-                            if ((j + 1) <= size) {
-                                prefetch_vector(
-                                        (const char *) (data_level0_memory_ +
-                                        (*(data + j + 1)) * size_data_per_element_ + offsetData_),
-                                        sizeof(float) *(*((size_t *)dist_func_param_)));
-                            }
+                            if ((j + 1) < size)
+                                prefetch_vector((const char *) level0.vector(links[j + 1]), level0.vector_bytes);
 
                             stats.distance_computations_bsl++;
 
-
-                            float dist =  fstdistfunc_(query_data,
-                                                       getDataByInternalId(id), dist_func_param_);
-
+                            float dist =  fstdistfunc_(query_data, level0.vector(id), dist_func_param_);
                             if (dist >=  best_L_nodes[ l - 1].distance && ( l == ef_))
                                 continue;
 
@@ -2544,9 +2851,22 @@ if(data_level0_memory_ != nullptr)
             for(int i = 0;i<K;i++)
                 result[i] = best_L_nodes[i].distance;
 
-            stats.time_leaves_search = start->getElapsedTime();
+            stats.time_leaves_search = start.getElapsedTime();
             return result;
+        }
+
+        InterleavedLevel0 interleavedLevel0() const {
+            return InterleavedLevel0{data_level0_memory_, size_data_per_element_, offsetLevel0_, offsetData_, data_size_};
+        }
 
+        /** Beam search over the split level 0 (loaded with LEVEL0_SPLIT). */
+        float * searchGraphBSFSPQ(const void *query_data, size_t K, querying_stats & stats) const {
+            return searchLevel0Beam(split_level0_.view(), query_data, K, stats);
+        };
+
+        /** Beam search over the interleaved level 0 of hnswlib. */
+        float * searchGraphBSFSPQALIGNMEM(const void *query_data, size_t K, querying_stats & stats) const {
+            return searchLevel0Beam(interleavedLevel0(), query_data, K, stats);
         };
 
 
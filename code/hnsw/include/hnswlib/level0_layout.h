@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace hnswlib {
+
+    /**
+     * Level-0 storage of hnswlib: the links, the vector and the label of a node are stored side by side
+     * in one record of size_per_element bytes.
+     */
+    struct InterleavedLevel0 {
+        const char *memory;
+        size_t size_per_element;
+        size_t offset_links;
+        size_t offset_data;
+        size_t vector_bytes;
+
+        inline const void *vector(unsigned int id) const {
+            return memory + id * size_per_element + offset_data;
+        }
+
+        inline const unsigned int *links(unsigned int id, size_t &size) const {
+            const unsigned int *list = (const unsigned int *) (memory + id * size_per_element + offset_links);
+            size = *((const unsigned short int *) list);
+            return list + 1;
+        }
+    };
+
+    /**
+     * Split level-0 storage: a fixed-stride adjacency array (per node, the number of links followed by up to
+     * maxM0 ids) and a separate array of vectors, each row padded to a multiple of 64 bytes and 64-byte aligned.
+     * A node's links fit in a few cache lines and the vectors are streamed without the links in between.
+     */
+    struct SplitLevel0 {
+        const unsigned int *adjacency;
+        size_t adjacency_stride;
+        const float *vectors;
+        size_t vector_stride;
+        size_t vector_bytes;
+
+        inline const void *vector(unsigned int id) const {
+            return vectors + id * vector_stride;
+        }
+
+        inline const unsigned int *links(unsigned int id, size_t &size) const {
+            const unsigned int *list = adjacency + id * adjacency_stride;
+            size = list[0];
+            return list + 1;
+        }
+    };
+
+    /**
+     * Owner of the split arrays, persisted next to index.bin so the layout is built only once.
+     * File: magic, #nodes, dim, vector_stride, adjacency_stride (uint64 each), the adjacency array, the vectors.
+     */
+    class SplitLevel0Storage {
+    public:
+        static const size_t MAGIC = 0x53504c4954304c30; // "SPLIT0L0"
+
+        unsigned int *adjacency = nullptr;
+        float *vectors = nullptr;
+        size_t num_nodes = 0;
+        size_t dim = 0;
+        size_t vector_stride = 0;
+        size_t adjacency_stride = 0;
+
+        ~SplitLevel0Storage() {
+            free(adjacency);
+            free(vectors);
+        }
+
+        void allocate(size_t n, size_t d, size_t max_links) {
+            free(adjacency);
+            free(vectors);
+            num_nodes = n;
+            dim = d;
+            vector_stride = (d + 15) / 16 * 16;
+            adjacency_stride = max_links + 1;
+            adjacency = (unsigned int *) aligned_alloc(64, roundUp(n * adjacency_stride * sizeof(unsigned int)));
+            vectors = (float *) aligned_alloc(64, roundUp(n * vector_stride * sizeof(float)));
+            if (adjacency == nullptr || vectors == nullptr)
+                throw std::runtime_error("Not enough memory: failed to allocate the split level 0");
+            memset(adjacency, 0, n * adjacency_stride * sizeof(unsigned int));
+            memset(vectors, 0, n * vector_stride * sizeof(float));
+        }
+
+        /** Copies node id of the interleaved layout into the split arrays. */
+        void copyNode(unsigned int id, const InterleavedLevel0 &level0) {
+            size_t size;
+            const unsigned int *links = level0.links(id, size);
+            unsigned int *list = adjacency + id * adjacency_stride;
+            list[0] = (unsigned int) size;
+            memcpy(list + 1, links, size * sizeof(unsigned int));
+            memcpy(vectors + id * vector_stride, level0.vector(id), dim * sizeof(float));
+        }
+
+        SplitLevel0 view() const {
+            return SplitLevel0{adjacency, adjacency_stride, vectors, vector_stride, dim * sizeof(float)};
+        }
+
+        void save(const std::string &location) const {
+            std::ofstream output(location, std::ios::binary);
+            if (!output.is_open())
+                throw std::runtime_error("Cannot write the split level 0 to " + location);
+            size_t header[5] = {MAGIC, num_nodes, dim, vector_stride, adjacency_stride};
+            output.write((const char *) header, sizeof(header));
+            output.write((const char *) adjacency, num_nodes * adjacency_stride * sizeof(unsigned int));
+            output.write((const char *) vectors, num_nodes * vector_stride * sizeof(float));
+        }
+
+        /** Returns false when the file is missing or does not match the index (n nodes of dimension d). */
+        bool load(const std::string &location, size_t n, size_t d, size_t max_links) {
+            std::ifstream input(location, std::ios::binary);
+            if (!input.is_open())
+                return false;
+            size_t header[5];
+            input.read((char *) header, sizeof(header));
+            if (!input || header[0] != MAGIC || header[1] != n || header[2] != d || header[4] != max_links + 1)
+                return false;
+            allocate(n, d, max_links);
+            if (header[3] != vector_stride)
+                return false;
+            input.read((char *) adjacency, n * adjacency_stride * sizeof(unsigned int));
+            input.read((char *) vectors, n * vector_stride * sizeof(float));
+            return (bool) input;
+        }
+
+    private:
+        static size_t roundUp(size_t bytes) {
+            return (bytes + 63) / 64 * 64; // aligned_alloc wants a multiple of the alignment
+        }
+    };
+}
@@ -33,17 +33,28 @@ typedef float ts_type;
 #include <chrono>
 #include "hnswlib/hnswlib.h"
 #include "dirent.h"
+#include "Evaluation.h"
+#include "ChunkReader.h"
 
 #include <unordered_set>
 
 using namespace std;
 using namespace hnswlib;
 
+/**
+ * In-process evaluation of a query workload (--groundtruth, --summary).
+ * Per-query lines are not printed when an evaluator is set.
+ */
+struct workload_output {
+    evaluation::Evaluator * evaluator = nullptr;
+    char * summary_file = nullptr;
+};
+
 void
 query_workload(size_t vecsize,
                size_t qsize, HierarchicalNSW<ts_type> &appr_alg,
                size_t vecdim, vector<std::priority_queue<std::pair<ts_type, labeltype >>> &answers,
-               size_t k, char * queries, size_t efs,bool flatt,int sims);
+               size_t k, char * queries, size_t efs,bool flatt,int sims, workload_output &output);
 void
 query_workload_IQP(size_t vecsize,
                size_t qsize, HierarchicalNSW<ts_type> &appr_alg,
@@ -52,6 +63,11 @@ query_workload_IQP(size_t vecsize,
 
 void printKNN(float * results, int k,  querying_stats stats, unsigned int *ids = nullptr);
 
+void record_query(workload_output &output, int i, float * results, unsigned int * ids, size_t k,
+                  querying_stats stats);
+
+void finish_workload(workload_output &output, double search_time);
+
 
 void read_data(char * dataset,
                ts_type ** pdata,
@@ -63,8 +79,12 @@ void add_data(HierarchicalNSW<ts_type> &appr_alg, ts_type *data, unsigned int ts
               unsigned int label_offset, int i, float d, int cnt, int range=0);
 void add_data_ksrep(HierarchicalNSW<ts_type> &appr_alg, ts_type *data, unsigned int ts_length, unsigned int data_size,
                unsigned int label_offset, int i, float d);
+void add_data_bulk(HierarchicalNSW<ts_type> &appr_alg, ts_type *data, unsigned int ts_length, unsigned int data_size,
+              unsigned int label_offset, int i, float d, int cnt, int range=0);
+void add_data_batched(HierarchicalNSW<ts_type> &appr_alg, ts_type *data, unsigned int ts_length, unsigned int data_size,
+              unsigned int label_offset, int i, float d, int batch);
 void query_workloadrdseed(        size_t vecsize,        size_t qsize,        HierarchicalNSW<ts_type> &appr_alg,        size_t vecdim,        vector<std::priority_queue<std::pair<ts_type, labeltype >>> &answers,
-        size_t k,        char * queries,        size_t efs);
+        size_t k,        char * queries,        size_t efs, workload_output &output);
 
 
 
@@ -75,7 +95,7 @@ void query_workload_kdt(size_t vecsize,
                              vector<std::priority_queue<std::pair<ts_type, labeltype >>> &answers,
                              size_t k,
                              char * queries,
-                             size_t efs, uint **kdeps);
+                             size_t efs, uint **kdeps, workload_output &output);
 
 void peak_memory_footprint() {
 
@@ -214,6 +234,10 @@ int main (int argc, char **argv) {
     static char *queries = "/query_current.txt";
 
     static char *index_path = "out/";
+    static char *groundtruth_file = nullptr;
+    static char *summary_file = nullptr;
+    static int use_mmap = 0; //map level 0 of index.bin instead of reading it
+    static int dataset_mmap = 0; //build from a mapping of the dataset file instead of prefetched chunk reads
     static unsigned int dataset_size = 1000;
     static unsigned int queries_size = 5;
     static unsigned int ts_length = 256;
@@ -232,6 +256,8 @@ int main (int argc, char **argv) {
     int depth = 8;
     int ntrees = 8;
     int range = 0;//use visited listed instead of top K nn as candidate neighbors set
+    int bulk = 0;//build with addPointBulk, the labels are the dense positions in the dataset
+    int batch = 0;//build with addPointsBatched, in batches of at most this many points
     while (1) {
         static struct option long_options[] = {
                 {"efconstruction",  required_argument, 0, 'b'},
@@ -252,6 +278,12 @@ int main (int argc, char **argv) {
                 {"depth",required_argument, 0, 'dp'},
                 {"nt",required_argument, 0, 'nt'},
                   {"range", required_argument, 0, 'lr'},
+                {"groundtruth",required_argument, 0, 'gt'},
+                {"summary",required_argument, 0, 'sm'},
+                {"mmap",required_argument, 0, 'mm'},
+                {"bulk",required_argument, 0, 'bk'},
+                {"batch",required_argument, 0, 'bt'},
+                {"dataset-mmap",required_argument, 0, 'dm'},
 
                 {"help",            no_argument,       0, '?'}
         };
@@ -279,6 +311,24 @@ int main (int argc, char **argv) {
             case 'q':
                 queries = optarg;
                 break;
+            case 'gt':
+                groundtruth_file = optarg;
+                break;
+            case 'sm':
+                summary_file = optarg;
+                break;
+            case 'mm':
+                use_mmap = atoi(optarg);
+                break;
+            case 'bk':
+                bulk = atoi(optarg);
+                break;
+            case 'bt':
+                batch = atoi(optarg);
+                break;
+            case 'dm':
+                dataset_mmap = atoi(optarg);
+                break;
             case 'b':
                 efConstruction = atoi(optarg);
                 break;
@@ -344,6 +394,11 @@ int main (int argc, char **argv) {
     index_full_filename = strcpy(index_full_filename, index_path);
     index_full_filename = strcat(index_full_filename, "index.bin");
 
+    workload_output output;
+    output.summary_file = summary_file;
+    if ((mode == 1 || mode == 6 || mode == 7) && groundtruth_file != nullptr)
+        output.evaluator = new evaluation::Evaluator(groundtruth_file, queries_size, k);
+
     if (mode == 0)  //only build and store the index
     {
 
@@ -352,19 +407,15 @@ int main (int argc, char **argv) {
         mkdir(index_path , 07777);
 
 
-        ts_type *data = (ts_type *)malloc(dataset_size * ts_length * sizeof(ts_type));
-
         HierarchicalNSW<ts_type> appr_alg(&l2space, dataset_size, M, efConstruction);
 
         auto t_build = new PTK::Timer() ;
 
-        int i;
-
         auto buffer_size = 100000;
         if(buffer_size > dataset_size)buffer_size=dataset_size;
-        unsigned int chunk_count = (unsigned  int) (dataset_size / buffer_size);
-        unsigned int last_chunk_size = dataset_size % buffer_size;
-        unsigned int chunk_size = buffer_size;
+        // the next chunk is read while the current one is inserted
+        dataset::ChunkReader reader(dataset, dataset_size, ts_length, buffer_size,
+                                    dataset_mmap ? dataset::ChunkReader::MMAP : dataset::ChunkReader::READ);
 
         double kPi = 3.14159265358979323846264;
         if(rng == 2) {
@@ -373,23 +424,26 @@ int main (int argc, char **argv) {
             cout << " cos "<<prune << endl;
         }
 
-    for (i = 0; i < chunk_count; ++i) {
-        printf("Loading %ld vectors of chunk %ld\n", chunk_size, i + 1);
-        read_data(dataset, &data, ts_length, chunk_size, i * chunk_size);
-        if(ep==0)
-        add_data(appr_alg, data, ts_length, chunk_size, i * chunk_size, rng, prune,connectivity, range);
+    size_t first, chunk_size;
+    while (const ts_type *chunk = reader.next(first, chunk_size)) {
+        printf("Loading %ld vectors of chunk %ld\n", chunk_size, first / buffer_size + 1);
+        ts_type *data = (ts_type *) chunk;
+        if(ep==0 && batch)
+        add_data_batched(appr_alg, data, ts_length, chunk_size, first, rng, prune, batch);
+        else if(ep==0 && bulk)
+        add_data_bulk(appr_alg, data, ts_length, chunk_size, first, rng, prune,connectivity, range);
+        else if(ep==0)
+        add_data(appr_alg, data, ts_length, chunk_size, first, rng, prune,connectivity, range);
         if(ep==3)
-        add_data_ksrep(appr_alg, data, ts_length, chunk_size, i * chunk_size, rng, prune);
-    }
-    if (last_chunk_size != 0) {
-        printf("Loading %ld vectors of the last chunk %ld\n", last_chunk_size, i + 1);
-        read_data(dataset, &data, ts_length, last_chunk_size, i * chunk_size);
-        if(ep==0)add_data(appr_alg, data, ts_length, last_chunk_size, i * chunk_size, rng, prune,connectivity,range);
-        if(ep==3)add_data_ksrep(appr_alg, data, ts_length, last_chunk_size, i * chunk_size, rng, prune);
+        add_data_ksrep(appr_alg, data, ts_length, chunk_size, first, rng, prune);
     }
+    if(ep==0 && bulk && !batch)appr_alg.finishBulkBuild();
 
 
+        double build_time = t_build->getElapsedTime();
         t_build->printElapsedTime(std::string ("Index Building").c_str());
+        cout << "[Build] threads " << omp_get_max_threads() << " - " << dataset_size / build_time << " points/s" << endl;
+        cout << reader.describe() << endl;
 
         t_build->restart();
 
@@ -408,7 +462,7 @@ int main (int argc, char **argv) {
 
         // HIERARCHY
         if(ep ==0) {
-            HierarchicalNSW<ts_type> appr_alg(&l2space, index_full_filename, false);
+            HierarchicalNSW<ts_type> appr_alg(&l2space, index_full_filename, false, 0, use_mmap ? LEVEL0_MMAP : LEVEL0_READ);
             auto s_build = new PTK::Timer();
             vector<std::priority_queue<std::pair<ts_type, labeltype >>> answers;
             query_workload(
@@ -419,14 +473,14 @@ int main (int argc, char **argv) {
                     answers,
                     (size_t) k,
                     queries,
-                    (size_t) efs, 0, 0);
+                    (size_t) efs, 0, 0, output);
 
 //            s_build->printElapsedTime(std::string("TOTAL TIME").c_str());
         }
         // MEDOID
             //calculate medoid
         else if(ep == 15){ // save the meoid in index/medoid.bin
-            HierarchicalNSW<ts_type> appr_alg(&l2space, index_full_filename, false);
+            HierarchicalNSW<ts_type> appr_alg(&l2space, index_full_filename, false, 0, use_mmap ? LEVEL0_MMAP : LEVEL0_READ);
 
             auto dim = *((int*)appr_alg.dist_func_param_) ;
 
@@ -473,7 +527,7 @@ int main (int argc, char **argv) {
         }
             // search using medoid as ep
         else if(ep == 1){ // medoid 1
-            HierarchicalNSW<ts_type> appr_alg(&l2space, index_full_filename, false);
+            HierarchicalNSW<ts_type> appr_alg(&l2space, index_full_filename, false, 0, use_mmap ? LEVEL0_MMAP : LEVEL0_READ);
 
             auto dim = *((int*)appr_alg.dist_func_param_) ;
 
@@ -499,14 +553,14 @@ int main (int argc, char **argv) {
                     answers,
                     (size_t) k,
                     queries,
-                    (size_t) efs, 1, 0);
+                    (size_t) efs, 1, 0, output);
 
             s_build->printElapsedTime(std::string("TOTAL TIME").c_str());
 
         }
         // PREDEFINED 1 RANDOM POINT
         if(ep ==2) {//1 random point
-            HierarchicalNSW<ts_type> appr_alg(&l2space, index_full_filename, false);
+            HierarchicalNSW<ts_type> appr_alg(&l2space, index_full_filename, false, 0, use_mmap ? LEVEL0_MMAP : LEVEL0_READ);
             auto s_build = new PTK::Timer();
             vector<std::priority_queue<std::pair<ts_type, labeltype >>> answers;
             query_workload(
@@ -517,13 +571,13 @@ int main (int argc, char **argv) {
                     answers,
                     (size_t) k,
                     queries,
-                    (size_t) efs, 1, 0);
+                    (size_t) efs, 1, 0, output);
 
             s_build->printElapsedTime(std::string("TOTAL TIME").c_str());
         }
         // SAMPLE K init candidate
         if(ep ==3) {
-            HierarchicalNSW<ts_type> appr_alg(&l2space, index_full_filename, false);
+            HierarchicalNSW<ts_type> appr_alg(&l2space, index_full_filename, false, 0, use_mmap ? LEVEL0_MMAP : LEVEL0_READ);
             auto s_build = new PTK::Timer();
             vector<std::priority_queue<std::pair<ts_type, labeltype >>> answers;
             query_workloadrdseed(
@@ -534,12 +588,12 @@ int main (int argc, char **argv) {
                     answers,
                     (size_t) k,
                     queries,
-                    (size_t) efs);
+                    (size_t) efs, output);
 
             s_build->printElapsedTime(std::string("TOTAL TIME").c_str());
         }
         if(ep==4){
-            HierarchicalNSW<ts_type> appr_alg(&l2space, index_full_filename, false);
+            HierarchicalNSW<ts_type> appr_alg(&l2space, index_full_filename, false, 0, use_mmap ? LEVEL0_MMAP : LEVEL0_READ);
             char *kdtreesrpath = (char *) malloc(sizeof(char) * (strlen(index_path) + 10));
             kdtreesrpath = strcpy(kdtreesrpath, index_path);
             kdtreesrpath = strcat(kdtreesrpath, "kdtrs.bin");
@@ -561,7 +615,7 @@ int main (int argc, char **argv) {
                     answers,
                     (size_t) k,
                     queries,
-                    (size_t) efs, kdeps);
+                    (size_t) efs, kdeps, output);
 
             s_build->printElapsedTime(std::string("TOTAL TIME").c_str());
         }
@@ -570,7 +624,7 @@ else   if(mode == 6){
         if(chdir(index_path) != 0)
             throw std::runtime_error("The index folder doesn't exist, Please make sure to give an existing index path!");
 
-        HierarchicalNSW<ts_type> appr_alg(&l2space, index_full_filename, false);
+        HierarchicalNSW<ts_type> appr_alg(&l2space, index_full_filename, false, 0, use_mmap ? LEVEL0_MMAP : LEVEL0_READ);
         auto s_build = new PTK::Timer();
         ts_type  * query = (float * ) aligned_alloc(8* sizeof(float),
                                                     ts_length*queries_size* sizeof(float));
@@ -590,20 +644,22 @@ else   if(mode == 6){
         s.num_hops_bsl=0;s.distance_computations_hrl=0;s.num_hops_hrl=0;s.distance_computations_bsl=0;
         s.saxdist_computations_bsl=0;s.saxdist_computations_hsl=0;
 
+        PTK::Timer t_search;
         for(int i=0;i<queries_size;i++){
             result = appr_alg.searchGraphBSFSPQALIGNMEM(query + i*ts_length, k, s);
-            printKNN(result, k, s);
+            record_query(output, i, result, nullptr, k, s);
             s.time_cnmd=0;s.time_update_knn=0;s.time_leaves_search=0;s.time_routing=0;s.time_layer0=0;s.time_pq=0;
             s.num_hops_bsl=0;s.distance_computations_hrl=0;s.num_hops_hrl=0;s.distance_computations_bsl=0;
             s.saxdist_computations_bsl=0;s.saxdist_computations_hsl=0;
         };
+        finish_workload(output, t_search.getElapsedTime());
         s_build->printElapsedTime(std::string("TOTAL TIME").c_str());
     }
     else if(mode == 7){
         if(chdir(index_path) != 0)
             throw std::runtime_error("The index folder doesn't exist, Please make sure to give an existing index path!");
 
-        HierarchicalNSW<ts_type> appr_alg(&l2space, index_full_filename, 7);
+        HierarchicalNSW<ts_type> appr_alg(&l2space, index_full_filename, false, 0, LEVEL0_SPLIT);
 
         auto s_build = new PTK::Timer();
 
@@ -623,15 +679,17 @@ else   if(mode == 6){
         float* result;
 
 
+        PTK::Timer t_search;
         for(int i=0;i<queries_size;i++){
             result = appr_alg.searchGraphBSFSPQ(query + i*appr_alg.dim_, k, s);
 
-            printKNN(result, k, s);
+            record_query(output, i, result, nullptr, k, s);
 
             s.time_cnmd=0;s.time_update_knn=0;s.time_leaves_search=0;s.time_routing=0;s.time_layer0=0;s.time_pq=0;
             s.num_hops_bsl=0;s.distance_computations_hrl=0;s.num_hops_hrl=0;s.distance_computations_bsl=0;
             s.saxdist_computations_bsl=0;s.saxdist_computations_hsl=0;
         };
+        finish_workload(output, t_search.getElapsedTime());
         s_build->printElapsedTime(std::string("TOTAL TIME").c_str());
 
     }
@@ -746,7 +804,7 @@ void query_workload_kdt(size_t vecsize,
                            vector<std::priority_queue<std::pair<ts_type, labeltype >>> &answers,
                            size_t k,
                            char * queries,
-                           size_t efs, uint **kdeps) {
+                           size_t efs, uint **kdeps, workload_output &output) {
     size_t correct = 0;
     size_t total = 0;
 
@@ -761,16 +819,18 @@ void query_workload_kdt(size_t vecsize,
     //#pragma omp parallel for
     querying_stats s;
     float* result;
+    PTK::Timer t_search;
 
     for (int i = 0; i < qsize; i++) {
         fread(query, sizeof(ts_type), vecdim, dfp);
         appr_alg.setEf(efs);
             result = appr_alg.searchGraphBsltreeps(query, k, kdeps[i],s);
-        printKNN(result, k, s);
+        record_query(output, i, result, nullptr, k, s);
         s.time_cnmd=0;s.time_update_knn=0;s.time_leaves_search=0;s.time_routing=0;s.time_layer0=0;s.time_pq=0;
         s.num_hops_bsl=0;s.distance_computations_hrl=0;s.num_hops_hrl=0;s.distance_computations_bsl=0;
         s.saxdist_computations_bsl=0;s.saxdist_computations_hsl=0;
     }
+    finish_workload(output, t_search.getElapsedTime());
 
 }
 
@@ -790,6 +850,30 @@ void add_data(HierarchicalNSW<ts_type> &appr_alg, ts_type *data, unsigned int ts
 }
 
 
+/**
+ * Inserts a chunk with addPointBulk: the threads reserve their internal ids from a counter and share no lock besides
+ * the ones of the nodes they link, so the first point does not need to be inserted alone.
+ */
+void add_data_bulk(HierarchicalNSW<ts_type> &appr_alg, ts_type *data, unsigned int ts_length, unsigned int data_size,
+              unsigned int label_offset, int rng, float prune,int cnt, int range)
+
+{
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int i = 0; i < data_size; i++) {
+        appr_alg.addPointBulk((void *) (data + ts_length * i), (size_t) i+label_offset, rng, prune, cnt, range);
+    }
+}
+
+
+void add_data_batched(HierarchicalNSW<ts_type> &appr_alg, ts_type *data, unsigned int ts_length, unsigned int data_size,
+              unsigned int label_offset, int rng, float prune, int batch)
+
+{
+    //the batches are parallelized inside
+    appr_alg.addPointsBatched((void *) data, data_size, label_offset, rng, prune, batch);
+}
+
+
 void add_data_ksrep(HierarchicalNSW<ts_type> &appr_alg, ts_type *data, unsigned int ts_length, unsigned int data_size,
               unsigned int label_offset, int rng, float prune)
 
@@ -828,7 +912,7 @@ query_workload(//ts_type *massQ,
         size_t k,
         char * queries,
         size_t efs,
-        bool flatt,int sims)
+        bool flatt,int sims, workload_output &output)
 {
     size_t correct = 0;
     size_t total = 0;
@@ -845,6 +929,7 @@ query_workload(//ts_type *massQ,
     querying_stats s;
     float* result;
     unsigned int * ids;
+    PTK::Timer t_search;
 
     for (int i = 0; i < qsize; i++) {
 
@@ -868,12 +953,13 @@ query_workload(//ts_type *massQ,
         }
 
 
-        printKNN(result, k, s,ids);
+        record_query(output, i, result, ids, k, s);
 
         s.time_cnmd=0;s.time_update_knn=0;s.time_leaves_search=0;s.time_routing=0;s.time_layer0=0;s.time_pq=0;
         s.num_hops_bsl=0;s.distance_computations_hrl=0;s.num_hops_hrl=0;s.distance_computations_bsl=0;
         s.saxdist_computations_bsl=0;s.saxdist_computations_hsl=0;
     }
+    finish_workload(output, t_search.getElapsedTime());
 
 }
 
@@ -887,7 +973,7 @@ query_workloadrdseed(
         vector<std::priority_queue<std::pair<ts_type, labeltype >>> &answers,
         size_t k,
         char * queries,
-        size_t efs)
+        size_t efs, workload_output &output)
 {
     size_t correct = 0;
     size_t total = 0;
@@ -903,6 +989,7 @@ query_workloadrdseed(
     querying_stats s;
     float* result;
     appr_alg.setEf(efs);
+    PTK::Timer t_search;
     for (int i = 0; i < qsize; i++) {
 
 
@@ -914,15 +1001,29 @@ query_workloadrdseed(
             result = appr_alg.searchGraphBslrdseed(query, k, s);
 
 
-        printKNN(result, k, s);
+        record_query(output, i, result, nullptr, k, s);
 
         s.time_cnmd=0;s.time_update_knn=0;s.time_leaves_search=0;s.time_routing=0;s.time_layer0=0;s.time_pq=0;
         s.num_hops_bsl=0;s.distance_computations_hrl=0;s.num_hops_hrl=0;s.distance_computations_bsl=0;
         s.saxdist_computations_bsl=0;s.saxdist_computations_hsl=0;
     }
+    finish_workload(output, t_search.getElapsedTime());
+
+}
+
 
+void record_query(workload_output &output, int i, float * results, unsigned int * ids, size_t k,
+                  querying_stats stats){
+    if (output.evaluator != nullptr)
+        output.evaluator->record(i, ids, results, stats.time_leaves_search);
+    else
+        printKNN(results, k, stats, ids);
 }
 
+void finish_workload(workload_output &output, double search_time){
+    if (output.evaluator != nullptr)
+        output.evaluator->report("HNSW", search_time, output.summary_file ? output.summary_file : "");
+}
 
 void printKNN(float * results, int k, querying_stats stats,unsigned  int * ids){
     if(ids == nullptr){
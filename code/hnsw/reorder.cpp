@@ -0,0 +1,224 @@
+#include <iostream>
+#include <fstream>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+#include "hnswlib/hnswlib.h"
+#include "Evaluation.h"
+#include "CacheCounters.h"
+#include "Reordering.h"
+
+using namespace std;
+using namespace hnswlib;
+
+typedef float ts_type;
+
+/**
+ * Runs the query file on the index at location with searchGraph and prints the QPS, the cache misses per query
+ * and, when a ground truth is given, the recall. Returns the QPS.
+ */
+double measure(const char *label, L2Space &l2space, const string &location, char *queries,
+               size_t queries_size, size_t ts_length, size_t k, size_t efs, char *groundtruth_file) {
+    HierarchicalNSW<ts_type> appr_alg(&l2space, location, false);
+    appr_alg.setEf(efs);
+
+    vector<ts_type> query(ts_length * queries_size);
+    FILE *dfp = fopen(queries, "rb");
+    if (dfp == NULL) {
+        fprintf(stderr, "Queries file %s not found!\n", queries);
+        exit(-1);
+    }
+    if (fread(query.data(), sizeof(ts_type), query.size(), dfp) != query.size()) {
+        fprintf(stderr, "Queries file %s holds fewer than %zu queries!\n", queries, queries_size);
+        exit(-1);
+    }
+    fclose(dfp);
+
+    evaluation::Evaluator *evaluator = nullptr;
+    if (groundtruth_file != nullptr)
+        evaluator = new evaluation::Evaluator(groundtruth_file, queries_size, k);
+
+    querying_stats s;
+    evaluation::CacheCounters counters;
+    PTK::Timer t_search;
+    counters.start();
+    for (size_t i = 0; i < queries_size; i++) {
+        s.time_cnmd=0;s.time_update_knn=0;s.time_leaves_search=0;s.time_routing=0;s.time_layer0=0;s.time_pq=0;
+        s.num_hops_bsl=0;s.distance_computations_hrl=0;s.num_hops_hrl=0;s.distance_computations_bsl=0;
+        s.saxdist_computations_bsl=0;s.saxdist_computations_hsl=0;
+        auto result = appr_alg.searchGraph(query.data() + i * ts_length, k, s);
+        if (evaluator != nullptr)
+            evaluator->record(i, result.second, result.first, s.time_routing + s.time_layer0);
+        free(result.first);
+        free(result.second);
+    }
+    counters.stop();
+    double search_time = t_search.getElapsedTime();
+    double qps = queries_size / search_time;
+
+    cout << label << ": qps=" << qps << ", " << counters.describe(queries_size);
+    if (evaluator != nullptr)
+        cout << ", recall=" << evaluator->summarize(search_time).recall;
+    cout << endl;
+    delete evaluator;
+    return qps;
+}
+
+int main(int argc, char **argv) {
+    static char *queries = nullptr;
+    static const char *index_path = "out/";
+    static const char *method = "bfs";
+    static char *groundtruth_file = nullptr;
+    static unsigned int queries_size = 0;
+    static unsigned int ts_length = 256;
+    int window = 5;
+    int k = 10;
+    int efs = 100;
+    while (1) {
+        static struct option long_options[] = {
+                {"index-path",      required_argument, 0, 'p'},
+                {"method",          required_argument, 0, 'r'},
+                {"window",          required_argument, 0, 'w'},
+                {"queries",         required_argument, 0, 'q'},
+                {"queries-size",    required_argument, 0, 'g'},
+                {"timeseries-size", required_argument, 0, 't'},
+                {"k",               required_argument, 0, 'k'},
+                {"ef",              required_argument, 0, 'e'},
+                {"groundtruth",     required_argument, 0, 'gt'},
+                {"help",            no_argument,       0, '?'}
+        };
+
+        int option_index = 0;
+        int c = getopt_long(argc, argv, "", long_options, &option_index);
+        if (c == -1)
+            break;
+        switch (c) {
+            case 'p':
+                index_path = optarg;
+                break;
+            case 'r':
+                method = optarg;
+                break;
+            case 'w':
+                window = atoi(optarg);
+                break;
+            case 'q':
+                queries = optarg;
+                break;
+            case 'g':
+                queries_size = atoi(optarg);
+                break;
+            case 't':
+                ts_length = atoi(optarg);
+                break;
+            case 'k':
+                k = atoi(optarg);
+                break;
+            case 'e':
+                efs = atoi(optarg);
+                break;
+            case 'gt':
+                groundtruth_file = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s --index-path dir/ --timeseries-size dim [--method bfs|rcm|gorder] "
+                                "[--window w] [--queries q.bin --queries-size nq [--k k] [--ef ef] "
+                                "[--groundtruth gt]]\n", argv[0]);
+                exit(-1);
+        }
+    }
+
+    reordering::Method reorder_method = reordering::parseMethod(method);
+    L2Space l2space(ts_length);
+    string index_file = string(index_path) + "index.bin";
+    bool measured = queries != nullptr && queries_size > 0;
+
+    double qps_before = 0;
+    if (measured)
+        qps_before = measure("original ", l2space, index_file, queries, queries_size, ts_length, k, efs,
+                             groundtruth_file);
+
+    vector<unsigned int> order;
+    {
+        HierarchicalNSW<ts_type> appr_alg(&l2space, index_file, false);
+        reordering::Graph graph;
+        for (size_t i = 0; i < appr_alg.cur_element_count; i++) {
+            linklistsizeint *data = appr_alg.get_linklist0(i);
+            graph.addNode((unsigned int *) (data + 1), appr_alg.getListCount(data));
+        }
+
+        PTK::Timer t_order;
+        order = reordering::computeOrder(graph, appr_alg.enterpoint_node_, reorder_method, window);
+        vector<unsigned int> identity(order.size());
+        for (size_t i = 0; i < identity.size(); i++) identity[i] = i;
+        cout << method << " order computed in " << t_order.getElapsedTime() << "s, average edge gap "
+             << reordering::averageGap(graph, identity) << " -> "
+             << reordering::averageGap(graph, reordering::inverse(order)) << endl;
+
+        // write next to the index, then swap, so a failure never leaves a truncated index.bin
+        string tmp_file = index_file + ".tmp";
+        appr_alg.saveIndexReordered(tmp_file, order);
+        if (rename(tmp_file.c_str(), index_file.c_str()) != 0)
+            throw runtime_error("Cannot replace " + index_file);
+    }
+    // the id map always leads back to the labeling the index was built with, across repeated reorderings
+    vector<unsigned int> id_map = order;
+    if (access((index_file + ".idmap").c_str(), F_OK) == 0) {
+        vector<unsigned int> previous = reordering::readIdMap(index_file + ".idmap");
+        if (previous.size() == order.size())
+            for (size_t i = 0; i < order.size(); i++) id_map[i] = previous[order[i]];
+    }
+    reordering::writeIdMap(index_file + ".idmap", id_map);
+    // the split level 0 of --mode 7 is derived from the old labeling
+    unlink((index_file + ".split").c_str());
+
+    vector<unsigned int> rank = reordering::inverse(order);
+    // medoid.bin (--ep 15) holds an internal id
+    string medoid_file = string(index_path) + "medoid.bin";
+    FILE *file = fopen(medoid_file.c_str(), "rb");
+    if (file != NULL) {
+        unsigned int medoid;
+        bool read = fread(&medoid, sizeof(unsigned int), 1, file) == 1;
+        fclose(file);
+        if (read && medoid < order.size()) {
+            medoid = rank[medoid];
+            file = fopen(medoid_file.c_str(), "wb");
+            fwrite(&medoid, sizeof(unsigned int), 1, file);
+            fclose(file);
+        }
+    }
+    // kdtrs.bin (--ep 4) holds the internal ids of the seeds of every query
+    string kdtrs_file = string(index_path) + "kdtrs.bin";
+    file = fopen(kdtrs_file.c_str(), "rb");
+    if (file != NULL) {
+        vector<unsigned int> seeds;
+        unsigned int buffer[4096];
+        size_t n;
+        while ((n = fread(buffer, sizeof(unsigned int), 4096, file)) > 0)
+            seeds.insert(seeds.end(), buffer, buffer + n);
+        fclose(file);
+        for (auto &seed : seeds)
+            if (seed < rank.size()) seed = rank[seed];
+        string tmp_kdtrs = kdtrs_file + ".tmp";
+        file = fopen(tmp_kdtrs.c_str(), "wb");
+        bool written = file != NULL;
+        if (written) {
+            written = fwrite(seeds.data(), sizeof(unsigned int), seeds.size(), file) == seeds.size();
+            written = fclose(file) == 0 && written;
+        }
+        if (!written || rename(tmp_kdtrs.c_str(), kdtrs_file.c_str()) != 0) {
+            unlink(tmp_kdtrs.c_str());
+            unlink(kdtrs_file.c_str());
+            cerr << "Cannot rewrite " << kdtrs_file << ", removed it: rebuild the kd-tree seeds before --ep 4" << endl;
+        }
+    }
+
+    if (measured) {
+        double qps_after = measure("reordered", l2space, index_file, queries, queries_size, ts_length, k, efs,
+                                   groundtruth_file);
+        cout << "qps change: " << (qps_after / qps_before - 1) * 100 << "%" << endl;
+    }
+    return 0;
+}